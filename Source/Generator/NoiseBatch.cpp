@@ -0,0 +1,210 @@
+#include <atomic>
+#include "NoiseBatch.h"
+#include "NoiseKernels.h"
+#include "PerlinNoise.h"
+#include "SimplexNoise.h"
+
+#ifdef NOISE_BATCH_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(NOISE_BATCH_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef NOISE_BATCH_SSE2
+namespace {
+
+struct Sse2Lanes {
+    typedef __m128d Double;
+    typedef __m128 Float;
+    static const unsigned DOUBLE_LANES = 2;
+    static const unsigned FLOAT_LANES = 4;
+
+    static Double Set(double value) { return _mm_set1_pd(value); }
+    static Double Load(const double* values) { return _mm_loadu_pd(values); }
+    static void Store(double* values, Double v) { _mm_storeu_pd(values, v); }
+    static Double Mask(const std::int64_t* masks) { return _mm_castsi128_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(masks))); }
+    static Double Add(Double a, Double b) { return _mm_add_pd(a, b); }
+    static Double Sub(Double a, Double b) { return _mm_sub_pd(a, b); }
+    static Double Mul(Double a, Double b) { return _mm_mul_pd(a, b); }
+    static Double And(Double a, Double b) { return _mm_and_pd(a, b); }
+    static Double Xor(Double a, Double b) { return _mm_xor_pd(a, b); }
+    static Double Select(Double mask, Double a, Double b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+
+    static Double Floor(Double x)
+    {
+        // No roundpd before SSE4.1. Round |x| to an integer by adding 2^52, restore the sign and step down
+        // where rounding went up. Values of 2^52 and above, infinities and NaN are integral already
+        const __m128d sign = _mm_set1_pd(-0.0);
+        const __m128d magic = _mm_set1_pd(4503599627370496.0);
+        const __m128d absolute = _mm_andnot_pd(sign, x);
+        __m128d rounded = _mm_sub_pd(_mm_add_pd(absolute, magic), magic);
+        rounded = _mm_or_pd(rounded, _mm_and_pd(sign, x));
+        rounded = _mm_sub_pd(rounded, _mm_and_pd(_mm_cmpgt_pd(rounded, x), _mm_set1_pd(1.0)));
+        return Select(_mm_cmplt_pd(absolute, magic), rounded, x);
+    }
+
+    static Float Set(float value) { return _mm_set1_ps(value); }
+    static Float Load(const float* values) { return _mm_loadu_ps(values); }
+    static void Store(float* values, Float v) { _mm_storeu_ps(values, v); }
+    static Float Mask(const std::int32_t* masks) { return _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(masks))); }
+    static Float FromInt(const std::int32_t* values) { return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values))); }
+    static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+    static Float AndNot(Float a, Float b) { return _mm_andnot_ps(a, b); }
+    static Float Xor(Float a, Float b) { return _mm_xor_ps(a, b); }
+    static Float CmpLt(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    static Float CmpGt(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+    static Float Select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static int MoveMask(Float mask) { return _mm_movemask_ps(mask); }
+};
+
+}
+#endif
+
+static bool HasAvx2()
+{
+#if defined(NOISE_BATCH_AVX2) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    // OSXSAVE and AVX, then the OS has to save the ymm registers
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(NOISE_BATCH_AVX2)
+    // Checks the OS support as well
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+static NoiseKernel GetBestNoiseKernel()
+{
+    if (HasAvx2()) {
+        return NK_AVX2;
+    }
+#ifdef NOISE_BATCH_SSE2
+    return NK_SSE2;
+#else
+    return NK_SCALAR;
+#endif
+}
+
+static std::atomic<int> currentKernel(NK_NONE);
+
+NoiseKernel GetNoiseKernel()
+{
+    int kernel = currentKernel.load(std::memory_order_relaxed);
+    if (kernel == NK_NONE) {
+        kernel = GetBestNoiseKernel();
+        currentKernel.store(kernel, std::memory_order_relaxed);
+    }
+    return static_cast<NoiseKernel>(kernel);
+}
+
+bool SetNoiseKernel(NoiseKernel kernel)
+{
+    if (!IsNoiseKernelSupported(kernel)) {
+        return false;
+    }
+    currentKernel.store(kernel, std::memory_order_relaxed);
+    return true;
+}
+
+bool IsNoiseKernelSupported(NoiseKernel kernel)
+{
+    switch (kernel) {
+        case NK_SCALAR:
+            return true;
+        case NK_SSE2:
+#ifdef NOISE_BATCH_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case NK_AVX2:
+            return HasAvx2();
+        default:
+            return false;
+    }
+}
+
+const char* GetNoiseKernelName(NoiseKernel kernel)
+{
+    switch (kernel) {
+        case NK_SCALAR:
+            return "scalar";
+        case NK_SSE2:
+            return "SSE2";
+        case NK_AVX2:
+            return "AVX2";
+        default:
+            return "none";
+    }
+}
+
+static unsigned PerlinOctaveNoiseVector(const std::uint8_t* permutation, const double* x, const double* y,
+    const int* octaves, int fixedOctaves, double* result, unsigned count)
+{
+    switch (GetNoiseKernel()) {
+#ifdef NOISE_BATCH_AVX2
+        case NK_AVX2:
+            return PerlinOctaveNoiseAvx2(permutation, x, y, octaves, fixedOctaves, result, count);
+#endif
+#ifdef NOISE_BATCH_SSE2
+        case NK_SSE2:
+            return PerlinOctaveNoiseBatch<Sse2Lanes>(permutation, x, y, octaves, fixedOctaves, result, count);
+#endif
+        default:
+            return 0;
+    }
+}
+
+void PerlinNoise::octaveNoise(const double* x, const double* y, double* result, unsigned count, int octaves) const
+{
+    unsigned done = PerlinOctaveNoiseVector(randomNumbers, x, y, nullptr, octaves, result, count);
+    for (unsigned i = done; i < count; i++) {
+        result[i] = octaveNoise(x[i], y[i], octaves);
+    }
+}
+
+void PerlinNoise::octaveNoise(const double* x, const double* y, const int* octaves, double* result, unsigned count) const
+{
+    unsigned done = PerlinOctaveNoiseVector(randomNumbers, x, y, octaves, 0, result, count);
+    for (unsigned i = done; i < count; i++) {
+        result[i] = octaveNoise(x[i], y[i], octaves[i]);
+    }
+}
+
+void SimplexNoise::fractal(size_t octaves, const float* x, const float* y, float* result, unsigned count) const
+{
+    unsigned done = 0;
+    switch (GetNoiseKernel()) {
+#ifdef NOISE_BATCH_AVX2
+        case NK_AVX2:
+            done = SimplexFractalAvx2(mPerm, octaves, mFrequency, mAmplitude, mLacunarity, mPersistence, x, y, result, count);
+            break;
+#endif
+#ifdef NOISE_BATCH_SSE2
+        case NK_SSE2:
+            done = SimplexFractalBatch<Sse2Lanes>(mPerm, octaves, mFrequency, mAmplitude, mLacunarity, mPersistence, x, y, result, count);
+            break;
+#endif
+        default:
+            break;
+    }
+    for (unsigned i = done; i < count; i++) {
+        result[i] = fractal(octaves, x[i], y[i]);
+    }
+}
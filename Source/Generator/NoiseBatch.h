@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * Instruction set used by the batch noise calls of PerlinNoise and SimplexNoise.
+ * Every kernel returns exactly the bits of the scalar noise functions: the vector code repeats the scalar
+ * operations in the same order, without fused multiply-add, and leaves the table lookups scalar per lane.
+ * This holds as long as the scalar code is compiled for SSE math as well, on x87 builds the values may
+ * differ in the last bits
+ */
+enum NoiseKernel {
+    NK_SCALAR,
+    NK_SSE2,
+    NK_AVX2,
+    NK_NONE
+};
+
+/**
+ * Kernel in use, the best one the CPU supports unless SetNoiseKernel picked another
+ */
+NoiseKernel GetNoiseKernel();
+
+/**
+ * Use the given kernel for all following batch calls, returns false when the CPU or build does not support it.
+ * Results do not change, so it may be switched while other threads sample noise
+ */
+bool SetNoiseKernel(NoiseKernel kernel);
+
+bool IsNoiseKernelSupported(NoiseKernel kernel);
+
+const char* GetNoiseKernelName(NoiseKernel kernel);
@@ -0,0 +1,84 @@
+// AVX2 instances of the batch noise kernels. Only this file is compiled for AVX2, the standard headers
+// are included before the target switch so that none of their inline functions get AVX2 code
+#include <cstddef>
+#include <cstdint>
+
+// Same condition as NOISE_BATCH_AVX2, the kernel templates below have to be defined after the switch
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define NOISE_BATCH_AVX2_TARGET
+#include <immintrin.h>
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+#elif defined(_MSC_VER)
+#include <immintrin.h>
+#endif
+
+#include "NoiseKernels.h"
+
+#ifdef NOISE_BATCH_AVX2
+
+namespace {
+
+struct Avx2Lanes {
+    typedef __m256d Double;
+    typedef __m256 Float;
+    static const unsigned DOUBLE_LANES = 4;
+    static const unsigned FLOAT_LANES = 8;
+
+    static Double Set(double value) { return _mm256_set1_pd(value); }
+    static Double Load(const double* values) { return _mm256_loadu_pd(values); }
+    static void Store(double* values, Double v) { _mm256_storeu_pd(values, v); }
+    static Double Mask(const std::int64_t* masks) { return _mm256_castsi256_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks))); }
+    static Double Add(Double a, Double b) { return _mm256_add_pd(a, b); }
+    static Double Sub(Double a, Double b) { return _mm256_sub_pd(a, b); }
+    static Double Mul(Double a, Double b) { return _mm256_mul_pd(a, b); }
+    static Double And(Double a, Double b) { return _mm256_and_pd(a, b); }
+    static Double Xor(Double a, Double b) { return _mm256_xor_pd(a, b); }
+    static Double Select(Double mask, Double a, Double b) { return _mm256_blendv_pd(b, a, mask); }
+    static Double Floor(Double x) { return _mm256_round_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+    static Float Set(float value) { return _mm256_set1_ps(value); }
+    static Float Load(const float* values) { return _mm256_loadu_ps(values); }
+    static void Store(float* values, Float v) { _mm256_storeu_ps(values, v); }
+    static Float Mask(const std::int32_t* masks) { return _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks))); }
+    static Float FromInt(const std::int32_t* values) { return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values))); }
+    static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+    static Float AndNot(Float a, Float b) { return _mm256_andnot_ps(a, b); }
+    static Float Xor(Float a, Float b) { return _mm256_xor_ps(a, b); }
+    static Float CmpLt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Float CmpGt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    static int MoveMask(Float mask) { return _mm256_movemask_ps(mask); }
+};
+
+}
+
+unsigned PerlinOctaveNoiseAvx2(const std::uint8_t* permutation, const double* x, const double* y, const int* octaves,
+    int fixedOctaves, double* result, unsigned count)
+{
+    return PerlinOctaveNoiseBatch<Avx2Lanes>(permutation, x, y, octaves, fixedOctaves, result, count);
+}
+
+unsigned SimplexFractalAvx2(const std::uint8_t* permutation, std::size_t octaves, float frequency, float amplitude,
+    float lacunarity, float persistence, const float* x, const float* y, float* result, unsigned count)
+{
+    return SimplexFractalBatch<Avx2Lanes>(permutation, octaves, frequency, amplitude, lacunarity, persistence, x, y, result, count);
+}
+
+#endif
+
+#ifdef NOISE_BATCH_AVX2_TARGET
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
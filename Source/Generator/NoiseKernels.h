@@ -0,0 +1,281 @@
+#pragma once
+// Lane generic bodies of the batch noise kernels, included by one source file per instruction set
+// together with a lane type wrapping its intrinsics.
+// Each step repeats PerlinNoise::noise(x, y) and SimplexNoise::noise(x, y) in the same order,
+// so every lane gives the bits of the scalar call. Lattice hashing stays scalar per lane.
+// Everything here is static or a template of a file local lane type, functions compiled for one
+// instruction set are never shared with another translation unit
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_BATCH_SSE2
+#endif
+
+#if defined(NOISE_BATCH_SSE2) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) \
+    && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define NOISE_BATCH_AVX2
+#endif
+
+#ifdef NOISE_BATCH_AVX2
+// Defined in NoiseBatchAvx2.cpp, callers check the CPU first. Return the number of samples done,
+// always a multiple of the lane count, the rest is left to the scalar code
+unsigned PerlinOctaveNoiseAvx2(const std::uint8_t* permutation, const double* x, const double* y, const int* octaves,
+    int fixedOctaves, double* result, unsigned count);
+unsigned SimplexFractalAvx2(const std::uint8_t* permutation, std::size_t octaves, float frequency, float amplitude,
+    float lacunarity, float persistence, const float* x, const float* y, float* result, unsigned count);
+#endif
+
+enum PerlinGradFlag {
+    PGF_U_IS_Y,
+    PGF_V_IS_Y,
+    PGF_V_IS_X,
+    PGF_NEGATE_U,
+    PGF_NEGATE_V,
+    PGF_COUNT
+};
+
+enum SimplexGradFlag {
+    SGF_SWAP,
+    SGF_NEGATE_U,
+    SGF_NEGATE_V,
+    SGF_COUNT
+};
+
+// PerlinNoise::Grad(hash, x, y, 0.0) as lane masks
+static inline void GetPerlinGradMasks(int hash, std::int64_t* masks, unsigned lanes, unsigned lane)
+{
+    const int h = hash & 15;
+    masks[PGF_U_IS_Y * lanes + lane] = h < 8 ? 0 : -1;
+    masks[PGF_V_IS_Y * lanes + lane] = h < 4 ? -1 : 0;
+    masks[PGF_V_IS_X * lanes + lane] = h >= 4 && (h == 12 || h == 14) ? -1 : 0;
+    masks[PGF_NEGATE_U * lanes + lane] = (h & 1) ? -1 : 0;
+    masks[PGF_NEGATE_V * lanes + lane] = (h & 2) ? -1 : 0;
+}
+
+// SimplexNoise grad(hash, x, y) as lane masks
+static inline void GetSimplexGradMasks(int hash, std::int32_t* masks, unsigned lanes, unsigned lane)
+{
+    const int h = hash & 0x3F;
+    masks[SGF_SWAP * lanes + lane] = h < 4 ? 0 : -1;
+    masks[SGF_NEGATE_U * lanes + lane] = (h & 1) ? -1 : 0;
+    masks[SGF_NEGATE_V * lanes + lane] = (h & 2) ? -1 : 0;
+}
+
+// Same as fastfloor in SimplexNoise.cpp
+static inline std::int32_t SimplexFloor(float fp)
+{
+    std::int32_t i = static_cast<std::int32_t>(fp);
+    return (fp < i) ? (i - 1) : (i);
+}
+
+template <class L>
+static typename L::Double PerlinFade(typename L::Double t)
+{
+    // t * t * t * (t * (t * 6 - 15) + 10)
+    typename L::Double inner = L::Sub(L::Mul(t, L::Set(6.0)), L::Set(15.0));
+    inner = L::Add(L::Mul(t, inner), L::Set(10.0));
+    return L::Mul(L::Mul(L::Mul(t, t), t), inner);
+}
+
+template <class L>
+static typename L::Double PerlinLerp(typename L::Double t, typename L::Double a, typename L::Double b)
+{
+    return L::Add(a, L::Mul(t, L::Sub(b, a)));
+}
+
+template <class L>
+static typename L::Double PerlinGrad(const std::int64_t* masks, typename L::Double x, typename L::Double y)
+{
+    const unsigned W = L::DOUBLE_LANES;
+    const typename L::Double sign = L::Set(-0.0);
+    typename L::Double u = L::Select(L::Mask(masks + PGF_U_IS_Y * W), y, x);
+    typename L::Double v = L::Select(L::Mask(masks + PGF_V_IS_X * W), x, L::Set(0.0));
+    v = L::Select(L::Mask(masks + PGF_V_IS_Y * W), y, v);
+    // Negation only flips the sign bit
+    u = L::Xor(u, L::And(L::Mask(masks + PGF_NEGATE_U * W), sign));
+    v = L::Xor(v, L::And(L::Mask(masks + PGF_NEGATE_V * W), sign));
+    return L::Add(u, v);
+}
+
+/**
+ * PerlinNoise::octaveNoise(x, y, octaves) for whole vectors, octaves may be null to use fixedOctaves for all samples
+ */
+template <class L>
+static unsigned PerlinOctaveNoiseBatch(const std::uint8_t* p, const double* xs, const double* ys, const int* octaves,
+    int fixedOctaves, double* out, unsigned count)
+{
+    typedef typename L::Double D;
+    const unsigned W = L::DOUBLE_LANES;
+    const D one = L::Set(1.0);
+    unsigned i = 0;
+    for (; i + W <= count; i += W) {
+        D x = L::Load(xs + i);
+        D y = L::Load(ys + i);
+        D result = L::Set(0.0);
+        D amp = one;
+
+        int maxOctaves = fixedOctaves;
+        if (octaves) {
+            maxOctaves = 0;
+            for (unsigned l = 0; l < W; l++) {
+                maxOctaves = octaves[i + l] > maxOctaves ? octaves[i + l] : maxOctaves;
+            }
+        }
+
+        for (int o = 0; o < maxOctaves; o++) {
+            const D fx = L::Floor(x);
+            const D fy = L::Floor(y);
+            alignas(32) double floorX[W];
+            alignas(32) double floorY[W];
+            alignas(32) std::int64_t masks[4][PGF_COUNT * W];
+            L::Store(floorX, fx);
+            L::Store(floorY, fy);
+            for (unsigned l = 0; l < W; l++) {
+                const int X = static_cast<int>(floorX[l]) & 255;
+                const int Y = static_cast<int>(floorY[l]) & 255;
+                const int A = p[X] + Y;
+                const int B = p[X + 1] + Y;
+                GetPerlinGradMasks(p[p[A]], masks[0], W, l);
+                GetPerlinGradMasks(p[p[B]], masks[1], W, l);
+                GetPerlinGradMasks(p[p[A + 1]], masks[2], W, l);
+                GetPerlinGradMasks(p[p[B + 1]], masks[3], W, l);
+            }
+
+            const D rx = L::Sub(x, fx);
+            const D ry = L::Sub(y, fy);
+            const D rx1 = L::Sub(rx, one);
+            const D ry1 = L::Sub(ry, one);
+            const D u = PerlinFade<L>(rx);
+            const D v = PerlinFade<L>(ry);
+            const D noise = PerlinLerp<L>(v,
+                PerlinLerp<L>(u, PerlinGrad<L>(masks[0], rx, ry), PerlinGrad<L>(masks[1], rx1, ry)),
+                PerlinLerp<L>(u, PerlinGrad<L>(masks[2], rx, ry1), PerlinGrad<L>(masks[3], rx1, ry1)));
+
+            const D next = L::Add(result, L::Mul(noise, amp));
+            if (octaves) {
+                // Lanes with fewer octaves keep their sum
+                alignas(32) std::int64_t active[W];
+                for (unsigned l = 0; l < W; l++) {
+                    active[l] = o < octaves[i + l] ? -1 : 0;
+                }
+                result = L::Select(L::Mask(active), next, result);
+            } else {
+                result = next;
+            }
+            x = L::Mul(x, L::Set(2.0));
+            y = L::Mul(y, L::Set(2.0));
+            amp = L::Mul(amp, L::Set(0.5));
+        }
+        L::Store(out + i, result);
+    }
+    return i;
+}
+
+template <class L>
+static typename L::Float SimplexGrad(const std::int32_t* masks, typename L::Float x, typename L::Float y)
+{
+    const unsigned W = L::FLOAT_LANES;
+    const typename L::Float sign = L::Set(-0.0f);
+    const typename L::Float swap = L::Mask(masks + SGF_SWAP * W);
+    typename L::Float u = L::Select(swap, y, x);
+    typename L::Float v = L::Mul(L::Set(2.0f), L::Select(swap, x, y));
+    u = L::Xor(u, L::And(L::Mask(masks + SGF_NEGATE_U * W), sign));
+    v = L::Xor(v, L::And(L::Mask(masks + SGF_NEGATE_V * W), sign));
+    return L::Add(u, v);
+}
+
+template <class L>
+static typename L::Float SimplexCorner(const std::int32_t* masks, typename L::Float x, typename L::Float y)
+{
+    typedef typename L::Float F;
+    F t = L::Sub(L::Sub(L::Set(0.5f), L::Mul(x, x)), L::Mul(y, y));
+    const F outside = L::CmpLt(t, L::Set(0.0f));
+    t = L::Mul(t, t);
+    return L::AndNot(outside, L::Mul(L::Mul(t, t), SimplexGrad<L>(masks, x, y)));
+}
+
+/**
+ * SimplexNoise::noise(x, y) for one vector
+ */
+template <class L>
+static typename L::Float SimplexNoise2(const std::uint8_t* perm, typename L::Float x, typename L::Float y)
+{
+    typedef typename L::Float F;
+    const unsigned W = L::FLOAT_LANES;
+    const float F2 = 0.366025403f;
+    const float G2 = 0.211324865f;
+    const F one = L::Set(1.0f);
+    const F g2 = L::Set(G2);
+
+    const F s = L::Mul(L::Add(x, y), L::Set(F2));
+    alignas(32) float skewedX[W];
+    alignas(32) float skewedY[W];
+    L::Store(skewedX, L::Add(x, s));
+    L::Store(skewedY, L::Add(y, s));
+    alignas(32) std::int32_t cellX[W];
+    alignas(32) std::int32_t cellY[W];
+    alignas(32) std::int32_t cellSum[W];
+    for (unsigned l = 0; l < W; l++) {
+        cellX[l] = SimplexFloor(skewedX[l]);
+        cellY[l] = SimplexFloor(skewedY[l]);
+        cellSum[l] = cellX[l] + cellY[l];
+    }
+
+    const F t = L::Mul(L::FromInt(cellSum), g2);
+    const F x0 = L::Sub(x, L::Sub(L::FromInt(cellX), t));
+    const F y0 = L::Sub(y, L::Sub(L::FromInt(cellY), t));
+    const F lower = L::CmpGt(x0, y0);
+    const F x1 = L::Add(L::Sub(x0, L::And(lower, one)), g2);
+    const F y1 = L::Add(L::Sub(y0, L::AndNot(lower, one)), g2);
+    const F x2 = L::Add(L::Sub(x0, one), L::Set(2.0f * G2));
+    const F y2 = L::Add(L::Sub(y0, one), L::Set(2.0f * G2));
+
+    const int lowerBits = L::MoveMask(lower);
+    alignas(32) std::int32_t masks[3][SGF_COUNT * W];
+    for (unsigned l = 0; l < W; l++) {
+        const std::int32_t i = cellX[l];
+        const std::int32_t j = cellY[l];
+        const std::int32_t i1 = (lowerBits >> l) & 1;
+        const std::int32_t j1 = 1 - i1;
+        GetSimplexGradMasks(perm[static_cast<std::uint8_t>(i + perm[static_cast<std::uint8_t>(j)])], masks[0], W, l);
+        GetSimplexGradMasks(perm[static_cast<std::uint8_t>(i + i1 + perm[static_cast<std::uint8_t>(j + j1)])], masks[1], W, l);
+        GetSimplexGradMasks(perm[static_cast<std::uint8_t>(i + 1 + perm[static_cast<std::uint8_t>(j + 1)])], masks[2], W, l);
+    }
+
+    const F n0 = SimplexCorner<L>(masks[0], x0, y0);
+    const F n1 = SimplexCorner<L>(masks[1], x1, y1);
+    const F n2 = SimplexCorner<L>(masks[2], x2, y2);
+    return L::Mul(L::Set(45.23065f), L::Add(L::Add(n0, n1), n2));
+}
+
+/**
+ * SimplexNoise::fractal(octaves, x, y) for whole vectors
+ */
+template <class L>
+static unsigned SimplexFractalBatch(const std::uint8_t* perm, std::size_t octaves, float frequency, float amplitude,
+    float lacunarity, float persistence, const float* xs, const float* ys, float* out, unsigned count)
+{
+    typedef typename L::Float F;
+    const unsigned W = L::FLOAT_LANES;
+    unsigned i = 0;
+    for (; i + W <= count; i += W) {
+        const F x = L::Load(xs + i);
+        const F y = L::Load(ys + i);
+        F output = L::Set(0.0f);
+        float denom = 0.0f;
+        float octaveFrequency = frequency;
+        float octaveAmplitude = amplitude;
+        for (std::size_t o = 0; o < octaves; o++) {
+            const F f = L::Set(octaveFrequency);
+            const F noise = SimplexNoise2<L>(perm, L::Mul(x, f), L::Mul(y, f));
+            output = L::Add(output, L::Mul(L::Set(octaveAmplitude), noise));
+            denom += octaveAmplitude;
+            octaveFrequency *= lacunarity;
+            octaveAmplitude *= persistence;
+        }
+        L::Store(out + i, L::Div(output, L::Set(denom)));
+    }
+    return i;
+}
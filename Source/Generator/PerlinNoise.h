@@ -10,7 +10,8 @@ class PerlinNoise
 {
 private:
 
-    std::uint8_t randomNumbers[POOL_SIZE];
+    // Permutation repeated twice so that the corner lookups never wrap
+    std::uint8_t randomNumbers[POOL_SIZE * 2];
 
     static double Fade(double t) noexcept
     {
@@ -39,18 +40,32 @@ public:
 
     explicit PerlinNoise()
     {
+        reseed(0);
     }
 
+    /**
+     * Shuffle the permutation with a generator owned by this call, the global Urho3D random state is not touched.
+     * Noise is only read afterwards, so it can be sampled from any number of threads until the next reseed
+     */
     void reseed(int seed)
     {
-        SetRandomSeed(seed);
+        std::mt19937 engine(static_cast<std::uint32_t>(seed));
         for (size_t i = 0; i < POOL_SIZE; ++i)
         {
             randomNumbers[i] = static_cast<std::uint8_t>(i);
-            randomNumbers[i] = Random();
         }
-
-//        std::begin(randomNumbers), std::begin(randomNumbers) + 512, std::default_random_engine(seed);
+        // Fisher-Yates with plain engine output, the same on every platform for the same seed
+        for (size_t i = POOL_SIZE - 1; i > 0; --i)
+        {
+            size_t j = engine() % (i + 1);
+            std::uint8_t value = randomNumbers[i];
+            randomNumbers[i] = randomNumbers[j];
+            randomNumbers[j] = value;
+        }
+        for (size_t i = 0; i < POOL_SIZE; ++i)
+        {
+            randomNumbers[POOL_SIZE + i] = randomNumbers[i];
+        }
     }
 
     double noise(double x) const
@@ -60,7 +75,25 @@ public:
 
     double noise(double x, double y) const
     {
-        return noise(x, y, 0.0);
+        // noise(x, y, 0.0) without the upper z lattice, its interpolation weight is zero
+        const double fx = Floor(x);
+        const double fy = Floor(y);
+        const int X = static_cast<int>(fx) & (POOL_SIZE - 1);
+        const int Y = static_cast<int>(fy) & (POOL_SIZE - 1);
+
+        x -= fx;
+        y -= fy;
+
+        const double u = Fade(x);
+        const double v = Fade(y);
+
+        const int A = randomNumbers[X] + Y;
+        const int B = randomNumbers[X + 1] + Y;
+
+        return Lerp(v, Lerp(u, Grad(randomNumbers[randomNumbers[A]], x, y, 0.0),
+                            Grad(randomNumbers[randomNumbers[B]], x - 1, y, 0.0)),
+                    Lerp(u, Grad(randomNumbers[randomNumbers[A + 1]], x, y - 1, 0.0),
+                         Grad(randomNumbers[randomNumbers[B + 1]], x - 1, y - 1, 0.0)));
     }
 
     double noise(double x, double y, double z) const
@@ -121,6 +154,17 @@ public:
         return result;
     }
 
+    /**
+     * octaveNoise(x[i], y[i], octaves) of count samples with the SIMD kernel picked by GetNoiseKernel,
+     * every result has the bits of the scalar call
+     */
+    void octaveNoise(const double* x, const double* y, double* result, unsigned count, int octaves) const;
+
+    /**
+     * Same with an octave count per sample
+     */
+    void octaveNoise(const double* x, const double* y, const int* octaves, double* result, unsigned count) const;
+
     double octaveNoise(double x, double y, double z, int octaves) const
     {
         double result = 0.0;
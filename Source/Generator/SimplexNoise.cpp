@@ -27,6 +27,8 @@
 #include "SimplexNoise.h"
 #include <Urho3D/Math/MathDefs.h>
 #include <cstdint>  // int32_t/uint8_t
+#include <cstring>  // memcpy
+#include <random>
 
 /**
  * Computes the largest integer value not greater than the float one
@@ -68,7 +70,7 @@ static inline int32_t fastfloor(float fp) {
  * A vector-valued noise over 3D accesses it 96 times, and a
  * float-valued 4D noise 64 times. We want this to fit in the cache!
  */
-static uint8_t perm[256] = {
+static const uint8_t perm[256] = {
         151, 160, 137, 91, 90, 15,
         131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23,
         190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33,
@@ -84,22 +86,6 @@ static uint8_t perm[256] = {
         138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
 };
 
-/**
- * Helper function to hash an integer using the above permutation table
- *
- *  This inline function costs around 1ns, and is called N+1 times for a noise of N dimension.
- *
- *  Using a real hash function would be better to improve the "repeatability of 256" of the above permutation table,
- * but fast integer Hash functions uses more time and have bad random properties.
- *
- * @param[in] i Integer value to hash
- *
- * @return 8-bits hashed value
- */
-static inline uint8_t hash(int32_t i) {
-    return perm[static_cast<uint8_t>(i)];
-}
-
 /* NOTE Gradient table to test if lookup-table are more efficient than calculs
 static const float gradients1D[16] = {
         -8.f, -7.f, -6.f, -5.f, -4.f, -3.f, -2.f, -1.f,
@@ -163,11 +149,27 @@ static float grad(int32_t hash, float x, float y, float z) {
     return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
 }
 
+SimplexNoise::SimplexNoise(float frequency, float amplitude, float lacunarity, float persistence) :
+        mFrequency(frequency),
+        mAmplitude(amplitude),
+        mLacunarity(lacunarity),
+        mPersistence(persistence) {
+    memcpy(mPerm, perm, sizeof(mPerm));
+}
+
 void SimplexNoise::SetSeed(int seed)
 {
-    Urho3D::SetRandomSeed(seed);
+    // Fisher-Yates shuffle with a local engine, the global Urho3D random state is not touched
+    // and the table is the same on every platform for the same seed
+    std::mt19937 engine(static_cast<uint32_t>(seed));
     for (int i = 0; i < 256; i++) {
-        perm[i] = Urho3D::Random();
+        mPerm[i] = static_cast<uint8_t>(i);
+    }
+    for (int i = 255; i > 0; i--) {
+        int j = static_cast<int>(engine() % static_cast<uint32_t>(i + 1));
+        uint8_t value = mPerm[i];
+        mPerm[i] = mPerm[j];
+        mPerm[j] = value;
     }
 }
 
@@ -180,7 +182,7 @@ void SimplexNoise::SetSeed(int seed)
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::noise(float x) {
+float SimplexNoise::noise(float x) const {
     float n0, n1;   // Noise contributions from the two "corners"
 
     // No need to skew the input space in 1D
@@ -219,7 +221,7 @@ float SimplexNoise::noise(float x) {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::noise(float x, float y) {
+float SimplexNoise::noise(float x, float y) const {
     float n0, n1, n2;   // Noise contributions from the three corners
 
     // Skewing/Unskewing factors for 2D
@@ -307,7 +309,7 @@ float SimplexNoise::noise(float x, float y) {
  *
  * @return Noise value in the range[-1; 1], value of 0 on all integer coordinates.
  */
-float SimplexNoise::noise(float x, float y, float z) {
+float SimplexNoise::noise(float x, float y, float z) const {
     float n0, n1, n2, n3; // Noise contributions from the four corners
 
     // Skewing/Unskewing factors for 3D
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <cstddef>  // size_t
+#include <cstdint>  // int32_t/uint8_t
 
 /**
  * @brief A Perlin Simplex Noise C++ Implementation (1D, 2D, 3D, 4D).
@@ -17,16 +18,22 @@
 class SimplexNoise {
 public:
     // 1D Perlin simplex noise
-    static float noise(float x);
+    float noise(float x) const;
     // 2D Perlin simplex noise
-    static float noise(float x, float y);
+    float noise(float x, float y) const;
     // 3D Perlin simplex noise
-    static float noise(float x, float y, float z);
+    float noise(float x, float y, float z) const;
 
     // Fractal/Fractional Brownian Motion (fBm) noise summation
     float fractal(size_t octaves, float x) const;
     float fractal(size_t octaves, float x, float y) const;
     float fractal(size_t octaves, float x, float y, float z) const;
+    // fractal(octaves, x[i], y[i]) of count samples with the SIMD kernel picked by GetNoiseKernel, same bits as the scalar call
+    void fractal(size_t octaves, const float* x, const float* y, float* result, unsigned count) const;
+    /**
+     * Shuffle the permutation table with a generator owned by this instance.
+     * Must not be called while other threads sample the noise
+     */
     void SetSeed(int seed);
 
     /**
@@ -40,18 +47,17 @@ public:
     explicit SimplexNoise(float frequency = 1.0f,
                           float amplitude = 1.0f,
                           float lacunarity = 2.0f,
-                          float persistence = 0.5f) :
-            mFrequency(frequency),
-            mAmplitude(amplitude),
-            mLacunarity(lacunarity),
-            mPersistence(persistence) {
-    }
+                          float persistence = 0.5f);
 
 private:
+    uint8_t hash(int32_t i) const {
+        return mPerm[static_cast<uint8_t>(i)];
+    }
+
     // Parameters of Fractional Brownian Motion (fBm) : sum of N "octaves" of noise
     float mFrequency;   ///< Frequency ("width") of the first octave of noise (default to 1.0)
     float mAmplitude;   ///< Amplitude ("height") of the first octave of noise (default to 1.0)
     float mLacunarity;  ///< Lacunarity specifies the frequency multiplier between successive octaves (default to 2.0).
     float mPersistence; ///< Persistence is the loss of amplitude between successive octaves (usually 1/lacunarity)
-    float mSeed;
+    uint8_t mPerm[256]; ///< Permutation table, reference table until SetSeed is called
 };
\ No newline at end of file
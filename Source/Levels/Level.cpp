@@ -39,6 +39,11 @@
 #include "Voxel/VoxelEvents.h"
 #include "Voxel/ChunkGenerator.h"
 #include "Voxel/TreeGenerator.h"
+#include "Voxel/ChunkStorage.h"
+#include "Voxel/ChunkIOService.h"
+#include "Voxel/EditJournal.h"
+#include "Voxel/ChunkStreamer.h"
+#include "Voxel/VoxelBenchmark.h"
 
 using namespace Levels;
 using namespace ConsoleHandlerEvents;
@@ -66,6 +71,12 @@ Level::~Level()
         context_->RemoveSubsystem<ChunkGenerator>();
         context_->RemoveSubsystem<LightManager>();
         context_->RemoveSubsystem<TreeGenerator>();
+        context_->RemoveSubsystem<VoxelBenchmark>();
+        context_->RemoveSubsystem<ChunkIOService>();
+        context_->RemoveSubsystem<ChunkStreamer>();
+        // Folds the journal into the storage, after the disk thread stopped
+        context_->RemoveSubsystem<EditJournal>();
+        context_->RemoveSubsystem<ChunkStorage>();
     }
 }
 
@@ -79,6 +90,11 @@ void Level::RegisterObject(Context* context)
     ChunkGenerator::RegisterObject(context);
     LightManager::RegisterObject(context);
     TreeGenerator::RegisterObject(context);
+    ChunkStorage::RegisterObject(context);
+    ChunkIOService::RegisterObject(context);
+    EditJournal::RegisterObject(context);
+    ChunkStreamer::RegisterObject(context);
+    VoxelBenchmark::RegisterObject(context);
 }
 
 void Level::Init()
@@ -180,6 +196,21 @@ void Level::CreateVoxelWorld()
     if (!GetSubsystem<TreeGenerator>()) {
         context_->RegisterSubsystem(new TreeGenerator(context_));
     }
+    if (!GetSubsystem<ChunkStorage>()) {
+        context_->RegisterSubsystem(new ChunkStorage(context_));
+    }
+    if (!GetSubsystem<ChunkIOService>()) {
+        context_->RegisterSubsystem(new ChunkIOService(context_));
+    }
+    if (!GetSubsystem<EditJournal>()) {
+        context_->RegisterSubsystem(new EditJournal(context_));
+    }
+    if (!GetSubsystem<ChunkStreamer>()) {
+        context_->RegisterSubsystem(new ChunkStreamer(context_));
+    }
+    if (!GetSubsystem<VoxelBenchmark>()) {
+        context_->RegisterSubsystem(new VoxelBenchmark(context_));
+    }
     GetSubsystem<VoxelWorld>()->Init();
 }
 
@@ -533,6 +564,9 @@ void Level::HandleClientConnected(StringHash eventType, VariantMap& eventData)
     remotePlayers_[newConnection] = CreatePlayer(REMOTE_PLAYER_ID, true, "Remote " + String(REMOTE_PLAYER_ID));
     remotePlayers_[newConnection]->SetClientConnection(newConnection);
     REMOTE_PLAYER_ID++;
+    if (GetSubsystem<VoxelWorld>()) {
+        GetSubsystem<VoxelWorld>()->AddEditSubscriber(newConnection, remotePlayers_[newConnection]->GetNode());
+    }
 
     using namespace RemoteClientId;
     VariantMap data;
@@ -549,6 +583,12 @@ void Level::HandleClientDisconnected(StringHash eventType, VariantMap& eventData
 
     // When a client connects, assign to scene to begin scene replication
     auto* connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+    if (GetSubsystem<VoxelWorld>()) {
+        GetSubsystem<VoxelWorld>()->RemoveEditSubscriber(connection);
+    }
+    if (GetSubsystem<ChunkStreamer>()) {
+        GetSubsystem<ChunkStreamer>()->RemoveServerQueue(connection);
+    }
     remotePlayers_.Erase(connection);
 }
 
@@ -586,9 +626,7 @@ void Level::HandlePlayerTargetChanged(StringHash eventType, VariantMap& eventDat
     }
 }
 
-bool Level::RaycastFromCamera(Camera* camera, float maxDistance, Vector3& hitPos, Vector3& hitNormal, Drawable*& hitDrawable) {
-    hitDrawable = nullptr;
-
+bool Level::RaycastFromCamera(Camera* camera, float maxDistance, VoxelRaycastResult& result) {
     UI* ui = GetSubsystem<UI>();
     Input* input = GetSubsystem<Input>();
     IntVector2 pos = ui->GetCursorPosition();
@@ -598,19 +636,9 @@ bool Level::RaycastFromCamera(Camera* camera, float maxDistance, Vector3& hitPos
 
     Graphics* graphics = GetSubsystem<Graphics>();
     Ray cameraRay = camera->GetScreenRay((float)pos.x_ / graphics->GetWidth(), (float)pos.y_ / graphics->GetHeight());
-    // Pick only geometry objects, not eg. zones or lights, only get the first (closest) hit
-    PODVector<RayQueryResult> results;
-    RayOctreeQuery query(results, cameraRay, RAY_TRIANGLE, maxDistance, DRAWABLE_GEOMETRY, VIEW_MASK_CHUNK);
-    scene_->GetComponent<Octree>()->RaycastSingle(query);
-    if (results.Size()) {
-        RayQueryResult& result = results[0];
-        hitPos = result.position_;
-        hitNormal = result.normal_;
-        hitDrawable = result.drawable_;
-        return true;
-    }
-
-    return false;
+    // Block data is walked directly, no need to wait for the chunk meshes
+    auto world = GetSubsystem<VoxelWorld>();
+    return world && world->Raycast(cameraRay.origin_, cameraRay.direction_, maxDistance, result);
 }
 
 void Level::HandleMappedControlPressed(StringHash eventType, VariantMap& eventData)
@@ -621,34 +649,30 @@ void Level::HandleMappedControlPressed(StringHash eventType, VariantMap& eventDa
         int controllerId = eventData[P_CONTROLLER].GetInt();
         if (cameras_.Contains(controllerId)) {
             Camera* camera = cameras_[controllerId]->GetComponent<Camera>();
-            Vector3 hitPosition;
-            Vector3 hitNormal;
-            Drawable* hitDrawable;
-            bool hit = RaycastFromCamera(camera, 100.0f, hitPosition, hitNormal, hitDrawable);
-            if (hit) {
-//                URHO3D_LOGINFO("Hit target " + hitDrawable->GetNode()->GetName() + " Normal: " + hitNormal.ToString() + " Position " + hitPosition.ToString());
+            VoxelRaycastResult hit;
+            if (RaycastFromCamera(camera, 100.0f, hit)) {
+//                URHO3D_LOGINFO("Hit block " + hit.blockPosition_.ToString() + " Normal: " + hit.normal_.ToString());
                 using namespace ChunkHit;
+                Vector3 blockCenter = Vector3(hit.blockPosition_.x_, hit.blockPosition_.y_, hit.blockPosition_.z_) + Vector3::ONE * 0.5f;
                 VariantMap& data = GetEventDataMap();
-                data[P_POSITION] = hitPosition - hitNormal * 0.5f;
-                data[P_DIRECTION] = hitNormal * 0.5f;
-                data[P_ORIGIN] = hitPosition + hitNormal * 0.5f;;
+                data[P_POSITION] = blockCenter;
+                data[P_DIRECTION] = hit.normal_ * 0.5f;
+                data[P_ORIGIN] = blockCenter + hit.normal_;
                 data[P_CONTROLLER_ID] = eventData[P_CONTROLLER];
                 data[P_ACTION_ID] = action;
-                hitDrawable->GetNode()->GetParent()->SendEvent(E_CHUNK_HIT, data);
+                hit.chunk_->GetNode()->SendEvent(E_CHUNK_HIT, data);
             }
         }
     } else if (action == CTRL_SECONDARY || action == CTRL_DETECT) {
         int controllerId = eventData[P_CONTROLLER].GetInt();
         if (cameras_.Contains(controllerId)) {
             Camera* camera = cameras_[controllerId]->GetComponent<Camera>();
-            Vector3 hitPosition;
-            Vector3 hitNormal;
-            Drawable* hitDrawable;
-            bool hit = RaycastFromCamera(camera, 100.0f, hitPosition, hitNormal, hitDrawable);
-            if (hit) {
-//                URHO3D_LOGINFO("Hit target " + hitDrawable->GetNode()->GetName() + " Normal: " + hitNormal.ToString());
+            VoxelRaycastResult hit;
+            if (RaycastFromCamera(camera, 100.0f, hit)) {
+//                URHO3D_LOGINFO("Hit block " + hit.blockPosition_.ToString() + " Normal: " + hit.normal_.ToString());
                 Vector3 playerPosition = players_[controllerId]->GetNode()->GetWorldPosition();
-                Vector3 blockPosition = hitPosition + hitNormal * 0.5f;
+                // Center of the air block in front of the hit face
+                Vector3 blockPosition = Vector3(hit.blockPosition_.x_, hit.blockPosition_.y_, hit.blockPosition_.z_) + Vector3::ONE * 0.5f + hit.normal_;
 //                URHO3D_LOGINFO("Player position " + playerPosition.ToString() + " block position " + blockPosition.ToString());
                 if (
                         Floor(blockPosition.x_) != Floor(playerPosition.x_) ||
@@ -661,7 +685,8 @@ void Level::HandleMappedControlPressed(StringHash eventType, VariantMap& eventDa
                     data[P_CONTROLLER_ID] = eventData[P_CONTROLLER];
                     data[P_ACTION_ID]  = action;
                     data[P_ITEM_ID] = players_[controllerId]->GetSelectedItem();
-                    hitDrawable->GetNode()->GetParent()->SendEvent(E_CHUNK_ADD, data);
+                    // Chunk forwards the event when the block belongs to its neighbor
+                    hit.chunk_->GetNode()->SendEvent(E_CHUNK_ADD, data);
                 } else {
                     URHO3D_LOGINFO("You cannot place a block where you stand");
                 }
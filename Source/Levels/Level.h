@@ -8,6 +8,8 @@
 #include "../BaseLevel.h"
 #include "Player/Player.h"
 
+struct VoxelRaycastResult;
+
 namespace Levels {
     class Level : public BaseLevel
     {
@@ -53,7 +55,7 @@ namespace Levels {
         void HandleServerDisconnected(StringHash eventType, VariantMap& eventData);
         void HandleMappedControlPressed(StringHash eventType, VariantMap& eventData);
 
-        bool RaycastFromCamera(Camera* camera, float maxDistance, Vector3& hitPos, Vector3& hitNormal, Drawable*& hitDrawable);
+        bool RaycastFromCamera(Camera* camera, float maxDistance, VoxelRaycastResult& result);
 
         void ShowPauseMenu();
         void PauseMenuHidden();
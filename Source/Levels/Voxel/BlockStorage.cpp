@@ -0,0 +1,137 @@
+#include <cstring>
+#include "BlockStorage.h"
+#include "Chunk.h"
+
+static_assert(BT_NONE <= 16, "Block types must fit into a 4 bit palette");
+
+static unsigned GetWordCount(unsigned bits)
+{
+    return (CHUNK_VOXEL_COUNT * bits + 31) / 32;
+}
+
+BlockStorage::BlockStorage():
+    layout_(CreateLayout(0))
+{
+}
+
+BlockStorage::~BlockStorage()
+{
+    Compact();
+    delete layout_;
+}
+
+BlockStorage::Layout* BlockStorage::CreateLayout(unsigned bits)
+{
+    Layout* layout = new Layout();
+    layout->bits_ = static_cast<unsigned char>(bits);
+    if (bits) {
+        unsigned count = GetWordCount(bits);
+        layout->words_ = new unsigned[count];
+        memset(layout->words_.Get(), 0, count * sizeof(unsigned));
+    }
+    return layout;
+}
+
+void BlockStorage::Write(Layout* layout, unsigned index, unsigned value)
+{
+    unsigned bit = index * layout->bits_;
+    unsigned shift = bit & 31;
+    unsigned mask = ((1u << layout->bits_) - 1) << shift;
+    unsigned& word = layout->words_.Get()[bit >> 5];
+    word = (word & ~mask) | (value << shift);
+}
+
+void BlockStorage::Replace(Layout* layout)
+{
+    retired_.Push(layout_);
+    layout_ = layout;
+}
+
+void BlockStorage::Set(unsigned index, BlockType type)
+{
+    Layout* layout = layout_;
+    unsigned value = 0;
+    while (value < layout->paletteSize_ && layout->palette_[value] != type) {
+        value++;
+    }
+
+    if (value == layout->paletteSize_) {
+        if (layout->paletteSize_ == (1u << layout->bits_)) {
+            // Palette full, widen the indices 0 -> 1 -> 2 -> 4 bits
+            Layout* wider = CreateLayout(layout->bits_ ? layout->bits_ * 2 : 1);
+            wider->paletteSize_ = layout->paletteSize_;
+            memcpy(wider->palette_, layout->palette_, sizeof(layout->palette_));
+            if (layout->bits_) {
+                for (unsigned i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+                    unsigned bit = i * layout->bits_;
+                    Write(wider, i, (layout->words_.Get()[bit >> 5] >> (bit & 31)) & ((1u << layout->bits_) - 1));
+                }
+            }
+            Replace(wider);
+            layout = wider;
+        }
+        // Entry is written before it becomes reachable through an index
+        layout->palette_[value] = static_cast<unsigned char>(type);
+        layout->paletteSize_++;
+    }
+
+    if (layout->bits_) {
+        Write(layout, index, value);
+    }
+}
+
+void BlockStorage::Assign(const BlockType* types)
+{
+    unsigned char palette[MAX_PALETTE_SIZE];
+    unsigned char lookup[MAX_PALETTE_SIZE];
+    unsigned paletteSize = 0;
+    memset(lookup, 0xFF, sizeof(lookup));
+    for (unsigned i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+        unsigned type = types[i];
+        if (lookup[type] == 0xFF) {
+            lookup[type] = static_cast<unsigned char>(paletteSize);
+            palette[paletteSize++] = static_cast<unsigned char>(type);
+        }
+    }
+
+    unsigned bits = 0;
+    while ((1u << bits) < paletteSize) {
+        bits = bits ? bits * 2 : 1;
+    }
+    Layout* layout = CreateLayout(bits);
+    layout->paletteSize_ = static_cast<unsigned char>(paletteSize);
+    memcpy(layout->palette_, palette, paletteSize);
+    if (bits) {
+        for (unsigned i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+            Write(layout, i, lookup[types[i]]);
+        }
+    }
+    Replace(layout);
+}
+
+void BlockStorage::Clear()
+{
+    // Zeroed palette holds BT_AIR
+    Replace(CreateLayout(0));
+}
+
+void BlockStorage::Compact()
+{
+    if (!IsUniform()) {
+        BlockType types[CHUNK_VOXEL_COUNT];
+        for (unsigned i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+            types[i] = Get(i);
+        }
+        Assign(types);
+    }
+    for (auto it = retired_.Begin(); it != retired_.End(); ++it) {
+        delete *it;
+    }
+    retired_.Clear();
+}
+
+unsigned BlockStorage::GetMemoryUsage() const
+{
+    const Layout* layout = layout_;
+    return sizeof(BlockStorage) + sizeof(Layout) + GetWordCount(layout->bits_) * sizeof(unsigned);
+}
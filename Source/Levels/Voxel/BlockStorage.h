@@ -0,0 +1,77 @@
+#pragma once
+#include <Urho3D/Container/ArrayPtr.h>
+#include <Urho3D/Container/Vector.h>
+#include "VoxelDefs.h"
+
+using namespace Urho3D;
+
+/**
+ * Palette compressed block types of a single chunk.
+ * Voxels store an index into a small palette packed into 1, 2 or 4 bits,
+ * a chunk made of a single block type keeps no per voxel data at all.
+ * Blocks are addressed by linear index, (x * SIZE_Y + y) * SIZE_Z + z
+ */
+class BlockStorage {
+public:
+    BlockStorage();
+    ~BlockStorage();
+
+    BlockType Get(unsigned index) const
+    {
+        // Read the layout once, a concurrent Set may replace it with a wider one
+        const Layout* layout = layout_;
+        if (!layout->bits_) {
+            return static_cast<BlockType>(layout->palette_[0]);
+        }
+        unsigned bit = index * layout->bits_;
+        unsigned value = (layout->words_.Get()[bit >> 5] >> (bit & 31)) & ((1u << layout->bits_) - 1);
+        return static_cast<BlockType>(layout->palette_[value]);
+    }
+
+    void Set(unsigned index, BlockType type);
+
+    /**
+     * Replace all blocks, count must match the chunk voxel count
+     */
+    void Assign(const BlockType* types);
+
+    /**
+     * Make every block air
+     */
+    void Clear();
+
+    /**
+     * Rebuild the palette from the blocks in use with the narrowest index width.
+     * Also frees replaced layouts, must not run while other threads read the chunk
+     */
+    void Compact();
+
+    bool IsUniform() const { return layout_->bits_ == 0; }
+    BlockType GetUniformType() const { return static_cast<BlockType>(layout_->palette_[0]); }
+    unsigned GetBitsPerBlock() const { return layout_->bits_; }
+    unsigned GetPaletteSize() const { return layout_->paletteSize_; }
+
+    /**
+     * Heap and inline bytes used by the storage
+     */
+    unsigned GetMemoryUsage() const;
+
+private:
+    static const unsigned MAX_PALETTE_SIZE = 16;
+
+    struct Layout {
+        unsigned char bits_{0};
+        unsigned char paletteSize_{1};
+        unsigned char palette_[MAX_PALETTE_SIZE]{};
+        // Null while bits_ is zero
+        SharedArrayPtr<unsigned> words_;
+    };
+
+    static Layout* CreateLayout(unsigned bits);
+    static void Write(Layout* layout, unsigned index, unsigned value);
+    void Replace(Layout* layout);
+
+    Layout* layout_;
+    // Layouts replaced while readers may still use them, freed by Compact
+    PODVector<Layout*> retired_;
+};
@@ -1,4 +1,5 @@
 #include "Chunk.h"
+#include <cassert>
 #include <Urho3D/Graphics/Model.h>
 #include <Urho3D/Graphics/Material.h>
 #include <Urho3D/Graphics/DebugRenderer.h>
@@ -33,6 +34,11 @@
 #include "../../Console/ConsoleHandlerEvents.h"
 #include "LightManager.h"
 #include "TreeGenerator.h"
+#include "ChunkStorage.h"
+#include "ChunkIOService.h"
+#include "EditJournal.h"
+#include "ChunkStreamer.h"
+#include "ChunkCodec.h"
 #include "../../Audio/AudioManagerDefs.h"
 #include "../../Audio/AudioEvents.h"
 
@@ -44,14 +50,6 @@ Object(context),
 chunkMesh_(context),
 chunkWaterMesh_(context)
 {
-    for (int x = 0; x < SIZE_X; x++) {
-        for (int y = 0; y < SIZE_Y; y++) {
-            for (int z = 0; z < SIZE_Z; z++) {
-                SetVoxel(x, y, z, BlockType::BT_AIR);
-            }
-        }
-    }
-    memset(lightMap_, 0, sizeof(lightMap_));
 }
 
 Chunk::~Chunk()
@@ -69,7 +67,16 @@ void Chunk::Init(Scene* scene, const Vector3& position)
     scene_ = scene;
     position_ = position;
 
-    CreateNode();
+    if (node_) {
+        // Recycled chunk, move the existing nodes
+        node_->SetName("Chunk" + position_.ToString());
+        groundNode_->SetName("ChunkGround" + position_.ToString());
+        waterNode_->SetName("ChunkWater" + position_.ToString());
+        node_->SetWorldPosition(position_);
+        node_->ResetDeepEnabled();
+    } else {
+        CreateNode();
+    }
 
     SendEvent(
             E_CONSOLE_COMMAND_ADD,
@@ -93,98 +100,108 @@ void Chunk::Load()
     Timer loadTime;
     MutexLock lock(mutex_);
 
-    JSONFile file(context_);
-    JSONValue& root = file.GetRoot();
-    Vector3 position = Vector3(position_.x_ / SIZE_X, position_.y_ / SIZE_Y, position_.z_ / SIZE_Z);
-    String filename = "World/chunk_" + String(position.x_) + "_" + String(position.y_) + "_" + String(position.z_) + ".json";
-    if(GetSubsystem<FileSystem>() && GetSubsystem<FileSystem>()->FileExists(filename)) {
-        file.LoadFile(filename);
-        for (int x = 0; x < SIZE_X; ++x) {
-            for (int y = 0; y < SIZE_Y; y++) {
-                for (int z = 0; z < SIZE_Z; z++) {
-                    String key = String(x) + "_" + String(y) + "_" + String(z);
-                    if (root.Contains(key)) {
-                        SetVoxel(x, y, z, static_cast<BlockType>(root[key].GetInt()));
-                    }
-                }
-            }
+    bool generated = true;
+    BlockType voxels[CHUNK_VOXEL_COUNT];
+    if (diskState_ == CDS_LOADED && diskEdits_) {
+        // Generated again, the edits are applied after the decoration
+        MemoryBuffer buffer(diskData_);
+        if (!ChunkStorage::DecodeEdits(buffer, edits_)) {
+            URHO3D_LOGERROR("Invalid player edits of chunk " + position_.ToString());
+            edits_.Clear();
         }
-    } else {
+        diskData_.Clear();
+    } else if (diskState_ == CDS_LOADED && diskData_.Size() == CHUNK_VOXEL_COUNT) {
+        for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+            voxels[i] = static_cast<BlockType>(diskData_[i]);
+        }
+        diskData_.Clear();
+        generated = false;
+    } else if (diskState_ == CDS_NONE) {
+        // No I/O service running, read directly
+        auto storage = GetSubsystem<ChunkStorage>();
+        generated = !storage || storage->LoadChunk(GetChunkCoordinates(), voxels, edits_) != CR_BLOCKS;
+    }
+    blocksRecord_ = !generated;
 
+    if (generated) {
         auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+        // Surface height, biome and trees are shared with the chunks above and below
+        ChunkColumn column;
+        IntVector3 chunkCoordinates = GetChunkCoordinates();
+        chunkGenerator->GetColumn(chunkCoordinates.x_, chunkCoordinates.z_, column);
+
+        // Ore and cave noise shared by the terrain and cave passes
+        ChunkDensity density;
+        chunkGenerator->GetDensity(position_, chunkGenerator->GetDensityStep(), density);
+
         // Terrain
-        for (int x = 0; x < SIZE_X; ++x) {
-            for (int z = 0; z < SIZE_Z; z++) {
-                Vector3 blockPosition = position_ + Vector3(x, 0, z);
-                int surfaceHeight = chunkGenerator->GetTerrainHeight(blockPosition);
-                for (int y = 0; y < SIZE_Y; y++) {
-                    blockPosition.y_ = position_.y_ + y;
-                    BlockType block = chunkGenerator->GetBlockType(blockPosition, surfaceHeight);
-                    SetVoxel(x, y, z, block);
-                }
-            }
-        }
+        chunkGenerator->GetBlockTypes(position_, column, density, voxels);
+        stage_ = CGS_TERRAIN;
 
-        // Water
+        // Caves
+        chunkGenerator->ApplyCaves(density, voxels);
+        stage_ = CGS_CAVES;
+
+        // Water, after the caves so that lakes have no holes carved into them
         const int SEA_LEVEL = 0;
         for (int x = 0; x < SIZE_X; ++x) {
             for (int z = 0; z < SIZE_Z; z++) {
                 Vector3 blockPosition = position_ + Vector3(x, 0, z);
-                int surfaceHeight = chunkGenerator->GetTerrainHeight(blockPosition);
+                int surfaceHeight = column.heights_[x * SIZE_Z + z];
                 for (int y = 0; y < SIZE_Y; y++) {
                     int height = blockPosition.y_ + y;
                     if (height < SEA_LEVEL && height > surfaceHeight) {
-                        SetVoxel(x, y, z, BT_WATER);
+                        voxels[GetBlockIndex(x, y, z)] = BT_WATER;
                     }
                 }
             }
         }
+        // Decoration waits for the neighbors, the update pass schedules it
+        blocks_.Assign(voxels);
+        stage_ = CGS_WATER;
+        return;
+    }
+    // Palette is built once from the finished blocks
+    blocks_.Assign(voxels);
+    CompleteLoad();
+//    URHO3D_LOGINFO("Chunk " + String(position_) + " loaded in " + String(loadTime.GetMSec(false)) + "ms");
+//    Save();
+    // Chunks read from the region file are already up to date on disk
+    shouldSave_ = false;
+}
 
-        // Caves
-        for (int x = 0; x < SIZE_X; ++x) {
-            for (int y = 0; y < SIZE_Y; y++) {
-                for (int z = 0; z < SIZE_Z; z++) {
-                    Vector3 blockPosition = position_ + Vector3(x, y, z);
-                    BlockType block = chunkGenerator->GetCaveBlockType(blockPosition, data_[x][y][z].type);
-                    SetVoxel(x, y, z, block);
-                }
-            }
-        }
-
-        // Trees
-        for (int x = 0; x < SIZE_X; ++x) {
-            for (int z = 0; z < SIZE_Z; z++) {
-                Vector3 blockPosition = position_ + Vector3(x, 0, z);
-                int surfaceHeight = chunkGenerator->GetTerrainHeight(blockPosition);
-
-                for (int y = SIZE_Y - 1; y >= 0; y--) {
-                    blockPosition.y_ = position_.y_ + y;
-                    BlockType type = data_[x][y][z].type;
-                    if (surfaceHeight >= blockPosition.y_ && type == BT_DIRT) {
-                        if (GetSubsystem<ChunkGenerator>()->HaveTree(blockPosition)) {
-//                            GetSubsystem<TreeGenerator>()->AddTreeNode(x, y, z, 0, 0, this);
-                            SetVoxel(x, y, z, BT_WOOD);
-                            break;
-                        }
-                    }
-                }
-            }
+void Chunk::Decorate()
+{
+    MutexLock lock(mutex_);
+    auto treeGenerator = GetSubsystem<TreeGenerator>();
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    if (treeGenerator && chunkGenerator) {
+        BlockType voxels[CHUNK_VOXEL_COUNT];
+        GetBlocks(voxels);
+        // Includes the parts of the trees growing in the neighbor columns
+        TreeGenerator::PlaceTrees(chunkGenerator, GetChunkCoordinates(), voxels);
+        // Stored player edits win over everything generated
+        for (auto it = edits_.Begin(); it != edits_.End(); ++it) {
+            voxels[(*it).index_] = static_cast<BlockType>((*it).type_);
         }
+        blocks_.Assign(voxels);
     }
+    CompleteLoad();
+    // Only complete chunks are written to disk, Save skips untouched chunks of worlds that store edits
+    shouldSave_ = true;
+}
+
+void Chunk::CompleteLoad()
+{
     CalculateLight();
+    CalculateSunlight();
+    // Nobody reads the chunk before it is loaded, old layouts can be freed right away
+    CompactStorage();
     MarkForGeometryCalculation();
-    for (int i = 0; i < 6; i++) {
-        BlockSide side = static_cast<BlockSide>(i);
-        auto neighbor = GetNeighbor(side);
-        if (neighbor) {
-            neighbor->CalculateLight();
-            neighbor->MarkForGeometryCalculation();
-        }
-    }
-//    URHO3D_LOGINFO("Chunk " + String(position_) + " loaded in " + String(loadTime.GetMSec(false)) + "ms");
-//    Save();
+    // Neighbors may be generated at the same time, light is joined across borders in the update pass
+    lightSeedPending_ = true;
+    stage_ = CGS_DECORATED;
     loaded_ = true;
-    shouldSave_ = true;
 }
 
 bool Chunk::Render()
@@ -194,319 +211,366 @@ bool Chunk::Render()
     }
     renderCount_++;
     MutexLock lock(mutex_);
-    {
-        groundNode_->RemoveComponent<StaticModel>();
-        SharedPtr<Model> chunkModel(new Model(context_));
-        SharedPtr<Geometry> geometry = chunkMesh_.GetGeometry();
-
-        chunkModel->SetNumGeometries(1);
-        chunkModel->SetGeometry(0, 0, geometry);
-        chunkModel->SetBoundingBox(BoundingBox(Vector3(0, 0, 0), Vector3(SIZE_X, SIZE_Y, SIZE_Z)));
-
-        StaticModel *chunkObject = groundNode_->CreateComponent<StaticModel>(LOCAL);
-        chunkObject->SetModel(chunkModel);
-        chunkObject->SetViewMask(VIEW_MASK_CHUNK);
-        chunkObject->SetOccluder(true);
-        chunkObject->SetOccludee(true);
-        Material *material = SharedPtr<Material>(
-                GetSubsystem<ResourceCache>()->GetResource<Material>("Materials/Voxel.xml"));
-        chunkObject->SetMaterial(material);
-
-        if (node_->GetScene()->GetComponent<PhysicsWorld>() && geometry->GetVertexCount() > 0) {
-            node_->GetScene()->GetComponent<PhysicsWorld>()->RemoveCachedGeometry(chunkObject->GetModel());
-            groundNode_->GetComponent<CollisionShape>()->SetTriangleMesh(chunkObject->GetModel());
+    UploadMesh(groundNode_, groundModel_, chunkMesh_, groundBoxes_);
+    UploadMesh(waterNode_, waterModel_, chunkWaterMesh_, waterBoxes_);
+    shouldRender_ = false;
+    return true;
+}
+
+void Chunk::UploadMesh(Node* node, Model* model, ChunkMesh& mesh, const PODVector<ChunkCollisionBox>& boxes)
+{
+    // Buffers, geometry and model stay the same, only their contents change
+    mesh.Upload();
+    bool empty = mesh.GetIndexCount() == 0;
+    node->GetComponent<StaticModel>()->SetEnabled(!empty);
+    if (collisionMode_ == CM_BOXES) {
+        node->GetComponent<RigidBody>()->SetEnabled(!boxes.Empty());
+        UploadCollisionBoxes(node, boxes);
+        return;
+    }
+
+    node->GetComponent<RigidBody>()->SetEnabled(!empty);
+    auto physicsWorld = node_->GetScene()->GetComponent<PhysicsWorld>();
+    if (physicsWorld && !empty) {
+        physicsWorld->RemoveCachedGeometry(model);
+        PODVector<CollisionShape*> shapes;
+        node->GetComponents<CollisionShape>(shapes);
+        // Left over from box collision
+        for (unsigned i = 1; i < shapes.Size(); i++) {
+            node->RemoveComponent(shapes[i]);
         }
+        shapes[0]->SetTriangleMesh(model);
     }
+}
 
-    {
-        waterNode_->RemoveComponent<StaticModel>();
-        SharedPtr<Model> chunkModel(new Model(context_));
-        SharedPtr<Geometry> geometry = chunkWaterMesh_.GetGeometry();
-
-        chunkModel->SetNumGeometries(1);
-        chunkModel->SetGeometry(0, 0, geometry);
-        chunkModel->SetBoundingBox(BoundingBox(Vector3(0, 0, 0), Vector3(SIZE_X, SIZE_Y, SIZE_Z)));
-
-        StaticModel *chunkObject = waterNode_->CreateComponent<StaticModel>(LOCAL);
-        chunkObject->SetModel(chunkModel);
-        chunkObject->SetViewMask(VIEW_MASK_CHUNK);
-        chunkObject->SetOccluder(false);
-        chunkObject->SetOccludee(true);
-        Material *material = SharedPtr<Material>(
-                GetSubsystem<ResourceCache>()->GetResource<Material>("Materials/VoxelWater.xml"));
-        chunkObject->SetMaterial(material);
-
-        if (node_->GetScene()->GetComponent<PhysicsWorld>() && geometry->GetVertexCount() > 0) {
-            node_->GetScene()->GetComponent<PhysicsWorld>()->RemoveCachedGeometry(chunkObject->GetModel());
-            waterNode_->GetComponent<CollisionShape>()->SetTriangleMesh(chunkObject->GetModel());
+void Chunk::UploadCollisionBoxes(Node* node, const PODVector<ChunkCollisionBox>& boxes)
+{
+    auto body = node->GetComponent<RigidBody>();
+    PODVector<CollisionShape*> shapes;
+    node->GetComponents<CollisionShape>(shapes);
+    // Static body, mass properties are updated once for all shapes
+    body->DisableMassUpdate();
+    for (unsigned i = 0; i < boxes.Size(); i++) {
+        CollisionShape* shape = i < shapes.Size() ? shapes[i] : node->CreateComponent<CollisionShape>(LOCAL);
+        Vector3 size(boxes[i].size_.x_, boxes[i].size_.y_, boxes[i].size_.z_);
+        Vector3 center = Vector3(boxes[i].origin_.x_, boxes[i].origin_.y_, boxes[i].origin_.z_) + size * 0.5f;
+        // Boxes before the edited block usually come out the same, their Bullet shapes are kept
+        if (shape->GetShapeType() != SHAPE_BOX || shape->GetSize() != size || shape->GetPosition() != center) {
+            shape->SetBox(size, center);
         }
     }
+    // One shape always stays on the node for the triangle mesh mode
+    for (unsigned i = Max(boxes.Size(), 1U); i < shapes.Size(); i++) {
+        node->RemoveComponent(shapes[i]);
+    }
+    body->EnableMassUpdate();
+}
 
-    shouldRender_ = false;
-    return true;
+SharedPtr<Model> Chunk::CreateMeshModel(Node* node, ChunkMesh& mesh, Material* material, bool occluder)
+{
+    SharedPtr<Model> model(new Model(context_));
+    model->SetNumGeometries(1);
+    model->SetGeometry(0, 0, mesh.GetGeometry());
+    model->SetBoundingBox(BoundingBox(Vector3(0, 0, 0), Vector3(SIZE_X, SIZE_Y, SIZE_Z)));
+
+    auto* object = node->CreateComponent<StaticModel>(LOCAL);
+    object->SetModel(model);
+    object->SetViewMask(VIEW_MASK_CHUNK);
+    object->SetOccluder(occluder);
+    object->SetOccludee(true);
+    object->SetMaterial(material);
+    // Shown after the first upload
+    object->SetEnabled(false);
+    node->GetComponent<RigidBody>()->SetEnabled(false);
+    return model;
 }
 
 void Chunk::CalculateGeometry()
+{
+    bool greedy = true;
+    CollisionMode collisionMode = CM_BOXES;
+    if (GetSubsystem<VoxelWorld>()) {
+        greedy = GetSubsystem<VoxelWorld>()->GetMeshingMode() == MM_GREEDY;
+        collisionMode = GetSubsystem<VoxelWorld>()->GetCollisionMode();
+    }
+    CalculateGeometry(greedy ? MM_GREEDY : MM_NAIVE, collisionMode);
+}
+
+void Chunk::CalculateGeometry(MeshingMode mode, CollisionMode collisionMode)
 {
     int currentIndex = calculateIndex_;
-    Timer loadTime;
+    HiresTimer loadTime;
     MutexLock lock(mutex_);
-    SetSunlight(15);
 
     chunkMesh_.Clear();
     chunkWaterMesh_.Clear();
+    groundBoxes_.Clear();
+    waterBoxes_.Clear();
+    collisionMode_ = collisionMode;
+
+    // All air and fully enclosed solid chunks have no visible faces
+    if (!shouldDelete_ && !IsGeometryEmpty()) {
+        if (mode == MM_GREEDY) {
+            CalculateGreedyGeometry();
+        } else {
+            CalculateNaiveGeometry();
+        }
+        if (collisionMode == CM_BOXES) {
+            CalculateCollisionBoxes();
+        }
+    }
+
+    meshStats_.mode_ = mode;
+    meshStats_.vertexCount_ = chunkMesh_.GetVertexCount() + chunkWaterMesh_.GetVertexCount();
+    meshStats_.indexCount_ = chunkMesh_.GetIndexCount() + chunkWaterMesh_.GetIndexCount();
+    meshStats_.time_ = loadTime.GetUSec(false);
+    meshStats_.collisionBoxes_ = groundBoxes_.Size() + waterBoxes_.Size();
 
+    shouldRender_ = true;
+    renderIndex_ = 0;
+    lastCalculatateIndex_ = currentIndex;
+}
+
+void Chunk::CalculateNaiveGeometry()
+{
     for (int x = 0; x < SIZE_X; x++) {
         for (int y = 0; y < SIZE_Y; y++) {
             for (int z = 0; z < SIZE_Z; z++) {
-                BlockType type = data_[x][y][z].type;
+                BlockType type = GetBlockValue(x, y, z);
                 if (type == BlockType::BT_AIR) {
                     continue;
                 }
 
-                if (!shouldDelete_) {
-                    Vector3 position(x, y, z);
-                    ChunkMesh* mesh = &chunkMesh_;
-                    if (type == BT_WATER) {
-                        mesh = &chunkWaterMesh_;
+                ChunkMesh* mesh = type == BT_WATER ? &chunkWaterMesh_ : &chunkMesh_;
+                for (int i = 0; i < 6; i++) {
+                    BlockSide side = static_cast<BlockSide>(i);
+                    if (!BlockHaveNeighbor(side, x, y, z)) {
+                        AddFace(mesh, side, type, NeighborLightValue(side, x, y, z), IntVector3(x, y, z), IntVector3(1, 1, 1));
                     }
+                }
+            }
+        }
+    }
+}
 
-                    if (!BlockHaveNeighbor(BlockSide::TOP, x, y, z)) {
-                        short vertexCount = mesh->GetVertexCount();
-                        unsigned char light = NeighborLightValue(BlockSide::TOP, x, y, z);
-                        Color color;
-                        color.r_ = static_cast<int>(light & 0xF) / 15.0f;
-                        color.g_ = static_cast<int>((light >> 4) & 0xF) / 15.0f;
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 1.0, 0.0f),
-                                Vector3::UP,
-                                color,
-                                GetTextureCoord(BlockSide::TOP, static_cast<BlockType>(type), Vector2(0.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 1.0, 1.0),
-                                Vector3::UP,
-                                color,
-                                GetTextureCoord(BlockSide::TOP, static_cast<BlockType>(type), Vector2(0.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 1.0, 0.0f),
-                                Vector3::UP,
-                                color,
-                                GetTextureCoord(BlockSide::TOP, static_cast<BlockType>(type), Vector2(1.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 1.0, 1.0f),
-                                Vector3::UP,
-                                color,
-                                GetTextureCoord(BlockSide::TOP, static_cast<BlockType>(type), Vector2(1.0, 1.0))
-                        });
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 2);
-
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 3);
-                        mesh->AddIndice(vertexCount + 2);
-                    }
-                    if (!BlockHaveNeighbor(BlockSide::BOTTOM, x, y, z)) {
-                        short vertexCount = mesh->GetVertexCount();
-                        unsigned char light = NeighborLightValue(BlockSide::BOTTOM, x, y, z);
-                        Color color;
-                        color.r_ = static_cast<int>(light & 0xF) / 15.0f;
-                        color.g_ = static_cast<int>((light >> 4) & 0xF) / 15.0f;
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 0.0f, 1.0),
-                                Vector3::DOWN,
-                                color,
-                                GetTextureCoord(BlockSide::BOTTOM, static_cast<BlockType>(type), Vector2(0.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 0.0f, 0.0f),
-                                Vector3::DOWN,
-                                color,
-                                GetTextureCoord(BlockSide::BOTTOM, static_cast<BlockType>(type), Vector2(0.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 0.0f, 0.0f),
-                                Vector3::DOWN,
-                                color,
-                                GetTextureCoord(BlockSide::BOTTOM, static_cast<BlockType>(type), Vector2(1.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 0.0f, 1.0),
-                                Vector3::DOWN,
-                                color,
-                                GetTextureCoord(BlockSide::BOTTOM, static_cast<BlockType>(type), Vector2(1.0, 1.0))
-                        });
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 2);
-
-                        mesh->AddIndice(vertexCount + 3);
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 2);
+void Chunk::CalculateCollisionBoxes()
+{
+    if (blocks_.IsUniform()) {
+        ChunkCollisionBox box;
+        box.origin_ = IntVector3::ZERO;
+        box.size_ = IntVector3(SIZE_X, SIZE_Y, SIZE_Z);
+        (blocks_.GetUniformType() == BT_WATER ? waterBoxes_ : groundBoxes_).Push(box);
+        return;
+    }
+
+    BlockType types[CHUNK_VOXEL_COUNT];
+    GetBlocks(types);
+    bool merged[CHUNK_VOXEL_COUNT] = {};
+    // Solid blocks merge with any other solid block, water only with water
+    auto canMerge = [&](int x0, int x1, int y0, int y1, int z0, int z1, bool water) {
+        for (int x = x0; x < x1; x++) {
+            for (int y = y0; y < y1; y++) {
+                for (int z = z0; z < z1; z++) {
+                    int index = GetBlockIndex(x, y, z);
+                    if (merged[index] || types[index] == BT_AIR || (types[index] == BT_WATER) != water) {
+                        return false;
                     }
-                    if (!BlockHaveNeighbor(BlockSide::LEFT, x, y, z)) {
-                        short vertexCount = mesh->GetVertexCount();
-                        unsigned char light = NeighborLightValue(BlockSide::LEFT, x, y, z);
-                        Color color;
-                        color.r_ = static_cast<int>(light & 0xF) / 15.0f;
-                        color.g_ = static_cast<int>((light >> 4) & 0xF) / 15.0f;
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 0.0f, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::LEFT, static_cast<BlockType>(type), Vector2(0.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 1.0, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::LEFT, static_cast<BlockType>(type), Vector2(0.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 0.0f, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::LEFT, static_cast<BlockType>(type), Vector2(1.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 1.0, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::LEFT, static_cast<BlockType>(type), Vector2(1.0, 0.0))
-                        });
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 2);
-
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 3);
-                        mesh->AddIndice(vertexCount + 2);
+                }
+            }
+        }
+        return true;
+    };
+
+    for (int x = 0; x < SIZE_X; x++) {
+        for (int y = 0; y < SIZE_Y; y++) {
+            for (int z = 0; z < SIZE_Z; z++) {
+                int index = GetBlockIndex(x, y, z);
+                if (merged[index] || types[index] == BT_AIR) {
+                    continue;
+                }
+                bool water = types[index] == BT_WATER;
+                int endZ = z + 1;
+                while (endZ < SIZE_Z && canMerge(x, x + 1, y, y + 1, endZ, endZ + 1, water)) {
+                    endZ++;
+                }
+                int endY = y + 1;
+                while (endY < SIZE_Y && canMerge(x, x + 1, endY, endY + 1, z, endZ, water)) {
+                    endY++;
+                }
+                int endX = x + 1;
+                while (endX < SIZE_X && canMerge(endX, endX + 1, y, endY, z, endZ, water)) {
+                    endX++;
+                }
+                for (int mx = x; mx < endX; mx++) {
+                    for (int my = y; my < endY; my++) {
+                        for (int mz = z; mz < endZ; mz++) {
+                            merged[GetBlockIndex(mx, my, mz)] = true;
+                        }
                     }
-                    if (!BlockHaveNeighbor(BlockSide::RIGHT, x, y, z)) {
-                        short vertexCount = mesh->GetVertexCount();
-                        unsigned char light = NeighborLightValue(BlockSide::RIGHT, x, y, z);
-                        Color color;
-                        color.r_ = static_cast<int>(light & 0xF) / 15.0f;
-                        color.g_ = static_cast<int>((light >> 4) & 0xF) / 15.0f;
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 0.0f, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::RIGHT, static_cast<BlockType>(type), Vector2(0.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 1.0, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::RIGHT, static_cast<BlockType>(type), Vector2(0.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 0.0f, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::RIGHT, static_cast<BlockType>(type), Vector2(1.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 1.0, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::RIGHT, static_cast<BlockType>(type), Vector2(1.0, 0.0))
-                        });
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 2);
-
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 3);
-                        mesh->AddIndice(vertexCount + 2);
+                }
+
+                ChunkCollisionBox box;
+                box.origin_ = IntVector3(x, y, z);
+                box.size_ = IntVector3(endX - x, endY - y, endZ - z);
+                (water ? waterBoxes_ : groundBoxes_).Push(box);
+            }
+        }
+    }
+}
+
+void Chunk::CalculateGreedyGeometry()
+{
+    const int sizes[3] = {SIZE_X, SIZE_Y, SIZE_Z};
+    // Visible face key per slice cell: block type, light value and a visibility bit, 0 means no face.
+    // Chunks are cubes so every slice has the same cell count
+    unsigned mask[SIZE_X * SIZE_Y];
+
+    for (int i = 0; i < 6; i++) {
+        BlockSide side = static_cast<BlockSide>(i);
+        // Normal axis and the two axes spanning the face plane
+        int axis = (side == TOP || side == BOTTOM) ? 1 : ((side == LEFT || side == RIGHT) ? 0 : 2);
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        for (int slice = 0; slice < sizes[axis]; slice++) {
+            for (int b = 0; b < sizes[v]; b++) {
+                for (int a = 0; a < sizes[u]; a++) {
+                    int block[3];
+                    block[axis] = slice;
+                    block[u] = a;
+                    block[v] = b;
+                    unsigned& key = mask[b * sizes[u] + a];
+                    key = 0;
+                    BlockType type = GetBlockValue(block[0], block[1], block[2]);
+                    if (type != BT_AIR && !BlockHaveNeighbor(side, block[0], block[1], block[2])) {
+                        unsigned char light = NeighborLightValue(side, block[0], block[1], block[2]);
+                        key = 0x10000 | (light << 8) | static_cast<unsigned>(type);
                     }
-                    if (!BlockHaveNeighbor(BlockSide::FRONT, x, y, z)) {
-                        short vertexCount = mesh->GetVertexCount();
-                        unsigned char light = NeighborLightValue(BlockSide::FRONT, x, y, z);
-                        Color color;
-                        color.r_ = static_cast<int>(light & 0xF) / 15.0f;
-                        color.g_ = static_cast<int>((light >> 4) & 0xF) / 15.0f;
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 0.0f, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::FRONT, static_cast<BlockType>(type), Vector2(0.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 1.0, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::FRONT, static_cast<BlockType>(type), Vector2(0.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 0.0f, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::FRONT, static_cast<BlockType>(type), Vector2(1.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 1.0, 0.0f),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::FRONT, static_cast<BlockType>(type), Vector2(1.0, 0.0))
-                        });
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 2);
-
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 3);
-                        mesh->AddIndice(vertexCount + 2);
+                }
+            }
 
+            // Grow each face first along u, then along v while the whole row matches
+            for (int b = 0; b < sizes[v]; b++) {
+                for (int a = 0; a < sizes[u];) {
+                    unsigned key = mask[b * sizes[u] + a];
+                    if (!key) {
+                        a++;
+                        continue;
+                    }
+                    int width = 1;
+                    while (a + width < sizes[u] && mask[b * sizes[u] + a + width] == key) {
+                        width++;
+                    }
+                    int height = 1;
+                    bool rowMatches = true;
+                    while (b + height < sizes[v] && rowMatches) {
+                        for (int k = 0; k < width; k++) {
+                            if (mask[(b + height) * sizes[u] + a + k] != key) {
+                                rowMatches = false;
+                                break;
+                            }
+                        }
+                        if (rowMatches) {
+                            height++;
+                        }
                     }
-                    if (!BlockHaveNeighbor(BlockSide::BACK, x, y, z)) {
-                        short vertexCount = mesh->GetVertexCount();
-                        unsigned char light = NeighborLightValue(BlockSide::BACK, x, y, z);
-                        Color color;
-                        color.r_ = static_cast<int>(light & 0xF) / 15.0f;
-                        color.g_ = static_cast<int>((light >> 4) & 0xF) / 15.0f;
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 0.0f, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::BACK, static_cast<BlockType>(type), Vector2(0.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(1.0, 1.0, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::BACK, static_cast<BlockType>(type), Vector2(0.0, 0.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 0.0f, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::BACK, static_cast<BlockType>(type), Vector2(1.0, 1.0))
-                        });
-                        mesh->AddVertex(MeshVertex{
-                                position + Vector3(0.0f, 1.0, 1.0),
-                                Vector3::LEFT,
-                                color,
-                                GetTextureCoord(BlockSide::BACK, static_cast<BlockType>(type), Vector2(1.0, 0.0))
-                        });
-                        mesh->AddIndice(vertexCount);
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 2);
-
-                        mesh->AddIndice(vertexCount + 1);
-                        mesh->AddIndice(vertexCount + 3);
-                        mesh->AddIndice(vertexCount + 2);
+                    for (int h = 0; h < height; h++) {
+                        for (int k = 0; k < width; k++) {
+                            mask[(b + h) * sizes[u] + a + k] = 0;
+                        }
                     }
+
+                    int origin[3];
+                    int size[3];
+                    origin[axis] = slice;
+                    origin[u] = a;
+                    origin[v] = b;
+                    size[axis] = 1;
+                    size[u] = width;
+                    size[v] = height;
+                    BlockType type = static_cast<BlockType>(key & 0xFF);
+                    ChunkMesh* mesh = type == BT_WATER ? &chunkWaterMesh_ : &chunkMesh_;
+                    AddFace(mesh, side, type, static_cast<unsigned char>((key >> 8) & 0xFF),
+                            IntVector3(origin[0], origin[1], origin[2]), IntVector3(size[0], size[1], size[2]));
+                    a += width;
                 }
             }
         }
     }
-    shouldRender_ = true;
-    renderIndex_ = 0;
-    lastCalculatateIndex_ = currentIndex;
+}
+
+void Chunk::AddFace(ChunkMesh* mesh, BlockSide side, BlockType type, unsigned char light, const IntVector3& origin, const IntVector3& size)
+{
+    // Face corners of a unit block in the order the indices expect
+    static const IntVector3 corners[6][4] = {
+            {IntVector3(0, 1, 0), IntVector3(0, 1, 1), IntVector3(1, 1, 0), IntVector3(1, 1, 1)}, // TOP
+            {IntVector3(0, 0, 1), IntVector3(0, 0, 0), IntVector3(1, 0, 0), IntVector3(1, 0, 1)}, // BOTTOM
+            {IntVector3(0, 0, 1), IntVector3(0, 1, 1), IntVector3(0, 0, 0), IntVector3(0, 1, 0)}, // LEFT
+            {IntVector3(1, 0, 0), IntVector3(1, 1, 0), IntVector3(1, 0, 1), IntVector3(1, 1, 1)}, // RIGHT
+            {IntVector3(0, 0, 0), IntVector3(0, 1, 0), IntVector3(1, 0, 0), IntVector3(1, 1, 0)}, // FRONT
+            {IntVector3(1, 0, 1), IntVector3(1, 1, 1), IntVector3(0, 0, 1), IntVector3(0, 1, 1)}  // BACK
+    };
+
+    unsigned char tile = GetTextureTileIndex(side, type);
+
+    short vertexCount = mesh->GetVertexCount();
+    for (int i = 0; i < 4; i++) {
+        const IntVector3& corner = corners[side][i];
+        // Texture coordinates are in block units, the shader repeats the atlas tile across merged faces
+        int u = 0;
+        int v = 0;
+        switch (side) {
+            case BlockSide::TOP:
+            case BlockSide::BOTTOM:
+                u = corner.x_ * size.x_;
+                v = corner.z_ * size.z_;
+                break;
+            case BlockSide::LEFT:
+                u = (1 - corner.z_) * size.z_;
+                v = (1 - corner.y_) * size.y_;
+                break;
+            case BlockSide::RIGHT:
+                u = corner.z_ * size.z_;
+                v = (1 - corner.y_) * size.y_;
+                break;
+            case BlockSide::FRONT:
+                u = corner.x_ * size.x_;
+                v = (1 - corner.y_) * size.y_;
+                break;
+            case BlockSide::BACK:
+                u = (1 - corner.x_) * size.x_;
+                v = (1 - corner.y_) * size.y_;
+                break;
+        }
+        MeshVertex vertex;
+        vertex.x_ = static_cast<unsigned char>(origin.x_ + corner.x_ * size.x_);
+        vertex.y_ = static_cast<unsigned char>(origin.y_ + corner.y_ * size.y_);
+        vertex.z_ = static_cast<unsigned char>(origin.z_ + corner.z_ * size.z_);
+        vertex.face_ = static_cast<unsigned char>(side);
+        vertex.u_ = static_cast<unsigned char>(u);
+        vertex.v_ = static_cast<unsigned char>(v);
+        vertex.light_ = light;
+        vertex.tile_ = tile;
+        mesh->AddVertex(vertex);
+    }
+
+    if (side == BlockSide::BOTTOM) {
+        mesh->AddIndice(vertexCount);
+        mesh->AddIndice(vertexCount + 1);
+        mesh->AddIndice(vertexCount + 2);
+
+        mesh->AddIndice(vertexCount + 3);
+        mesh->AddIndice(vertexCount);
+        mesh->AddIndice(vertexCount + 2);
+    } else {
+        mesh->AddIndice(vertexCount);
+        mesh->AddIndice(vertexCount + 1);
+        mesh->AddIndice(vertexCount + 2);
+
+        mesh->AddIndice(vertexCount + 1);
+        mesh->AddIndice(vertexCount + 3);
+        mesh->AddIndice(vertexCount + 2);
+    }
 }
 
 //void Chunk::CalculateGeometry2()
@@ -531,12 +595,12 @@ void Chunk::CalculateGeometry()
 //    for (int x = 0; x < SIZE_X; x++) {
 //        for (int y = 0; y < SIZE_Y; y++) {
 //            for (int z = 0; z < SIZE_Z; z++) {
-//                BlockType type = data_[x][y][z].type;
+//                BlockType type = GetBlockValue(x, y, z);
 //                if (type == BlockType::BT_AIR) {
 //                    continue;
 //                }
 //                if (!shouldDelete_) {
-//                    int blockId = data_[x][y][z].type;
+//                    int blockId = GetBlockValue(x, y, z);
 //                    Vector3 position(x, y, z);
 //                    int index = GetPartIndex(x, y, z);
 //                    if (blockId == BT_WATER) {
@@ -1024,10 +1088,6 @@ void Chunk::HandleUpdate(StringHash eventType, VariantMap& eventData)
 //        Save();
 //    }
 
-    if (requestedFromServer_ && !loaded_ && remoteLoadTimer_.GetMSec(false) > 5000) {
-        // Server didn't send us the chunk in time, request it again
-        LoadFromServer();
-    }
 }
 
 IntVector3 Chunk::GetChunkBlock(Vector3 position)
@@ -1071,9 +1131,9 @@ void Chunk::HandleHit(StringHash eventType, VariantMap& eventData)
         }
         return;
     }
-    BlockType type = data_[blockPosition.x_][blockPosition.y_][blockPosition.z_].type;
+    BlockType type = GetBlockValue(blockPosition.x_, blockPosition.y_, blockPosition.z_);
     if (type != BT_AIR) {
-        SetBlockData(blockPosition, BT_AIR);
+        SetPlayerBlock(blockPosition, BT_AIR);
         URHO3D_LOGINFO("Removing block " + blockPosition.ToString() + " Type: " + String(static_cast<int>(type)) + "; Chunk position: " + position_.ToString());
 
         VariantMap& data = GetEventDataMap();
@@ -1096,8 +1156,28 @@ void Chunk::HandleHit(StringHash eventType, VariantMap& eventData)
 
 void Chunk::SetBlockData(const IntVector3& blockPosition, BlockType type)
 {
+    unsigned short index = static_cast<unsigned short>(GetBlockIndex(blockPosition.x_, blockPosition.y_, blockPosition.z_));
+    {
+        // Save and Load use the edits on the workers. Only the recording is locked,
+        // the light propagation below waits for tasks that lock the chunk
+        MutexLock lock(mutex_);
+        auto it = edits_.Begin();
+        while (it != edits_.End() && (*it).index_ != index) {
+            ++it;
+        }
+        if (it == edits_.End()) {
+            BlockEdit edit;
+            edit.index_ = index;
+            edits_.Push(edit);
+            it = edits_.End() - 1;
+        }
+        (*it).type_ = static_cast<unsigned char>(type);
+    }
+
+    // Light waves running on the workers must not see a half applied edit
+    GetSubsystem<LightManager>()->CompletePropagation();
     int lightLevel = GetTorchlight(blockPosition.x_, blockPosition.y_, blockPosition.z_);
-    BlockType currentType = GetBlockAt(blockPosition)->type;
+    BlockType currentType = GetBlockAt(blockPosition).type;
     SetVoxel(blockPosition.x_, blockPosition.y_, blockPosition.z_, type);
     SetTorchlight(blockPosition.x_, blockPosition.y_, blockPosition.z_, 0);
 
@@ -1108,14 +1188,50 @@ void Chunk::SetBlockData(const IntVector3& blockPosition, BlockType type)
         SetTorchlight(blockPosition.x_, blockPosition.y_, blockPosition.z_, 0);
         GetSubsystem<LightManager>()->AddLightRemovalNode(blockPosition.x_, blockPosition.y_, blockPosition.z_, lightLevel, this);
     }
+    int sunlightLevel = GetSunlight(blockPosition.x_, blockPosition.y_, blockPosition.z_);
+    if (!LightManager::IsTransparent(type) && sunlightLevel > 0) {
+        // Only the shaded part below and around the block is relit
+        SetSunlight(blockPosition.x_, blockPosition.y_, blockPosition.z_, 0);
+        GetSubsystem<LightManager>()->AddSunlightRemovalNode(blockPosition.x_, blockPosition.y_, blockPosition.z_, sunlightLevel, this);
+    }
     for (int i = 0; i < 6; i++) {
         auto neighborPosition = NeighborBlockWorldPosition(static_cast<BlockSide>(i), blockPosition);
         GetSubsystem<LightManager>()->AddLightNode(neighborPosition);
+        if (LightManager::IsTransparent(type)) {
+            GetSubsystem<LightManager>()->AddSunlightNode(neighborPosition);
+        }
     }
 //    MarkForGeometryCalculation();
     shouldSave_ = true;
 }
 
+void Chunk::SetPlayerBlock(const IntVector3& blockPosition, BlockType type)
+{
+    // Callers reject positions outside of the chunk, the journal index only has room for the chunk's blocks
+    assert(IsBlockInside(blockPosition));
+    auto journal = GetSubsystem<EditJournal>();
+    auto network = GetSubsystem<Network>();
+    if (journal && journal->IsOpen() && (!network || !network->GetServerConnection())) {
+        journal->Append(GetChunkCoordinates(), static_cast<unsigned short>(GetBlockIndex(blockPosition.x_, blockPosition.y_, blockPosition.z_)),
+            GetBlockValue(blockPosition.x_, blockPosition.y_, blockPosition.z_), type);
+    }
+    SetBlockData(blockPosition, type);
+}
+
+void Chunk::GetEditState(PODVector<BlockEdit>& edits, bool& shouldSave)
+{
+    MutexLock lock(mutex_);
+    edits = edits_;
+    shouldSave = shouldSave_;
+}
+
+void Chunk::SetEditState(const PODVector<BlockEdit>& edits, bool shouldSave)
+{
+    MutexLock lock(mutex_);
+    edits_ = edits;
+    shouldSave_ = shouldSave;
+}
+
 Vector3 Chunk::NeighborBlockWorldPosition(BlockSide side, IntVector3 blockPosition)
 {
     Vector3 position = position_;
@@ -1153,9 +1269,11 @@ void Chunk::HandleAdd(StringHash eventType, VariantMap& eventData)
         }
         return;
     }
-    if (data_[blockPosition.x_][blockPosition.y_][blockPosition.z_].type == BlockType::BT_AIR) {
+    if (GetBlockValue(blockPosition.x_, blockPosition.y_, blockPosition.z_) == BlockType::BT_AIR) {
         if (eventData[P_ACTION_ID].GetInt() == CTRL_DETECT) {
             URHO3D_LOGINFOF("Render count=%d, geometry calculated=%d, should render=%d", renderCount_, IsGeometryCalculated(), ShouldRender());
+            URHO3D_LOGINFOF("Mesh %s: vertices=%d, indices=%d, time=%dus", meshStats_.mode_ == MM_GREEDY ? "greedy" : "naive",
+                            meshStats_.vertexCount_, meshStats_.indexCount_, (int)meshStats_.time_);
 //            URHO3D_LOGINFO("Chunk selected: " + position_.ToString() + "; block: " + blockPosition.ToString()
 //            + " Torch light: " + String(GetTorchlight(blockPosition.x_, blockPosition.y_, blockPosition.z_)) +
 //            "; Sun light: " + String(GetSunlight(blockPosition.x_, blockPosition.y_, blockPosition.z_)));
@@ -1169,7 +1287,7 @@ void Chunk::HandleAdd(StringHash eventType, VariantMap& eventData)
             return;
         }
         BlockType type = static_cast<BlockType>(eventData[P_ITEM_ID].GetInt());
-        SetBlockData(blockPosition, type);
+        SetPlayerBlock(blockPosition, type);
 
         VariantMap& data = GetEventDataMap();
         data[BlockAdded::P_POSITION] = blockPosition;
@@ -1194,50 +1312,75 @@ const Vector3& Chunk::GetPosition()
     return position_;
 }
 
-Vector2 Chunk::GetTextureCoord(BlockSide side, BlockType blockType, Vector2 position)
+IntVector3 Chunk::GetChunkCoordinates() const
+{
+    return IntVector3(Floor(position_.x_ / SIZE_X), Floor(position_.y_ / SIZE_Y), Floor(position_.z_ / SIZE_Z));
+}
+
+static_assert((BT_NONE - 1) * 6 <= 256, "Atlas tile index must fit in a vertex byte");
+
+unsigned char Chunk::GetTextureTileIndex(BlockSide side, BlockType blockType)
+{
+    // Atlas has a column per block side and a row per block type
+    return static_cast<unsigned char>((static_cast<int>(blockType) - 1) * 6 + static_cast<int>(side));
+}
+
+Vector2 Chunk::GetTextureTileSize()
 {
     int textureCount = static_cast<int>(BlockType::BT_NONE) - 1;
-    Vector2 quadSize(1.0f / 6, 1.0f / textureCount);
-    float typeOffset = (static_cast<int>(blockType) - 1) * quadSize.y_;
-    switch (side) {
-        case BlockSide::TOP: {
-            return Vector2(quadSize.x_ * 0.0f + quadSize.x_ * position.x_, quadSize.y_ * position.y_ + typeOffset);
-        }
-        case BlockSide::BOTTOM: {
-            return Vector2(quadSize.x_ * 1.0f + quadSize.x_ * position.x_, quadSize.y_ * position.y_ + typeOffset);
-        }
-        case BlockSide::LEFT: {
-            return Vector2(quadSize.x_ * 2.0f + quadSize.x_ * position.x_, quadSize.y_ * position.y_ + typeOffset);
-        }
-        case BlockSide::RIGHT: {
-            return Vector2(quadSize.x_ * 3.0f + quadSize.x_ * position.x_, quadSize.y_ * position.y_ + typeOffset);
-        }
-        case BlockSide::FRONT: {
-            return Vector2(quadSize.x_ * 4.0f + quadSize.x_ * position.x_, quadSize.y_ * position.y_ + typeOffset);
-        }
-        case BlockSide::BACK: {
-            return Vector2(quadSize.x_ * 5.0f + quadSize.x_ * position.x_, quadSize.y_ * position.y_ + typeOffset);
-        }
-    }
-    return position;
+    return Vector2(1.0f / 6, 1.0f / textureCount);
+}
+
+const ChunkMeshStats& Chunk::GetMeshStats()
+{
+    return meshStats_;
 }
 
 void Chunk::Save()
 {
-    JSONFile file(context_);
-    JSONValue& root = file.GetRoot();
-    for (int x = 0; x < SIZE_X; ++x) {
-        for (int y = 0; y < SIZE_Y; y++) {
-            for (int z = 0; z < SIZE_Z; z++) {
-                root.Set(String(x) + "_" + String(y) + "_" + String(z), static_cast<int>(data_[x][y][z].type));
+    auto storage = GetSubsystem<ChunkStorage>();
+    // Generated chunks are restored from the seed, only their player edits are needed
+    bool saveEdits = storage && storage->GetPersistence() == CP_EDITS && !blocksRecord_;
+    PODVector<BlockEdit> edits;
+    {
+        // Edits keep coming in on the main thread while the update pass saves
+        MutexLock lock(mutex_);
+        edits = edits_;
+    }
+    if (saveEdits && edits.Empty()) {
+        shouldSave_ = false;
+        return;
+    }
+    auto ioService = GetSubsystem<ChunkIOService>();
+    if (ioService && saveEdits) {
+        VectorBuffer buffer;
+        ChunkStorage::EncodeEdits(edits, buffer);
+        ioService->RequestSave(GetChunkCoordinates(), buffer.GetBuffer(), true);
+    } else if (ioService) {
+        PODVector<unsigned char> voxels(CHUNK_VOXEL_COUNT);
+        int index = 0;
+        for (int x = 0; x < SIZE_X; ++x) {
+            for (int y = 0; y < SIZE_Y; y++) {
+                for (int z = 0; z < SIZE_Z; z++) {
+                    voxels[index++] = static_cast<unsigned char>(GetBlockValue(x, y, z));
+                }
             }
         }
+        ioService->RequestSave(GetChunkCoordinates(), voxels);
+    } else if (storage && saveEdits) {
+        storage->SaveChunkEdits(GetChunkCoordinates(), edits);
+    } else if (storage) {
+        BlockType voxels[CHUNK_VOXEL_COUNT];
+        int index = 0;
+        for (int x = 0; x < SIZE_X; ++x) {
+            for (int y = 0; y < SIZE_Y; y++) {
+                for (int z = 0; z < SIZE_Z; z++) {
+                    voxels[index++] = GetBlockValue(x, y, z);
+                }
+            }
+        }
+        storage->SaveChunk(GetChunkCoordinates(), voxels);
     }
-    if(!GetSubsystem<FileSystem>()->DirExists("World")) {
-        GetSubsystem<FileSystem>()->CreateDir("World");
-    }
-    Vector3 position = Vector3(position_.x_ / SIZE_X, position_.y_ / SIZE_Y, position_.z_ / SIZE_Z);
-    file.SaveFile("World/chunk_" + String(position.x_) + "_" + String(position.y_) + "_" + String(position.z_) + ".json");
 //    URHO3D_LOGINFO("Chunk saved " + chunk->position_.ToString());
     shouldSave_ = false;
 }
@@ -1262,6 +1405,12 @@ void Chunk::CreateNode()
         body->SetCollisionLayerAndMask(COLLISION_MASK_GROUND, COLLISION_MASK_PLAYER | COLLISION_MASK_OBSTACLES);
         waterNode_->CreateComponent<CollisionShape>(LOCAL);
     }
+    auto world = GetSubsystem<VoxelWorld>();
+    groundModel_ = CreateMeshModel(groundNode_, chunkMesh_,
+            world ? world->GetLandMaterial() : cache->GetResource<Material>("Materials/Voxel.xml"), true);
+    waterModel_ = CreateMeshModel(waterNode_, chunkWaterMesh_,
+            world ? world->GetWaterMaterial() : cache->GetResource<Material>("Materials/VoxelWater.xml"), false);
+
     node_->SetScale(1.0f);
     node_->SetWorldPosition(position_);
 
@@ -1307,6 +1456,80 @@ void Chunk::RemoveNode()
     }
 }
 
+void Chunk::Reset()
+{
+    MutexLock lock(mutex_);
+    Suspend(false);
+    blocks_.Clear();
+    blocks_.Compact();
+    lightMap_.Reset();
+    uniformLight_ = 0;
+    storageDirty_ = false;
+    shouldDelete_ = false;
+    isActive_ = true;
+    loaded_ = false;
+    stage_ = CGS_NONE;
+    requestedFromServer_ = false;
+    notified_ = false;
+    distance_ = 0;
+    calculateIndex_ = 0;
+    lastCalculatateIndex_ = 0;
+    meshStats_ = ChunkMeshStats();
+    shouldSave_ = false;
+    diskState_ = CDS_NONE;
+    diskData_.Clear();
+    diskEdits_ = false;
+    edits_.Clear();
+    blocksRecord_ = false;
+    renderCount_ = 0;
+    workScheduled_ = false;
+    for (int i = 0; i < 6; i++) {
+        neighbors_[i] = nullptr;
+    }
+    handle_ = ChunkHandle();
+    lightSeedPending_ = false;
+}
+
+void Chunk::Suspend(bool keepMesh)
+{
+    if (node_) {
+        node_->SetDeepEnabled(false);
+    }
+    if (keepMesh) {
+        return;
+    }
+    // Buffers keep their capacity for the next mesh
+    chunkMesh_.Clear();
+    chunkWaterMesh_.Clear();
+    groundBoxes_.Clear();
+    waterBoxes_.Clear();
+    shouldRender_ = false;
+    if (groundNode_) {
+        groundNode_->GetComponent<StaticModel>()->SetEnabled(false);
+        groundNode_->GetComponent<RigidBody>()->SetEnabled(false);
+        waterNode_->GetComponent<StaticModel>()->SetEnabled(false);
+        waterNode_->GetComponent<RigidBody>()->SetEnabled(false);
+    }
+    MarkForGeometryCalculation();
+}
+
+void Chunk::Resume()
+{
+    node_->ResetDeepEnabled();
+    // Neighbors may have changed meanwhile, the kept mesh is shown until the new one is ready
+    MarkForGeometryCalculation();
+    lightSeedPending_ = true;
+}
+
+unsigned Chunk::GetMemoryUsage()
+{
+    unsigned meshBytes = (chunkMesh_.GetVertexCount() + chunkWaterMesh_.GetVertexCount()) * sizeof(MeshVertex)
+        + (chunkMesh_.GetIndexCount() + chunkWaterMesh_.GetIndexCount()) * sizeof(short);
+    // Mesh data lives both in the CPU copy and on the GPU
+    unsigned collisionBytes = (groundBoxes_.Size() + waterBoxes_.Size()) * sizeof(ChunkCollisionBox);
+    return sizeof(Chunk) + GetStorageMemory() + meshBytes * 2 + collisionBytes;
+}
+
 unsigned char Chunk::NeighborLightValue(BlockSide side, int x, int y, int z)
 {
     bool insideChunk = true;
@@ -1378,7 +1601,7 @@ unsigned char Chunk::NeighborLightValue(BlockSide side, int x, int y, int z)
 
 BlockType Chunk::GetBlockNeighbor(BlockSide side, int x, int y, int z)
 {
-    BlockType type = data_[x][y][z].type;
+    BlockType type = GetBlockValue(x, y, z);
     bool insideChunk = true;
     int dX = x;
     int dY = y;
@@ -1435,7 +1658,7 @@ BlockType Chunk::GetBlockNeighbor(BlockSide side, int x, int y, int z)
     }
 
     if (insideChunk) {
-        BlockType neighborType = data_[dX][dY][dZ].type;
+        BlockType neighborType = GetBlockValue(dX, dY, dZ);
         return neighborType;
     } else {
         auto neighbor = GetNeighbor(side);
@@ -1450,7 +1673,7 @@ BlockType Chunk::GetBlockNeighbor(BlockSide side, int x, int y, int z)
 
 bool Chunk::BlockHaveNeighbor(BlockSide side, int x, int y, int z)
 {
-    BlockType type = data_[x][y][z].type;
+    BlockType type = GetBlockValue(x, y, z);
     bool insideChunk = true;
     int dX = x;
     int dY = y;
@@ -1507,7 +1730,7 @@ bool Chunk::BlockHaveNeighbor(BlockSide side, int x, int y, int z)
     }
 
     if (insideChunk) {
-        BlockType neighborType = data_[dX][dY][dZ].type;
+        BlockType neighborType = GetBlockValue(dX, dY, dZ);
         if (neighborType != type && (neighborType == BT_AIR || neighborType == BT_WATER)) {
             return false;
         }
@@ -1560,103 +1783,227 @@ void Chunk::SetActive()
 
 Chunk* Chunk::GetNeighbor(BlockSide side)
 {
-    if (!GetSubsystem<VoxelWorld>()) {
-        return nullptr;
-    }
+    return neighbors_[side];
+}
 
-    Chunk* neighbor = nullptr;
-    switch(side) {
-        case BlockSide::TOP:
-            neighbor = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position_ + Vector3::UP * SIZE_Y);
-            break;
-        case BlockSide::BOTTOM:
-            neighbor = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position_ + Vector3::DOWN * SIZE_Y);
-            break;
-        case BlockSide::LEFT:
-            neighbor = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position_ + Vector3::LEFT * SIZE_X);
-            break;
-        case BlockSide::RIGHT:
-            neighbor = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position_ + Vector3::RIGHT * SIZE_X);
-            break;
-        case BlockSide::FRONT:
-            neighbor = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position_ + Vector3::BACK * SIZE_Z);
-            break;
-        case BlockSide::BACK:
-            neighbor = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position_ + Vector3::FORWARD * SIZE_Z);
-            break;
-    }
-    return neighbor;
+void Chunk::SetNeighbor(BlockSide side, Chunk* neighbor)
+{
+    neighbors_[side] = neighbor;
 }
 
 BlockType Chunk::GetBlockValue(int x, int y, int z)
 {
-    return data_[x][y][z].type;
+    return blocks_.Get(GetBlockIndex(x, y, z));
 }
 
-VoxelBlock* Chunk::GetBlockAt(IntVector3 position)
+VoxelBlock Chunk::GetBlockAt(IntVector3 position)
 {
-    if (IsBlockInsideChunk(position)) {
-        return &data_[position.x_][position.y_][position.z_];
-    }
-    return nullptr;
+    VoxelBlock block;
+    block.type = IsBlockInsideChunk(position) ? GetBlockValue(position.x_, position.y_, position.z_) : BT_NONE;
+    return block;
 }
 
 int Chunk::GetSunlight(int x, int y, int z)
 {
-    return (lightMap_[x][y][z] >> 4) & 0xF;
+    return (GetLightValue(x, y, z) >> 4) & 0xF;
 }
 
 void Chunk::SetSunlight(int x, int y, int z, int value)
 {
-    if (GetSunlight(x, y, z) != value) {
-        MarkForGeometryCalculation();
-    }
-    lightMap_[x][y][z] = (lightMap_[x][y][z] & 0xF) | (value << 4);
+    SetLightValue(x, y, z, (GetLightValue(x, y, z) & 0xF) | (value << 4));
 }
 
 int Chunk::GetTorchlight(int x, int y, int z)
 {
-    return lightMap_[x][y][z] & 0xF;
+    return GetLightValue(x, y, z) & 0xF;
 }
 
 void Chunk::SetTorchlight(int x, int y, int z, int value)
 {
-    if (GetTorchlight(x, y, z) != value) {
+    SetLightValue(x, y, z, (GetLightValue(x, y, z) & 0xF0) | value);
+}
+
+unsigned char Chunk::GetLightValue(int x, int y, int z)
+{
+    // Read the pointer once, it is only released by CompactStorage
+    unsigned char* lightMap = lightMap_.Get();
+    return lightMap ? lightMap[GetBlockIndex(x, y, z)] : uniformLight_;
+}
+
+void Chunk::SetLightValue(int x, int y, int z, unsigned char value)
+{
+    if (GetLightValue(x, y, z) != value) {
         MarkForGeometryCalculation();
+        WriteLight(GetBlockIndex(x, y, z), value);
     }
-    lightMap_[x][y][z] = (lightMap_[x][y][z] & 0xF0) | value;
 }
 
-unsigned char Chunk::GetLightValue(int x, int y, int z)
+void Chunk::WriteLight(int index, unsigned char value)
+{
+    if (!lightMap_) {
+        if (value == uniformLight_) {
+            return;
+        }
+        // First differing value, expand the uniform light into a full map
+        unsigned char* lightMap = new unsigned char[CHUNK_VOXEL_COUNT];
+        memset(lightMap, uniformLight_, CHUNK_VOXEL_COUNT);
+        lightMap_ = lightMap;
+        storageDirty_ = true;
+    }
+    lightMap_.Get()[index] = value;
+}
+
+void Chunk::CompactStorage()
+{
+    blocks_.Compact();
+    if (lightMap_) {
+        unsigned char* lightMap = lightMap_.Get();
+        bool uniform = true;
+        for (int i = 1; i < CHUNK_VOXEL_COUNT && uniform; i++) {
+            uniform = lightMap[i] == lightMap[0];
+        }
+        if (uniform) {
+            uniformLight_ = lightMap[0];
+            lightMap_.Reset();
+        }
+    }
+    storageDirty_ = false;
+}
+
+bool Chunk::IsStorageDirty()
+{
+    return storageDirty_;
+}
+
+unsigned Chunk::GetStorageMemory()
+{
+    return blocks_.GetMemoryUsage() + (lightMap_ ? CHUNK_VOXEL_COUNT : 0);
+}
+
+bool Chunk::IsUniform()
+{
+    return blocks_.IsUniform();
+}
+
+bool Chunk::IsSideOpaque(BlockSide side)
+{
+    if (blocks_.IsUniform()) {
+        return !LightManager::IsTransparent(blocks_.GetUniformType());
+    }
+    for (int a = 0; a < SIZE_X; a++) {
+        for (int b = 0; b < SIZE_Z; b++) {
+            int x = a;
+            int y = b;
+            int z = b;
+            switch (side) {
+                case BlockSide::TOP:    x = a; y = SIZE_Y - 1; z = b; break;
+                case BlockSide::BOTTOM: x = a; y = 0; z = b; break;
+                case BlockSide::LEFT:   x = 0; y = a; z = b; break;
+                case BlockSide::RIGHT:  x = SIZE_X - 1; y = a; z = b; break;
+                case BlockSide::FRONT:  x = a; y = b; z = 0; break;
+                case BlockSide::BACK:   x = a; y = b; z = SIZE_Z - 1; break;
+            }
+            if (LightManager::IsTransparent(GetBlockValue(x, y, z))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Chunk::IsGeometryEmpty()
 {
-    return lightMap_[x][y][z];
+    if (!blocks_.IsUniform()) {
+        return false;
+    }
+    BlockType type = blocks_.GetUniformType();
+    if (type == BT_AIR) {
+        return true;
+    }
+    if (LightManager::IsTransparent(type)) {
+        return false;
+    }
+    // Solid chunk, faces only appear where a neighbor exposes air or water
+    for (int i = 0; i < 6; i++) {
+        Chunk* neighbor = GetNeighbor(static_cast<BlockSide>(i));
+        if (neighbor && !neighbor->IsSideOpaque(static_cast<BlockSide>(i ^ 1))) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void Chunk::SetSunlight(int value)
+void Chunk::CalculateSunlight()
 {
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    auto lightManager = GetSubsystem<LightManager>();
+    auto network = GetSubsystem<Network>();
+    // Clients don't share the server seed, their columns start as sky and the chunk above shades them
+    // once the borders are seeded
+    bool useColumn = chunkGenerator && !(network && network->GetServerConnection());
+    ChunkColumn column;
+    if (useColumn) {
+        IntVector3 chunkCoordinates = GetChunkCoordinates();
+        chunkGenerator->GetColumn(chunkCoordinates.x_, chunkCoordinates.z_, column);
+    }
     for (int x = 0; x < SIZE_X; x++) {
         for (int z = 0; z < SIZE_Z; z++) {
-            bool added = false;
+            // Columns above the terrain surface see the sky, anything under it starts dark
+            int light = 15;
+            if (useColumn && position_.y_ + SIZE_Y - 1 <= column.heights_[x * SIZE_Z + z]) {
+                light = 0;
+            }
             for (int y = SIZE_Y - 1; y >= 0; y--) {
-                BlockType type = data_[x][y][z].type;
-//                if (added) {
-//                    SetSunlight(x, y, z, 0);
-//                }
-//                if (type != BT_AIR && !added) {
-                    SetSunlight(x, y, z, value);
-                    added = true;
-//                }
+                BlockType type = GetBlockValue(x, y, z);
+                if (!LightManager::IsTransparent(type)) {
+                    light = 0;
+                } else if (type == BT_WATER) {
+                    light = Max(light - 2, 0);
+                }
+                WriteLight(GetBlockIndex(x, y, z), (GetLightValue(x, y, z) & 0xF) | (light << 4));
+            }
+        }
+    }
+
+    if (!lightManager) {
+        return;
+    }
+    // Spread sideways wherever a lit column borders a darker transparent block
+    for (int x = 0; x < SIZE_X; x++) {
+        for (int y = 0; y < SIZE_Y; y++) {
+            for (int z = 0; z < SIZE_Z; z++) {
+                int light = GetSunlight(x, y, z);
+                if (light <= 1) {
+                    continue;
+                }
+                bool darkerNeighbor = (x > 0 && GetSunlight(x - 1, y, z) + 1 < light && LightManager::IsTransparent(GetBlockValue(x - 1, y, z)))
+                        || (x < SIZE_X - 1 && GetSunlight(x + 1, y, z) + 1 < light && LightManager::IsTransparent(GetBlockValue(x + 1, y, z)))
+                        || (z > 0 && GetSunlight(x, y, z - 1) + 1 < light && LightManager::IsTransparent(GetBlockValue(x, y, z - 1)))
+                        || (z < SIZE_Z - 1 && GetSunlight(x, y, z + 1) + 1 < light && LightManager::IsTransparent(GetBlockValue(x, y, z + 1)));
+                if (darkerNeighbor) {
+                    lightManager->AddSunlightNode(x, y, z, this);
+                }
             }
         }
     }
 }
 
+bool Chunk::IsLightSeedPending()
+{
+    return lightSeedPending_;
+}
+
+void Chunk::SetLightSeedPending(bool value)
+{
+    lightSeedPending_ = value;
+}
+
 void Chunk::CalculateLight()
 {
     for (int x = 0; x < SIZE_X; x++) {
         for (int y = 0; y < SIZE_Y; y++) {
             for (int z = 0; z < SIZE_Z; z++) {
-                if (data_[x][y][z].type == BT_TORCH) {
+                if (GetBlockValue(x, y, z) == BT_TORCH) {
                     SetTorchlight(x, y, z);
                     GetSubsystem<LightManager>()->AddLightNode(x, y, z, this);
                 }
@@ -1667,10 +2014,27 @@ void Chunk::CalculateLight()
 
 void Chunk::SetVoxel(int x, int y, int z, BlockType block)
 {
-    if (data_[x][y][z].type != block) {
-        MarkForGeometryCalculation();
+    if (GetBlockValue(x, y, z) == block) {
+        return;
+    }
+    MarkForGeometryCalculation();
+    blocks_.Set(GetBlockIndex(x, y, z), block);
+    // Palette may have been widened, the old layout is freed by CompactStorage
+    storageDirty_ = true;
+}
+
+void Chunk::GetBlocks(BlockType* blocks)
+{
+    for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+        blocks[i] = blocks_.Get(i);
     }
-    data_[x][y][z].type = block;
+}
+
+void Chunk::SetBlocks(const BlockType* blocks)
+{
+    blocks_.Assign(blocks);
+    storageDirty_ = true;
+    MarkForGeometryCalculation();
 }
 
 void Chunk::MarkForGeometryCalculation()
@@ -1678,6 +2042,38 @@ void Chunk::MarkForGeometryCalculation()
     calculateIndex_++;
 }
 
+bool Chunk::AreNeighborsLoaded()
+{
+    for (int i = 0; i < 6; i++) {
+        auto neighbor = GetNeighbor(static_cast<BlockSide>(i));
+        if (neighbor && !neighbor->IsLoaded()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Chunk::AreNeighborsAtStage(ChunkGenerationStage stage)
+{
+    for (int i = 0; i < 6; i++) {
+        auto neighbor = GetNeighbor(static_cast<BlockSide>(i));
+        if (neighbor && neighbor->GetGenerationStage() < stage) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Chunk::SetWorkScheduled(bool value)
+{
+    workScheduled_ = value;
+}
+
+bool Chunk::IsWorkScheduled()
+{
+    return workScheduled_;
+}
+
 int Chunk::GetPartIndex(int x, int y, int z)
 {
     return Floor(x / (SIZE_X / (PART_COUNT - 1)));
@@ -1741,27 +2137,26 @@ const int Chunk::GetDistance() const
 
 void Chunk::LoadFromServer()
 {
-    remoteLoadTimer_.Reset();
     requestedFromServer_ = true;
-    auto* network = GetSubsystem<Network>();
-    Connection* serverConnection = network->GetServerConnection();
-    if (!network->IsServerRunning() && serverConnection) {
-        VectorBuffer sendMsg;
-        sendMsg.WriteVector3(position_);
-        serverConnection->SendMessage(NETWORK_REQUEST_CHUNK, true, true, sendMsg);
+    // Streamer paces the requests and asks again when the server is busy
+    if (GetSubsystem<ChunkStreamer>()) {
+        GetSubsystem<ChunkStreamer>()->RequestChunk(GetChunkCoordinates(), distance_);
     }
 }
 
 void Chunk::ProcessServerResponse(MemoryBuffer& buffer)
 {
-    for (int x = 0; x < SIZE_X; x++) {
-        for (int y = 0; y < SIZE_Y; y++) {
-            for (int z = 0; z < SIZE_Z; z++) {
-                SetVoxel(x, y, z, static_cast<BlockType>(buffer.ReadInt()));
-            }
-        }
+    BlockType blocks[CHUNK_VOXEL_COUNT];
+    if (!ChunkCodec::Decode(buffer, blocks)) {
+        URHO3D_LOGERROR("Failed to decode chunk " + position_.ToString() + " received from server");
+        return;
     }
+    SetBlocks(blocks);
     CalculateLight();
+    CalculateSunlight();
+    SetLightSeedPending(true);
+    // Server sends decorated chunks
+    stage_ = CGS_DECORATED;
     loaded_ = true;
 
 //    for (int i = 0; i < 6; i++) {
@@ -1818,3 +2213,21 @@ bool Chunk::ShouldSave()
 {
     return shouldSave_;
 }
+
+ChunkDiskState Chunk::GetDiskState()
+{
+    return diskState_;
+}
+
+void Chunk::SetDiskState(ChunkDiskState state)
+{
+    diskState_ = state;
+}
+
+void Chunk::SetDiskData(bool found, const PODVector<unsigned char>& data, bool edits)
+{
+    MutexLock lock(mutex_);
+    diskData_ = data;
+    diskEdits_ = edits;
+    diskState_ = found ? CDS_LOADED : CDS_MISSING;
+}
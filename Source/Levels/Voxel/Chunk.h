@@ -9,17 +9,56 @@
 #include <Urho3D/Graphics/VertexBuffer.h>
 #include <Urho3D/Graphics/IndexBuffer.h>
 #include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/Material.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 #include "VoxelDefs.h"
 #include "ChunkMesh.h"
+#include "BlockStorage.h"
 
 const int SIZE_X = 16;
 const int SIZE_Y = 16;
 const int SIZE_Z = 16;
+const int CHUNK_VOXEL_COUNT = SIZE_X * SIZE_Y * SIZE_Z;
 const int PART_COUNT = 3;
 
+enum ChunkDiskState {
+    CDS_NONE,
+    CDS_REQUESTED,
+    CDS_LOADED,
+    CDS_MISSING
+};
+
+/**
+ * Generation stages in the order a chunk passes them. Decoration reaches into other chunks,
+ * it only starts once all neighbors finished the stages before it
+ */
+enum ChunkGenerationStage {
+    CGS_NONE,
+    CGS_TERRAIN,
+    CGS_CAVES,
+    CGS_WATER,
+    CGS_DECORATED
+};
+
 using namespace Urho3D;
 
+struct ChunkMeshStats {
+    MeshingMode mode_{MM_NAIVE};
+    unsigned vertexCount_{0};
+    unsigned indexCount_{0};
+    // Meshing time in microseconds
+    long long time_{0};
+    unsigned collisionBoxes_{0};
+};
+
+/**
+ * Block aligned collision box in chunk local block coordinates
+ */
+struct ChunkCollisionBox {
+    IntVector3 origin_;
+    IntVector3 size_;
+};
+
 class Chunk : public Object {
     URHO3D_OBJECT(Chunk, Object);
     Chunk(Context* context);
@@ -28,8 +67,22 @@ class Chunk : public Object {
     static void RegisterObject(Context* context);
 public:
     void Init(Scene* scene, const Vector3& position);
+    /**
+     * Read the chunk from disk or run the generation stages up to water.
+     * Chunks read from disk are complete and loaded right away
+     */
     void Load();
+    /**
+     * Decoration stage, the chunk is loaded afterwards. Blocks for other chunks are handed to the TreeGenerator
+     */
+    void Decorate();
+    ChunkGenerationStage GetGenerationStage() const { return stage_; }
+    /**
+     * All existing neighbors passed the stage
+     */
+    bool AreNeighborsAtStage(ChunkGenerationStage stage);
     const Vector3& GetPosition();
+    IntVector3 GetChunkCoordinates() const;
     Node* GetNode() { return node_; }
     void Save();
     void MarkForDeletion(bool value);
@@ -39,21 +92,61 @@ public:
     void SetActive();
     BlockType GetBlockValue(int x, int y, int z);
     bool Render();
-    VoxelBlock* GetBlockAt(IntVector3 position);
+    VoxelBlock GetBlockAt(IntVector3 position);
     int GetSunlight(int x, int y, int z);
     void SetSunlight(int x, int y, int z, int value);
     int GetTorchlight(int x, int y, int z);
     void SetTorchlight(int x, int y, int z, int value = 15);
     unsigned char GetLightValue(int x, int y, int z);
-    void SetSunlight(int value);
+    void SetLightValue(int x, int y, int z, unsigned char value);
+
+    /**
+     * Linear block index used by the block and light storage
+     */
+    static int GetBlockIndex(int x, int y, int z) { return (x * SIZE_Y + y) * SIZE_Z + z; }
+    /**
+     * Block position lies inside of a chunk
+     */
+    static bool IsBlockInside(const IntVector3& blockPosition)
+    {
+        return blockPosition.x_ >= 0 && blockPosition.x_ < SIZE_X && blockPosition.y_ >= 0 && blockPosition.y_ < SIZE_Y
+            && blockPosition.z_ >= 0 && blockPosition.z_ < SIZE_Z;
+    }
+
+    /**
+     * Shrink block palette and light map to their smallest form.
+     * Must not run while other threads read the chunk
+     */
+    void CompactStorage();
+    bool IsStorageDirty();
+    unsigned GetStorageMemory();
+    // Single block type in the whole chunk
+    bool IsUniform();
+    void CalculateSunlight();
+    bool IsLightSeedPending();
+    void SetLightSeedPending(bool value);
     bool ShouldRender();
     bool IsLoaded();
     bool IsGeometryCalculated();
     void CalculateLight();
     void CalculateGeometry();
+    void CalculateGeometry(MeshingMode mode, CollisionMode collisionMode = CM_BOXES);
+    const ChunkMeshStats& GetMeshStats();
+    static Vector2 GetTextureTileSize();
     void MarkForGeometryCalculation();
+    bool AreNeighborsLoaded();
+    void SetWorkScheduled(bool value);
+    bool IsWorkScheduled();
     Chunk* GetNeighbor(BlockSide side);
+    void SetNeighbor(BlockSide side, Chunk* neighbor);
+    const ChunkHandle& GetHandle() const { return handle_; }
+    void SetHandle(const ChunkHandle& handle) { handle_ = handle; }
     void SetVoxel(int x, int y, int z, BlockType block);
+    /**
+     * Copy all blocks in GetBlockIndex order
+     */
+    void GetBlocks(BlockType* blocks);
+    void SetBlocks(const BlockType* blocks);
     BlockSide GetNeighborDirection(const IntVector3& position);
     IntVector3 GetNeighborBlockPosition(const IntVector3& position);
     Vector3 NeighborBlockWorldPosition(BlockSide side, IntVector3 blockPosition);
@@ -63,40 +156,98 @@ public:
     bool IsRequestedFromServer();
     void LoadFromServer();
     void ProcessServerResponse(MemoryBuffer& buffer);
+    /**
+     * Player edit, recorded so that worlds storing edits can restore it over the generated chunk
+     */
     void SetBlockData(const IntVector3& blockPosition, BlockType type);
+    /**
+     * Block changed by a player of this world, written to the edit journal before it is applied.
+     * Clients leave the persistence to the server
+     */
+    void SetPlayerBlock(const IntVector3& blockPosition, BlockType type);
+    /**
+     * Recorded player edits and the save flag. Benchmarks editing live chunks put them back afterwards
+     */
+    void GetEditState(PODVector<BlockEdit>& edits, bool& shouldSave);
+    void SetEditState(const PODVector<BlockEdit>& edits, bool shouldSave);
     bool ShouldSave();
+    ChunkDiskState GetDiskState();
+    void SetDiskState(ChunkDiskState state);
+    /**
+     * Result of the disk read, data holds block types or encoded player edits
+     */
+    void SetDiskData(bool found, const PODVector<unsigned char>& data, bool edits = false);
+
+    /**
+     * Return to the state of a new chunk for reuse.
+     * Scene nodes, components and mesh buffers are kept, the nodes stay disabled until the next Init
+     */
+    void Reset();
+    /**
+     * Hide the chunk and its collision while it is kept out of the world
+     */
+    void Suspend(bool keepMesh);
+    void Resume();
+    /**
+     * Block, light and mesh bytes held by the chunk
+     */
+    unsigned GetMemoryUsage();
 
 private:
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    /**
+     * Light and storage of the finished blocks
+     */
+    void CompleteLoad();
     void HandleHit(StringHash eventType, VariantMap& eventData);
     void HandleAdd(StringHash eventType, VariantMap& eventData);
-    Vector2 GetTextureCoord(BlockSide side, BlockType blockType, Vector2 position);
+    unsigned char GetTextureTileIndex(BlockSide side, BlockType blockType);
+    void CalculateNaiveGeometry();
+    void CalculateGreedyGeometry();
+    /**
+     * Merge solid and water blocks into boxes, growing each box along z, then y, then x
+     */
+    void CalculateCollisionBoxes();
+    void AddFace(ChunkMesh* mesh, BlockSide side, BlockType type, unsigned char light, const IntVector3& origin, const IntVector3& size);
     bool IsBlockInsideChunk(IntVector3 position);
     void CreateNode();
     void RemoveNode();
     bool BlockHaveNeighbor(BlockSide side, int x, int y, int z);
+    bool IsSideOpaque(BlockSide side);
+    bool IsGeometryEmpty();
+    void WriteLight(int index, unsigned char value);
     BlockType GetBlockNeighbor(BlockSide side, int x, int y, int z);
     unsigned char NeighborLightValue(BlockSide side, int x, int y, int z);
     int GetPartIndex(int x, int y, int z);
     void SendHitToServer(const IntVector3& position);
     void SendAddToServer(const IntVector3& position, BlockType type);
+    SharedPtr<Model> CreateMeshModel(Node* node, ChunkMesh& mesh, Material* material, bool occluder);
+    void UploadMesh(Node* node, Model* model, ChunkMesh& mesh, const PODVector<ChunkCollisionBox>& boxes);
+    void UploadCollisionBoxes(Node* node, const PODVector<ChunkCollisionBox>& boxes);
 
     Vector<SharedPtr<Node>> parts_;
     SharedPtr<Node> node_;
     SharedPtr<Node> waterNode_;
     SharedPtr<Node> groundNode_;
     SharedPtr<Node> label_;
+    // Created once per chunk object, the mesh uploads only refill their buffers
+    SharedPtr<Model> groundModel_;
+    SharedPtr<Model> waterModel_;
     Scene* scene_;
     Vector3 position_;
-    VoxelBlock data_[SIZE_X][SIZE_Y][SIZE_Z];
-    unsigned char lightMap_[SIZE_X][SIZE_Y][SIZE_Z];
+    BlockStorage blocks_;
+    // Null while every block has the same light, uniformLight_ holds the value then
+    SharedArrayPtr<unsigned char> lightMap_;
+    unsigned char uniformLight_{0};
+    // Block palette or light map may be shrunk by CompactStorage
+    bool storageDirty_{false};
     bool shouldDelete_{false};
     bool isActive_{true};
     Mutex mutex_;
 
     bool loaded_{false};
+    ChunkGenerationStage stage_{CGS_NONE};
     bool requestedFromServer_{false};
-    Timer remoteLoadTimer_;
     bool shouldRender_{false};
     bool notified_{false};
     int renderIndex_{0};
@@ -107,6 +258,24 @@ private:
     ChunkMesh chunkWaterMesh_;
     int calculateIndex_{0};
     int lastCalculatateIndex_{0};
+    ChunkMeshStats meshStats_;
+    // Collision built by the last geometry calculation, applied together with the mesh
+    CollisionMode collisionMode_{CM_BOXES};
+    PODVector<ChunkCollisionBox> groundBoxes_;
+    PODVector<ChunkCollisionBox> waterBoxes_;
     bool shouldSave_{false};
+    ChunkDiskState diskState_{CDS_NONE};
+    PODVector<unsigned char> diskData_;
+    bool diskEdits_{false};
+    // Player edits in the order they were first made, one per block
+    PODVector<BlockEdit> edits_;
+    // Read from a block record, saved with all blocks again
+    bool blocksRecord_{false};
     int renderCount_{0};
+    bool workScheduled_{false};
+    // Adjacent loaded chunks per BlockSide, maintained by VoxelWorld
+    Chunk* neighbors_[6]{};
+    ChunkHandle handle_;
+    // Light has not been connected with the neighbor chunks yet
+    bool lightSeedPending_{false};
 };
@@ -0,0 +1,75 @@
+#include "ChunkCache.h"
+#include "Chunk.h"
+
+void ChunkCache::Insert(Chunk* chunk)
+{
+    IntVector3 coordinates = chunk->GetChunkCoordinates();
+    auto existing = entries_.Find(coordinates);
+    if (existing != entries_.End()) {
+        memoryUsage_ -= (*existing).second_.memory_;
+        order_.Erase((*existing).second_.order_);
+        entries_.Erase(existing);
+    }
+    Entry entry;
+    entry.chunk_ = chunk;
+    entry.memory_ = chunk->GetMemoryUsage();
+    entry.order_ = order_.Insert(order_.End(), coordinates);
+    entries_[coordinates] = entry;
+    memoryUsage_ += entry.memory_;
+    Trim();
+}
+
+SharedPtr<Chunk> ChunkCache::Take(const IntVector3& coordinates)
+{
+    auto it = entries_.Find(coordinates);
+    if (it == entries_.End()) {
+        misses_++;
+        return SharedPtr<Chunk>();
+    }
+    hits_++;
+    SharedPtr<Chunk> chunk = (*it).second_.chunk_;
+    memoryUsage_ -= (*it).second_.memory_;
+    order_.Erase((*it).second_.order_);
+    entries_.Erase(it);
+    return chunk;
+}
+
+void ChunkCache::Trim()
+{
+    while (memoryUsage_ > memoryLimit_ && !order_.Empty()) {
+        auto it = entries_.Find(order_.Front());
+        SharedPtr<Chunk> chunk = (*it).second_.chunk_;
+        memoryUsage_ -= (*it).second_.memory_;
+        entries_.Erase(it);
+        order_.PopFront();
+        Release(chunk);
+    }
+}
+
+SharedPtr<Chunk> ChunkCache::Acquire(Context* context)
+{
+    if (pool_.Empty()) {
+        return SharedPtr<Chunk>(new Chunk(context));
+    }
+    SharedPtr<Chunk> chunk = pool_.Back();
+    pool_.Pop();
+    return chunk;
+}
+
+void ChunkCache::Clear()
+{
+    entries_.Clear();
+    order_.Clear();
+    pool_.Clear();
+    memoryUsage_ = 0;
+}
+
+void ChunkCache::Release(SharedPtr<Chunk> chunk)
+{
+    if (pool_.Size() >= poolLimit_) {
+        // Destroyed together with its nodes
+        return;
+    }
+    chunk->Reset();
+    pool_.Push(chunk);
+}
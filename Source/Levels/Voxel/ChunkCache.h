@@ -0,0 +1,73 @@
+#pragma once
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/List.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+class Chunk;
+
+/**
+ * Recently unloaded chunks kept with their blocks, light and optionally mesh.
+ * Least recently unloaded chunks are evicted first once the memory limit is exceeded.
+ * Evicted chunks go to a pool and are reused for new chunks
+ */
+class ChunkCache {
+public:
+    /**
+     * Keep the chunk, it must already be removed from the world
+     */
+    void Insert(Chunk* chunk);
+
+    /**
+     * Remove the cached chunk of the coordinates, null when it is not cached.
+     * Counts as a cache hit or miss
+     */
+    SharedPtr<Chunk> Take(const IntVector3& coordinates);
+
+    /**
+     * Evict chunks until the cache fits into the memory limit
+     */
+    void Trim();
+
+    /**
+     * Pooled chunk ready for Init or a new one when the pool is empty
+     */
+    SharedPtr<Chunk> Acquire(Context* context);
+
+    /**
+     * Put a chunk that is not worth caching into the pool
+     */
+    void Release(SharedPtr<Chunk> chunk);
+
+    /**
+     * Drop every cached and pooled chunk
+     */
+    void Clear();
+
+    void SetMemoryLimit(unsigned bytes) { memoryLimit_ = bytes; }
+    unsigned GetMemoryLimit() const { return memoryLimit_; }
+    unsigned GetMemoryUsage() const { return memoryUsage_; }
+    unsigned GetSize() const { return entries_.Size(); }
+    unsigned GetPoolSize() const { return pool_.Size(); }
+    unsigned GetHits() const { return hits_; }
+    unsigned GetMisses() const { return misses_; }
+
+private:
+    struct Entry {
+        SharedPtr<Chunk> chunk_;
+        unsigned memory_;
+        List<IntVector3>::Iterator order_;
+    };
+
+    HashMap<IntVector3, Entry> entries_;
+    // Oldest first
+    List<IntVector3> order_;
+    Vector<SharedPtr<Chunk>> pool_;
+    unsigned poolLimit_{64};
+    unsigned memoryLimit_{32 * 1024 * 1024};
+    unsigned memoryUsage_{0};
+    unsigned hits_{0};
+    unsigned misses_{0};
+};
@@ -0,0 +1,153 @@
+#include <cstring>
+#include <Urho3D/IO/Compression.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/ThirdParty/LZ4/lz4.h>
+#include "ChunkCodec.h"
+#include "Chunk.h"
+
+enum ChunkCodecFlags {
+    // Whole chunk is one block type, only that type follows
+    CCF_UNIFORM = 1,
+    // Run data is LZ4 compressed
+    CCF_COMPRESSED = 2
+};
+
+// Palette index in the low 4 bits of every run, run length - 1 above it
+static const unsigned RUN_INDEX_BITS = 4;
+
+static_assert(BT_NONE <= (1 << RUN_INDEX_BITS), "Palette index must fit into a run");
+
+// Anything that is not a block type is sent as air, the lookup stays inside the table and Decode accepts the palette
+static unsigned char GetEncodedType(BlockType type)
+{
+    return static_cast<unsigned>(type) < BT_NONE ? static_cast<unsigned char>(type) : static_cast<unsigned char>(BT_AIR);
+}
+
+void ChunkCodec::Encode(const BlockType* blocks, Serializer& dest, bool compress)
+{
+    unsigned char lookup[BT_NONE];
+    unsigned char palette[BT_NONE];
+    unsigned paletteSize = 0;
+    memset(lookup, 0xFF, sizeof(lookup));
+    for (unsigned i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+        unsigned char type = GetEncodedType(blocks[i]);
+        if (lookup[type] == 0xFF) {
+            lookup[type] = static_cast<unsigned char>(paletteSize);
+            palette[paletteSize++] = type;
+        }
+    }
+
+    dest.WriteUByte(VERSION);
+    if (paletteSize == 1) {
+        dest.WriteUByte(CCF_UNIFORM);
+        dest.WriteUByte(palette[0]);
+        return;
+    }
+
+    VectorBuffer runs;
+    for (unsigned i = 0; i < CHUNK_VOXEL_COUNT;) {
+        unsigned char type = GetEncodedType(blocks[i]);
+        unsigned end = i + 1;
+        while (end < CHUNK_VOXEL_COUNT && GetEncodedType(blocks[end]) == type) {
+            end++;
+        }
+        runs.WriteVLE(((end - i - 1) << RUN_INDEX_BITS) | lookup[type]);
+        i = end;
+    }
+
+    unsigned char flags = 0;
+    PODVector<unsigned char> compressed;
+    if (compress) {
+        compressed.Resize(EstimateCompressBound(runs.GetSize()));
+        unsigned size = CompressData(&compressed[0], runs.GetData(), runs.GetSize());
+        // Short run lists often do not get any smaller
+        if (size > 0 && size < runs.GetSize()) {
+            compressed.Resize(size);
+            flags |= CCF_COMPRESSED;
+        }
+    }
+
+    dest.WriteUByte(flags);
+    dest.WriteUByte(static_cast<unsigned char>(paletteSize));
+    dest.Write(palette, paletteSize);
+    dest.WriteVLE(runs.GetSize());
+    if (flags & CCF_COMPRESSED) {
+        dest.WriteVLE(compressed.Size());
+        dest.Write(&compressed[0], compressed.Size());
+    } else {
+        dest.Write(runs.GetData(), runs.GetSize());
+    }
+}
+
+bool ChunkCodec::Decode(Deserializer& source, BlockType* blocks)
+{
+    if (source.ReadUByte() != VERSION) {
+        return false;
+    }
+    unsigned char flags = source.ReadUByte();
+    if (flags & CCF_UNIFORM) {
+        unsigned type = source.ReadUByte();
+        if (type >= BT_NONE) {
+            return false;
+        }
+        for (unsigned i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+            blocks[i] = static_cast<BlockType>(type);
+        }
+        return true;
+    }
+
+    unsigned paletteSize = source.ReadUByte();
+    unsigned char palette[BT_NONE];
+    if (paletteSize < 2 || paletteSize > BT_NONE || source.Read(palette, paletteSize) != paletteSize) {
+        return false;
+    }
+    for (unsigned i = 0; i < paletteSize; i++) {
+        if (palette[i] >= BT_NONE) {
+            return false;
+        }
+    }
+
+    // A run takes at most 3 bytes and covers at least one block
+    unsigned runsSize = source.ReadVLE();
+    if (runsSize == 0 || runsSize > CHUNK_VOXEL_COUNT * 3) {
+        return false;
+    }
+    PODVector<unsigned char> runs(runsSize);
+    if (flags & CCF_COMPRESSED) {
+        unsigned compressedSize = source.ReadVLE();
+        if (compressedSize == 0 || compressedSize > EstimateCompressBound(runsSize)) {
+            return false;
+        }
+        PODVector<unsigned char> compressed(compressedSize);
+        if (source.Read(&compressed[0], compressedSize) != compressedSize) {
+            return false;
+        }
+        // Region files and network messages are untrusted, the bounded decoder never reads or writes past the buffers
+        int decompressed = LZ4_decompress_safe(reinterpret_cast<const char*>(&compressed[0]), reinterpret_cast<char*>(&runs[0]),
+            static_cast<int>(compressedSize), static_cast<int>(runsSize));
+        if (decompressed != static_cast<int>(runsSize)) {
+            return false;
+        }
+    } else if (source.Read(&runs[0], runsSize) != runsSize) {
+        return false;
+    }
+
+    MemoryBuffer reader(runs);
+    unsigned index = 0;
+    while (index < CHUNK_VOXEL_COUNT) {
+        if (reader.IsEof()) {
+            return false;
+        }
+        unsigned run = reader.ReadVLE();
+        unsigned value = run & ((1u << RUN_INDEX_BITS) - 1);
+        unsigned length = (run >> RUN_INDEX_BITS) + 1;
+        if (value >= paletteSize || index + length > CHUNK_VOXEL_COUNT) {
+            return false;
+        }
+        for (unsigned end = index + length; index < end; index++) {
+            blocks[index] = static_cast<BlockType>(palette[value]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+#include "VoxelDefs.h"
+
+using namespace Urho3D;
+
+/**
+ * Wire format of chunk blocks.
+ * Blocks are reduced to a palette and run-length encoded in storage order,
+ * the runs are optionally LZ4 compressed when that makes them smaller.
+ * A chunk of a single block type is sent as just that type
+ */
+class ChunkCodec {
+public:
+    static const unsigned char VERSION = 1;
+
+    /**
+     * Write count blocks, count must match the chunk voxel count
+     */
+    static void Encode(const BlockType* blocks, Serializer& dest, bool compress = true);
+
+    /**
+     * Read blocks written by Encode, returns false on version mismatch or malformed data
+     */
+    static bool Decode(Deserializer& source, BlockType* blocks);
+};
@@ -1,8 +1,84 @@
 #include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include "ChunkGenerator.h"
 #include "Chunk.h"
 #include <Urho3D/IO/Log.h>
 
+static_assert(SIZE_X == SIZE_Y && SIZE_Y == SIZE_Z, "Noise planes are square");
+static const int PLANE_SAMPLES = SIZE_X * SIZE_Y;
+
+// Terrain height noise, the first picks the octave count, the second the height range of the surface noise
+static const float TERRAIN_OCTAVES_SMOOTHNESS = 111.33f;
+static const float TERRAIN_RANGE_SMOOTHNESS = 193.33f;
+static const float TERRAIN_SURFACE_SMOOTHNESS = 333.33f;
+static const int TERRAIN_HEIGHT_LIMIT = 100;
+// Block type noise planes
+static const float BLOCK_SMOOTHNESS_XY = 111.13f;
+static const float BLOCK_SMOOTHNESS_YZ = 222.13f;
+static const float BLOCK_SMOOTHNESS_XZ = 333.13f;
+// Cave noise planes
+static const float CAVE_SMOOTHNESS_XY = 77.13f;
+static const float CAVE_SMOOTHNESS_YZ = 66.13f;
+static const float CAVE_SMOOTHNESS_XZ = 55.13f;
+static const int CAVE_OCTAVES = 6;
+static const float TREE_SMOOTHNESS = 3.13f;
+
+static int GetTerrainOctaves(double noise)
+{
+    return (noise * 0.5 + 0.5 + 1) * 16;
+}
+
+static int GetTerrainRange(double noise)
+{
+    return (noise * 0.5 + 0.5) * TERRAIN_HEIGHT_LIMIT;
+}
+
+static int GetSurfaceHeight(double surfaceNoise, int range)
+{
+    float surfaceHeight = surfaceNoise * range;
+    return Ceil(surfaceHeight);
+}
+
+static bool IsTree(float noise)
+{
+    float result = noise * 0.5 + 0.5;
+    return result > 0.8f;
+}
+
+static BlockType SelectBlockType(int heightToSurface, float result, Biome biome)
+{
+    if (heightToSurface <= 10) {
+        if (result > 0.2) {
+            return BlockType::BT_COAL;
+        }
+        if (result > 0.18) {
+            return BlockType::BT_STONE;
+        }
+        if (result > 0.16) {
+            return BlockType::BT_SAND;
+        }
+        switch (biome) {
+            case B_GRASS:
+                return BlockType::BT_DIRT;
+            case B_SEA:
+                return BlockType::BT_WATER;
+            case B_FOREST:
+                return BlockType::BT_WOOD;
+            case B_MOUNTAINS:
+                return BlockType::BT_STONE;
+            case B_DESERT:
+                return BlockType::BT_SAND;
+            default:
+                return BlockType::BT_DIRT;
+        }
+    }
+
+    if (result > 0.8) {
+        return BlockType::BT_COAL;
+    }
+    return BlockType::BT_STONE;
+}
+
 ChunkGenerator::ChunkGenerator(Context* context):
 Object(context),
 simplexNoise_()
@@ -21,54 +97,137 @@ void ChunkGenerator::RegisterObject(Context* context)
 void ChunkGenerator::SetSeed(int seed)
 {
     URHO3D_LOGINFOF("Changing world generating seed to %d", seed);
+    // Noise tables are only read while chunks generate, they change when no worker can use them
+    auto workQueue = GetSubsystem<WorkQueue>();
+    if (workQueue) {
+        workQueue->Complete(0);
+    }
     perlin_.reseed(seed);
     simplexNoise_.SetSeed(seed);
+    seed_ = seed;
+    ClearColumnCache();
+}
+
+void ChunkGenerator::SetDensityStep(int step)
+{
+    if (step < 1 || step > SIZE_X / 2 || SIZE_X % step != 0) {
+        URHO3D_LOGERRORF("Density step %d must divide the chunk size %d and be at most %d", step, SIZE_X, SIZE_X / 2);
+        return;
+    }
+    auto workQueue = GetSubsystem<WorkQueue>();
+    if (workQueue) {
+        workQueue->Complete(0);
+    }
+    densityStep_ = step;
+    URHO3D_LOGINFOF("Chunk density step changed to %d", step);
+}
+
+void ChunkGenerator::ClearColumnCache()
+{
+    MutexLock lock(columnMutex_);
+    columns_.Clear();
 }
 
 int ChunkGenerator::GetTerrainHeight(const Vector3& blockPosition)
 {
-//    float octaves = 16;
-
-    float smoothness1 = 55.33f;
-    float smoothness2 = 111.33f;
-    float smoothness3 = 193.33f;
-    double dx1 = blockPosition.x_ / smoothness1;
-    double dz1 = blockPosition.z_ / smoothness1;
-    double dx2 = blockPosition.x_ / smoothness2;
-    double dz2 = blockPosition.z_ / smoothness2;
-    double dx3 = blockPosition.x_ / smoothness3;
-    double dz3 = blockPosition.z_ / smoothness3;
-//    double result1 = perlin_.octaveNoise(dx1, dz1, 1) * 0.5 + 0.5;
-    int octaves = (perlin_.octaveNoise(dx2, dz2, 1) * 0.5 + 0.5 + 1) * 16;
-    int heightLimit = 100;
-    int height = (perlin_.octaveNoise(dx3, dz3, 1) * 0.5 + 0.5) * heightLimit;
-//
-//
-    float smoothness4 = 333.33f;
-    double dx4 = blockPosition.x_ / smoothness4;
-    double dz4 = blockPosition.z_ / smoothness4;
-    double result2 = perlin_.octaveNoise(dx4, dz4, octaves);
-//    float result2 = simplexNoise_.noise(dx1, dz1);
-//    float height = simplexNoise_.noise(dx2, dz2) * 100;
-    float surfaceHeight = result2 * height;
-//    if (surfaceHeight < -10) {
-//        surfaceHeight = -10;
-//    }
-    return Ceil(surfaceHeight);
+    return GetTerrainHeight((double)blockPosition.x_, (double)blockPosition.z_);
 }
 
-bool ChunkGenerator::HaveTree(const Vector3& blockPosition)
+void ChunkGenerator::GetTerrainHeights(const IntRect& region, int* heights)
 {
-    float smoothness = 3.13f;
-    double dx = blockPosition.x_ / smoothness;
-    double dz = blockPosition.z_ / smoothness;
-    float result = simplexNoise_.fractal(4, dx, dz) * 0.5 + 0.5;
+    // Same values as GetTerrainHeight, the noise of a slice of columns is sampled in batches
+    int sizeZ = region.bottom_ - region.top_;
+    int count = (region.right_ - region.left_) * sizeZ;
+    double x[PLANE_SAMPLES];
+    double z[PLANE_SAMPLES];
+    double noise[PLANE_SAMPLES];
+    int octaves[PLANE_SAMPLES];
+    int ranges[PLANE_SAMPLES];
+    for (int first = 0; first < count; first += PLANE_SAMPLES) {
+        int slice = Min(count - first, PLANE_SAMPLES);
+        auto sampleColumns = [&](float smoothness) {
+            for (int i = 0; i < slice; i++) {
+                x[i] = (double)(region.left_ + (first + i) / sizeZ) / smoothness;
+                z[i] = (double)(region.top_ + (first + i) % sizeZ) / smoothness;
+            }
+        };
+        sampleColumns(TERRAIN_OCTAVES_SMOOTHNESS);
+        perlin_.octaveNoise(x, z, noise, slice, 1);
+        for (int i = 0; i < slice; i++) {
+            octaves[i] = GetTerrainOctaves(noise[i]);
+        }
+        sampleColumns(TERRAIN_RANGE_SMOOTHNESS);
+        perlin_.octaveNoise(x, z, noise, slice, 1);
+        for (int i = 0; i < slice; i++) {
+            ranges[i] = GetTerrainRange(noise[i]);
+        }
+        sampleColumns(TERRAIN_SURFACE_SMOOTHNESS);
+        perlin_.octaveNoise(x, z, octaves, noise, slice);
+        for (int i = 0; i < slice; i++) {
+            heights[first + i] = GetSurfaceHeight(noise[i], ranges[i]);
+        }
+    }
+}
 
-    if (result > 0.8f) {
-        return true;
+void ChunkGenerator::GetColumn(int chunkX, int chunkZ, ChunkColumn& column)
+{
+    IntVector2 key(chunkX, chunkZ);
+    {
+        MutexLock lock(columnMutex_);
+        auto it = columns_.Find(key);
+        if (it != columns_.End()) {
+            column = (*it).second_;
+            columnHits_++;
+            return;
+        }
+        columnMisses_++;
     }
 
-    return false;
+    // Computed without the lock, chunks of other columns keep generating meanwhile
+    int originX = chunkX * SIZE_X;
+    int originZ = chunkZ * SIZE_Z;
+    GetTerrainHeights(IntRect(originX, originZ, originX + SIZE_X, originZ + SIZE_Z), column.heights_);
+    float treeX[SIZE_X * SIZE_Z];
+    float treeZ[SIZE_X * SIZE_Z];
+    float treeNoise[SIZE_X * SIZE_Z];
+    for (int x = 0; x < SIZE_X; x++) {
+        for (int z = 0; z < SIZE_Z; z++) {
+            Vector3 blockPosition(originX + x, 0, originZ + z);
+            column.biomes_[x * SIZE_Z + z] = static_cast<unsigned char>(GetBiomeType(blockPosition));
+            treeX[x * SIZE_Z + z] = blockPosition.x_ / TREE_SMOOTHNESS;
+            treeZ[x * SIZE_Z + z] = blockPosition.z_ / TREE_SMOOTHNESS;
+        }
+    }
+    simplexNoise_.fractal(4, treeX, treeZ, treeNoise, SIZE_X * SIZE_Z);
+    for (int i = 0; i < SIZE_X * SIZE_Z; i++) {
+        column.trees_[i] = IsTree(treeNoise[i]);
+    }
+
+    MutexLock lock(columnMutex_);
+    columns_[key] = column;
+    while (columns_.Size() > columnLimit_) {
+        columns_.Erase(columns_.Begin());
+    }
+}
+
+void ChunkGenerator::ResetColumnCacheStats()
+{
+    MutexLock lock(columnMutex_);
+    columnHits_ = 0;
+    columnMisses_ = 0;
+}
+
+int ChunkGenerator::GetTerrainHeight(double x, double z)
+{
+    int octaves = GetTerrainOctaves(perlin_.octaveNoise(x / TERRAIN_OCTAVES_SMOOTHNESS, z / TERRAIN_OCTAVES_SMOOTHNESS, 1));
+    int range = GetTerrainRange(perlin_.octaveNoise(x / TERRAIN_RANGE_SMOOTHNESS, z / TERRAIN_RANGE_SMOOTHNESS, 1));
+    double result = perlin_.octaveNoise(x / TERRAIN_SURFACE_SMOOTHNESS, z / TERRAIN_SURFACE_SMOOTHNESS, octaves);
+    return GetSurfaceHeight(result, range);
+}
+
+bool ChunkGenerator::HaveTree(const Vector3& blockPosition)
+{
+    return IsTree(simplexNoise_.fractal(4, blockPosition.x_ / TREE_SMOOTHNESS, blockPosition.z_ / TREE_SMOOTHNESS));
 }
 
 Biome ChunkGenerator::GetBiomeType(const Vector3& blockPosition)
@@ -90,51 +249,19 @@ Biome ChunkGenerator::GetBiomeType(const Vector3& blockPosition)
 
 BlockType ChunkGenerator::GetBlockType(const Vector3& blockPosition, int surfaceHeight)
 {
-    Biome biome = GetBiomeType(blockPosition);
-//    if (surfaceHeight <= -10) {
-//        biome = B_SEA;
-//    }
+    return GetBlockType(blockPosition, surfaceHeight, GetBiomeType(blockPosition));
+}
+
+BlockType ChunkGenerator::GetBlockType(const Vector3& blockPosition, int surfaceHeight, Biome biome)
+{
     int heightToSurface = surfaceHeight - blockPosition.y_;
     if (heightToSurface < 0) {
         return BlockType::BT_AIR;
     }
-    float smoothness1 = 111.13f;
-    float smoothness2 = 222.13f;
-    float smoothness3 = 333.13f;
-    float result1 = perlin_.octaveNoise(blockPosition.x_ / smoothness1, blockPosition.y_ / smoothness1, 1) * 0.5 + 0.5;
-    float result2 = perlin_.octaveNoise(blockPosition.y_ / smoothness2, blockPosition.z_ / smoothness2, 1) * 0.5 + 0.5;
-    float result3 = perlin_.octaveNoise(blockPosition.x_ / smoothness3, blockPosition.z_ / smoothness3, 1) * 0.5 + 0.5;
-    float result = result1 * result2 * result3;
-    if (heightToSurface <= 10) {
-        if (result > 0.2) {
-            return BlockType::BT_COAL;
-        }
-        if (result > 0.18) {
-            return BlockType::BT_STONE;
-        }
-        if (result > 0.16) {
-            return BlockType::BT_SAND;
-        }
-        switch (biome) {
-            case B_GRASS:
-                return BlockType::BT_DIRT;
-            case B_SEA:
-                return BlockType::BT_WATER;
-            case B_FOREST:
-                return BlockType::BT_WOOD;
-            case B_MOUNTAINS:
-                return BlockType::BT_STONE;
-            case B_DESERT:
-                return BlockType::BT_SAND;
-            default:
-                return BlockType::BT_DIRT;
-        }
-    }
-
-    if (result > 0.8) {
-        return BlockType::BT_COAL;
-    }
-    return BlockType::BT_STONE;
+    float result1 = perlin_.octaveNoise(blockPosition.x_ / BLOCK_SMOOTHNESS_XY, blockPosition.y_ / BLOCK_SMOOTHNESS_XY, 1) * 0.5 + 0.5;
+    float result2 = perlin_.octaveNoise(blockPosition.y_ / BLOCK_SMOOTHNESS_YZ, blockPosition.z_ / BLOCK_SMOOTHNESS_YZ, 1) * 0.5 + 0.5;
+    float result3 = perlin_.octaveNoise(blockPosition.x_ / BLOCK_SMOOTHNESS_XZ, blockPosition.z_ / BLOCK_SMOOTHNESS_XZ, 1) * 0.5 + 0.5;
+    return SelectBlockType(heightToSurface, result1 * result2 * result3, biome);
 }
 
 BlockType ChunkGenerator::GetCaveBlockType(const Vector3& blockPosition, BlockType currentBlock)
@@ -143,12 +270,9 @@ BlockType ChunkGenerator::GetCaveBlockType(const Vector3& blockPosition, BlockTy
         return currentBlock;
     }
 
-    float smoothness1 = 77.13f;
-    float smoothness2 = 66.13f;
-    float smoothness3 = 55.13f;
-    float result1 = perlin_.octaveNoise(blockPosition.x_ / smoothness1, blockPosition.y_ / smoothness1, 6) * 0.5 + 0.5;
-    float result2 = perlin_.octaveNoise(blockPosition.y_ / smoothness2, blockPosition.z_ / smoothness2, 6) * 0.5 + 0.5;
-    float result3 = perlin_.octaveNoise(blockPosition.x_ / smoothness3, blockPosition.z_ / smoothness3, 6) * 0.5 + 0.5;
+    float result1 = perlin_.octaveNoise(blockPosition.x_ / CAVE_SMOOTHNESS_XY, blockPosition.y_ / CAVE_SMOOTHNESS_XY, CAVE_OCTAVES) * 0.5 + 0.5;
+    float result2 = perlin_.octaveNoise(blockPosition.y_ / CAVE_SMOOTHNESS_YZ, blockPosition.z_ / CAVE_SMOOTHNESS_YZ, CAVE_OCTAVES) * 0.5 + 0.5;
+    float result3 = perlin_.octaveNoise(blockPosition.x_ / CAVE_SMOOTHNESS_XZ, blockPosition.z_ / CAVE_SMOOTHNESS_XZ, CAVE_OCTAVES) * 0.5 + 0.5;
     float result = result1 * result2 * result3;
 //    float result = simplexNoise_.noise(blockPosition.x_ / smoothness1, blockPosition.y_ / smoothness1, blockPosition.z_ / smoothness1);
 //    float result2 = simplexNoise_.noise(blockPosition.z_ / smoothness1, blockPosition.x_ / smoothness1, blockPosition.y_ / smoothness1);
@@ -159,3 +283,104 @@ BlockType ChunkGenerator::GetCaveBlockType(const Vector3& blockPosition, BlockTy
 
     return currentBlock;
 }
+
+void ChunkGenerator::GetNoisePlane(float originA, float originB, int step, int points, float smoothness, int octaves, float* result)
+{
+    double a[PLANE_SAMPLES];
+    double b[PLANE_SAMPLES];
+    double noise[PLANE_SAMPLES];
+    for (int i = 0; i < points; i++) {
+        for (int j = 0; j < points; j++) {
+            // Same float division as the per block functions
+            a[i * points + j] = (originA + i * step) / smoothness;
+            b[i * points + j] = (originB + j * step) / smoothness;
+        }
+    }
+    perlin_.octaveNoise(a, b, noise, points * points, octaves);
+    for (int i = 0; i < points * points; i++) {
+        result[i] = noise[i] * 0.5 + 0.5;
+    }
+}
+
+// values of every block from a lattice of points^3 values spaced step blocks apart
+static void InterpolateLattice(const float* lattice, int points, int step, float* values)
+{
+    for (int x = 0; x < SIZE_X; x++) {
+        const float fx = (float)(x % step) / step;
+        for (int y = 0; y < SIZE_Y; y++) {
+            const float fy = (float)(y % step) / step;
+            for (int z = 0; z < SIZE_Z; z++) {
+                const float fz = (float)(z % step) / step;
+                const float* corner = lattice + ((x / step) * points + y / step) * points + z / step;
+                const float* cornerX = corner + points * points;
+                float value0 = Lerp(Lerp(corner[0], corner[1], fz), Lerp(corner[points], corner[points + 1], fz), fy);
+                float value1 = Lerp(Lerp(cornerX[0], cornerX[1], fz), Lerp(cornerX[points], cornerX[points + 1], fz), fy);
+                values[Chunk::GetBlockIndex(x, y, z)] = Lerp(value0, value1, fx);
+            }
+        }
+    }
+}
+
+void ChunkGenerator::GetDensity(const Vector3& chunkPosition, int step, ChunkDensity& density)
+{
+    // Every noise term depends on two axes only, the planes are multiplied into the 3D lattice.
+    // A step of 1 is the lattice of all blocks, larger steps add the far chunk border for the interpolation
+    if (step < 1 || step > SIZE_X / 2 || SIZE_X % step != 0) {
+        step = 1;
+    }
+    int points = step == 1 ? SIZE_X : SIZE_X / step + 1;
+    float planes[6][PLANE_SAMPLES];
+    GetNoisePlane(chunkPosition.x_, chunkPosition.y_, step, points, BLOCK_SMOOTHNESS_XY, 1, planes[0]);
+    GetNoisePlane(chunkPosition.y_, chunkPosition.z_, step, points, BLOCK_SMOOTHNESS_YZ, 1, planes[1]);
+    GetNoisePlane(chunkPosition.x_, chunkPosition.z_, step, points, BLOCK_SMOOTHNESS_XZ, 1, planes[2]);
+    GetNoisePlane(chunkPosition.x_, chunkPosition.y_, step, points, CAVE_SMOOTHNESS_XY, CAVE_OCTAVES, planes[3]);
+    GetNoisePlane(chunkPosition.y_, chunkPosition.z_, step, points, CAVE_SMOOTHNESS_YZ, CAVE_OCTAVES, planes[4]);
+    GetNoisePlane(chunkPosition.x_, chunkPosition.z_, step, points, CAVE_SMOOTHNESS_XZ, CAVE_OCTAVES, planes[5]);
+
+    // Exact lattice has the block layout already, coarse ones hold at most 9^3 points
+    float* ore = density.ore_;
+    float* caves = density.caves_;
+    float oreLattice[9 * 9 * 9];
+    float caveLattice[9 * 9 * 9];
+    if (step > 1) {
+        ore = oreLattice;
+        caves = caveLattice;
+    }
+    for (int x = 0; x < points; x++) {
+        for (int y = 0; y < points; y++) {
+            for (int z = 0; z < points; z++) {
+                int index = (x * points + y) * points + z;
+                ore[index] = planes[0][x * points + y] * planes[1][y * points + z] * planes[2][x * points + z];
+                caves[index] = planes[3][x * points + y] * planes[4][y * points + z] * planes[5][x * points + z];
+            }
+        }
+    }
+    if (step > 1) {
+        InterpolateLattice(oreLattice, points, step, density.ore_);
+        InterpolateLattice(caveLattice, points, step, density.caves_);
+    }
+}
+
+void ChunkGenerator::GetBlockTypes(const Vector3& chunkPosition, const ChunkColumn& column, const ChunkDensity& density, BlockType* blocks)
+{
+    for (int x = 0; x < SIZE_X; x++) {
+        for (int z = 0; z < SIZE_Z; z++) {
+            int surfaceHeight = column.heights_[x * SIZE_Z + z];
+            Biome biome = static_cast<Biome>(column.biomes_[x * SIZE_Z + z]);
+            for (int y = 0; y < SIZE_Y; y++) {
+                int heightToSurface = surfaceHeight - (chunkPosition.y_ + y);
+                int index = Chunk::GetBlockIndex(x, y, z);
+                blocks[index] = heightToSurface < 0 ? BlockType::BT_AIR : SelectBlockType(heightToSurface, density.ore_[index], biome);
+            }
+        }
+    }
+}
+
+void ChunkGenerator::ApplyCaves(const ChunkDensity& density, BlockType* blocks)
+{
+    for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+        if (blocks[i] != BlockType::BT_AIR && density.caves_[i] > 0.2f) {
+            blocks[i] = BlockType::BT_AIR;
+        }
+    }
+}
@@ -1,11 +1,42 @@
 #pragma once
 #include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Math/Rect.h>
 #include "../../Generator/PerlinNoise.h"
 #include "VoxelDefs.h"
 #include "../../Generator/SimplexNoise.h"
+#include "Chunk.h"
 
 using namespace Urho3D;
 
+/**
+ * Bumped whenever the blocks generated for a seed change. Worlds storing only player edits
+ * regenerate everything else and depend on it
+ */
+const unsigned GENERATOR_VERSION = 1;
+
+/**
+ * Terrain values shared by all chunks stacked in one chunk column, indexed by x * SIZE_Z + z
+ */
+struct ChunkColumn {
+    int heights_[SIZE_X * SIZE_Z];
+    unsigned char biomes_[SIZE_X * SIZE_Z];
+    bool trees_[SIZE_X * SIZE_Z];
+};
+
+/**
+ * Ore and cave noise of every block of a chunk, indexed like Chunk::GetBlockIndex.
+ * Computed once per chunk and read by both the terrain and the cave pass
+ */
+struct ChunkDensity {
+    float ore_[CHUNK_VOXEL_COUNT];
+    float caves_[CHUNK_VOXEL_COUNT];
+};
+
+/**
+ * Terrain generation. Immutable between SetSeed calls, every method may be used from any WorkQueue thread
+ */
 class ChunkGenerator : public Object {
     URHO3D_OBJECT(ChunkGenerator, Object);
     ChunkGenerator(Context* context);
@@ -14,12 +45,63 @@ class ChunkGenerator : public Object {
 public:
     static void RegisterObject(Context* context);
     int GetTerrainHeight(const Vector3& blockPosition);
+    /**
+     * Surface heights of the block columns in region, left/right along x and top/bottom along z,
+     * written x-major to heights
+     */
+    void GetTerrainHeights(const IntRect& region, int* heights);
+    /**
+     * Copy the column values of the chunk column, computed once and cached. Safe to call from worker threads
+     */
+    void GetColumn(int chunkX, int chunkZ, ChunkColumn& column);
     BlockType GetBlockType(const Vector3& blockPosition, int surfaceHeight);
+    BlockType GetBlockType(const Vector3& blockPosition, int surfaceHeight, Biome biome);
     BlockType GetCaveBlockType(const Vector3& blockPosition, BlockType currentBlock);
+    /**
+     * Ore and cave density of the chunk at chunkPosition. Step 1 evaluates the noise of every block exactly,
+     * larger steps sample a lattice every step blocks and interpolate trilinearly in between
+     */
+    void GetDensity(const Vector3& chunkPosition, int step, ChunkDensity& density);
+    /**
+     * GetBlockType of every block in the chunk at chunkPosition, ore noise taken from density
+     */
+    void GetBlockTypes(const Vector3& chunkPosition, const ChunkColumn& column, const ChunkDensity& density, BlockType* blocks);
+    /**
+     * GetCaveBlockType of every block of a chunk, cave noise taken from density
+     */
+    void ApplyCaves(const ChunkDensity& density, BlockType* blocks);
     bool HaveTree(const Vector3& blockPosition);
     Biome GetBiomeType(const Vector3& blockPosition);
+    /**
+     * Reseed the noise, waits for queued work first so that no worker reads the tables meanwhile
+     */
     void SetSeed(int seed);
+    int GetSeed() const { return seed_; }
+    void ClearColumnCache();
+    /**
+     * Density lattice step used by Chunk::Load, a divisor of the chunk size. Only chunks generated afterwards change,
+     * waits for queued work like SetSeed
+     */
+    void SetDensityStep(int step);
+    int GetDensityStep() const { return densityStep_; }
+    unsigned GetColumnCacheHits() const { return columnHits_; }
+    unsigned GetColumnCacheMisses() const { return columnMisses_; }
+    void ResetColumnCacheStats();
 private:
+    int GetTerrainHeight(double x, double z);
+    /**
+     * octaveNoise * 0.5 + 0.5 of points x points samples (originA + a * step) / smoothness, (originB + b * step) / smoothness, a-major
+     */
+    void GetNoisePlane(float originA, float originB, int step, int points, float smoothness, int octaves, float* result);
+
     PerlinNoise perlin_;
     SimplexNoise simplexNoise_;
+    // Recently used columns in insertion order, the oldest is dropped first
+    HashMap<IntVector2, ChunkColumn> columns_;
+    Mutex columnMutex_;
+    unsigned columnLimit_{1024};
+    unsigned columnHits_{0};
+    unsigned columnMisses_{0};
+    int densityStep_{1};
+    int seed_{0};
 };
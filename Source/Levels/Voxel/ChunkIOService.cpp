@@ -0,0 +1,269 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include "ChunkIOService.h"
+#include "ChunkStorage.h"
+#include "EditJournal.h"
+#include "VoxelEvents.h"
+
+using namespace VoxelEvents;
+
+ChunkIOService::ChunkIOService(Context* context):
+    Object(context)
+{
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(ChunkIOService, HandleUpdate));
+    Run();
+}
+
+ChunkIOService::~ChunkIOService()
+{
+    Stop();
+    // Anything still queued must reach the disk before the world goes away
+    Flush();
+}
+
+void ChunkIOService::RegisterObject(Context* context)
+{
+    context->RegisterFactory<ChunkIOService>();
+}
+
+void ChunkIOService::RequestLoad(const IntVector3& chunkPosition, int priority)
+{
+    MutexLock lock(queueMutex_);
+    auto it = readQueue_.Find(chunkPosition);
+    if (it != readQueue_.End()) {
+        (*it).second_.priority_ = Min((*it).second_.priority_, priority);
+        return;
+    }
+    ChunkReadRequest request;
+    request.priority_ = priority;
+    request.requestTime_ = Time::GetSystemTime();
+    readQueue_[chunkPosition] = request;
+}
+
+void ChunkIOService::CancelLoad(const IntVector3& chunkPosition)
+{
+    MutexLock lock(queueMutex_);
+    readQueue_.Erase(chunkPosition);
+}
+
+void ChunkIOService::RequestSave(const IntVector3& chunkPosition, const PODVector<unsigned char>& data, bool edits)
+{
+    MutexLock lock(queueMutex_);
+    auto it = writeQueue_.Find(chunkPosition);
+    if (it != writeQueue_.End()) {
+        // Coalesce, keep the original request time so latency covers the whole wait
+        (*it).second_.data_ = data;
+        (*it).second_.edits_ = edits;
+        return;
+    }
+    ChunkWriteRequest request;
+    request.data_ = data;
+    request.edits_ = edits;
+    request.requestTime_ = Time::GetSystemTime();
+    writeQueue_[chunkPosition] = request;
+}
+
+unsigned ChunkIOService::GetReadQueueSize()
+{
+    MutexLock lock(queueMutex_);
+    return readQueue_.Size();
+}
+
+unsigned ChunkIOService::GetWriteQueueSize()
+{
+    MutexLock lock(queueMutex_);
+    return writeQueue_.Size();
+}
+
+void ChunkIOService::ThreadFunction()
+{
+    while (shouldRun_) {
+        bool processed = ProcessRead();
+        processed = ProcessWrite() || processed;
+        processed = ProcessJournal() || processed;
+        if (!processed) {
+            Time::Sleep(1);
+        }
+    }
+}
+
+void ChunkIOService::Flush()
+{
+    while (ProcessWrite()) {
+    }
+}
+
+bool ChunkIOService::ProcessRead()
+{
+    IntVector3 position;
+    ChunkIOResult result;
+    unsigned requestTime;
+    {
+        MutexLock lock(queueMutex_);
+        if (readQueue_.Empty()) {
+            return false;
+        }
+        auto next = readQueue_.Begin();
+        for (auto it = readQueue_.Begin(); it != readQueue_.End(); ++it) {
+            if ((*it).second_.priority_ < (*next).second_.priority_) {
+                next = it;
+            }
+        }
+        position = (*next).first_;
+        requestTime = (*next).second_.requestTime_;
+        readQueue_.Erase(next);
+
+        // Chunk is still waiting to be written, serve the newest snapshot
+        auto pendingWrite = writeQueue_.Find(position);
+        if (pendingWrite != writeQueue_.End()) {
+            result.position_ = position;
+            result.found_ = true;
+            result.isWrite_ = false;
+            result.data_ = (*pendingWrite).second_.data_;
+            result.edits_ = (*pendingWrite).second_.edits_;
+            completed_.Push(result);
+            readCount_++;
+            return true;
+        }
+    }
+
+    BlockType voxels[CHUNK_VOXEL_COUNT];
+    PODVector<BlockEdit> edits;
+    auto storage = GetSubsystem<ChunkStorage>();
+    ChunkRecord record = storage ? storage->LoadChunk(position, voxels, edits) : CR_MISSING;
+    result.position_ = position;
+    result.isWrite_ = false;
+    // Unreadable chunks are generated again like missing ones
+    result.found_ = record == CR_BLOCKS || record == CR_EDITS;
+    if (record == CR_BLOCKS) {
+        result.data_.Resize(CHUNK_VOXEL_COUNT);
+        for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+            result.data_[i] = static_cast<unsigned char>(voxels[i]);
+        }
+    } else if (record == CR_EDITS) {
+        VectorBuffer buffer;
+        ChunkStorage::EncodeEdits(edits, buffer);
+        result.data_ = buffer.GetBuffer();
+        result.edits_ = true;
+    }
+
+    MutexLock lock(queueMutex_);
+    completed_.Push(result);
+    readCount_++;
+    readLatencyTotal_ += Time::GetSystemTime() - requestTime;
+    return true;
+}
+
+bool ChunkIOService::ProcessWrite()
+{
+    IntVector3 position;
+    ChunkWriteRequest request;
+    {
+        MutexLock lock(queueMutex_);
+        if (writeQueue_.Empty()) {
+            return false;
+        }
+        auto next = writeQueue_.Begin();
+        position = (*next).first_;
+        request = (*next).second_;
+        writeQueue_.Erase(next);
+    }
+
+    auto storage = GetSubsystem<ChunkStorage>();
+    if (storage && request.edits_) {
+        PODVector<BlockEdit> edits;
+        MemoryBuffer buffer(request.data_);
+        if (ChunkStorage::DecodeEdits(buffer, edits)) {
+            storage->SaveChunkEdits(position, edits);
+        }
+    } else if (storage) {
+        BlockType voxels[CHUNK_VOXEL_COUNT];
+        for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+            voxels[i] = static_cast<BlockType>(request.data_[i]);
+        }
+        storage->SaveChunk(position, voxels);
+    }
+
+    ChunkIOResult result;
+    result.position_ = position;
+    result.found_ = true;
+    result.isWrite_ = true;
+
+    MutexLock lock(queueMutex_);
+    completed_.Push(result);
+    writeCount_++;
+    writeLatencyTotal_ += Time::GetSystemTime() - request.requestTime_;
+    return true;
+}
+
+bool ChunkIOService::ProcessJournal()
+{
+    auto journal = GetSubsystem<EditJournal>();
+    if (!journal || !journal->IsOpen()) {
+        return false;
+    }
+    bool processed = journal->Sync();
+    if (!journal->IsCompactionDue()) {
+        return processed;
+    }
+    {
+        // Queued chunk snapshots may be older than the journal, folding it before they are written would
+        // let them overwrite its edits. Saves requested after the rotation already contain all moved edits
+        MutexLock lock(queueMutex_);
+        if (!writeQueue_.Empty()) {
+            return processed;
+        }
+        journal->Rotate();
+    }
+    journal->Compact();
+    return true;
+}
+
+void ChunkIOService::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    List<ChunkIOResult> completed;
+    {
+        MutexLock lock(queueMutex_);
+        completed.Swap(completed_);
+        if (GetSubsystem<DebugHud>()) {
+            GetSubsystem<DebugHud>()->SetAppStats("ChunkIO read queue", readQueue_.Size());
+            GetSubsystem<DebugHud>()->SetAppStats("ChunkIO write queue", writeQueue_.Size());
+            GetSubsystem<DebugHud>()->SetAppStats("ChunkIO reads", readCount_);
+            GetSubsystem<DebugHud>()->SetAppStats("ChunkIO writes", writeCount_);
+            if (GetSubsystem<ChunkStorage>()) {
+                GetSubsystem<DebugHud>()->SetAppStats("ChunkIO KB written", (unsigned)(GetSubsystem<ChunkStorage>()->GetBytesWritten() / 1024));
+            }
+            auto journal = GetSubsystem<EditJournal>();
+            if (journal) {
+                GetSubsystem<DebugHud>()->SetAppStats("Journal edits", journal->GetJournalCount());
+                GetSubsystem<DebugHud>()->SetAppStats("Journal syncs", journal->GetSyncCount());
+                GetSubsystem<DebugHud>()->SetAppStats("Journal edits folded", journal->GetCompactedCount());
+            }
+            GetSubsystem<DebugHud>()->SetAppStats("ChunkIO avg read latency ms", readCount_ ? (float)readLatencyTotal_ / readCount_ : 0.0f);
+            GetSubsystem<DebugHud>()->SetAppStats("ChunkIO avg write latency ms", writeCount_ ? (float)writeLatencyTotal_ / writeCount_ : 0.0f);
+        }
+    }
+
+    for (auto it = completed.Begin(); it != completed.End(); ++it) {
+        Vector3 position((*it).position_.x_ * SIZE_X, (*it).position_.y_ * SIZE_Y, (*it).position_.z_ * SIZE_Z);
+        if ((*it).isWrite_) {
+            using namespace ChunkIOSaved;
+            VariantMap& data = GetEventDataMap();
+            data[P_POSITION] = position;
+            SendEvent(E_CHUNK_IO_SAVED, data);
+        } else {
+            using namespace ChunkIOLoaded;
+            VariantMap& data = GetEventDataMap();
+            data[P_POSITION] = position;
+            data[P_FOUND] = (*it).found_;
+            data[P_DATA] = (*it).data_;
+            data[P_EDITS] = (*it).edits_;
+            SendEvent(E_CHUNK_IO_LOADED, data);
+        }
+    }
+}
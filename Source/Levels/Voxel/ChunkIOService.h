@@ -0,0 +1,88 @@
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/List.h>
+#include "VoxelDefs.h"
+#include "Chunk.h"
+
+using namespace Urho3D;
+
+struct ChunkReadRequest {
+    int priority_;
+    unsigned requestTime_;
+};
+
+struct ChunkWriteRequest {
+    PODVector<unsigned char> data_;
+    // Data is a ChunkStorage::EncodeEdits payload instead of block types
+    bool edits_{false};
+    unsigned requestTime_;
+};
+
+struct ChunkIOResult {
+    IntVector3 position_;
+    bool found_;
+    bool isWrite_;
+    PODVector<unsigned char> data_;
+    bool edits_{false};
+};
+
+/**
+ * Dedicated disk thread for chunk persistence.
+ * Reads are served nearest-first, writes are queued behind and coalesced per chunk.
+ * Completed requests are dispatched as events on the main thread.
+ * Also syncs the EditJournal and folds it into the chunk storage.
+ * Never touches the voxel world, only ChunkStorage.
+ */
+class ChunkIOService : public Object, public Thread {
+    URHO3D_OBJECT(ChunkIOService, Object);
+    ChunkIOService(Context* context);
+    virtual ~ChunkIOService();
+
+public:
+    static void RegisterObject(Context* context);
+
+    /**
+     * Queue chunk read, lower priority value is served first
+     */
+    void RequestLoad(const IntVector3& chunkPosition, int priority);
+
+    /**
+     * Drop pending read of the chunk
+     */
+    void CancelLoad(const IntVector3& chunkPosition);
+
+    /**
+     * Queue chunk write, replaces previous unwritten snapshot of the same chunk.
+     * Data holds CHUNK_VOXEL_COUNT block types, or the encoded player edits when edits is set
+     */
+    void RequestSave(const IntVector3& chunkPosition, const PODVector<unsigned char>& data, bool edits = false);
+
+    /**
+     * Write out all pending chunks on the calling thread
+     */
+    void Flush();
+
+    unsigned GetReadQueueSize();
+    unsigned GetWriteQueueSize();
+
+    virtual void ThreadFunction() override;
+
+private:
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    bool ProcessRead();
+    bool ProcessWrite();
+    bool ProcessJournal();
+
+    HashMap<IntVector3, ChunkReadRequest> readQueue_;
+    HashMap<IntVector3, ChunkWriteRequest> writeQueue_;
+    List<ChunkIOResult> completed_;
+    Mutex queueMutex_;
+
+    unsigned readCount_{0};
+    unsigned writeCount_{0};
+    unsigned readLatencyTotal_{0};
+    unsigned writeLatencyTotal_{0};
+};
@@ -0,0 +1,190 @@
+#include <queue>
+#include "ChunkLightTask.h"
+#include "Chunk.h"
+#include "LightManager.h"
+
+struct QueuedBlock {
+    QueuedBlock(int x, int y, int z, int level): x_(x), y_(y), z_(z), level_(level) {}
+    short x_;
+    short y_;
+    short z_;
+    short level_;
+};
+
+static int GetLight(Chunk* chunk, LightChannel channel, int x, int y, int z)
+{
+    return channel == LC_SUN ? chunk->GetSunlight(x, y, z) : chunk->GetTorchlight(x, y, z);
+}
+
+static void SetLight(Chunk* chunk, LightChannel channel, int x, int y, int z, int value)
+{
+    if (channel == LC_SUN) {
+        chunk->SetSunlight(x, y, z, value);
+    } else {
+        chunk->SetTorchlight(x, y, z, value);
+    }
+}
+
+/**
+ * Light level a block of the given type receives from an adjacent source block
+ */
+static int GetSpreadLevel(LightChannel channel, BlockType type, int sourceLevel, bool down)
+{
+    if (!LightManager::IsTransparent(type)) {
+        return 0;
+    }
+    if (type == BT_WATER) {
+        // Light in water will fade out a bit quicker
+        return sourceLevel - 2;
+    }
+    if (channel == LC_SUN && down && sourceLevel == 15) {
+        // Direct sunlight travels down without fading
+        return 15;
+    }
+    return sourceLevel - 1;
+}
+
+static void ApplyRemoval(Chunk* chunk, LightChannel channel, int x, int y, int z, int sourceLevel, bool down,
+                         std::queue<QueuedBlock>& removal, std::queue<QueuedBlock>& spread)
+{
+    int level = GetLight(chunk, channel, x, y, z);
+    // Full sunlight below came straight down the removed column
+    bool column = channel == LC_SUN && down && sourceLevel == 15;
+    if (level != 0 && (level < sourceLevel || column)) {
+        SetLight(chunk, channel, x, y, z, 0);
+        removal.emplace(x, y, z, level);
+    } else if (level >= sourceLevel) {
+        // Lit from elsewhere, spread it back into the cleared area
+        spread.emplace(x, y, z, level);
+    }
+}
+
+static void ApplySpread(Chunk* chunk, LightChannel channel, int x, int y, int z, int level, std::queue<QueuedBlock>& spread)
+{
+    if (level > GetLight(chunk, channel, x, y, z)) {
+        SetLight(chunk, channel, x, y, z, level);
+        spread.emplace(x, y, z, level);
+    }
+}
+
+Chunk* ChunkLightTask::StepToNeighbor(Chunk* chunk, BlockSide side, int& x, int& y, int& z)
+{
+    switch (side) {
+        case BlockSide::LEFT:
+            if (--x >= 0) {
+                return chunk;
+            }
+            x = SIZE_X - 1;
+            break;
+        case BlockSide::RIGHT:
+            if (++x < SIZE_X) {
+                return chunk;
+            }
+            x = 0;
+            break;
+        case BlockSide::BOTTOM:
+            if (--y >= 0) {
+                return chunk;
+            }
+            y = SIZE_Y - 1;
+            break;
+        case BlockSide::TOP:
+            if (++y < SIZE_Y) {
+                return chunk;
+            }
+            y = 0;
+            break;
+        case BlockSide::FRONT:
+            if (--z >= 0) {
+                return chunk;
+            }
+            z = SIZE_Z - 1;
+            break;
+        case BlockSide::BACK:
+            if (++z < SIZE_Z) {
+                return chunk;
+            }
+            z = 0;
+            break;
+    }
+    Chunk* neighbor = chunk->GetNeighbor(side);
+    return neighbor && neighbor->IsLoaded() ? neighbor : nullptr;
+}
+
+void ChunkLightTask::Run(Chunk* chunk)
+{
+    std::queue<QueuedBlock> removal[2];
+    std::queue<QueuedBlock> spread[2];
+    processedNodes_ = 0;
+    outbox_.Clear();
+
+    // Removals go first so that only surviving light is spread, same as the serial pass
+    for (auto it = inbox_.Begin(); it != inbox_.End(); ++it) {
+        if ((*it).type_ == LV_SEED_REMOVAL) {
+            removal[(*it).channel_].emplace((*it).x_, (*it).y_, (*it).z_, (*it).level_);
+        } else if ((*it).type_ == LV_REMOVAL) {
+            ApplyRemoval(chunk, (*it).channel_, (*it).x_, (*it).y_, (*it).z_, (*it).level_, (*it).down_,
+                         removal[(*it).channel_], spread[(*it).channel_]);
+        }
+    }
+
+    for (int channelIndex = 0; channelIndex < 2; channelIndex++) {
+        LightChannel channel = static_cast<LightChannel>(channelIndex);
+        while (!removal[channel].empty()) {
+            QueuedBlock node = removal[channel].front();
+            removal[channel].pop();
+            processedNodes_++;
+            for (int i = 0; i < 6; i++) {
+                BlockSide side = static_cast<BlockSide>(i);
+                int dX = node.x_;
+                int dY = node.y_;
+                int dZ = node.z_;
+                Chunk* target = StepToNeighbor(chunk, side, dX, dY, dZ);
+                if (target == chunk) {
+                    ApplyRemoval(chunk, channel, dX, dY, dZ, node.level_, side == BlockSide::BOTTOM, removal[channel], spread[channel]);
+                } else if (target) {
+                    outbox_.Push(LightVisit(target->GetHandle(), dX, dY, dZ, node.level_, channel, LV_REMOVAL, side == BlockSide::BOTTOM));
+                }
+            }
+        }
+    }
+
+    for (auto it = inbox_.Begin(); it != inbox_.End(); ++it) {
+        LightChannel channel = (*it).channel_;
+        if ((*it).type_ == LV_SEED_SPREAD) {
+            spread[channel].emplace((*it).x_, (*it).y_, (*it).z_, 0);
+        } else if ((*it).type_ == LV_SPREAD) {
+            BlockType type = chunk->GetBlockValue((*it).x_, (*it).y_, (*it).z_);
+            int level = GetSpreadLevel(channel, type, (*it).level_, (*it).down_);
+            ApplySpread(chunk, channel, (*it).x_, (*it).y_, (*it).z_, level, spread[channel]);
+        }
+    }
+    inbox_.Clear();
+
+    for (int channelIndex = 0; channelIndex < 2; channelIndex++) {
+        LightChannel channel = static_cast<LightChannel>(channelIndex);
+        while (!spread[channel].empty()) {
+            QueuedBlock node = spread[channel].front();
+            spread[channel].pop();
+            processedNodes_++;
+            // Current level, the block may have been brightened after it was queued
+            int level = GetLight(chunk, channel, node.x_, node.y_, node.z_);
+            if (level <= 1) {
+                continue;
+            }
+            for (int i = 0; i < 6; i++) {
+                BlockSide side = static_cast<BlockSide>(i);
+                int dX = node.x_;
+                int dY = node.y_;
+                int dZ = node.z_;
+                Chunk* target = StepToNeighbor(chunk, side, dX, dY, dZ);
+                if (target == chunk) {
+                    int newLevel = GetSpreadLevel(channel, chunk->GetBlockValue(dX, dY, dZ), level, side == BlockSide::BOTTOM);
+                    ApplySpread(chunk, channel, dX, dY, dZ, newLevel, spread[channel]);
+                } else if (target) {
+                    outbox_.Push(LightVisit(target->GetHandle(), dX, dY, dZ, level, channel, LV_SPREAD, side == BlockSide::BOTTOM));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include "VoxelDefs.h"
+
+using namespace Urho3D;
+
+class Chunk;
+
+enum LightChannel {
+    LC_TORCH,
+    LC_SUN
+};
+
+enum LightVisitType {
+    // Block already holds its light, spread it further
+    LV_SEED_SPREAD,
+    // Block light was already cleared, level_ is the removed value
+    LV_SEED_REMOVAL,
+    // Light arriving from a neighbor chunk, level_ is the source block level
+    LV_SPREAD,
+    // Removal arriving from a neighbor chunk, level_ is the source block level
+    LV_REMOVAL
+};
+
+struct LightVisit {
+    LightVisit() {}
+    LightVisit(const ChunkHandle& chunk, int x, int y, int z, int level, LightChannel channel, LightVisitType type, bool down = false):
+        chunk_(chunk), x_(x), y_(y), z_(z), level_(level), channel_(channel), type_(type), down_(down) {}
+    ChunkHandle chunk_;
+    short x_;
+    short y_;
+    short z_;
+    short level_;
+    LightChannel channel_;
+    LightVisitType type_;
+    // Light travelled downwards, keeps full sunlight
+    bool down_;
+};
+
+/**
+ * Light propagation work of a single chunk for one wave.
+ * Only the owning chunk is modified, light crossing the border is
+ * collected in the outbox and handed to the neighbor in the next wave
+ */
+class ChunkLightTask : public RefCounted {
+public:
+    ChunkLightTask(const ChunkHandle& chunk): chunk_(chunk) {}
+
+    void Run(Chunk* chunk);
+
+    /**
+     * Move from the block to the adjacent one on the given side.
+     * Returns the chunk owning the adjacent block or null when that chunk is not loaded
+     */
+    static Chunk* StepToNeighbor(Chunk* chunk, BlockSide side, int& x, int& y, int& z);
+
+    ChunkHandle chunk_;
+    PODVector<LightVisit> inbox_;
+    PODVector<LightVisit> outbox_;
+    // Blocks handled during the last run
+    unsigned processedNodes_{0};
+};
@@ -0,0 +1,129 @@
+#include "ChunkMap.h"
+#include "Chunk.h"
+
+static const unsigned INITIAL_CAPACITY = 256;
+
+ChunkMap::ChunkMap()
+{
+    slots_.Resize(INITIAL_CAPACITY);
+}
+
+unsigned long long ChunkMap::PackKey(const IntVector3& coordinates)
+{
+    const unsigned long long mask = 0x1FFFFF;
+    const int bias = 1 << 20;
+    return (static_cast<unsigned long long>(coordinates.x_ + bias) & mask)
+           | ((static_cast<unsigned long long>(coordinates.y_ + bias) & mask) << 21)
+           | ((static_cast<unsigned long long>(coordinates.z_ + bias) & mask) << 42);
+}
+
+unsigned ChunkMap::GetHomeSlot(unsigned long long key) const
+{
+    // Fibonacci hashing spreads neighboring coordinates over the table
+    return static_cast<unsigned>((key * 0x9E3779B97F4A7C15ULL) >> 32) & (slots_.Size() - 1);
+}
+
+Chunk* ChunkMap::Find(const IntVector3& coordinates) const
+{
+    unsigned long long key = PackKey(coordinates);
+    unsigned mask = slots_.Size() - 1;
+    for (unsigned i = GetHomeSlot(key); slots_[i].chunk_; i = (i + 1) & mask) {
+        if (slots_[i].key_ == key) {
+            return slots_[i].chunk_.Get();
+        }
+    }
+    return nullptr;
+}
+
+bool ChunkMap::Contains(const IntVector3& coordinates) const
+{
+    return Find(coordinates) != nullptr;
+}
+
+void ChunkMap::Insert(const IntVector3& coordinates, Chunk* chunk)
+{
+    if (!chunk) {
+        return;
+    }
+    // Keep load factor at or below one half so probe sequences stay short
+    if ((size_ + 1) * 2 > slots_.Size()) {
+        Grow();
+    }
+
+    unsigned long long key = PackKey(coordinates);
+    unsigned mask = slots_.Size() - 1;
+    unsigned i = GetHomeSlot(key);
+    while (slots_[i].chunk_) {
+        if (slots_[i].key_ == key) {
+            slots_[i].chunk_ = chunk;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    slots_[i].key_ = key;
+    slots_[i].chunk_ = chunk;
+    size_++;
+}
+
+bool ChunkMap::Erase(const IntVector3& coordinates)
+{
+    unsigned long long key = PackKey(coordinates);
+    unsigned mask = slots_.Size() - 1;
+    unsigned i = GetHomeSlot(key);
+    while (slots_[i].chunk_ && slots_[i].key_ != key) {
+        i = (i + 1) & mask;
+    }
+    if (!slots_[i].chunk_) {
+        return false;
+    }
+
+    slots_[i].chunk_.Reset();
+    size_--;
+
+    // Backward shift deletion, move following entries into the hole when their probe sequence allows it
+    unsigned j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!slots_[j].chunk_) {
+            break;
+        }
+        unsigned home = GetHomeSlot(slots_[j].key_);
+        bool canMove = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if (canMove) {
+            slots_[i].key_ = slots_[j].key_;
+            slots_[i].chunk_ = slots_[j].chunk_;
+            slots_[j].chunk_.Reset();
+            i = j;
+        }
+    }
+    return true;
+}
+
+void ChunkMap::Clear()
+{
+    slots_.Clear();
+    slots_.Resize(INITIAL_CAPACITY);
+    size_ = 0;
+}
+
+void ChunkMap::Grow()
+{
+    Vector<Slot> oldSlots;
+    oldSlots.Swap(slots_);
+    slots_.Resize(oldSlots.Size() * 2);
+    size_ = 0;
+
+    unsigned mask = slots_.Size() - 1;
+    for (auto it = oldSlots.Begin(); it != oldSlots.End(); ++it) {
+        if (!(*it).chunk_) {
+            continue;
+        }
+        unsigned i = GetHomeSlot((*it).key_);
+        while (slots_[i].chunk_) {
+            i = (i + 1) & mask;
+        }
+        slots_[i].key_ = (*it).key_;
+        slots_[i].chunk_ = (*it).chunk_;
+        size_++;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+class Chunk;
+
+/**
+ * Chunk index keyed by chunk coordinates packed into 64 bits.
+ * Open addressing with linear probing, lookups never allocate.
+ * Slots can be iterated by index, Erase may move entries between slots
+ */
+class ChunkMap {
+public:
+    ChunkMap();
+
+    /**
+     * Pack chunk coordinates into a single key, 21 bits per axis
+     */
+    static unsigned long long PackKey(const IntVector3& coordinates);
+
+    Chunk* Find(const IntVector3& coordinates) const;
+    bool Contains(const IntVector3& coordinates) const;
+    void Insert(const IntVector3& coordinates, Chunk* chunk);
+    bool Erase(const IntVector3& coordinates);
+    void Clear();
+
+    unsigned Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    /**
+     * Slot count, use with GetSlot to iterate all chunks
+     */
+    unsigned GetCapacity() const { return slots_.Size(); }
+
+    /**
+     * Chunk stored in the slot or null when the slot is empty
+     */
+    Chunk* GetSlot(unsigned index) const { return slots_[index].chunk_.Get(); }
+
+private:
+    struct Slot {
+        unsigned long long key_{0};
+        SharedPtr<Chunk> chunk_;
+    };
+
+    unsigned GetHomeSlot(unsigned long long key) const;
+    void Grow();
+
+    Vector<Slot> slots_;
+    unsigned size_{0};
+};
@@ -44,54 +44,43 @@ void ChunkMesh::RegisterObject(Context* context)
     context->RegisterFactory<ChunkMesh>();
 }
 
-void ChunkMesh::WriteToVertexBuffer()
+static_assert(sizeof(MeshVertex) == 8, "MeshVertex must stay packed");
+
+const PODVector<VertexElement>& ChunkMesh::GetVertexElements()
 {
-    unsigned elementMask = MASK_POSITION | MASK_NORMAL | MASK_COLOR | MASK_TEXCOORD1;
-    vb_->SetSize(vertices_.Size(), elementMask, false);
-    vb_->SetShadowed(true);
+    static PODVector<VertexElement> elements;
+    if (elements.Empty()) {
+        // x, y, z, face
+        elements.Push(VertexElement(TYPE_UBYTE4, SEM_POSITION));
+        // u, v, light, tile
+        elements.Push(VertexElement(TYPE_UBYTE4, SEM_COLOR));
+    }
+    return elements;
+}
+
+// Smallest buffer size, avoids reallocating for small meshes
+static const unsigned MIN_BUFFER_SIZE = 64;
 
+/**
+ * Buffer size to use for count elements, keeps the current one unless it is too small or far too big
+ */
+static unsigned GetBufferSize(unsigned current, unsigned count)
+{
+    if (count <= current && (current <= MIN_BUFFER_SIZE || count * 4 > current)) {
+        return current;
+    }
+    return Max(NextPowerOfTwo(count), MIN_BUFFER_SIZE);
+}
+
+void ChunkMesh::WriteToVertexBuffer()
+{
+    unsigned size = GetBufferSize(vb_->GetVertexCount(), vertices_.Size());
+    if (size != vb_->GetVertexCount()) {
+        vb_->SetShadowed(true);
+        vb_->SetSize(size, GetVertexElements(), false);
+    }
     if (!vertices_.Empty()) {
-        unsigned char *dest = (unsigned char *) vb_->Lock(0, vertices_.Size(), true);
-
-        if (dest) {
-            for (auto i = 0; i < vertices_.Size(); ++i) {
-                if (elementMask & MASK_POSITION) {
-                    *((Vector3 *) dest) = vertices_[i].position_;
-                    dest += sizeof(Vector3);
-                }
-                if (elementMask & MASK_NORMAL) {
-                    *((Vector3 *) dest) = vertices_[i].normal_;
-                    dest += sizeof(Vector3);
-                }
-                if (elementMask & MASK_COLOR) {
-                    *((unsigned *) dest) = vertices_[i].color_.ToUInt();
-                    dest += sizeof(unsigned);
-                }
-                if (elementMask & MASK_TEXCOORD1) {
-                    *((Vector2 *) dest) = vertices_[i].uv_;
-                    dest += sizeof(Vector2);
-                }
-//            if (elementMask & MASK_TEXCOORD2) {
-//                *((Vector2*)dest) = vertices_[i].texCoord2_;
-//                dest += sizeof(Vector2);
-//            }
-//            if (elementMask & MASK_CUBETEXCOORD1) {
-//                *((Vector3*)dest) = vertices_[i].cubeTexCoord1_;
-//                dest += sizeof(Vector3);
-//            }
-//            if (elementMask & MASK_CUBETEXCOORD2) {
-//                *((Vector3*)dest) = vertices_[i].cubeTexCoord2_;
-//                dest += sizeof(Vector3);
-//            }
-//            if (elementMask & MASK_TANGENT) {
-//                *((Vector4*)dest) = vertices_[i].tangent_;
-//                dest += sizeof(Vector4);
-//            }
-            }
-        } else {
-            URHO3D_LOGERROR("Failed to lock vertex buffer");
-        }
-        vb_->Unlock();
+        vb_->SetDataRange(vertices_.Buffer(), 0, vertices_.Size());
     }
 }
 
@@ -107,10 +96,13 @@ void ChunkMesh::AddIndice(short index)
 
 void ChunkMesh::WriteToIndexBuffer()
 {
-    ib_->SetShadowed(true);
-    ib_->SetSize(indices_.Size(), false);
+    unsigned size = GetBufferSize(ib_->GetIndexCount(), indices_.Size());
+    if (size != ib_->GetIndexCount()) {
+        ib_->SetShadowed(true);
+        ib_->SetSize(size, false);
+    }
     if (!indices_.Empty()) {
-        ib_->SetData(indices_.Buffer());
+        ib_->SetDataRange(indices_.Buffer(), 0, indices_.Size());
     }
 }
 
@@ -130,19 +122,37 @@ unsigned ChunkMesh::GetVertexCount()
     return vertices_.Size();
 }
 
+unsigned ChunkMesh::GetIndexCount()
+{
+    return indices_.Size();
+}
+
 void ChunkMesh::Clear()
 {
     indices_.Clear();
     vertices_.Clear();
 }
 
-SharedPtr<Geometry> ChunkMesh::GetGeometry()
+void ChunkMesh::Upload()
 {
     WriteToVertexBuffer();
     WriteToIndexBuffer();
+
+    // Physics and octree raycasts expect float positions, keep them only on the CPU side
+    unsigned vertexCount = vertices_.Size();
+    if (vertexCount > rawPositionCapacity_ || !rawPositions_) {
+        rawPositionCapacity_ = Max(NextPowerOfTwo(vertexCount), MIN_BUFFER_SIZE);
+        rawPositions_ = new unsigned char[rawPositionCapacity_ * sizeof(Vector3)];
+        PODVector<VertexElement> rawElements;
+        rawElements.Push(VertexElement(TYPE_VECTOR3, SEM_POSITION));
+        geometry_->SetRawVertexData(rawPositions_, rawElements);
+    }
+    Vector3* dest = reinterpret_cast<Vector3*>(rawPositions_.Get());
+    for (unsigned i = 0; i < vertexCount; ++i) {
+        dest[i] = Vector3(vertices_[i].x_, vertices_[i].y_, vertices_[i].z_);
+    }
+
     geometry_->SetVertexBuffer(0, vb_);
     geometry_->SetIndexBuffer(ib_);
     geometry_->SetDrawRange(TRIANGLE_LIST, 0, indices_.Size(), 0, vertices_.Size());
-
-    return geometry_;
-}
\ No newline at end of file
+}
@@ -15,13 +15,23 @@
 
 using namespace Urho3D;
 
+/**
+ * Packed chunk vertex, 8 bytes.
+ * Positions are chunk local and never exceed the chunk size, so a byte per axis is enough
+ */
 struct MeshVertex {
-    MeshVertex() {}
-    MeshVertex(Vector3 p, Vector3 n, Color c, Vector2 u): position_(p), normal_(n), color_(c), uv_(u) {}
-    Vector3 position_;
-    Vector3 normal_;
-    Color color_;
-    Vector2 uv_;
+    unsigned char x_;
+    unsigned char y_;
+    unsigned char z_;
+    // BlockSide of the face, replaces the normal
+    unsigned char face_;
+    // Texture coordinates in block units, repeated inside the atlas tile
+    unsigned char u_;
+    unsigned char v_;
+    // Torchlight in the low nibble, sunlight in the high nibble
+    unsigned char light_;
+    // Atlas tile index, row * 6 + column
+    unsigned char tile_;
 };
 
 class ChunkMesh : public Object {
@@ -38,19 +48,36 @@ public:
     void AddIndice(short index);
 
     unsigned GetVertexCount();
+    unsigned GetIndexCount();
 
     void Clear();
 
     void WriteToVertexBuffer();
     void WriteToIndexBuffer();
 
-    SharedPtr<Geometry> GetGeometry();
+    /**
+     * Copy the mesh into the GPU buffers, they only grow or shrink when the size is far off
+     */
+    void Upload();
+
+    /**
+     * Geometry drawing the last upload, the same object for the lifetime of the mesh
+     */
+    SharedPtr<Geometry> GetGeometry() { return geometry_; }
+
+    /**
+     * Vertex layout used on the GPU, matches the PACKEDVERTEX shader variant
+     */
+    static const PODVector<VertexElement>& GetVertexElements();
 private:
     SharedPtr<VertexBuffer> vb_;
     SharedPtr<IndexBuffer> ib_;
 
-    Vector<MeshVertex> vertices_;
-    Vector<short> indices_;
+    PODVector<MeshVertex> vertices_;
+    PODVector<short> indices_;
 
     SharedPtr<Geometry> geometry_;
+    // Float positions for physics and raycasts, reused between uploads
+    SharedArrayPtr<unsigned char> rawPositions_;
+    unsigned rawPositionCapacity_{0};
 };
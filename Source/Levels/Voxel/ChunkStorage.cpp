@@ -0,0 +1,603 @@
+#include <cstdio>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include "ChunkStorage.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const String WORLD_HEADER_FILE = "world.bin";
+// File ID, version, seed, generator version, density step, persistence
+static const unsigned WORLD_HEADER_SIZE = 4 * 5 + 1;
+static const unsigned REGION_HEADER_SIZE = 8 + REGION_CHUNK_COUNT * 8;
+static const unsigned REGION_HEADER_SECTORS = (REGION_HEADER_SIZE + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+// Replaced payloads waiting for a sync before their sectors are reused
+static const unsigned REGION_RELEASE_SYNC_COUNT = 64;
+
+static int FloorDiv(int value, int divider)
+{
+    return value >= 0 ? value / divider : (value - divider + 1) / divider;
+}
+
+static int VoxelIndex(int x, int y, int z)
+{
+    return x * SIZE_Y * SIZE_Z + y * SIZE_Z + z;
+}
+
+RegionFile::RegionFile(Context* context):
+    context_(context)
+{
+    memset(offsets_, 0, sizeof(offsets_));
+    memset(lengths_, 0, sizeof(lengths_));
+}
+
+RegionFile::~RegionFile()
+{
+    if (file_) {
+        file_->Close();
+    }
+}
+
+bool RegionFile::Open(const String& fileName)
+{
+    if (!context_->GetSubsystem<FileSystem>()->FileExists(fileName)) {
+        // Create empty region with zeroed offset table
+        File newFile(context_, fileName, FILE_WRITE);
+        if (!newFile.IsOpen()) {
+            URHO3D_LOGERROR("Failed to create region file " + fileName);
+            return false;
+        }
+        newFile.WriteFileID("VXRG");
+        newFile.WriteUInt(REGION_FILE_VERSION);
+        PODVector<unsigned char> empty(REGION_HEADER_SECTORS * REGION_SECTOR_SIZE - 8);
+        memset(empty.Buffer(), 0, empty.Size());
+        newFile.Write(empty.Buffer(), empty.Size());
+        newFile.Close();
+    }
+
+    file_ = new File(context_, fileName, FILE_READWRITE);
+    if (!file_->IsOpen()) {
+        URHO3D_LOGERROR("Failed to open region file " + fileName);
+        return false;
+    }
+    if (file_->ReadFileID() != "VXRG" || file_->ReadUInt() != REGION_FILE_VERSION) {
+        URHO3D_LOGERROR("Invalid region file " + fileName);
+        file_->Close();
+        return false;
+    }
+    for (int i = 0; i < REGION_CHUNK_COUNT; i++) {
+        offsets_[i] = file_->ReadUInt();
+        lengths_[i] = file_->ReadUInt();
+    }
+
+    unsigned fileSectors = GetSectorCount(file_->GetSize());
+    usedSectors_.Resize(Max(fileSectors, REGION_HEADER_SECTORS));
+    for (unsigned i = 0; i < usedSectors_.Size(); i++) {
+        usedSectors_[i] = i < REGION_HEADER_SECTORS;
+    }
+    for (int i = 0; i < REGION_CHUNK_COUNT; i++) {
+        if (lengths_[i] > 0) {
+            if (offsets_[i] < REGION_HEADER_SECTORS || offsets_[i] + GetSectorCount(lengths_[i]) > usedSectors_.Size()) {
+                URHO3D_LOGERRORF("Region file %s has invalid entry %d, dropping it", fileName.CString(), i);
+                offsets_[i] = 0;
+                lengths_[i] = 0;
+                continue;
+            }
+            MarkSectors(offsets_[i], GetSectorCount(lengths_[i]), true);
+        }
+    }
+    return true;
+}
+
+bool RegionFile::Read(int index, PODVector<unsigned char>& payload)
+{
+    if (!file_ || !HasChunk(index)) {
+        return false;
+    }
+    payload.Resize(lengths_[index]);
+    file_->Seek(offsets_[index] * REGION_SECTOR_SIZE);
+    return file_->Read(payload.Buffer(), payload.Size()) == payload.Size();
+}
+
+bool RegionFile::Sync()
+{
+    if (!file_ || !ChunkStorage::SyncFile(file_)) {
+        return false;
+    }
+    // The offset table on the disk no longer points at the replaced payloads
+    for (auto it = releasedSectors_.Begin(); it != releasedSectors_.End(); ++it) {
+        MarkSectors((*it).x_, (*it).y_, false);
+    }
+    releasedSectors_.Clear();
+    return true;
+}
+
+bool RegionFile::Write(int index, const PODVector<unsigned char>& payload)
+{
+    if (!file_ || payload.Empty()) {
+        return false;
+    }
+    // The old payload stays untouched until the offset table points at the new one,
+    // a crash in between leaves the previous version of the chunk
+    unsigned sectorCount = GetSectorCount(payload.Size());
+    unsigned offset = AllocateSectors(sectorCount);
+
+    // Always write whole sectors so appended payloads keep the file sector aligned
+    PODVector<unsigned char> sectors(sectorCount * REGION_SECTOR_SIZE);
+    memset(sectors.Buffer(), 0, sectors.Size());
+    memcpy(sectors.Buffer(), payload.Buffer(), payload.Size());
+    file_->Seek(offset * REGION_SECTOR_SIZE);
+    if (file_->Write(sectors.Buffer(), sectors.Size()) != sectors.Size()) {
+        MarkSectors(offset, sectorCount, false);
+        return false;
+    }
+    file_->Flush();
+
+    if (HasChunk(index)) {
+        // Reused only after the next sync, until then the table on the disk may still point at them
+        releasedSectors_.Push(IntVector2(offsets_[index], GetSectorCount(lengths_[index])));
+    }
+    offsets_[index] = offset;
+    lengths_[index] = payload.Size();
+    file_->Seek(8 + index * 8);
+    file_->WriteUInt(offsets_[index]);
+    file_->WriteUInt(lengths_[index]);
+    file_->Flush();
+    if (releasedSectors_.Size() >= REGION_RELEASE_SYNC_COUNT) {
+        // Bounds the file growth when nobody else syncs the region
+        Sync();
+    }
+    return true;
+}
+
+unsigned RegionFile::GetSectorCount(unsigned length) const
+{
+    return (length + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+}
+
+unsigned RegionFile::AllocateSectors(unsigned count)
+{
+    // First fit inside the file
+    unsigned runStart = 0;
+    unsigned runLength = 0;
+    for (unsigned i = REGION_HEADER_SECTORS; i < usedSectors_.Size(); i++) {
+        if (usedSectors_[i]) {
+            runLength = 0;
+            continue;
+        }
+        if (runLength == 0) {
+            runStart = i;
+        }
+        runLength++;
+        if (runLength == count) {
+            MarkSectors(runStart, count, true);
+            return runStart;
+        }
+    }
+
+    // Append at the end of the file
+    unsigned offset = usedSectors_.Size();
+    MarkSectors(offset, count, true);
+    return offset;
+}
+
+void RegionFile::MarkSectors(unsigned offset, unsigned count, bool used)
+{
+    if (usedSectors_.Size() < offset + count) {
+        unsigned oldSize = usedSectors_.Size();
+        usedSectors_.Resize(offset + count);
+        for (unsigned i = oldSize; i < usedSectors_.Size(); i++) {
+            usedSectors_[i] = false;
+        }
+    }
+    for (unsigned i = offset; i < offset + count; i++) {
+        usedSectors_[i] = used;
+    }
+}
+
+ChunkStorage::ChunkStorage(Context* context):
+    Object(context)
+{
+}
+
+ChunkStorage::~ChunkStorage()
+{
+    Close();
+}
+
+void ChunkStorage::RegisterObject(Context* context)
+{
+    context->RegisterFactory<ChunkStorage>();
+}
+
+bool ChunkStorage::Sync()
+{
+    MutexLock lock(mutex_);
+    bool success = true;
+    for (auto it = regions_.Begin(); it != regions_.End(); ++it) {
+        success = (*it).second_->Sync() && success;
+    }
+    return success;
+}
+
+bool ChunkStorage::SyncFile(File* file)
+{
+    file->Flush();
+    FILE* handle = static_cast<FILE*>(file->GetHandle());
+    if (!handle) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(handle)) == 0;
+#else
+    return fsync(fileno(handle)) == 0;
+#endif
+}
+
+void ChunkStorage::Close()
+{
+    MutexLock lock(mutex_);
+    regions_.Clear();
+}
+
+void ChunkStorage::SetDirectory(const String& directory)
+{
+    MutexLock lock(mutex_);
+    regions_.Clear();
+    directory_ = directory;
+}
+
+bool ChunkStorage::HasStoredChunks()
+{
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->DirExists(directory_)) {
+        return false;
+    }
+    Vector<String> files;
+    fileSystem->ScanDir(files, directory_, "", SCAN_FILES, false);
+    for (auto it = files.Begin(); it != files.End(); ++it) {
+        if (((*it).StartsWith("region_") && (*it).EndsWith(".bin")) || ((*it).StartsWith("chunk_") && (*it).EndsWith(".json"))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ChunkStorage::GetRegionIndex(const IntVector3& chunkPosition)
+{
+    int x = chunkPosition.x_ - FloorDiv(chunkPosition.x_, REGION_SIZE) * REGION_SIZE;
+    int y = chunkPosition.y_ - FloorDiv(chunkPosition.y_, REGION_SIZE) * REGION_SIZE;
+    int z = chunkPosition.z_ - FloorDiv(chunkPosition.z_, REGION_SIZE) * REGION_SIZE;
+    return x * REGION_SIZE * REGION_SIZE + y * REGION_SIZE + z;
+}
+
+RegionFile* ChunkStorage::GetRegion(const IntVector3& chunkPosition, bool create)
+{
+    IntVector3 regionPosition(
+        FloorDiv(chunkPosition.x_, REGION_SIZE),
+        FloorDiv(chunkPosition.y_, REGION_SIZE),
+        FloorDiv(chunkPosition.z_, REGION_SIZE)
+    );
+    auto it = regions_.Find(regionPosition);
+    if (it != regions_.End()) {
+        return (*it).second_;
+    }
+
+    String fileName = directory_ + "/region_" + String(regionPosition.x_) + "_" + String(regionPosition.y_) + "_" + String(regionPosition.z_) + ".bin";
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!create && !fileSystem->FileExists(fileName)) {
+        return nullptr;
+    }
+    if (!fileSystem->DirExists(directory_)) {
+        fileSystem->CreateDir(directory_);
+    }
+
+    SharedPtr<RegionFile> region(new RegionFile(context_));
+    if (!region->Open(fileName)) {
+        return nullptr;
+    }
+    regions_[regionPosition] = region;
+    return region;
+}
+
+bool ChunkStorage::OpenWorld(WorldHeader& header)
+{
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->FileExists(directory_ + "/" + WORLD_HEADER_FILE)) {
+        // New world, or one from before the header that holds block records only
+        return SetWorldHeader(header);
+    }
+
+    File file(context_, directory_ + "/" + WORLD_HEADER_FILE, FILE_READ);
+    if (!file.IsOpen() || file.GetSize() < WORLD_HEADER_SIZE || file.ReadFileID() != "VXWD" || file.ReadUInt() != WORLD_HEADER_VERSION) {
+        URHO3D_LOGERROR("Invalid world header " + directory_ + "/" + WORLD_HEADER_FILE);
+        return false;
+    }
+    WorldHeader stored;
+    stored.seed_ = file.ReadInt();
+    stored.generatorVersion_ = file.ReadUInt();
+    stored.densityStep_ = file.ReadInt();
+    stored.persistence_ = file.ReadUByte() == CP_BLOCKS ? CP_BLOCKS : CP_EDITS;
+    MutexLock lock(mutex_);
+    header_ = stored;
+    header = stored;
+    return true;
+}
+
+bool ChunkStorage::SetWorldHeader(const WorldHeader& header)
+{
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->DirExists(directory_)) {
+        fileSystem->CreateDir(directory_);
+    }
+    File file(context_, directory_ + "/" + WORLD_HEADER_FILE, FILE_WRITE);
+    if (!file.IsOpen()) {
+        URHO3D_LOGERROR("Failed to write world header " + directory_ + "/" + WORLD_HEADER_FILE);
+        return false;
+    }
+    file.WriteFileID("VXWD");
+    file.WriteUInt(WORLD_HEADER_VERSION);
+    file.WriteInt(header.seed_);
+    file.WriteUInt(header.generatorVersion_);
+    file.WriteInt(header.densityStep_);
+    file.WriteUByte(static_cast<unsigned char>(header.persistence_));
+    file.Close();
+    MutexLock lock(mutex_);
+    header_ = header;
+    return true;
+}
+
+ChunkRecord ChunkStorage::LoadChunk(const IntVector3& chunkPosition, BlockType* data, PODVector<BlockEdit>& edits)
+{
+    MutexLock lock(mutex_);
+    RegionFile* region = GetRegion(chunkPosition, false);
+    int index = GetRegionIndex(chunkPosition);
+    if (region && region->HasChunk(index)) {
+        PODVector<unsigned char> payload;
+        if (region->Read(index, payload) && !payload.Empty()) {
+            // Both payload kinds start with their version
+            MemoryBuffer buffer(payload);
+            if (payload[0] == CHUNK_EDITS_PAYLOAD_VERSION) {
+                if (DecodeEdits(buffer, edits)) {
+                    return CR_EDITS;
+                }
+            } else if (DecodeVoxels(buffer, data)) {
+                return CR_BLOCKS;
+            }
+        }
+        URHO3D_LOGERROR("Failed to read chunk " + chunkPosition.ToString() + " from region file");
+        return CR_ERROR;
+    }
+
+    String legacyFileName = GetLegacyFileName(chunkPosition);
+    if (GetSubsystem<FileSystem>()->FileExists(legacyFileName)) {
+        return LoadLegacyChunk(legacyFileName, data) ? CR_BLOCKS : CR_ERROR;
+    }
+
+    return CR_MISSING;
+}
+
+bool ChunkStorage::SaveChunk(const IntVector3& chunkPosition, const BlockType* data)
+{
+    VectorBuffer buffer;
+    EncodeVoxels(data, buffer);
+    return WritePayload(chunkPosition, buffer.GetBuffer());
+}
+
+bool ChunkStorage::SaveChunkEdits(const IntVector3& chunkPosition, const PODVector<BlockEdit>& edits)
+{
+    VectorBuffer buffer;
+    EncodeEdits(edits, buffer);
+    return WritePayload(chunkPosition, buffer.GetBuffer());
+}
+
+bool ChunkStorage::WritePayload(const IntVector3& chunkPosition, const PODVector<unsigned char>& payload)
+{
+    MutexLock lock(mutex_);
+    RegionFile* region = GetRegion(chunkPosition, true);
+    if (!region || !region->Write(GetRegionIndex(chunkPosition), payload)) {
+        URHO3D_LOGERROR("Failed to save chunk " + chunkPosition.ToString());
+        return false;
+    }
+    bytesWritten_ += payload.Size();
+    return true;
+}
+
+void ChunkStorage::EncodeVoxels(const BlockType* data, Serializer& dest)
+{
+    PODVector<unsigned> palette;
+    unsigned char paletteIndex[BT_NONE + 1];
+    memset(paletteIndex, 0xFF, sizeof(paletteIndex));
+    for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+        // Anything that is not a block type shares the BT_NONE entry, the index stays inside the table
+        unsigned type = Min(static_cast<unsigned>(data[i]), static_cast<unsigned>(BT_NONE));
+        if (paletteIndex[type] == 0xFF) {
+            paletteIndex[type] = static_cast<unsigned char>(palette.Size());
+            palette.Push(type);
+        }
+    }
+
+    dest.WriteUByte(CHUNK_PAYLOAD_VERSION);
+    dest.WriteVLE(palette.Size());
+    for (auto it = palette.Begin(); it != palette.End(); ++it) {
+        dest.WriteVLE(*it);
+    }
+
+    // Runs follow horizontal layers, terrain compresses best that way
+    unsigned char currentIndex = 0;
+    unsigned runLength = 0;
+    for (int y = 0; y < SIZE_Y; y++) {
+        for (int z = 0; z < SIZE_Z; z++) {
+            for (int x = 0; x < SIZE_X; x++) {
+                unsigned char index = paletteIndex[Min(static_cast<unsigned>(data[VoxelIndex(x, y, z)]), static_cast<unsigned>(BT_NONE))];
+                if (runLength > 0 && index != currentIndex) {
+                    dest.WriteUByte(currentIndex);
+                    dest.WriteVLE(runLength);
+                    runLength = 0;
+                }
+                currentIndex = index;
+                runLength++;
+            }
+        }
+    }
+    dest.WriteUByte(currentIndex);
+    dest.WriteVLE(runLength);
+}
+
+bool ChunkStorage::DecodeVoxels(Deserializer& source, BlockType* data)
+{
+    if (source.ReadUByte() != CHUNK_PAYLOAD_VERSION) {
+        return false;
+    }
+    unsigned paletteSize = source.ReadVLE();
+    if (paletteSize == 0 || paletteSize > BT_NONE + 1) {
+        return false;
+    }
+    BlockType palette[BT_NONE + 1];
+    for (unsigned i = 0; i < paletteSize; i++) {
+        unsigned type = source.ReadVLE();
+        if (type > BT_NONE) {
+            return false;
+        }
+        palette[i] = static_cast<BlockType>(type);
+    }
+
+    int position = 0;
+    while (position < CHUNK_VOXEL_COUNT) {
+        if (source.IsEof()) {
+            return false;
+        }
+        unsigned char index = source.ReadUByte();
+        unsigned runLength = source.ReadVLE();
+        if (index >= paletteSize || runLength == 0 || position + runLength > CHUNK_VOXEL_COUNT) {
+            return false;
+        }
+        for (unsigned i = 0; i < runLength; i++, position++) {
+            int x = position % SIZE_X;
+            int z = (position / SIZE_X) % SIZE_Z;
+            int y = position / (SIZE_X * SIZE_Z);
+            data[VoxelIndex(x, y, z)] = palette[index];
+        }
+    }
+    return true;
+}
+
+void ChunkStorage::EncodeEdits(const PODVector<BlockEdit>& edits, Serializer& dest)
+{
+    dest.WriteUByte(CHUNK_EDITS_PAYLOAD_VERSION);
+    dest.WriteVLE(edits.Size());
+    for (auto it = edits.Begin(); it != edits.End(); ++it) {
+        dest.WriteUShort((*it).index_);
+        dest.WriteUByte((*it).type_);
+    }
+}
+
+bool ChunkStorage::DecodeEdits(Deserializer& source, PODVector<BlockEdit>& edits)
+{
+    if (source.ReadUByte() != CHUNK_EDITS_PAYLOAD_VERSION) {
+        return false;
+    }
+    unsigned count = source.ReadVLE();
+    if (count > CHUNK_VOXEL_COUNT) {
+        return false;
+    }
+    edits.Resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        if (source.IsEof()) {
+            return false;
+        }
+        edits[i].index_ = source.ReadUShort();
+        edits[i].type_ = source.ReadUByte();
+        if (edits[i].index_ >= CHUNK_VOXEL_COUNT || edits[i].type_ >= BT_NONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+String ChunkStorage::GetLegacyFileName(const IntVector3& chunkPosition)
+{
+    return directory_ + "/chunk_" + String((float)chunkPosition.x_) + "_" + String((float)chunkPosition.y_) + "_" + String((float)chunkPosition.z_) + ".json";
+}
+
+bool ChunkStorage::LoadLegacyChunk(const String& fileName, BlockType* data)
+{
+    JSONFile file(context_);
+    if (!file.LoadFile(fileName)) {
+        return false;
+    }
+    JSONValue& root = file.GetRoot();
+    for (int x = 0; x < SIZE_X; ++x) {
+        for (int y = 0; y < SIZE_Y; y++) {
+            for (int z = 0; z < SIZE_Z; z++) {
+                String key = String(x) + "_" + String(y) + "_" + String(z);
+                int type = root.Contains(key) ? root[key].GetInt() : BT_AIR;
+                if (type < 0 || type >= BT_NONE) {
+                    URHO3D_LOGERRORF("Legacy chunk file %s has invalid block type %d at %s", fileName.CString(), type, key.CString());
+                    return false;
+                }
+                data[VoxelIndex(x, y, z)] = static_cast<BlockType>(type);
+            }
+        }
+    }
+    return true;
+}
+
+int ChunkStorage::ConvertLegacyFiles()
+{
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->DirExists(directory_)) {
+        return 0;
+    }
+
+    Vector<String> files;
+    fileSystem->ScanDir(files, directory_, "*.json", SCAN_FILES, false);
+    int converted = 0;
+    int failed = 0;
+    BlockType data[CHUNK_VOXEL_COUNT];
+    BlockType verify[CHUNK_VOXEL_COUNT];
+    for (auto it = files.Begin(); it != files.End(); ++it) {
+        if (!(*it).StartsWith("chunk_")) {
+            continue;
+        }
+        StringVector parts = GetFileName(*it).Split('_');
+        if (parts.Size() != 4) {
+            continue;
+        }
+        IntVector3 chunkPosition(ToInt(parts[1]), ToInt(parts[2]), ToInt(parts[3]));
+        String fileName = directory_ + "/" + (*it);
+        if (!LoadLegacyChunk(fileName, data) || !SaveChunk(chunkPosition, data)) {
+            failed++;
+            continue;
+        }
+
+        // Round trip check, legacy file is only removed when the region copy is identical
+        bool identical = false;
+        {
+            MutexLock lock(mutex_);
+            RegionFile* region = GetRegion(chunkPosition, false);
+            PODVector<unsigned char> payload;
+            if (region && region->Read(GetRegionIndex(chunkPosition), payload)) {
+                MemoryBuffer buffer(payload);
+                identical = DecodeVoxels(buffer, verify) && memcmp(data, verify, sizeof(data)) == 0;
+            }
+        }
+        if (!identical) {
+            URHO3D_LOGERROR("Converted chunk " + chunkPosition.ToString() + " doesn't match legacy file " + fileName);
+            failed++;
+            continue;
+        }
+        fileSystem->Delete(fileName);
+        converted++;
+    }
+
+    URHO3D_LOGINFOF("Converted %d legacy chunk files, %d failed", converted, failed);
+    return converted;
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Serializer.h>
+#include <Urho3D/IO/Deserializer.h>
+#include "VoxelDefs.h"
+#include "Chunk.h"
+
+using namespace Urho3D;
+
+// Region file holds REGION_SIZE x REGION_SIZE x REGION_SIZE chunks
+const int REGION_SIZE = 16;
+const int REGION_CHUNK_COUNT = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+const unsigned REGION_SECTOR_SIZE = 512;
+const unsigned REGION_FILE_VERSION = 1;
+const unsigned char CHUNK_PAYLOAD_VERSION = 1;
+const unsigned char CHUNK_EDITS_PAYLOAD_VERSION = 2;
+const unsigned WORLD_HEADER_VERSION = 1;
+
+enum ChunkPersistence {
+    // All blocks of every loaded chunk
+    CP_BLOCKS,
+    // Player edits of generated chunks, the rest is generated again. Untouched chunks are not stored
+    CP_EDITS
+};
+
+enum ChunkRecord {
+    CR_MISSING,
+    CR_BLOCKS,
+    CR_EDITS,
+    // Record exists but can't be read or decoded
+    CR_ERROR
+};
+
+/**
+ * Generator settings the stored chunks depend on, kept in the world directory
+ */
+struct WorldHeader {
+    int seed_{0};
+    unsigned generatorVersion_{0};
+    int densityStep_{1};
+    ChunkPersistence persistence_{CP_EDITS};
+};
+
+/**
+ * Single region file on disk.
+ * Layout: file ID, version, offset table (sector offset + byte length per chunk)
+ * followed by sector aligned chunk payloads. A rewritten chunk always goes to free sectors
+ * before its table entry is updated, its old sectors are reused after the next Sync.
+ * New payloads are appended at the end of the file when no free run fits.
+ */
+class RegionFile : public RefCounted {
+public:
+    RegionFile(Context* context);
+    ~RegionFile();
+
+    bool Open(const String& fileName);
+    bool Read(int index, PODVector<unsigned char>& payload);
+    bool Write(int index, const PODVector<unsigned char>& payload);
+    bool HasChunk(int index) const { return lengths_[index] > 0; }
+    bool Sync();
+
+private:
+    unsigned GetSectorCount(unsigned length) const;
+    unsigned AllocateSectors(unsigned count);
+    void MarkSectors(unsigned offset, unsigned count, bool used);
+
+    Context* context_;
+    SharedPtr<File> file_;
+    unsigned offsets_[REGION_CHUNK_COUNT];
+    unsigned lengths_[REGION_CHUNK_COUNT];
+    PODVector<bool> usedSectors_;
+    // Offset and sector count of replaced payloads
+    PODVector<IntVector2> releasedSectors_;
+};
+
+/**
+ * Binary chunk persistence, replaces the per-chunk JSON files
+ */
+class ChunkStorage : public Object {
+    URHO3D_OBJECT(ChunkStorage, Object);
+    ChunkStorage(Context* context);
+    virtual ~ChunkStorage();
+
+public:
+    static void RegisterObject(Context* context);
+
+    /**
+     * Read the world header, a new world gets the given header written instead.
+     * Returns false when the header exists but can't be read
+     */
+    bool OpenWorld(WorldHeader& header);
+
+    /**
+     * Replace the world header on disk
+     */
+    bool SetWorldHeader(const WorldHeader& header);
+    const WorldHeader& GetWorldHeader() const { return header_; }
+    ChunkPersistence GetPersistence() const { return header_.persistence_; }
+
+    /**
+     * Directory of the world header and region files, World unless a scratch storage uses another one
+     */
+    void SetDirectory(const String& directory);
+    const String& GetDirectory() const { return directory_; }
+
+    /**
+     * Read the chunk, falls back to the legacy JSON file. Block records fill data,
+     * edit records fill edits and have to be applied to the generated chunk.
+     * CR_MISSING means that nothing is stored, CR_ERROR that the stored chunk is unreadable
+     */
+    ChunkRecord LoadChunk(const IntVector3& chunkPosition, BlockType* data, PODVector<BlockEdit>& edits);
+
+    /**
+     * Write voxels of the chunk into its region file
+     */
+    bool SaveChunk(const IntVector3& chunkPosition, const BlockType* data);
+
+    /**
+     * Write the player edits of a generated chunk into its region file
+     */
+    bool SaveChunkEdits(const IntVector3& chunkPosition, const PODVector<BlockEdit>& edits);
+
+    /**
+     * The world directory holds region files or legacy chunk files
+     */
+    bool HasStoredChunks();
+
+    /**
+     * Payload bytes written since start
+     */
+    unsigned long long GetBytesWritten() const { return bytesWritten_; }
+
+    /**
+     * Force the written chunks of all opened region files to the disk
+     */
+    bool Sync();
+
+    /**
+     * Close all opened region files
+     */
+    void Close();
+
+    /**
+     * Move all legacy chunk_X_Y_Z.json files into region files.
+     * Every converted chunk is read back and compared before the JSON file is removed
+     * Returns number of converted chunks
+     */
+    int ConvertLegacyFiles();
+
+    /**
+     * Read a chunk_X_Y_Z.json file of the old storage, fails on block types that don't exist
+     */
+    bool LoadLegacyChunk(const String& fileName, BlockType* data);
+
+    /**
+     * Palette + run-length encoding of the chunk voxels. Values outside of the block types are stored as BT_NONE
+     */
+    static void EncodeVoxels(const BlockType* data, Serializer& dest);
+    static bool DecodeVoxels(Deserializer& source, BlockType* data);
+
+    /**
+     * Block index and type of every edit
+     */
+    static void EncodeEdits(const PODVector<BlockEdit>& edits, Serializer& dest);
+    static bool DecodeEdits(Deserializer& source, PODVector<BlockEdit>& edits);
+
+    /**
+     * Flush the file and wait until the operating system has written it to the disk
+     */
+    static bool SyncFile(File* file);
+
+private:
+    RegionFile* GetRegion(const IntVector3& chunkPosition, bool create);
+    int GetRegionIndex(const IntVector3& chunkPosition);
+    String GetLegacyFileName(const IntVector3& chunkPosition);
+    bool WritePayload(const IntVector3& chunkPosition, const PODVector<unsigned char>& payload);
+
+    HashMap<IntVector3, SharedPtr<RegionFile>> regions_;
+    String directory_{"World"};
+    WorldHeader header_;
+    unsigned long long bytesWritten_{0};
+    Mutex mutex_;
+};
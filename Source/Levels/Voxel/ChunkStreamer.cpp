@@ -0,0 +1,312 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Network/Network.h>
+#include "ChunkStreamer.h"
+#include "ChunkCodec.h"
+#include "VoxelWorld.h"
+#include "../../Console/ConsoleHandlerEvents.h"
+
+using namespace ConsoleHandlerEvents;
+
+// Request is sent again when no answer arrived in time
+static const unsigned STREAM_TIMEOUT_MS = 10000;
+// Wait before asking again after the server was busy, doubled with every busy reply up to the maximum
+static const unsigned STREAM_RETRY_MS = 500;
+static const unsigned STREAM_MAX_RETRY_MS = 8000;
+// Request is dropped after this many busy replies, the server doesn't load the chunk
+static const unsigned STREAM_MAX_BUSY_REPLIES = 16;
+// Expected size of a chunk until the first ones arrive
+static const float STREAM_INITIAL_CHUNK_BYTES = 1024.0f;
+
+ChunkStreamer::ChunkStreamer(Context* context):
+    Object(context),
+    averageChunkBytes_(STREAM_INITIAL_CHUNK_BYTES)
+{
+    availableBytes_ = (float)bytesPerSecond_;
+    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(ChunkStreamer, HandleUpdate));
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "chunk_stream_budget",
+            ConsoleCommandAdd::P_EVENT, "#chunk_stream_budget",
+            ConsoleCommandAdd::P_DESCRIPTION, "Chunk requests in flight and received KB per second [window] [kb]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#chunk_stream_budget", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 3) {
+            URHO3D_LOGERROR("This command requires exactly 2 arguments!");
+            return;
+        }
+        SetBudget(ToUInt(params[1]), ToUInt(params[2]) * 1024);
+    });
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+}
+
+void ChunkStreamer::RegisterObject(Context* context)
+{
+    context->RegisterFactory<ChunkStreamer>();
+}
+
+void ChunkStreamer::RequestChunk(const IntVector3& chunkPosition, int priority)
+{
+    MutexLock lock(queueMutex_);
+    auto inFlight = inFlight_.Find(chunkPosition);
+    if (inFlight != inFlight_.End()) {
+        return;
+    }
+    auto it = queue_.Find(chunkPosition);
+    if (it != queue_.End()) {
+        (*it).second_.priority_ = priority;
+        return;
+    }
+    ChunkStreamRequest request;
+    request.priority_ = priority;
+    request.retryTime_ = 0;
+    request.busyReplies_ = 0;
+    queue_[chunkPosition] = request;
+}
+
+void ChunkStreamer::CancelChunk(const IntVector3& chunkPosition)
+{
+    MutexLock lock(queueMutex_);
+    queue_.Erase(chunkPosition);
+    auto it = inFlight_.Find(chunkPosition);
+    if (it == inFlight_.End()) {
+        return;
+    }
+    availableBytes_ += (*it).second_.reservedBytes_;
+    inFlight_.Erase(it);
+
+    Connection* serverConnection = GetSubsystem<Network>()->GetServerConnection();
+    if (serverConnection) {
+        VectorBuffer msg;
+        msg.WriteVector3(Vector3(chunkPosition.x_ * SIZE_X, chunkPosition.y_ * SIZE_Y, chunkPosition.z_ * SIZE_Z));
+        serverConnection->SendMessage(NETWORK_CANCEL_CHUNK, true, true, msg);
+    }
+}
+
+void ChunkStreamer::ChunkReceived(const IntVector3& chunkPosition, unsigned size)
+{
+    MutexLock lock(queueMutex_);
+    receivedChunks_++;
+    receivedBytes_ += size;
+    averageChunkBytes_ = Lerp(averageChunkBytes_, (float)size, 0.1f);
+    auto it = inFlight_.Find(chunkPosition);
+    if (it != inFlight_.End()) {
+        // Settle the reservation with the real size
+        availableBytes_ += (*it).second_.reservedBytes_;
+        inFlight_.Erase(it);
+    }
+    availableBytes_ -= size;
+}
+
+void ChunkStreamer::ChunkBusy(const IntVector3& chunkPosition)
+{
+    MutexLock lock(queueMutex_);
+    busyReplies_++;
+    auto it = inFlight_.Find(chunkPosition);
+    if (it == inFlight_.End()) {
+        // Cancelled in the meantime
+        return;
+    }
+    availableBytes_ += (*it).second_.reservedBytes_;
+    unsigned busyReplies = (*it).second_.busyReplies_ + 1;
+    int priority = (*it).second_.priority_;
+    inFlight_.Erase(it);
+    if (busyReplies >= STREAM_MAX_BUSY_REPLIES) {
+        URHO3D_LOGDEBUGF("Server refused chunk %s %d times, request dropped", chunkPosition.ToString().CString(), busyReplies);
+        return;
+    }
+
+    ChunkStreamRequest request;
+    request.priority_ = priority;
+    request.retryTime_ = Time::GetSystemTime() + Min(STREAM_RETRY_MS << Min(busyReplies - 1, 4U), STREAM_MAX_RETRY_MS);
+    request.busyReplies_ = busyReplies;
+    queue_[chunkPosition] = request;
+}
+
+void ChunkStreamer::SetBudget(unsigned window, unsigned bytesPerSecond)
+{
+    MutexLock lock(queueMutex_);
+    window_ = Max(window, 1U);
+    bytesPerSecond_ = Max(bytesPerSecond, 1024U);
+    availableBytes_ = Min(availableBytes_, (float)bytesPerSecond_);
+    URHO3D_LOGINFOF("Chunk streaming window %d, budget %d KB/s", window_, bytesPerSecond_ / 1024);
+}
+
+void ChunkStreamer::QueueServerRequest(Connection* connection, const IntVector3& chunkPosition, int priority)
+{
+    ChunkStreamServerQueue& queue = serverQueues_[connection];
+    queue.connection_ = connection;
+    if (queue.requests_.Size() >= serverQueueLimit_ && !queue.requests_.Contains(chunkPosition)) {
+        SendBusy(connection, chunkPosition);
+        return;
+    }
+    queue.requests_[chunkPosition] = priority;
+}
+
+void ChunkStreamer::CancelServerRequest(Connection* connection, const IntVector3& chunkPosition)
+{
+    auto it = serverQueues_.Find(connection);
+    if (it != serverQueues_.End()) {
+        (*it).second_.requests_.Erase(chunkPosition);
+    }
+}
+
+void ChunkStreamer::RemoveServerQueue(Connection* connection)
+{
+    // Connection objects are released after the disconnect, their address may be reused by the next client
+    serverQueues_.Erase(connection);
+}
+
+void ChunkStreamer::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace Update;
+    auto network = GetSubsystem<Network>();
+    if (network->IsServerRunning()) {
+        UpdateServer();
+    } else if (network->GetServerConnection()) {
+        UpdateClient(eventData[P_TIMESTEP].GetFloat());
+    }
+
+    if (statsTimer_.GetMSec(false) >= 1000) {
+        statsTimer_.Reset();
+        if (GetSubsystem<DebugHud>()) {
+            if (network->IsServerRunning()) {
+                unsigned queued = 0;
+                for (auto it = serverQueues_.Begin(); it != serverQueues_.End(); ++it) {
+                    queued += (*it).second_.requests_.Size();
+                }
+                GetSubsystem<DebugHud>()->SetAppStats("Stream server queue", queued);
+                GetSubsystem<DebugHud>()->SetAppStats("Stream sent chunks/s", sentChunks_);
+                GetSubsystem<DebugHud>()->SetAppStats("Stream busy replies/s", busyReplies_);
+            } else {
+                MutexLock lock(queueMutex_);
+                GetSubsystem<DebugHud>()->SetAppStats("Stream queue", queue_.Size());
+                GetSubsystem<DebugHud>()->SetAppStats("Stream in flight", inFlight_.Size());
+                GetSubsystem<DebugHud>()->SetAppStats("Stream chunks/s", receivedChunks_);
+                GetSubsystem<DebugHud>()->SetAppStats("Stream KB/s", receivedBytes_ / 1024);
+                GetSubsystem<DebugHud>()->SetAppStats("Stream busy replies/s", busyReplies_);
+                GetSubsystem<DebugHud>()->SetAppStats("Stream timeouts", timeouts_);
+            }
+        }
+        receivedChunks_ = 0;
+        receivedBytes_ = 0;
+        busyReplies_ = 0;
+        sentChunks_ = 0;
+    }
+}
+
+void ChunkStreamer::UpdateClient(float timeStep)
+{
+    MutexLock lock(queueMutex_);
+    // At most one second worth of budget is saved up
+    availableBytes_ = Min(availableBytes_ + timeStep * bytesPerSecond_, (float)bytesPerSecond_);
+
+    unsigned now = Time::GetSystemTime();
+    for (auto it = inFlight_.Begin(); it != inFlight_.End();) {
+        if (now - (*it).second_.sendTime_ > STREAM_TIMEOUT_MS) {
+            availableBytes_ += (*it).second_.reservedBytes_;
+            ChunkStreamRequest request;
+            request.priority_ = (*it).second_.priority_;
+            request.retryTime_ = 0;
+            request.busyReplies_ = (*it).second_.busyReplies_;
+            queue_[(*it).first_] = request;
+            it = inFlight_.Erase(it);
+            timeouts_++;
+        } else {
+            ++it;
+        }
+    }
+
+    while (inFlight_.Size() < window_ && availableBytes_ > 0) {
+        auto best = queue_.End();
+        for (auto it = queue_.Begin(); it != queue_.End(); ++it) {
+            if ((int)(now - (*it).second_.retryTime_) < 0) {
+                continue;
+            }
+            if (best == queue_.End() || (*it).second_.priority_ < (*best).second_.priority_) {
+                best = it;
+            }
+        }
+        if (best == queue_.End()) {
+            break;
+        }
+
+        ChunkStreamInFlight request;
+        request.priority_ = (*best).second_.priority_;
+        request.sendTime_ = now;
+        request.reservedBytes_ = averageChunkBytes_;
+        request.busyReplies_ = (*best).second_.busyReplies_;
+        availableBytes_ -= request.reservedBytes_;
+        SendRequest((*best).first_, request.priority_);
+        inFlight_[(*best).first_] = request;
+        queue_.Erase(best);
+    }
+}
+
+void ChunkStreamer::UpdateServer()
+{
+    auto world = GetSubsystem<VoxelWorld>();
+    for (auto it = serverQueues_.Begin(); it != serverQueues_.End();) {
+        ChunkStreamServerQueue& queue = (*it).second_;
+        if (!queue.connection_) {
+            it = serverQueues_.Erase(it);
+            continue;
+        }
+
+        for (unsigned i = 0; i < serverChunksPerFrame_ && !queue.requests_.Empty(); i++) {
+            auto best = queue.requests_.Begin();
+            for (auto request = queue.requests_.Begin(); request != queue.requests_.End(); ++request) {
+                if ((*request).second_ < (*best).second_) {
+                    best = request;
+                }
+            }
+            IntVector3 chunkPosition = (*best).first_;
+            queue.requests_.Erase(best);
+
+            Chunk* chunk = world ? world->GetChunkByPosition(Vector3(chunkPosition.x_ * SIZE_X, chunkPosition.y_ * SIZE_Y, chunkPosition.z_ * SIZE_Z)) : nullptr;
+            if (!chunk || !chunk->IsLoaded()) {
+                SendBusy(queue.connection_, chunkPosition);
+                continue;
+            }
+
+            // Client holds this chunk now, keep it updated until the player moves on
+            world->AddEditSubscription(queue.connection_, chunkPosition);
+            VectorBuffer msg;
+            msg.WriteVector3(chunk->GetPosition());
+            BlockType blocks[CHUNK_VOXEL_COUNT];
+            chunk->GetBlocks(blocks);
+            ChunkCodec::Encode(blocks, msg);
+            queue.connection_->SendMessage(NETWORK_SEND_CHUNK, true, true, msg);
+            sentChunks_++;
+        }
+        ++it;
+    }
+}
+
+void ChunkStreamer::SendRequest(const IntVector3& chunkPosition, int priority)
+{
+    Connection* serverConnection = GetSubsystem<Network>()->GetServerConnection();
+    if (serverConnection) {
+        VectorBuffer msg;
+        msg.WriteVector3(Vector3(chunkPosition.x_ * SIZE_X, chunkPosition.y_ * SIZE_Y, chunkPosition.z_ * SIZE_Z));
+        msg.WriteVLE(Max(priority, 0));
+        serverConnection->SendMessage(NETWORK_REQUEST_CHUNK, true, true, msg);
+    }
+}
+
+void ChunkStreamer::SendBusy(Connection* connection, const IntVector3& chunkPosition)
+{
+    busyReplies_++;
+    VectorBuffer msg;
+    msg.WriteVector3(Vector3(chunkPosition.x_ * SIZE_X, chunkPosition.y_ * SIZE_Y, chunkPosition.z_ * SIZE_Z));
+    connection->SendMessage(NETWORK_CHUNK_BUSY, true, true, msg);
+}
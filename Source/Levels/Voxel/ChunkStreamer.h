@@ -0,0 +1,114 @@
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Network/Connection.h>
+#include "VoxelDefs.h"
+
+using namespace Urho3D;
+
+struct ChunkStreamRequest {
+    int priority_;
+    // Not sent again before this system time, used after the server was busy
+    unsigned retryTime_;
+    // Busy replies so far, the retry delay doubles with each of them
+    unsigned busyReplies_;
+};
+
+struct ChunkStreamInFlight {
+    int priority_;
+    unsigned sendTime_;
+    // Budget taken when the request was sent, settled once the chunk arrives
+    float reservedBytes_;
+    unsigned busyReplies_;
+};
+
+/**
+ * Chunk requests of a single client waiting on the server
+ */
+struct ChunkStreamServerQueue {
+    WeakPtr<Connection> connection_;
+    HashMap<IntVector3, int> requests_;
+};
+
+/**
+ * Chunk transfer between server and clients.
+ * Clients queue chunk requests and keep a limited number of them in flight,
+ * nearest chunks first and within a byte per second budget.
+ * The server answers queued requests a few chunks per frame and replies busy
+ * once a client queue is full or the chunk is not ready, the client retries later
+ * and gives up on chunks the server keeps refusing
+ */
+class ChunkStreamer : public Object {
+    URHO3D_OBJECT(ChunkStreamer, Object);
+    ChunkStreamer(Context* context);
+    virtual ~ChunkStreamer();
+
+public:
+    static void RegisterObject(Context* context);
+
+    /**
+     * Queue chunk request to the server, lower priority value is requested first.
+     * Safe to call from worker threads
+     */
+    void RequestChunk(const IntVector3& chunkPosition, int priority);
+
+    /**
+     * Drop queued request, the server is told to forget it when it was already sent
+     */
+    void CancelChunk(const IntVector3& chunkPosition);
+
+    /**
+     * Chunk data of the given size arrived from the server
+     */
+    void ChunkReceived(const IntVector3& chunkPosition, unsigned size);
+
+    /**
+     * Server could not send the chunk now, request it again later
+     */
+    void ChunkBusy(const IntVector3& chunkPosition);
+
+    /**
+     * Maximum requests waiting for an answer and bytes per second to receive
+     */
+    void SetBudget(unsigned window, unsigned bytesPerSecond);
+
+    /**
+     * Queue chunk request of a client, server only
+     */
+    void QueueServerRequest(Connection* connection, const IntVector3& chunkPosition, int priority);
+    void CancelServerRequest(Connection* connection, const IntVector3& chunkPosition);
+
+    /**
+     * Forget all requests of a disconnected client, server only
+     */
+    void RemoveServerQueue(Connection* connection);
+
+private:
+    void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    void UpdateClient(float timeStep);
+    void UpdateServer();
+    void SendRequest(const IntVector3& chunkPosition, int priority);
+    void SendBusy(Connection* connection, const IntVector3& chunkPosition);
+
+    HashMap<IntVector3, ChunkStreamRequest> queue_;
+    HashMap<IntVector3, ChunkStreamInFlight> inFlight_;
+    Mutex queueMutex_;
+    unsigned window_{16};
+    unsigned bytesPerSecond_{256 * 1024};
+    // Bytes that may still be received, refilled every frame up to one second of budget
+    float availableBytes_{0};
+    float averageChunkBytes_;
+
+    HashMap<Connection*, ChunkStreamServerQueue> serverQueues_;
+    unsigned serverChunksPerFrame_{8};
+    unsigned serverQueueLimit_{64};
+
+    Timer statsTimer_;
+    unsigned receivedChunks_{0};
+    unsigned receivedBytes_{0};
+    unsigned busyReplies_{0};
+    unsigned timeouts_{0};
+    unsigned sentChunks_{0};
+};
@@ -0,0 +1,337 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include "EditJournal.h"
+#include "ChunkStorage.h"
+
+static const unsigned JOURNAL_HEADER_SIZE = 8;
+static const unsigned FOLD_RETRY_INTERVAL = 5000;
+
+// FNV-1a over the record without its checksum
+static unsigned GetRecordChecksum(const unsigned char* data)
+{
+    unsigned hash = 2166136261u;
+    for (unsigned i = 0; i < EDIT_JOURNAL_RECORD_SIZE - 4; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+EditJournal::EditJournal(Context* context):
+    Object(context)
+{
+}
+
+EditJournal::~EditJournal()
+{
+    Close();
+}
+
+void EditJournal::RegisterObject(Context* context)
+{
+    context->RegisterFactory<EditJournal>();
+}
+
+bool EditJournal::Open()
+{
+    Close();
+    auto fileSystem = GetSubsystem<FileSystem>();
+    {
+        MutexLock lock(foldMutex_);
+        // Older journal first, both were synced before the edits reached the storage
+        if (fileSystem->FileExists(GetCompactFileName()) && !Fold(GetCompactFileName())) {
+            return false;
+        }
+        if (fileSystem->FileExists(fileName_)) {
+            fileSystem->Rename(fileName_, GetCompactFileName());
+            if (!Fold(GetCompactFileName())) {
+                return false;
+            }
+        }
+    }
+    MutexLock lock(fileMutex_);
+    return OpenJournalFile();
+}
+
+void EditJournal::Close()
+{
+    if (!file_) {
+        return;
+    }
+    {
+        MutexLock lock(fileMutex_);
+        WritePending();
+        file_.Reset();
+    }
+    // A journal waiting for its fold is older and goes first, whatever is left is folded by the next Open
+    Compact();
+    if (!GetSubsystem<FileSystem>()->FileExists(GetCompactFileName()) && GetSubsystem<FileSystem>()->Rename(fileName_, GetCompactFileName())) {
+        Compact();
+    }
+}
+
+void EditJournal::SetFileName(const String& fileName)
+{
+    Close();
+    fileName_ = fileName;
+}
+
+void EditJournal::SetStorage(ChunkStorage* storage)
+{
+    MutexLock lock(foldMutex_);
+    storage_ = storage;
+}
+
+void EditJournal::Append(const IntVector3& chunkPosition, unsigned short index, BlockType oldType, BlockType newType)
+{
+    JournalRecord record;
+    record.chunk_ = chunkPosition;
+    record.index_ = index;
+    record.oldType_ = static_cast<unsigned char>(oldType);
+    record.newType_ = static_cast<unsigned char>(newType);
+    record.tick_ = GetSubsystem<Time>()->GetFrameNumber();
+
+    MutexLock lock(pendingMutex_);
+    if (pending_.Empty()) {
+        pendingTimer_.Reset();
+    }
+    pending_.Push(record);
+}
+
+bool EditJournal::Sync(bool force)
+{
+    {
+        MutexLock lock(pendingMutex_);
+        if (pending_.Empty()) {
+            return false;
+        }
+        if (!force && pending_.Size() < syncBatch_ && pendingTimer_.GetMSec(false) < syncInterval_) {
+            return false;
+        }
+    }
+    MutexLock lock(fileMutex_);
+    return WritePending();
+}
+
+bool EditJournal::WritePending()
+{
+    PODVector<JournalRecord> records;
+    {
+        MutexLock lock(pendingMutex_);
+        records.Swap(pending_);
+    }
+    if (records.Empty() || !file_) {
+        return false;
+    }
+    VectorBuffer buffer;
+    for (auto it = records.Begin(); it != records.End(); ++it) {
+        WriteRecord(*it, buffer);
+    }
+    file_->Seek(file_->GetSize());
+    if (file_->Write(buffer.GetData(), buffer.GetSize()) != buffer.GetSize() || !ChunkStorage::SyncFile(file_)) {
+        URHO3D_LOGERROR("Failed to write edit journal " + fileName_);
+        return false;
+    }
+    journalCount_ += records.Size();
+    syncCount_++;
+    return true;
+}
+
+bool EditJournal::IsCompactionDue()
+{
+    if (journalCount_ == 0 && !foldFailed_) {
+        return false;
+    }
+    if (foldFailed_) {
+        // Retry a failed fold once in a while instead of on every call
+        return compactionTimer_.GetMSec(false) >= FOLD_RETRY_INTERVAL;
+    }
+    return journalCount_ >= compactionSize_ || compactionTimer_.GetMSec(false) >= compactionInterval_;
+}
+
+bool EditJournal::Rotate()
+{
+    MutexLock lock(fileMutex_);
+    if (!file_) {
+        return false;
+    }
+    WritePending();
+    if (GetSubsystem<FileSystem>()->FileExists(GetCompactFileName())) {
+        // Previous fold failed, it has to succeed before a newer journal can be moved aside
+        return false;
+    }
+    file_.Reset();
+    if (!GetSubsystem<FileSystem>()->Rename(fileName_, GetCompactFileName())) {
+        URHO3D_LOGERROR("Failed to move edit journal " + fileName_);
+        // Keep appending to the same journal
+        file_ = new File(context_, fileName_, FILE_READWRITE);
+        if (!file_->IsOpen()) {
+            file_.Reset();
+        }
+        return false;
+    }
+    return OpenJournalFile();
+}
+
+bool EditJournal::Compact()
+{
+    MutexLock lock(foldMutex_);
+    compactionTimer_.Reset();
+    if (!GetSubsystem<FileSystem>()->FileExists(GetCompactFileName())) {
+        return false;
+    }
+    foldFailed_ = !Fold(GetCompactFileName());
+    return !foldFailed_;
+}
+
+unsigned EditJournal::GetPendingCount()
+{
+    MutexLock lock(pendingMutex_);
+    return pending_.Size();
+}
+
+void EditJournal::WriteRecord(const JournalRecord& record, Serializer& dest)
+{
+    VectorBuffer buffer;
+    buffer.WriteInt(record.chunk_.x_);
+    buffer.WriteInt(record.chunk_.y_);
+    buffer.WriteInt(record.chunk_.z_);
+    buffer.WriteUShort(record.index_);
+    buffer.WriteUByte(record.oldType_);
+    buffer.WriteUByte(record.newType_);
+    buffer.WriteUInt(record.tick_);
+    buffer.WriteUInt(GetRecordChecksum(buffer.GetData()));
+    dest.Write(buffer.GetData(), buffer.GetSize());
+}
+
+bool EditJournal::ReadRecord(Deserializer& source, JournalRecord& record)
+{
+    unsigned char data[EDIT_JOURNAL_RECORD_SIZE];
+    if (source.Read(data, EDIT_JOURNAL_RECORD_SIZE) != EDIT_JOURNAL_RECORD_SIZE) {
+        return false;
+    }
+    MemoryBuffer buffer(data, EDIT_JOURNAL_RECORD_SIZE);
+    record.chunk_.x_ = buffer.ReadInt();
+    record.chunk_.y_ = buffer.ReadInt();
+    record.chunk_.z_ = buffer.ReadInt();
+    record.index_ = buffer.ReadUShort();
+    record.oldType_ = buffer.ReadUByte();
+    record.newType_ = buffer.ReadUByte();
+    record.tick_ = buffer.ReadUInt();
+    return buffer.ReadUInt() == GetRecordChecksum(data) && record.index_ < CHUNK_VOXEL_COUNT && record.newType_ < BT_NONE;
+}
+
+bool EditJournal::ReadRecords(Context* context, const String& fileName, PODVector<JournalRecord>& records)
+{
+    File file(context, fileName, FILE_READ);
+    if (!file.IsOpen() || file.GetSize() < JOURNAL_HEADER_SIZE || file.ReadFileID() != "VXJL" || file.ReadUInt() != EDIT_JOURNAL_VERSION) {
+        URHO3D_LOGERROR("Invalid edit journal " + fileName);
+        return false;
+    }
+    JournalRecord record;
+    while (!file.IsEof()) {
+        if (!ReadRecord(file, record)) {
+            // Crash while appending, everything before was synced
+            URHO3D_LOGWARNINGF("Edit journal %s ends with a torn record after %d records", fileName.CString(), records.Size());
+            break;
+        }
+        records.Push(record);
+    }
+    return true;
+}
+
+bool EditJournal::OpenJournalFile()
+{
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->DirExists(GetPath(fileName_))) {
+        fileSystem->CreateDir(GetPath(fileName_));
+    }
+    file_ = new File(context_, fileName_, FILE_WRITE);
+    if (!file_->IsOpen()) {
+        URHO3D_LOGERROR("Failed to create edit journal " + fileName_);
+        file_.Reset();
+        return false;
+    }
+    file_->WriteFileID("VXJL");
+    file_->WriteUInt(EDIT_JOURNAL_VERSION);
+    ChunkStorage::SyncFile(file_);
+    journalCount_ = 0;
+    compactionTimer_.Reset();
+    return true;
+}
+
+bool EditJournal::Fold(const String& fileName)
+{
+    ChunkStorage* storage = storage_ ? storage_.Get() : GetSubsystem<ChunkStorage>();
+    if (!storage) {
+        return false;
+    }
+    PODVector<JournalRecord> records;
+    if (!ReadRecords(context_, fileName, records)) {
+        // Nothing readable to keep, a broken journal must not block the newer ones
+        GetSubsystem<FileSystem>()->Delete(fileName);
+        return true;
+    }
+
+    // Latest type per block in journal order, chunks in the order they were first edited
+    HashMap<IntVector3, PODVector<BlockEdit>> chunkEdits;
+    for (auto it = records.Begin(); it != records.End(); ++it) {
+        PODVector<BlockEdit>& edits = chunkEdits[(*it).chunk_];
+        auto editIt = edits.Begin();
+        while (editIt != edits.End() && (*editIt).index_ != (*it).index_) {
+            ++editIt;
+        }
+        if (editIt == edits.End()) {
+            BlockEdit edit;
+            edit.index_ = (*it).index_;
+            edits.Push(edit);
+            editIt = edits.End() - 1;
+        }
+        (*editIt).type_ = (*it).newType_;
+    }
+
+    bool success = true;
+    for (auto it = chunkEdits.Begin(); it != chunkEdits.End(); ++it) {
+        BlockType blocks[CHUNK_VOXEL_COUNT];
+        PODVector<BlockEdit> stored;
+        const PODVector<BlockEdit>& edits = (*it).second_;
+        ChunkRecord record = storage->LoadChunk((*it).first_, blocks, stored);
+        if (record == CR_ERROR) {
+            // Saving the edits alone would replace the stored chunk, the journal is the only complete copy
+            URHO3D_LOGERROR("Can't fold journal edits into unreadable chunk " + (*it).first_.ToString());
+            success = false;
+            continue;
+        }
+        if (record == CR_BLOCKS) {
+            for (auto editIt = edits.Begin(); editIt != edits.End(); ++editIt) {
+                blocks[(*editIt).index_] = static_cast<BlockType>((*editIt).type_);
+            }
+            success = storage->SaveChunk((*it).first_, blocks) && success;
+            continue;
+        }
+        // Generated chunk, the journal edits join the stored ones
+        for (auto editIt = edits.Begin(); editIt != edits.End(); ++editIt) {
+            auto storedIt = stored.Begin();
+            while (storedIt != stored.End() && (*storedIt).index_ != (*editIt).index_) {
+                ++storedIt;
+            }
+            if (storedIt == stored.End()) {
+                stored.Push(*editIt);
+            } else {
+                (*storedIt).type_ = (*editIt).type_;
+            }
+        }
+        success = storage->SaveChunkEdits((*it).first_, stored) && success;
+    }
+    // The journal is only dropped once the chunks are on the disk
+    if (!success || !storage->Sync()) {
+        URHO3D_LOGERROR("Failed to fold edit journal " + fileName + " into the chunk storage, keeping it");
+        return false;
+    }
+    GetSubsystem<FileSystem>()->Delete(fileName);
+    compactedCount_ += records.Size();
+    URHO3D_LOGINFOF("Folded %d journal edits of %d chunks into the chunk storage", records.Size(), chunkEdits.Size());
+    return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Serializer.h>
+#include <Urho3D/IO/Deserializer.h>
+#include "VoxelDefs.h"
+
+using namespace Urho3D;
+
+class ChunkStorage;
+
+const unsigned EDIT_JOURNAL_VERSION = 1;
+// Chunk coordinates, block index, old and new type, tick and checksum
+const unsigned EDIT_JOURNAL_RECORD_SIZE = 24;
+
+struct JournalRecord {
+    IntVector3 chunk_;
+    unsigned short index_;
+    unsigned char oldType_;
+    unsigned char newType_;
+    unsigned tick_;
+};
+
+/**
+ * Write-ahead log of player block edits in World/edits.journal.
+ * Edits are appended as fixed size records and synced to disk in batches, so they survive a crash
+ * without rewriting whole chunks. The ChunkIOService thread folds the journal into the chunk storage,
+ * journals left behind by a crash are folded when the world is opened
+ */
+class EditJournal : public Object {
+    URHO3D_OBJECT(EditJournal, Object);
+    EditJournal(Context* context);
+    virtual ~EditJournal();
+
+public:
+    static void RegisterObject(Context* context);
+
+    /**
+     * Fold journals of the previous run into the chunk storage and start an empty journal
+     */
+    bool Open();
+
+    /**
+     * Sync the queued edits and fold the journal into the chunk storage
+     */
+    void Close();
+
+    bool IsOpen() const { return file_ != nullptr; }
+
+    /**
+     * Journal file, World/edits.journal unless a scratch journal uses another one. Closes the current journal
+     */
+    void SetFileName(const String& fileName);
+    const String& GetFileName() const { return fileName_; }
+
+    /**
+     * Chunk storage the journal is folded into, the ChunkStorage subsystem when not set
+     */
+    void SetStorage(ChunkStorage* storage);
+
+    /**
+     * Queue an edit for the next sync, main thread only
+     */
+    void Append(const IntVector3& chunkPosition, unsigned short index, BlockType oldType, BlockType newType);
+
+    /**
+     * Write the queued edits and sync the journal once the batch is full or its oldest edit waited
+     * for the sync interval, force writes them right away. Returns true when records were written
+     */
+    bool Sync(bool force = false);
+
+    /**
+     * The journal holds enough records or it was not folded for a while
+     */
+    bool IsCompactionDue();
+
+    /**
+     * Sync and move the journal aside, new edits go to an empty journal.
+     * The caller makes sure that no chunk snapshot older than the moved edits is still waiting to be written
+     */
+    bool Rotate();
+
+    /**
+     * Fold the moved journal into the chunk storage, sync the region files and remove it
+     */
+    bool Compact();
+
+    void SetSyncInterval(unsigned milliseconds) { syncInterval_ = milliseconds; }
+    void SetSyncBatch(unsigned records) { syncBatch_ = Max(records, 1U); }
+    void SetCompactionSize(unsigned records) { compactionSize_ = Max(records, 1U); }
+    unsigned GetSyncInterval() const { return syncInterval_; }
+    unsigned GetCompactionSize() const { return compactionSize_; }
+
+    /**
+     * Edits waiting for the next sync
+     */
+    unsigned GetPendingCount();
+
+    /**
+     * Records in the journal file that are not folded into the chunk storage yet
+     */
+    unsigned GetJournalCount() const { return journalCount_; }
+    unsigned GetSyncCount() const { return syncCount_; }
+    unsigned GetCompactedCount() const { return compactedCount_; }
+
+    static void WriteRecord(const JournalRecord& record, Serializer& dest);
+    static bool ReadRecord(Deserializer& source, JournalRecord& record);
+
+    /**
+     * Read all complete records of a journal file, a torn record at the end stops the read
+     */
+    static bool ReadRecords(Context* context, const String& fileName, PODVector<JournalRecord>& records);
+
+private:
+    /**
+     * Journal moved aside for folding, older than the one in the journal file
+     */
+    String GetCompactFileName() const { return fileName_ + ".compact"; }
+    bool OpenJournalFile();
+    bool WritePending();
+    bool Fold(const String& fileName);
+
+    String fileName_{"World/edits.journal"};
+    WeakPtr<ChunkStorage> storage_;
+    SharedPtr<File> file_;
+    PODVector<JournalRecord> pending_;
+    Mutex pendingMutex_;
+    Mutex fileMutex_;
+    // Close on the main thread may race with a fold on the disk thread
+    Mutex foldMutex_;
+    Timer pendingTimer_;
+    Timer compactionTimer_;
+
+    unsigned syncInterval_{100};
+    unsigned syncBatch_{256};
+    unsigned compactionSize_{16384};
+    // Folded at least this often while there are edits, milliseconds
+    unsigned compactionInterval_{60000};
+    unsigned journalCount_{0};
+    unsigned syncCount_{0};
+    unsigned compactedCount_{0};
+    bool foldFailed_{false};
+};
@@ -1,5 +1,6 @@
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/IO/Log.h>
 #include "LightManager.h"
 #include "VoxelWorld.h"
@@ -14,6 +15,7 @@ LightManager::LightManager(Context* context):
     SubscribeToEvent(E_CHUNK_GENERATED, URHO3D_HANDLER(LightManager, HandleEvents));
     SubscribeToEvent(E_BLOCK_ADDED, URHO3D_HANDLER(LightManager, HandleEvents));
     SubscribeToEvent(E_BLOCK_REMOVED, URHO3D_HANDLER(LightManager, HandleEvents));
+    SubscribeToEvent(E_WORKITEMCOMPLETED, URHO3D_HANDLER(LightManager, HandleWorkItemCompleted));
 }
 
 LightManager::~LightManager()
@@ -27,7 +29,9 @@ void LightManager::RegisterObject(Context* context)
 
 void LightManager::AddLightNode(int x, int y, int z, Chunk* chunk)
 {
-    lightBfsQueue_.emplace(x, y, z, chunk);
+    // Chunks are generated on several worker threads at once
+    MutexLock lock(mutex_);
+    lightBfsQueue_.emplace(x, y, z, chunk->GetHandle());
     chunk->MarkForGeometryCalculation();
 }
 
@@ -40,9 +44,37 @@ void LightManager::AddLightNode(Vector3 position)
     }
 }
 
+void LightManager::AddSunlightNode(int x, int y, int z, Chunk* chunk)
+{
+    MutexLock lock(mutex_);
+    sunlightBfsQueue_.emplace(x, y, z, chunk->GetHandle());
+}
+
+void LightManager::AddSunlightNode(Vector3 position)
+{
+    auto chunk = GetSubsystem<VoxelWorld>()->GetChunkByPosition(position);
+    if (chunk) {
+        IntVector3 blockPosition = chunk->GetChunkBlock(position);
+        AddSunlightNode(blockPosition.x_, blockPosition.y_, blockPosition.z_, chunk);
+    }
+}
+
+void LightManager::AddSunlightRemovalNode(int x, int y, int z, int level, Chunk* chunk)
+{
+    MutexLock lock(mutex_);
+    sunlightRemovalBfsQueue_.emplace(x, y, z, level, chunk->GetHandle());
+    chunk->MarkForGeometryCalculation();
+}
+
+bool LightManager::IsTransparent(BlockType type)
+{
+    return type == BT_AIR || type == BT_WATER;
+}
+
 void LightManager::AddLightRemovalNode(int x, int y, int z, int level, Chunk* chunk)
 {
-    lightRemovalBfsQueue_.emplace(x, y, z, level, chunk);
+    MutexLock lock(mutex_);
+    lightRemovalBfsQueue_.emplace(x, y, z, level, chunk->GetHandle());
     chunk->MarkForGeometryCalculation();
 }
 
@@ -77,6 +109,8 @@ void LightManager::ResetFailedCalculations()
 
 void LightManager::Process()
 {
+    // Waves write to the same light maps
+    CompletePropagation();
     if (GetSubsystem<DebugHud>()) {
         int size1 = lightRemovalBfsQueue_.size();
         int size2 = lightBfsQueue_.size();
@@ -84,207 +118,343 @@ void LightManager::Process()
 //        int size4 = failedLightBfsQueue_.size();
         GetSubsystem<DebugHud>()->SetAppStats("LightManager::lightRemovalBfsQueue_", size1);
         GetSubsystem<DebugHud>()->SetAppStats("LightManager::lightBfsQueue_", size2);
+        GetSubsystem<DebugHud>()->SetAppStats("LightManager::sunlightRemovalBfsQueue_", (int)sunlightRemovalBfsQueue_.size());
+        GetSubsystem<DebugHud>()->SetAppStats("LightManager::sunlightBfsQueue_", (int)sunlightBfsQueue_.size());
 //        GetSubsystem<DebugHud>()->SetAppStats("LightManager::failedLightRemovalBfsQueue_", size3);
 //        GetSubsystem<DebugHud>()->SetAppStats("LightManager::failedLightBfsQueue_", size4);
     }
+    auto world = GetSubsystem<VoxelWorld>();
     MutexLock lock(mutex_);
     while(!lightRemovalBfsQueue_.empty()) {
-        // Get a reference to the front node
-        LightRemovalNode &node = lightRemovalBfsQueue_.front();
+        // Copy the front node, it is no longer valid after pop
+        LightRemovalNode node = lightRemovalBfsQueue_.front();
         int lightLevel = static_cast<int>(node.value_);
-        Chunk* chunk = node.chunk_;
         // Pop the front node off the queue.
         lightRemovalBfsQueue_.pop();
-        if (!GetSubsystem<VoxelWorld>()->IsChunkValid(chunk)) {
+        processedNodes_++;
+        Chunk* chunk = world->GetChunk(node.chunk_);
+        if (!chunk) {
             continue;
         }
-        // Extract x, y, and z from our chunk. Same as before.
-        // NOTE: Don't forget chunk bounds checking! I didn't show it here.
-        // Check negative X neighbor
 
         for (int i = 0; i < 6; i++) {
             int dX = node.x_;
             int dY = node.y_;
             int dZ = node.z_;
-            bool insideChunk = true;
-            switch (i) {
-                case BlockSide::LEFT:
-                    if (dX - 1 < 0) {
-                        insideChunk = false;
-                        dX = SIZE_X - 1;
-                    } else {
-                        dX -= 1;
-                    }
-                    break;
-                case BlockSide::RIGHT:
-                    if (dX + 1 >= SIZE_X) {
-                        insideChunk = false;
-                        dX = 0;
-                    } else {
-                        dX += 1;
-                    }
-                    break;
-                case BlockSide::BOTTOM:
-                    if (dY - 1 < 0) {
-                        insideChunk = false;
-                        dY = SIZE_Y - 1;
-                    } else {
-                        dY -= 1;
-                    }
-                    break;
-                case BlockSide::TOP:
-                    if (dY + 1 >= SIZE_Y) {
-                        insideChunk = false;
-                        dY = 0;
-                    } else {
-                        dY += 1;
-                    }
-                    break;
-                case BlockSide::FRONT:
-                    if (dZ - 1 < 0) {
-                        insideChunk = false;
-                        dZ = SIZE_Z - 1;
-                    } else {
-                        dZ -= 1;
-                    }
-                    break;
-                case BlockSide::BACK:
-                    if (dZ + 1 >= SIZE_Z) {
-                        insideChunk = false;
-                        dZ = 0;
-                    } else {
-                        dZ += 1;
-                    }
-                    break;
+            Chunk* target = ChunkLightTask::StepToNeighbor(chunk, static_cast<BlockSide>(i), dX, dY, dZ);
+            if (!target) {
+//                failedLightRemovalBfsQueue_.emplace(node);
+                continue;
             }
-
-            if (insideChunk) {
-                auto neighborLightLevel = chunk->GetTorchlight(dX, dY, dZ);
-                if (neighborLightLevel != 0 && neighborLightLevel < lightLevel) {
-                    chunk->SetTorchlight(dX, dY, dZ, 0);
-                    AddLightRemovalNode(dX, dY, dZ, neighborLightLevel, chunk);
-                } else if (neighborLightLevel >= lightLevel) {
-                    AddLightNode(dX, dY, dZ, chunk);
-                }
-            } else {
-                auto neighbor = chunk->GetNeighbor(static_cast<BlockSide>(i));
-                if (neighbor) {
-                    auto neighborLightLevel = neighbor->GetTorchlight(dX, dY, dZ);
-                    if (neighborLightLevel != 0 && neighborLightLevel < lightLevel) {
-                        neighbor->SetTorchlight(dX, dY, dZ, 0);
-                        AddLightRemovalNode(dX, dY, dZ, neighborLightLevel, neighbor);
-                    } else if (neighborLightLevel >= lightLevel) {
-                        AddLightNode(SIZE_X - 1, node.y_, node.z_, neighbor);
-                    }
-                } else {
-//                    failedLightRemovalBfsQueue_.emplace(node);
-                }
+            auto neighborLightLevel = target->GetTorchlight(dX, dY, dZ);
+            if (neighborLightLevel != 0 && neighborLightLevel < lightLevel) {
+                target->SetTorchlight(dX, dY, dZ, 0);
+                lightRemovalBfsQueue_.emplace(dX, dY, dZ, neighborLightLevel, target->GetHandle());
+            } else if (neighborLightLevel >= lightLevel) {
+                lightBfsQueue_.emplace(dX, dY, dZ, target->GetHandle());
             }
         }
     }
     while(!lightBfsQueue_.empty()) {
-        // Get a reference to the front node.
-        LightNode &node = lightBfsQueue_.front();
-        Chunk* chunk = node.chunk_;
-        // Pop the front node off the queue. We no longer need the node reference
+        // Copy the front node, it is no longer valid after pop
+        LightNode node = lightBfsQueue_.front();
         lightBfsQueue_.pop();
-        if (!GetSubsystem<VoxelWorld>()->IsChunkValid(chunk)) {
+        processedNodes_++;
+        Chunk* chunk = world->GetChunk(node.chunk_);
+        if (!chunk) {
             continue;
         }
         // Grab the light level of the current node
         int lightLevel = chunk->GetTorchlight(node.x_, node.y_, node.z_);
-        // NOTE: You will need to do bounds checking!
-        // If you are on the edge of a chunk, then x - 1 will be -1. Instead
-        // you need to look at your left neighboring chunk and check the
-        // adjacent block there. When you do that, be sure to use the
-        // neighbor chunk when emplacing the new node to lightBfsQueue;
-        // Check negative X neighbor
         // Make sure you don't propagate light into opaque blocks like stone!
 
         for (int i = 0; i < 6; i++) {
             int dX = node.x_;
             int dY = node.y_;
             int dZ = node.z_;
-            bool insideChunk = true;
-            switch (i) {
-                case BlockSide::LEFT:
-                    if (dX - 1 < 0) {
-                        insideChunk = false;
-                        dX = SIZE_X - 1;
-                    } else {
-                        dX -= 1;
-                    }
-                    break;
-                case BlockSide::RIGHT:
-                    if (dX + 1 >= SIZE_X) {
-                        insideChunk = false;
-                        dX = 0;
-                    } else {
-                        dX += 1;
-                    }
-                    break;
-                case BlockSide::BOTTOM:
-                    if (dY - 1 < 0) {
-                        insideChunk = false;
-                        dY = SIZE_Y - 1;
-                    } else {
-                        dY -= 1;
-                    }
-                    break;
-                case BlockSide::TOP:
-                    if (dY + 1 >= SIZE_Y) {
-                        insideChunk = false;
-                        dY = 0;
-                    } else {
-                        dY += 1;
-                    }
-                    break;
-                case BlockSide::FRONT:
-                    if (dZ - 1 < 0) {
-                        insideChunk = false;
-                        dZ = SIZE_Z - 1;
-                    } else {
-                        dZ -= 1;
-                    }
-                    break;
-                case BlockSide::BACK:
-                    if (dZ + 1 >= SIZE_Z) {
-                        insideChunk = false;
-                        dZ = 0;
-                    } else {
-                        dZ += 1;
-                    }
-                    break;
+            Chunk* target = ChunkLightTask::StepToNeighbor(chunk, static_cast<BlockSide>(i), dX, dY, dZ);
+            if (!target) {
+//                failedLightBfsQueue_.emplace(node);
+                continue;
             }
-
-            if (insideChunk) {
-                BlockType type = chunk->GetBlockAt(IntVector3(dX, dY, dZ))->type;
-                int blockLightLevel = chunk->GetTorchlight(dX, dY, dZ);
-                if ((type == BlockType::BT_AIR || type == BlockType::BT_WATER) && blockLightLevel + 2 <= lightLevel) {
-                    if (type == BlockType::BT_WATER) {
-                        // Light in water will fade out a bit quicker
-                        chunk->SetTorchlight(dX, dY, dZ, lightLevel - 2);
-                    } else {
-                        chunk->SetTorchlight(dX, dY, dZ, lightLevel - 1);
-                    }
-                    lightBfsQueue_.emplace(dX, dY, dZ, chunk);
+            BlockType type = target->GetBlockValue(dX, dY, dZ);
+            int blockLightLevel = target->GetTorchlight(dX, dY, dZ);
+            if (IsTransparent(type) && blockLightLevel + 2 <= lightLevel) {
+                if (type == BlockType::BT_WATER) {
+                    // Light in water will fade out a bit quicker
+                    target->SetTorchlight(dX, dY, dZ, lightLevel - 2);
+                } else {
+                    target->SetTorchlight(dX, dY, dZ, lightLevel - 1);
                 }
+                lightBfsQueue_.emplace(dX, dY, dZ, target->GetHandle());
+            }
+        }
+    }
+    ProcessSunlight();
+}
+
+ChunkLightTask* LightManager::GetTask(const ChunkHandle& handle)
+{
+    auto it = pendingTasks_.Find(handle.slot_);
+    if (it != pendingTasks_.End()) {
+        return it->second_;
+    }
+    SharedPtr<ChunkLightTask> task(new ChunkLightTask(handle));
+    pendingTasks_[handle.slot_] = task;
+    return task;
+}
+
+static void RunLightTask(const WorkItem* item, unsigned threadIndex)
+{
+    ChunkLightTask* task = reinterpret_cast<ChunkLightTask*>(item->aux_);
+    task->Run(reinterpret_cast<Chunk*>(item->start_));
+}
+
+void LightManager::StartPropagation()
+{
+    if (propagating_) {
+        return;
+    }
+    auto world = GetSubsystem<VoxelWorld>();
+    {
+        MutexLock lock(mutex_);
+        // Nodes of chunks removed since they were queued are dropped
+        while (!lightRemovalBfsQueue_.empty()) {
+            LightRemovalNode node = lightRemovalBfsQueue_.front();
+            lightRemovalBfsQueue_.pop();
+            if (world->IsChunkValid(node.chunk_)) {
+                GetTask(node.chunk_)->inbox_.Push(LightVisit(node.chunk_, node.x_, node.y_, node.z_, node.value_, LC_TORCH, LV_SEED_REMOVAL));
+            }
+        }
+        while (!lightBfsQueue_.empty()) {
+            LightNode node = lightBfsQueue_.front();
+            lightBfsQueue_.pop();
+            if (world->IsChunkValid(node.chunk_)) {
+                GetTask(node.chunk_)->inbox_.Push(LightVisit(node.chunk_, node.x_, node.y_, node.z_, 0, LC_TORCH, LV_SEED_SPREAD));
+            }
+        }
+        while (!sunlightRemovalBfsQueue_.empty()) {
+            LightRemovalNode node = sunlightRemovalBfsQueue_.front();
+            sunlightRemovalBfsQueue_.pop();
+            if (world->IsChunkValid(node.chunk_)) {
+                GetTask(node.chunk_)->inbox_.Push(LightVisit(node.chunk_, node.x_, node.y_, node.z_, node.value_, LC_SUN, LV_SEED_REMOVAL));
+            }
+        }
+        while (!sunlightBfsQueue_.empty()) {
+            LightNode node = sunlightBfsQueue_.front();
+            sunlightBfsQueue_.pop();
+            if (world->IsChunkValid(node.chunk_)) {
+                GetTask(node.chunk_)->inbox_.Push(LightVisit(node.chunk_, node.x_, node.y_, node.z_, 0, LC_SUN, LV_SEED_SPREAD));
+            }
+        }
+    }
+
+    propagating_ = true;
+    waves_ = 0;
+    propagationTasks_ = 0;
+    propagationTimer_.Reset();
+    ScheduleWave();
+}
+
+void LightManager::ScheduleWave()
+{
+    auto world = GetSubsystem<VoxelWorld>();
+    runningTasks_.Clear();
+    PODVector<Chunk*> chunks;
+    for (auto it = pendingTasks_.Begin(); it != pendingTasks_.End(); ++it) {
+        Chunk* chunk = world->GetChunk(it->second_->chunk_);
+        if (chunk && chunk->IsLoaded()) {
+            runningTasks_.Push(it->second_);
+            chunks.Push(chunk);
+        }
+    }
+    pendingTasks_.Clear();
+
+    if (runningTasks_.Empty()) {
+        propagating_ = false;
+        if (waves_ > 0 && GetSubsystem<DebugHud>()) {
+            GetSubsystem<DebugHud>()->SetAppStats("Light waves", waves_);
+            GetSubsystem<DebugHud>()->SetAppStats("Light tasks per wave", propagationTasks_ / waves_);
+            GetSubsystem<DebugHud>()->SetAppStats("Light propagation us", (int)propagationTimer_.GetUSec(false));
+        }
+        using namespace LightPropagated;
+        VariantMap& data = GetEventDataMap();
+        data[P_WAVES] = waves_;
+        SendEvent(E_LIGHT_PROPAGATED, data);
+        return;
+    }
+
+    waves_++;
+    propagationTasks_ += runningTasks_.Size();
+    runningCount_ = runningTasks_.Size();
+    WorkQueue* workQueue = GetSubsystem<WorkQueue>();
+    for (unsigned i = 0; i < runningTasks_.Size(); i++) {
+        SharedPtr<WorkItem> item = workQueue->GetFreeItem();
+        // Ahead of all chunk work, CompletePropagation waits only for these
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = RunLightTask;
+        item->aux_ = runningTasks_[i].Get();
+        item->start_ = chunks[i];
+        item->end_ = nullptr;
+        item->sendEvent_ = true;
+        workQueue->AddWorkItem(item);
+    }
+}
+
+void LightManager::CompletePropagation()
+{
+    WorkQueue* workQueue = GetSubsystem<WorkQueue>();
+    while (propagating_) {
+        // Completion events of the current wave schedule the next one
+        workQueue->Complete(M_MAX_UNSIGNED);
+    }
+}
+
+void LightManager::HandleWorkItemCompleted(StringHash eventType, VariantMap& eventData)
+{
+    using namespace WorkItemCompleted;
+    WorkItem* workItem = reinterpret_cast<WorkItem*>(eventData[P_ITEM].GetPtr());
+    if (workItem->workFunction_ != RunLightTask || --runningCount_ > 0) {
+        return;
+    }
+
+    // Wave finished, hand border crossings to the neighbor tasks in a fixed order
+    for (auto it = runningTasks_.Begin(); it != runningTasks_.End(); ++it) {
+        processedNodes_ += (*it)->processedNodes_;
+        PODVector<LightVisit>& outbox = (*it)->outbox_;
+        for (auto visit = outbox.Begin(); visit != outbox.End(); ++visit) {
+            GetTask((*visit).chunk_)->inbox_.Push(*visit);
+        }
+        outbox.Clear();
+    }
+    ScheduleWave();
+}
+
+void LightManager::ProcessSunlight()
+{
+    auto world = GetSubsystem<VoxelWorld>();
+    while(!sunlightRemovalBfsQueue_.empty()) {
+        LightRemovalNode node = sunlightRemovalBfsQueue_.front();
+        sunlightRemovalBfsQueue_.pop();
+        processedNodes_++;
+        Chunk* chunk = world->GetChunk(node.chunk_);
+        if (!chunk) {
+            continue;
+        }
+        int lightLevel = node.value_;
+        for (int i = 0; i < 6; i++) {
+            BlockSide side = static_cast<BlockSide>(i);
+            int dX = node.x_;
+            int dY = node.y_;
+            int dZ = node.z_;
+            Chunk* target = ChunkLightTask::StepToNeighbor(chunk, side, dX, dY, dZ);
+            if (!target) {
+                continue;
+            }
+            int neighborLightLevel = target->GetSunlight(dX, dY, dZ);
+            // Full sunlight below came straight down the removed column
+            bool column = side == BlockSide::BOTTOM && lightLevel == 15;
+            if (neighborLightLevel != 0 && (neighborLightLevel < lightLevel || column)) {
+                target->SetSunlight(dX, dY, dZ, 0);
+                sunlightRemovalBfsQueue_.emplace(dX, dY, dZ, neighborLightLevel, target->GetHandle());
+            } else if (neighborLightLevel >= lightLevel) {
+                // Lit from elsewhere, spread it back into the cleared area
+                sunlightBfsQueue_.emplace(dX, dY, dZ, target->GetHandle());
+            }
+        }
+    }
+
+    while(!sunlightBfsQueue_.empty()) {
+        LightNode node = sunlightBfsQueue_.front();
+        sunlightBfsQueue_.pop();
+        processedNodes_++;
+        Chunk* chunk = world->GetChunk(node.chunk_);
+        if (!chunk) {
+            continue;
+        }
+        int lightLevel = chunk->GetSunlight(node.x_, node.y_, node.z_);
+        if (lightLevel <= 1) {
+            continue;
+        }
+        for (int i = 0; i < 6; i++) {
+            BlockSide side = static_cast<BlockSide>(i);
+            int dX = node.x_;
+            int dY = node.y_;
+            int dZ = node.z_;
+            Chunk* target = ChunkLightTask::StepToNeighbor(chunk, side, dX, dY, dZ);
+            if (!target) {
+                continue;
+            }
+            BlockType type = target->GetBlockValue(dX, dY, dZ);
+            if (!IsTransparent(type)) {
+                continue;
+            }
+            int newLevel;
+            if (type == BlockType::BT_WATER) {
+                newLevel = lightLevel - 2;
+            } else if (side == BlockSide::BOTTOM && lightLevel == 15) {
+                // Direct sunlight travels down without fading
+                newLevel = 15;
             } else {
-                auto neighbor = chunk->GetNeighbor(static_cast<BlockSide>(i));
-                if (neighbor) {
-                    BlockType type = neighbor->GetBlockAt(IntVector3(dX, dY, dZ))->type;
-                    int blockLightLevel = neighbor->GetTorchlight(dX, dY, dZ);
-                    if ((type == BlockType::BT_AIR || type == BlockType::BT_WATER) && blockLightLevel + 2 <= lightLevel) {
-                        if (type == BlockType::BT_WATER) {
-                            // Light in water will fade out a bit quicker
-                            neighbor->SetTorchlight(dX, dY, dZ, lightLevel - 2);
-                        } else {
-                            neighbor->SetTorchlight(dX, dY, dZ, lightLevel - 1);
-                        }
-                        AddLightNode(dX, dY, dZ, neighbor);
-                    }
-                } else {
-//                    failedLightBfsQueue_.emplace(node);
+                newLevel = lightLevel - 1;
+            }
+            if (target->GetSunlight(dX, dY, dZ) < newLevel) {
+                target->SetSunlight(dX, dY, dZ, newLevel);
+                sunlightBfsQueue_.emplace(dX, dY, dZ, target->GetHandle());
+            }
+        }
+    }
+}
+
+void LightManager::SeedChunkBorders(Chunk* chunk)
+{
+    MutexLock lock(mutex_);
+    for (int i = 0; i < 6; i++) {
+        BlockSide side = static_cast<BlockSide>(i);
+        Chunk* neighbor = chunk->GetNeighbor(side);
+        if (!neighbor || !neighbor->IsLoaded()) {
+            continue;
+        }
+        // Torches near the border can now reach into this chunk
+        neighbor->CalculateLight();
+        neighbor->MarkForGeometryCalculation();
+
+        for (int a = 0; a < SIZE_X; a++) {
+            for (int b = 0; b < SIZE_Z; b++) {
+                int x = a;
+                int y = b;
+                int z = b;
+                // Border block of this chunk facing the neighbor
+                switch (side) {
+                    case BlockSide::TOP:    x = a; y = SIZE_Y - 1; z = b; break;
+                    case BlockSide::BOTTOM: x = a; y = 0; z = b; break;
+                    case BlockSide::LEFT:   x = 0; y = a; z = b; break;
+                    case BlockSide::RIGHT:  x = SIZE_X - 1; y = a; z = b; break;
+                    case BlockSide::FRONT:  x = a; y = b; z = 0; break;
+                    case BlockSide::BACK:   x = a; y = b; z = SIZE_Z - 1; break;
+                }
+                int nX = x;
+                int nY = y;
+                int nZ = z;
+                ChunkLightTask::StepToNeighbor(chunk, side, nX, nY, nZ);
+
+                int light = chunk->GetSunlight(x, y, z);
+                int neighborLight = neighbor->GetSunlight(nX, nY, nZ);
+                // Column assumed open sky but the block above is shaded
+                if (side == BlockSide::TOP && light == 15 && neighborLight != 15) {
+                    chunk->SetSunlight(x, y, z, 0);
+                    sunlightRemovalBfsQueue_.emplace(x, y, z, light, chunk->GetHandle());
+                    continue;
+                }
+                if (side == BlockSide::BOTTOM && neighborLight == 15 && light != 15) {
+                    neighbor->SetSunlight(nX, nY, nZ, 0);
+                    sunlightRemovalBfsQueue_.emplace(nX, nY, nZ, neighborLight, neighbor->GetHandle());
+                    continue;
+                }
+                if (light > neighborLight + 1) {
+                    sunlightBfsQueue_.emplace(x, y, z, chunk->GetHandle());
+                } else if (neighborLight > light + 1) {
+                    sunlightBfsQueue_.emplace(nX, nY, nZ, neighbor->GetHandle());
                 }
             }
         }
@@ -1,27 +1,30 @@
 #pragma once
 #include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Core/Timer.h>
 #include <queue>
 #include "VoxelDefs.h"
 #include "VoxelEvents.h"
 #include "Chunk.h"
+#include "ChunkLightTask.h"
 
 using namespace Urho3D;
 
 struct LightRemovalNode {
-    LightRemovalNode(short x, short y, short z, short val, Chunk* ch) : x_(x), y_(y), z_(z), value_(val), chunk_(ch) {}
+    LightRemovalNode(short x, short y, short z, short val, const ChunkHandle& ch) : x_(x), y_(y), z_(z), value_(val), chunk_(ch) {}
     short x_;
     short y_;
     short z_;
     short value_;
-    Chunk* chunk_; //pointer to the chunk that owns it!
+    ChunkHandle chunk_; //handle of the chunk that owns it!
 };
 
 struct LightNode {
-    LightNode(short x, short y, short z, Chunk* ch) : x_(x), y_(y), z_(z), chunk_(ch) {}
+    LightNode(short x, short y, short z, const ChunkHandle& ch) : x_(x), y_(y), z_(z), chunk_(ch) {}
     short x_;
     short y_;
     short z_;
-    Chunk* chunk_; //pointer to the chunk that owns it!
+    ChunkHandle chunk_; //handle of the chunk that owns it!
 };
 
 class LightManager : public Object {
@@ -34,18 +37,71 @@ public:
     void AddLightNode(int x, int y, int z, Chunk* chunk);
     void AddLightRemovalNode(int x, int y, int z, int level, Chunk* chunk);
     void AddLightNode(Vector3 position);
+    void AddSunlightNode(int x, int y, int z, Chunk* chunk);
+    void AddSunlightRemovalNode(int x, int y, int z, int level, Chunk* chunk);
+    void AddSunlightNode(Vector3 position);
     void ResetFailedCalculations();
 
+    /**
+     * Connect light of a freshly loaded chunk with its loaded neighbors.
+     * Must run while no chunk work items are in flight
+     */
+    void SeedChunkBorders(Chunk* chunk);
+
+    /**
+     * Blocks that let light through
+     */
+    static bool IsTransparent(BlockType type);
+
+    /**
+     * Total light and removal nodes handled by Process
+     */
+    unsigned GetProcessedNodeCount() const { return processedNodes_; }
+
 //    void AddFailedLightNode(int x, int y, int z, Vector3 position);
 //    void AddFailedLightRemovalNode(int x, int y, int z, int level, Vector3 position);
+
+    /**
+     * Serial propagation of all queued nodes on the calling thread
+     */
     void Process();
 
+    /**
+     * Split queued nodes into per chunk tasks and propagate them in parallel waves.
+     * Light crossing a chunk border is handed to the neighbor task in the next wave.
+     * E_LIGHT_PROPAGATED is sent once no chunk has work left
+     */
+    void StartPropagation();
+
+    /**
+     * Run the remaining waves on the calling thread, blocks must not be edited while waves are running
+     */
+    void CompletePropagation();
+
+    bool IsPropagating() const { return propagating_; }
+
 private:
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
     void HandleEvents(StringHash eventType, VariantMap& eventData);
+    void HandleWorkItemCompleted(StringHash eventType, VariantMap& eventData);
+    void ProcessSunlight();
+    void ScheduleWave();
+    ChunkLightTask* GetTask(const ChunkHandle& handle);
 
     std::queue<LightNode> lightBfsQueue_;
     std::queue<LightRemovalNode> lightRemovalBfsQueue_;
+    std::queue<LightNode> sunlightBfsQueue_;
+    std::queue<LightRemovalNode> sunlightRemovalBfsQueue_;
+    unsigned processedNodes_{0};
+
+    // Tasks of the next wave by chunk handle slot
+    HashMap<unsigned, SharedPtr<ChunkLightTask>> pendingTasks_;
+    Vector<SharedPtr<ChunkLightTask>> runningTasks_;
+    unsigned runningCount_{0};
+    bool propagating_{false};
+    unsigned waves_{0};
+    unsigned propagationTasks_{0};
+    HiresTimer propagationTimer_;
 
 //    std::queue<LightNode> failedLightBfsQueue_;
 //    std::queue<LightRemovalNode> failedLightRemovalBfsQueue_;
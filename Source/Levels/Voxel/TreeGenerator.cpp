@@ -1,16 +1,98 @@
+#include <queue>
 #include <Urho3D/Core/Context.h>
-#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Mutex.h>
 #include <Urho3D/IO/Log.h>
 #include "TreeGenerator.h"
-#include "VoxelWorld.h"
+#include "ChunkGenerator.h"
 
-using namespace VoxelEvents;
+namespace {
+
+struct TreeBlock {
+    IntVector3 offset_;
+    BlockType type_;
+};
+
+// Bounds of the tree shape around its root, sideways growth stops after 3 blocks and upwards after 10
+const int TREE_RADIUS = 3;
+const int TREE_HEIGHT = 11;
+const int TREE_WIDTH = TREE_RADIUS * 2 + 1;
+
+// Offsets towards each BlockSide
+const IntVector3 SIDE_OFFSETS[6] = {
+        IntVector3(0, 1, 0), IntVector3(0, -1, 0), IntVector3(-1, 0, 0),
+        IntVector3(1, 0, 0), IntVector3(0, 0, -1), IntVector3(0, 0, 1)
+};
+
+/**
+ * Tree grown from the root without obstacles, the same breadth first growth the trees used to have in the world:
+ * trunk straight up, leaves once the height is above 5 and spreading sideways up to 3 blocks
+ */
+void BuildTreeShape(PODVector<TreeBlock>& shape)
+{
+    struct Node {
+        IntVector3 position_;
+        int height_;
+        int width_;
+    };
+    bool visited[TREE_WIDTH][TREE_HEIGHT][TREE_WIDTH] = {};
+    visited[TREE_RADIUS][0][TREE_RADIUS] = true;
+    std::queue<Node> queue;
+    queue.push({IntVector3::ZERO, 0, 0});
+    while (!queue.empty()) {
+        Node node = queue.front();
+        queue.pop();
+        int height = node.height_;
+        for (int i = 0; i < 6; i++) {
+            BlockSide side = static_cast<BlockSide>(i);
+            if (side == BOTTOM || (height < 5 && side != TOP)) {
+                continue;
+            }
+            if (side == TOP) {
+                // Sides of this node grow at the raised height as well
+                height++;
+            }
+            int width = node.width_;
+            if (side != TOP) {
+                if (node.width_ > 2) {
+                    continue;
+                }
+                width++;
+            }
+            IntVector3 position = node.position_ + SIDE_OFFSETS[i];
+            if (Abs(position.x_) > TREE_RADIUS || Abs(position.z_) > TREE_RADIUS || position.y_ >= TREE_HEIGHT) {
+                continue;
+            }
+            bool& seen = visited[position.x_ + TREE_RADIUS][position.y_][position.z_ + TREE_RADIUS];
+            if (seen) {
+                continue;
+            }
+            seen = true;
+            shape.Push({position, height > 5 ? BT_TREE_LEAVES : BT_WOOD});
+            if (height < 10) {
+                queue.push({position, height, width});
+            }
+        }
+    }
+}
+
+const PODVector<TreeBlock>& GetTreeShape()
+{
+    static PODVector<TreeBlock> shape;
+    static bool built = false;
+    static Mutex mutex;
+    MutexLock lock(mutex);
+    if (!built) {
+        BuildTreeShape(shape);
+        built = true;
+    }
+    return shape;
+}
+
+}
 
 TreeGenerator::TreeGenerator(Context* context):
         Object(context)
 {
-//    SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(TreeGenerator, HandleUpdate));
-    SubscribeToEvent(E_CHUNK_GENERATED, URHO3D_HANDLER(TreeGenerator, HandleChunkGenerated));
 }
 
 TreeGenerator::~TreeGenerator()
@@ -22,143 +104,58 @@ void TreeGenerator::RegisterObject(Context* context)
     context->RegisterFactory<TreeGenerator>();
 }
 
-void TreeGenerator::AddTreeNode(int x, int y, int z, int height, int width, Chunk *chunk)
+bool TreeGenerator::MergeBlock(BlockType& block, BlockType type)
 {
-    treeBfsQueue_.emplace(x, y, z, height, width, chunk);
-    chunk->MarkForGeometryCalculation();
-//    URHO3D_LOGINFOF("AddTreeNode %d %d %d => %d", x, y, z, height);
+    if (block == BT_AIR || (block == BT_TREE_LEAVES && type == BT_WOOD)) {
+        block = type;
+        return true;
+    }
+    return false;
 }
 
-void TreeGenerator::Process()
+bool TreeGenerator::HasTreeRoot(const ChunkColumn& column, int index)
 {
-    MutexLock lock(mutex_);
-
-    while(!treeBfsQueue_.empty()) {
-        // Get a reference to the front node.
-        TreeNode &node = treeBfsQueue_.front();
-        Chunk* chunk = node.chunk_;
-        int height = node.height_;
-        int width = node.width_;
-        // Pop the front node off the queue. We no longer need the node reference
-        treeBfsQueue_.pop();
-        if (!GetSubsystem<VoxelWorld>()->IsChunkValid(chunk)) {
-            continue;
-        }
-
-        for (int i = 0; i < 6; i++) {
-            BlockSide side = static_cast<BlockSide>(i);
-            int dX = node.x_;
-            int dY = node.y_;
-            int dZ = node.z_;
-            bool insideChunk = true;
-
-            if (side == BlockSide::BOTTOM) {
-                continue;
-            }
-
-            if (height < 5 && side != BlockSide::TOP) {
-                continue;
-            }
-
-            if (side == BlockSide::TOP) {
-                height++;
-            }
-            switch (i) {
-                case BlockSide::LEFT:
-                    if (dX - 1 < 0) {
-                        insideChunk = false;
-                        dX = SIZE_X - 1;
-                    } else {
-                        dX -= 1;
-                    }
-                    break;
-                case BlockSide::RIGHT:
-                    if (dX + 1 >= SIZE_X) {
-                        insideChunk = false;
-                        dX = 0;
-                    } else {
-                        dX += 1;
-                    }
-                    break;
-                case BlockSide::BOTTOM:
-                    if (dY - 1 < 0) {
-                        insideChunk = false;
-                        dY = SIZE_Y - 1;
-                    } else {
-                        dY -= 1;
-                    }
-                    break;
-                case BlockSide::TOP:
-                    if (dY + 1 >= SIZE_Y) {
-                        insideChunk = false;
-                        dY = 0;
-                    } else {
-                        dY += 1;
-                    }
-                    break;
-                case BlockSide::FRONT:
-                    if (dZ - 1 < 0) {
-                        insideChunk = false;
-                        dZ = SIZE_Z - 1;
-                    } else {
-                        dZ -= 1;
-                    }
-                    break;
-                case BlockSide::BACK:
-                    if (dZ + 1 >= SIZE_Z) {
-                        insideChunk = false;
-                        dZ = 0;
-                    } else {
-                        dZ += 1;
-                    }
-                    break;
-            }
+    // Trees only grow on dirt, the surface of grass columns and columns without a biome
+    Biome biome = static_cast<Biome>(column.biomes_[index]);
+    return column.trees_[index] && (biome == B_GRASS || biome >= B_NONE);
+}
 
-            int dWidth = width;
-            if (side == BlockSide::FRONT || side == BlockSide::BACK || side == BlockSide::LEFT || side == BlockSide::RIGHT) {
-                dWidth++;
-                if (width > 2) {
+void TreeGenerator::PlaceTrees(ChunkGenerator* generator, const IntVector3& chunkCoordinates, BlockType* blocks)
+{
+    const PODVector<TreeBlock>& shape = GetTreeShape();
+    int chunkY = chunkCoordinates.y_ * SIZE_Y;
+    // Trees are narrower than a chunk, only the adjacent chunk columns can reach into this one
+    for (int columnX = -1; columnX <= 1; columnX++) {
+        for (int columnZ = -1; columnZ <= 1; columnZ++) {
+            ChunkColumn column;
+            generator->GetColumn(chunkCoordinates.x_ + columnX, chunkCoordinates.z_ + columnZ, column);
+            for (int x = 0; x < SIZE_X; x++) {
+                // Root position relative to this chunk
+                int rootX = x + columnX * SIZE_X;
+                if (rootX < -TREE_RADIUS || rootX >= SIZE_X + TREE_RADIUS) {
                     continue;
                 }
-            }
-            if (insideChunk) {
-                BlockType type = chunk->GetBlockAt(IntVector3(dX, dY, dZ))->type;
-                if (type == BT_AIR) {
-                    chunk->SetVoxel(dX, dY, dZ, height > 5 ? BT_TREE_LEAVES : BT_WOOD);
-                    if (height < 10) {
-                        AddTreeNode(dX, dY, dZ, height, dWidth, chunk);
+                for (int z = 0; z < SIZE_Z; z++) {
+                    int rootZ = z + columnZ * SIZE_Z;
+                    int rootY = column.heights_[x * SIZE_Z + z] - chunkY;
+                    if (rootZ < -TREE_RADIUS || rootZ >= SIZE_Z + TREE_RADIUS || rootY <= -TREE_HEIGHT || rootY >= SIZE_Y
+                        || !HasTreeRoot(column, x * SIZE_Z + z)) {
+                        continue;
                     }
-                }
-            } else {
-                auto neighbor = chunk->GetNeighbor(static_cast<BlockSide>(i));
-                if (neighbor) {
-                    BlockType type = neighbor->GetBlockAt(IntVector3(dX, dY, dZ))->type;
-                    if (type == BT_AIR) {
-                        neighbor->SetVoxel(dX, dY, dZ, height > 5 ? BT_TREE_LEAVES : BT_WOOD);
-                        if (height < 10) {
-                            AddTreeNode(dX, dY, dZ, height, dWidth, neighbor);
+                    if (rootX >= 0 && rootX < SIZE_X && rootZ >= 0 && rootZ < SIZE_Z && rootY >= 0) {
+                        // Trunk replaces the surface block
+                        blocks[Chunk::GetBlockIndex(rootX, rootY, rootZ)] = BT_WOOD;
+                    }
+                    for (auto it = shape.Begin(); it != shape.End(); ++it) {
+                        int blockX = rootX + it->offset_.x_;
+                        int blockY = rootY + it->offset_.y_;
+                        int blockZ = rootZ + it->offset_.z_;
+                        if (blockX >= 0 && blockX < SIZE_X && blockY >= 0 && blockY < SIZE_Y && blockZ >= 0 && blockZ < SIZE_Z) {
+                            MergeBlock(blocks[Chunk::GetBlockIndex(blockX, blockY, blockZ)], it->type_);
                         }
                     }
-                } else {
-                    failedTreeBfsQueue_.emplace(node);
                 }
             }
         }
     }
 }
-
-void TreeGenerator::HandleUpdate(StringHash eventType, VariantMap& eventData)
-{
-    if (GetSubsystem<VoxelWorld>()) {
-        Process();
-    }
-}
-
-void TreeGenerator::HandleChunkGenerated(StringHash eventType, VariantMap& eventData)
-{
-    MutexLock lock(mutex_);
-    while(!failedTreeBfsQueue_.empty()) {
-        treeBfsQueue_.emplace(failedTreeBfsQueue_.front());
-        failedTreeBfsQueue_.pop();
-    }
-}
\ No newline at end of file
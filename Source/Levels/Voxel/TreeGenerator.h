@@ -1,22 +1,18 @@
 #pragma once
 #include <Urho3D/Core/Object.h>
-#include <queue>
 #include "VoxelDefs.h"
-#include "VoxelEvents.h"
-#include "Chunk.h"
 
 using namespace Urho3D;
 
-struct TreeNode {
-    TreeNode(short x, short y, short z, int height, int width, Chunk* ch) : x_(x), y_(y), z_(z), height_(height), width_(width), chunk_(ch) {}
-    short x_;
-    short y_;
-    short z_;
-    Chunk* chunk_;
-    int height_;
-    int width_;
-};
+class ChunkGenerator;
+struct ChunkColumn;
 
+/**
+ * Decoration stage of the chunk generation. Trees have a fixed shape grown from their root block on the surface
+ * of the grass columns marked by the ChunkColumn. Every chunk places the parts of all trees reaching into it,
+ * including the ones rooted in neighboring chunk columns, so the decoration only depends on the seed.
+ * Decoration blocks only replace air, or leaves with wood, so overlapping trees give the same result in any order
+ */
 class TreeGenerator : public Object {
 URHO3D_OBJECT(TreeGenerator, Object);
     TreeGenerator(Context* context);
@@ -24,14 +20,20 @@ URHO3D_OBJECT(TreeGenerator, Object);
 
 public:
     static void RegisterObject(Context* context);
-    void AddTreeNode(int x, int y, int z, int height, int width, Chunk* chunk);
-    void Process();
 
-private:
-    void HandleUpdate(StringHash eventType, VariantMap& eventData);
-    void HandleChunkGenerated(StringHash eventType, VariantMap& eventData);
+    /**
+     * Place the parts of the trees that fall into the chunk. Reads the columns of the chunk and its
+     * horizontal neighbors from the generator, safe on any thread
+     */
+    static void PlaceTrees(ChunkGenerator* generator, const IntVector3& chunkCoordinates, BlockType* blocks);
+
+    /**
+     * Combine a decoration block with the current one, returns false when the current block stays
+     */
+    static bool MergeBlock(BlockType& block, BlockType type);
 
-    std::queue<TreeNode> treeBfsQueue_;
-    std::queue<TreeNode> failedTreeBfsQueue_;
-    Mutex mutex_;
+    /**
+     * Column grows a tree from its surface block
+     */
+    static bool HasTreeRoot(const ChunkColumn& column, int index);
 };
@@ -0,0 +1,1727 @@
+#include <cstring>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include "../../Global.h"
+#include "VoxelBenchmark.h"
+#include "VoxelWorld.h"
+#include "LightManager.h"
+#include "ChunkCodec.h"
+#include "ChunkGenerator.h"
+#include "TreeGenerator.h"
+#include "ChunkStorage.h"
+#include "EditJournal.h"
+#include "../../Console/ConsoleHandlerEvents.h"
+#include "../../Generator/NoiseBatch.h"
+
+using namespace ConsoleHandlerEvents;
+using namespace VoxelEvents;
+
+// Benchmark chunks are placed high above the world so they never neighbor real chunks
+static const Vector3 BENCHMARK_ORIGIN(0, 100000, 0);
+
+// Far away from the played area but around the terrain surface, used where block content matters
+static const Vector3 TERRAIN_BENCHMARK_ORIGIN(100000, 0, 100000);
+
+// Chunk key used by VoxelWorld before the packed coordinate map
+static String GetLegacyChunkIdentificator(const Vector3& position)
+{
+    return String((int)position.x_) + "_" +  String((int)position.y_) + "_" + String((int)position.z_);
+}
+
+// All generation stages without waiting for neighbors. Trees growing in from the neighbor columns only depend
+// on the seed and match what the world would generate there
+static void GenerateBlocks(Chunk* chunk)
+{
+    chunk->Load();
+    // Chunks read from block records are complete
+    if (!chunk->IsLoaded()) {
+        chunk->Decorate();
+    }
+}
+
+static void GenerateBenchmarkChunk(const WorkItem* item, unsigned threadIndex)
+{
+    Chunk* chunk = reinterpret_cast<Chunk*>(item->aux_);
+    GenerateBlocks(chunk);
+    chunk->CalculateGeometry();
+}
+
+static void LoadBenchmarkChunk(const WorkItem* item, unsigned threadIndex)
+{
+    GenerateBlocks(reinterpret_cast<Chunk*>(item->aux_));
+}
+
+// FNV-1a over the block types of one chunk
+static unsigned HashBlocks(const BlockType* blocks)
+{
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < CHUNK_VOXEL_COUNT; i++) {
+        hash = (hash ^ static_cast<unsigned>(blocks[i])) * 16777619u;
+    }
+    return hash;
+}
+
+static unsigned HashChunkBlocks(Chunk* chunk)
+{
+    BlockType blocks[CHUNK_VOXEL_COUNT];
+    chunk->GetBlocks(blocks);
+    return HashBlocks(blocks);
+}
+
+// Decoration of one chunk outside of the world
+struct DecorationJob {
+    ChunkGenerator* generator_;
+    IntVector3 coordinates_;
+    BlockType* blocks_;
+};
+
+static void RunDecorationJob(DecorationJob& job)
+{
+    TreeGenerator::PlaceTrees(job.generator_, job.coordinates_, job.blocks_);
+}
+
+static void DecorateBenchmarkBlocks(const WorkItem* item, unsigned threadIndex)
+{
+    RunDecorationJob(*reinterpret_cast<DecorationJob*>(item->aux_));
+}
+
+VoxelBenchmark::VoxelBenchmark(Context* context):
+    Object(context)
+{
+    RegisterConsoleCommands();
+}
+
+VoxelBenchmark::~VoxelBenchmark()
+{
+}
+
+void VoxelBenchmark::RegisterObject(Context* context)
+{
+    context->RegisterFactory<VoxelBenchmark>();
+}
+
+void VoxelBenchmark::RegisterConsoleCommands()
+{
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_chunk_generation",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_chunk_generation",
+            ConsoleCommandAdd::P_DESCRIPTION, "Generate and mesh N^3 chunks serially and in parallel",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_chunk_generation", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        BenchmarkChunkGeneration(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_meshing",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_meshing",
+            ConsoleCommandAdd::P_DESCRIPTION, "Compare naive and greedy meshing of N^3 generated chunks",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_meshing", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        BenchmarkMeshing(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_chunk_lookup",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_chunk_lookup",
+            ConsoleCommandAdd::P_DESCRIPTION, "Compare String keyed and packed coordinate chunk lookups over N^3 chunks",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_chunk_lookup", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 8;
+        BenchmarkChunkLookup(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_relight",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_relight",
+            ConsoleCommandAdd::P_DESCRIPTION, "Measure light update cost of N block edits in the loaded world",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_relight", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 100;
+        BenchmarkRelight(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "test_light_determinism",
+            ConsoleCommandAdd::P_EVENT, "#test_light_determinism",
+            ConsoleCommandAdd::P_DESCRIPTION, "Compare serial and parallel light propagation after N block edits",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#test_light_determinism", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 100;
+        TestLightDeterminism(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "test_chunk_codec",
+            ConsoleCommandAdd::P_EVENT, "#test_chunk_codec",
+            ConsoleCommandAdd::P_DESCRIPTION, "Round-trip N^3 terrain chunks through the chunk wire codec",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#test_chunk_codec", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        TestChunkCodec(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_collision",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_collision",
+            ConsoleCommandAdd::P_DESCRIPTION, "Compare triangle mesh and box collision of N^3 terrain chunks",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_collision", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 3;
+        BenchmarkCollision(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_raycast",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_raycast",
+            ConsoleCommandAdd::P_DESCRIPTION, "Cast N random rays through the loaded world with the voxel and triangle raycasts",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_raycast", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 10000;
+        BenchmarkRaycast(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "test_generation_determinism",
+            ConsoleCommandAdd::P_EVENT, "#test_generation_determinism",
+            ConsoleCommandAdd::P_DESCRIPTION, "Generate N^3 terrain chunks serially and in parallel and compare block hashes",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#test_generation_determinism", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        TestGenerationDeterminism(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "test_decoration_determinism",
+            ConsoleCommandAdd::P_EVENT, "#test_decoration_determinism",
+            ConsoleCommandAdd::P_DESCRIPTION, "Decorate N^3 terrain chunks serially and in parallel in reverse order and compare the trees",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#test_decoration_determinism", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        TestDecorationDeterminism(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_noise",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_noise",
+            ConsoleCommandAdd::P_DESCRIPTION, "Sample N noise values with the scalar and SIMD noise kernels",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_noise", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 65536;
+        BenchmarkNoise(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_density_lattice",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_density_lattice",
+            ConsoleCommandAdd::P_DESCRIPTION, "Generate N^3 terrain chunks with every density lattice step and compare the blocks",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_density_lattice", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        BenchmarkDensityLattice(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "benchmark_persistence",
+            ConsoleCommandAdd::P_EVENT, "#benchmark_persistence",
+            ConsoleCommandAdd::P_DESCRIPTION, "Edit every 8th of N^3 terrain chunks, compare stored bytes of full blocks and player edits, verify regenerated chunks",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#benchmark_persistence", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        BenchmarkPersistence(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "test_edit_journal",
+            ConsoleCommandAdd::P_EVENT, "#test_edit_journal",
+            ConsoleCommandAdd::P_DESCRIPTION, "Journal N edits of a scratch world with batched syncs, fold them on close and after a crash that cut the last record",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#test_edit_journal", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 10000;
+        TestEditJournal(Max(count, 1));
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "test_region_roundtrip",
+            ConsoleCommandAdd::P_EVENT, "#test_region_roundtrip",
+            ConsoleCommandAdd::P_DESCRIPTION, "Write N^3 generated and legacy JSON chunks through a scratch region file, rewrite them and compare the blocks",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#test_region_roundtrip", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        int count = params.Size() > 1 ? ToInt(params[1]) : 4;
+        TestRegionRoundTrip(Max(count, 1));
+    });
+}
+
+void VoxelBenchmark::CreateChunks(Vector<SharedPtr<Chunk>>& chunks, int count, const Vector3& origin)
+{
+    if (!scene_) {
+        scene_ = new Scene(context_);
+    }
+    for (int x = 0; x < count; x++) {
+        for (int y = 0; y < count; y++) {
+            for (int z = 0; z < count; z++) {
+                SharedPtr<Chunk> chunk(new Chunk(context_));
+                chunk->Init(scene_, origin + Vector3(x * SIZE_X, y * SIZE_Y, z * SIZE_Z));
+                // Skip disk lookups, measure generation only
+                chunk->SetDiskState(CDS_MISSING);
+                chunks.Push(chunk);
+            }
+        }
+    }
+}
+
+void VoxelBenchmark::BenchmarkChunkGeneration(int count)
+{
+    auto workQueue = GetSubsystem<WorkQueue>();
+    int chunkCount = count * count * count;
+
+    // Both runs sample the terrain columns themselves
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, BENCHMARK_ORIGIN);
+    chunkGenerator->ClearColumnCache();
+    HiresTimer timer;
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        GenerateBlocks(*it);
+        (*it)->CalculateGeometry();
+    }
+    long long serialTime = timer.GetUSec(false);
+    chunks.Clear();
+
+    CreateChunks(chunks, count, BENCHMARK_ORIGIN);
+    chunkGenerator->ClearColumnCache();
+    timer.Reset();
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        SharedPtr<WorkItem> item = workQueue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = GenerateBenchmarkChunk;
+        item->aux_ = (*it).Get();
+        item->sendEvent_ = false;
+        item->start_ = nullptr;
+        item->end_ = nullptr;
+        workQueue->AddWorkItem(item);
+    }
+    workQueue->Complete(M_MAX_UNSIGNED);
+    long long parallelTime = timer.GetUSec(false);
+    chunks.Clear();
+
+    float serialRate = chunkCount / Max(serialTime / 1000000.0f, 0.000001f);
+    float parallelRate = chunkCount / Max(parallelTime / 1000000.0f, 0.000001f);
+    URHO3D_LOGINFOF("Chunk generation benchmark, %d chunks: serial %.2f chunks/s, parallel %.2f chunks/s on %d threads, speedup %.2fx",
+                    chunkCount, serialRate, parallelRate, workQueue->GetNumThreads() + 1, parallelRate / serialRate);
+}
+
+void VoxelBenchmark::BenchmarkMeshing(int count)
+{
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, BENCHMARK_ORIGIN);
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        GenerateBlocks(*it);
+    }
+
+    const MeshingMode modes[] = {MM_NAIVE, MM_GREEDY};
+    for (int i = 0; i < 2; i++) {
+        unsigned vertexCount = 0;
+        unsigned indexCount = 0;
+        HiresTimer timer;
+        for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+            (*it)->CalculateGeometry(modes[i]);
+            vertexCount += (*it)->GetMeshStats().vertexCount_;
+            indexCount += (*it)->GetMeshStats().indexCount_;
+        }
+        long long time = timer.GetUSec(false);
+        URHO3D_LOGINFOF("Meshing benchmark, %s, %d chunks: %u vertices (%u bytes), %u indices, %.2f ms total, %.1f us/chunk",
+                        modes[i] == MM_GREEDY ? "greedy" : "naive", chunks.Size(), vertexCount,
+                        (unsigned)(vertexCount * sizeof(MeshVertex)), indexCount, time / 1000.0f, (float)time / chunks.Size());
+    }
+}
+
+void VoxelBenchmark::BenchmarkChunkLookup(int count)
+{
+    const int lookupCount = 1000000;
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, BENCHMARK_ORIGIN);
+
+    HashMap<String, SharedPtr<Chunk>> legacyMap;
+    ChunkMap chunkMap;
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        legacyMap[GetLegacyChunkIdentificator((*it)->GetPosition())] = *it;
+        chunkMap.Insert((*it)->GetChunkCoordinates(), *it);
+    }
+
+    // Same query set for both maps, roughly half of the lookups miss.
+    // Local generator so the global random seed used by world generation is left alone
+    PODVector<Vector3> queries;
+    queries.Resize(lookupCount);
+    unsigned state = 1;
+    for (int i = 0; i < lookupCount; i++) {
+        int coordinates[3];
+        for (int j = 0; j < 3; j++) {
+            state = state * 1664525u + 1013904223u;
+            coordinates[j] = (state >> 16) % (j == 0 ? count * 2 : count);
+        }
+        queries[i] = BENCHMARK_ORIGIN + Vector3(coordinates[0] * SIZE_X, coordinates[1] * SIZE_Y, coordinates[2] * SIZE_Z);
+    }
+
+    unsigned legacyHits = 0;
+    HiresTimer timer;
+    for (int i = 0; i < lookupCount; i++) {
+        auto it = legacyMap.Find(GetLegacyChunkIdentificator(queries[i]));
+        if (it != legacyMap.End() && (*it).second_) {
+            legacyHits++;
+        }
+    }
+    long long legacyTime = timer.GetUSec(false);
+
+    unsigned hits = 0;
+    timer.Reset();
+    for (int i = 0; i < lookupCount; i++) {
+        IntVector3 coordinates(FloorToInt(queries[i].x_ / SIZE_X), FloorToInt(queries[i].y_ / SIZE_Y), FloorToInt(queries[i].z_ / SIZE_Z));
+        if (chunkMap.Find(coordinates)) {
+            hits++;
+        }
+    }
+    long long time = timer.GetUSec(false);
+
+    URHO3D_LOGINFOF("Chunk lookup benchmark, %d chunks, %d lookups: String keys %.1f ns/lookup (%u hits), packed keys %.1f ns/lookup (%u hits), speedup %.2fx",
+                    chunks.Size(), lookupCount, legacyTime * 1000.0f / lookupCount, legacyHits,
+                    time * 1000.0f / lookupCount, hits, (float)legacyTime / Max(time, 1LL));
+}
+
+/**
+ * Benchmark edits go through SetBlockData, which records them as player edits of the live chunks
+ */
+static void SnapshotEdits(const PODVector<Chunk*>& chunks, Vector<PODVector<BlockEdit>>& edits, PODVector<bool>& shouldSave)
+{
+    edits.Resize(chunks.Size());
+    shouldSave.Resize(chunks.Size());
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        bool save;
+        chunks[i]->GetEditState(edits[i], save);
+        shouldSave[i] = save;
+    }
+}
+
+static void RestoreEdits(const PODVector<Chunk*>& chunks, const Vector<PODVector<BlockEdit>>& edits, const PODVector<bool>& shouldSave)
+{
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        chunks[i]->SetEditState(edits[i], shouldSave[i]);
+    }
+}
+
+void VoxelBenchmark::BenchmarkRelight(int count)
+{
+    auto world = GetSubsystem<VoxelWorld>();
+    auto lightManager = GetSubsystem<LightManager>();
+    if (!world || !lightManager) {
+        URHO3D_LOGERROR("Relight benchmark requires a running voxel world");
+        return;
+    }
+
+    // Let generation, meshing and the update pass finish so nothing else touches the light maps
+    GetSubsystem<WorkQueue>()->Complete(0);
+
+    PODVector<Chunk*> chunks;
+    PODVector<Chunk*> loaded;
+    world->GetLoadedChunks(loaded);
+    for (auto it = loaded.Begin(); it != loaded.End(); ++it) {
+        if ((*it)->AreNeighborsLoaded()) {
+            chunks.Push(*it);
+        }
+    }
+    if (chunks.Empty()) {
+        URHO3D_LOGERROR("Relight benchmark found no loaded chunks with loaded neighbors");
+        return;
+    }
+    lightManager->Process();
+    Vector<PODVector<BlockEdit>> originalEdits;
+    PODVector<bool> originalShouldSave;
+    SnapshotEdits(chunks, originalEdits, originalShouldSave);
+
+    unsigned state = 1;
+    int edits = 0;
+    long long placeTime = 0;
+    long long removeTime = 0;
+    unsigned placeNodes = 0;
+    unsigned removeNodes = 0;
+    for (int i = 0; i < count; i++) {
+        state = state * 1664525u + 1013904223u;
+        Chunk* chunk = chunks[(state >> 8) % chunks.Size()];
+        state = state * 1664525u + 1013904223u;
+        int x = (state >> 8) % SIZE_X;
+        int z = (state >> 16) % SIZE_Z;
+
+        // First air block above the highest solid block of the column
+        int y = SIZE_Y - 2;
+        while (y >= 0 && chunk->GetBlockValue(x, y, z) == BT_AIR) {
+            y--;
+        }
+        if (y < 0 || chunk->GetBlockValue(x, y + 1, z) != BT_AIR) {
+            continue;
+        }
+        IntVector3 position(x, y + 1, z);
+
+        unsigned nodes = lightManager->GetProcessedNodeCount();
+        HiresTimer timer;
+        chunk->SetBlockData(position, BT_STONE);
+        lightManager->Process();
+        placeTime += timer.GetUSec(false);
+        placeNodes += lightManager->GetProcessedNodeCount() - nodes;
+
+        nodes = lightManager->GetProcessedNodeCount();
+        timer.Reset();
+        chunk->SetBlockData(position, BT_AIR);
+        lightManager->Process();
+        removeTime += timer.GetUSec(false);
+        removeNodes += lightManager->GetProcessedNodeCount() - nodes;
+        edits++;
+    }
+    // Every placed block was removed again, only the recorded edits are left over
+    RestoreEdits(chunks, originalEdits, originalShouldSave);
+
+    if (edits == 0) {
+        URHO3D_LOGERROR("Relight benchmark found no surface to edit");
+        return;
+    }
+    URHO3D_LOGINFOF("Relight benchmark, %d edits in %d chunks: place %.1f us/edit (%.0f nodes), remove %.1f us/edit (%.0f nodes)",
+                    edits, chunks.Size(), (float)placeTime / edits, (float)placeNodes / edits,
+                    (float)removeTime / edits, (float)removeNodes / edits);
+}
+
+/**
+ * Block types followed by light values of every chunk
+ */
+static void SnapshotChunks(const PODVector<Chunk*>& chunks, PODVector<unsigned char>& blocks, PODVector<unsigned char>& light)
+{
+    blocks.Clear();
+    light.Clear();
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        for (int x = 0; x < SIZE_X; x++) {
+            for (int y = 0; y < SIZE_Y; y++) {
+                for (int z = 0; z < SIZE_Z; z++) {
+                    blocks.Push(static_cast<unsigned char>((*it)->GetBlockValue(x, y, z)));
+                    light.Push((*it)->GetLightValue(x, y, z));
+                }
+            }
+        }
+    }
+}
+
+static void RestoreChunks(const PODVector<Chunk*>& chunks, const PODVector<unsigned char>& blocks, const PODVector<unsigned char>& light)
+{
+    unsigned index = 0;
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        for (int x = 0; x < SIZE_X; x++) {
+            for (int y = 0; y < SIZE_Y; y++) {
+                for (int z = 0; z < SIZE_Z; z++) {
+                    (*it)->SetVoxel(x, y, z, static_cast<BlockType>(blocks[index]));
+                    (*it)->SetLightValue(x, y, z, light[index]);
+                    index++;
+                }
+            }
+        }
+    }
+}
+
+struct LightTestEdit {
+    Chunk* chunk_;
+    IntVector3 position_;
+    BlockType type_;
+};
+
+void VoxelBenchmark::TestLightDeterminism(int count)
+{
+    auto world = GetSubsystem<VoxelWorld>();
+    auto lightManager = GetSubsystem<LightManager>();
+    if (!world || !lightManager) {
+        URHO3D_LOGERROR("Light determinism test requires a running voxel world");
+        return;
+    }
+
+    // Settle all pending work so both passes start from the same light
+    GetSubsystem<WorkQueue>()->Complete(0);
+    lightManager->Process();
+
+    PODVector<Chunk*> loaded;
+    world->GetLoadedChunks(loaded);
+    PODVector<Chunk*> chunks;
+    for (auto it = loaded.Begin(); it != loaded.End(); ++it) {
+        if ((*it)->AreNeighborsLoaded()) {
+            chunks.Push(*it);
+        }
+    }
+    if (chunks.Empty()) {
+        URHO3D_LOGERROR("Light determinism test found no loaded chunks with loaded neighbors");
+        return;
+    }
+
+    // Edits are picked up front so that both passes apply exactly the same sequence
+    PODVector<LightTestEdit> edits;
+    unsigned state = 1;
+    for (int i = 0; i < count; i++) {
+        state = state * 1664525u + 1013904223u;
+        Chunk* chunk = chunks[(state >> 8) % chunks.Size()];
+        state = state * 1664525u + 1013904223u;
+        int x = (state >> 8) % SIZE_X;
+        int z = (state >> 16) % SIZE_Z;
+        int y = SIZE_Y - 2;
+        while (y >= 0 && chunk->GetBlockValue(x, y, z) == BT_AIR) {
+            y--;
+        }
+        if (y < 0 || chunk->GetBlockValue(x, y + 1, z) != BT_AIR) {
+            continue;
+        }
+        LightTestEdit edit;
+        edit.chunk_ = chunk;
+        switch ((state >> 24) % 3) {
+            case 0:
+                edit.position_ = IntVector3(x, y + 1, z);
+                edit.type_ = BT_STONE;
+                break;
+            case 1:
+                edit.position_ = IntVector3(x, y + 1, z);
+                edit.type_ = BT_TORCH;
+                break;
+            default:
+                // Dig into the surface, opens the column for sunlight
+                edit.position_ = IntVector3(x, y, z);
+                edit.type_ = BT_AIR;
+                break;
+        }
+        edits.Push(edit);
+    }
+
+    PODVector<unsigned char> originalBlocks;
+    PODVector<unsigned char> originalLight;
+    SnapshotChunks(loaded, originalBlocks, originalLight);
+    Vector<PODVector<BlockEdit>> originalEdits;
+    PODVector<bool> originalShouldSave;
+    SnapshotEdits(loaded, originalEdits, originalShouldSave);
+
+    for (auto it = edits.Begin(); it != edits.End(); ++it) {
+        (*it).chunk_->SetBlockData((*it).position_, (*it).type_);
+    }
+    HiresTimer timer;
+    lightManager->Process();
+    long long serialTime = timer.GetUSec(false);
+    PODVector<unsigned char> blocks;
+    PODVector<unsigned char> serialLight;
+    SnapshotChunks(loaded, blocks, serialLight);
+
+    RestoreChunks(loaded, originalBlocks, originalLight);
+    for (auto it = edits.Begin(); it != edits.End(); ++it) {
+        (*it).chunk_->SetBlockData((*it).position_, (*it).type_);
+    }
+    unsigned waves = 0;
+    SubscribeToEvent(E_LIGHT_PROPAGATED, [&](StringHash eventType, VariantMap& eventData) {
+        waves = eventData[LightPropagated::P_WAVES].GetUInt();
+    });
+    timer.Reset();
+    lightManager->StartPropagation();
+    lightManager->CompletePropagation();
+    long long parallelTime = timer.GetUSec(false);
+    UnsubscribeFromEvent(E_LIGHT_PROPAGATED);
+    PODVector<unsigned char> parallelLight;
+    SnapshotChunks(loaded, blocks, parallelLight);
+
+    RestoreChunks(loaded, originalBlocks, originalLight);
+    RestoreEdits(loaded, originalEdits, originalShouldSave);
+
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < serialLight.Size(); i++) {
+        if (serialLight[i] != parallelLight[i]) {
+            mismatches++;
+        }
+    }
+    if (mismatches == 0) {
+        URHO3D_LOGINFOF("Light determinism test PASSED, %d edits in %d chunks: serial %lld us, parallel %lld us in %u waves",
+                        edits.Size(), loaded.Size(), serialTime, parallelTime, waves);
+    } else {
+        URHO3D_LOGERRORF("Light determinism test FAILED, %u of %u light values differ after %d edits",
+                         mismatches, serialLight.Size(), edits.Size());
+    }
+}
+
+void VoxelBenchmark::TestChunkCodec(int count)
+{
+    Vector<SharedPtr<Chunk>> chunks;
+    // Column of chunks centered on the surface so that the set mixes terrain, sky and solid ground
+    CreateChunks(chunks, count, TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0));
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        GenerateBlocks(*it);
+    }
+
+    // Previous format, position followed by a 32 bit integer per block
+    const unsigned rawSize = sizeof(Vector3) + CHUNK_VOXEL_COUNT * sizeof(int);
+    unsigned uniformChunks = 0;
+    unsigned failures = 0;
+    BlockType blocks[CHUNK_VOXEL_COUNT];
+    BlockType decoded[CHUNK_VOXEL_COUNT];
+    for (int compress = 0; compress < 2; compress++) {
+        unsigned totalSize = 0;
+        unsigned largestSize = 0;
+        long long encodeTime = 0;
+        long long decodeTime = 0;
+        for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+            (*it)->GetBlocks(blocks);
+            VectorBuffer message;
+            message.WriteVector3((*it)->GetPosition());
+            HiresTimer timer;
+            ChunkCodec::Encode(blocks, message, compress != 0);
+            encodeTime += timer.GetUSec(false);
+
+            MemoryBuffer received(message.GetData(), message.GetSize());
+            Vector3 position = received.ReadVector3();
+            timer.Reset();
+            bool valid = ChunkCodec::Decode(received, decoded);
+            decodeTime += timer.GetUSec(false);
+            if (!valid || position != (*it)->GetPosition() || memcmp(blocks, decoded, sizeof(blocks)) != 0 || !received.IsEof()) {
+                failures++;
+            }
+            totalSize += message.GetSize();
+            largestSize = Max(largestSize, message.GetSize());
+            if (compress == 0 && (*it)->IsUniform()) {
+                uniformChunks++;
+            }
+        }
+        URHO3D_LOGINFOF("Chunk codec, %s, %d chunks (%u uniform): %.1f bytes/chunk, largest %u bytes, raw %u bytes/chunk (%.1fx smaller), encode %.1f us/chunk, decode %.1f us/chunk",
+                        compress ? "palette+RLE+LZ4" : "palette+RLE", chunks.Size(), uniformChunks,
+                        (float)totalSize / chunks.Size(), largestSize, rawSize, (float)rawSize * chunks.Size() / Max(totalSize, 1u),
+                        (float)encodeTime / chunks.Size(), (float)decodeTime / chunks.Size());
+    }
+
+    if (failures == 0) {
+        URHO3D_LOGINFOF("Chunk codec test PASSED, %d chunks round-tripped", chunks.Size() * 2);
+    } else {
+        URHO3D_LOGERRORF("Chunk codec test FAILED, %u of %d round-trips differ", failures, chunks.Size() * 2);
+    }
+}
+
+void VoxelBenchmark::BenchmarkCollision(int count)
+{
+    const int editCount = 100;
+    const int bodyCount = 64;
+    const int stepCount = 300;
+    Vector<SharedPtr<Chunk>> chunks;
+    Vector3 origin = TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0);
+    CreateChunks(chunks, count, origin);
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        GenerateBlocks(*it);
+    }
+    auto physicsWorld = scene_->GetOrCreateComponent<PhysicsWorld>();
+
+    const CollisionMode modes[] = {CM_TRIANGLE_MESH, CM_BOXES};
+    for (int i = 0; i < 2; i++) {
+        unsigned triangles = 0;
+        unsigned boxes = 0;
+        HiresTimer timer;
+        for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+            (*it)->CalculateGeometry(MM_GREEDY, modes[i]);
+            (*it)->Render();
+            triangles += (*it)->GetMeshStats().indexCount_ / 3;
+            boxes += (*it)->GetMeshStats().collisionBoxes_;
+        }
+        long long buildTime = timer.GetUSec(false);
+
+        // Remove and put back the top block of random columns, same columns for both modes
+        unsigned state = 1;
+        int edits = 0;
+        long long meshTime = 0;
+        long long uploadTime = 0;
+        for (int j = 0; j < editCount; j++) {
+            state = state * 1664525u + 1013904223u;
+            Chunk* chunk = chunks[(state >> 8) % chunks.Size()];
+            state = state * 1664525u + 1013904223u;
+            int x = (state >> 8) % SIZE_X;
+            int z = (state >> 16) % SIZE_Z;
+            int y = SIZE_Y - 1;
+            while (y >= 0 && chunk->GetBlockValue(x, y, z) == BT_AIR) {
+                y--;
+            }
+            if (y < 0) {
+                continue;
+            }
+            BlockType type = chunk->GetBlockValue(x, y, z);
+            BlockType edit[] = {BT_AIR, type};
+            for (int k = 0; k < 2; k++) {
+                chunk->SetVoxel(x, y, z, edit[k]);
+                timer.Reset();
+                chunk->CalculateGeometry(MM_GREEDY, modes[i]);
+                meshTime += timer.GetUSec(false);
+                timer.Reset();
+                chunk->Render();
+                uploadTime += timer.GetUSec(false);
+                edits++;
+            }
+        }
+
+        // Rolling spheres over the terrain, roughly what the player body does
+        Vector<SharedPtr<Node>> bodies;
+        int side = CeilToInt(Sqrt((float)bodyCount));
+        float spacing = (float)(count * SIZE_X) / side;
+        for (int j = 0; j < bodyCount; j++) {
+            SharedPtr<Node> node(scene_->CreateChild("CollisionBenchmarkBody", LOCAL));
+            node->SetPosition(origin + Vector3((j % side + 0.5f) * spacing, count * SIZE_Y + 2, (j / side + 0.5f) * spacing));
+            auto body = node->CreateComponent<RigidBody>(LOCAL);
+            body->SetMass(1.0f);
+            body->SetCollisionLayerAndMask(COLLISION_MASK_OBSTACLES, COLLISION_MASK_GROUND);
+            body->SetLinearVelocity(Vector3((j % 5) - 2.0f, 0, (j % 3) - 1.0f) * 2.0f);
+            node->CreateComponent<CollisionShape>(LOCAL)->SetSphere(1.0f);
+            bodies.Push(node);
+        }
+        timer.Reset();
+        for (int j = 0; j < stepCount; j++) {
+            physicsWorld->Update(1.0f / physicsWorld->GetFps());
+        }
+        long long stepTime = timer.GetUSec(false);
+        for (auto it = bodies.Begin(); it != bodies.End(); ++it) {
+            (*it)->Remove();
+        }
+
+        URHO3D_LOGINFOF("Collision benchmark, %s, %d chunks: %u mesh triangles, %u boxes, build %.1f us/chunk, "
+                        "edit %.1f us (meshing %.1f us, upload and collision %.1f us), physics step %.3f ms with %d bodies",
+                        modes[i] == CM_BOXES ? "boxes" : "triangle mesh", chunks.Size(), triangles, boxes,
+                        (float)buildTime / chunks.Size(), (float)(meshTime + uploadTime) / Max(edits, 1),
+                        (float)meshTime / Max(edits, 1), (float)uploadTime / Max(edits, 1),
+                        stepTime / 1000.0f / stepCount, bodyCount);
+    }
+}
+
+void VoxelBenchmark::BenchmarkRaycast(int count)
+{
+    const float maxDistance = 64.0f;
+    auto world = GetSubsystem<VoxelWorld>();
+    PODVector<Chunk*> chunks;
+    if (world) {
+        world->GetLoadedChunks(chunks);
+    }
+    if (chunks.Empty()) {
+        URHO3D_LOGERROR("Raycast benchmark requires a running voxel world");
+        return;
+    }
+
+    // Rays start in air blocks of loaded chunks and point in random directions
+    PODVector<Ray> rays;
+    unsigned state = 1;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / (float)(1 << 24);
+    };
+    for (int i = 0; i < count * 10 && (int)rays.Size() < count; i++) {
+        Chunk* chunk = chunks[(unsigned)(random() * chunks.Size()) % chunks.Size()];
+        Vector3 local(random() * SIZE_X, random() * SIZE_Y, random() * SIZE_Z);
+        if (chunk->GetBlockValue(FloorToInt(local.x_), FloorToInt(local.y_), FloorToInt(local.z_)) != BT_AIR) {
+            continue;
+        }
+        Vector3 direction(random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f - 1.0f);
+        if (direction.LengthSquared() < 0.01f) {
+            continue;
+        }
+        rays.Push(Ray(chunk->GetPosition() + local, direction));
+    }
+    if (rays.Empty()) {
+        URHO3D_LOGERROR("Raycast benchmark found no air blocks in the loaded chunks");
+        return;
+    }
+
+    unsigned hits = 0;
+    HiresTimer timer;
+    VoxelRaycastResult result;
+    for (auto it = rays.Begin(); it != rays.End(); ++it) {
+        if (world->Raycast((*it).origin_, (*it).direction_, maxDistance, result)) {
+            hits++;
+        }
+    }
+    long long singleTime = timer.GetUSec(false);
+
+    PODVector<VoxelRaycastResult> results;
+    timer.Reset();
+    unsigned batchHits = world->Raycast(rays, maxDistance, results);
+    long long batchTime = timer.GetUSec(false);
+
+    URHO3D_LOGINFOF("Raycast benchmark, %d rays of %.0f units: voxel %.2f us/ray (%.0f rays/s, %u hits), batch %.2f us/ray (%.0f rays/s, %u hits)",
+                    rays.Size(), maxDistance, (float)singleTime / rays.Size(), rays.Size() / Max(singleTime / 1000000.0f, 0.000001f), hits,
+                    (float)batchTime / rays.Size(), rays.Size() / Max(batchTime / 1000000.0f, 0.000001f), batchHits);
+
+    // Previous block picking, needs uploaded chunk meshes
+    Octree* octree = chunks[0]->GetNode()->GetScene()->GetComponent<Octree>();
+    if (!octree) {
+        return;
+    }
+    unsigned octreeHits = 0;
+    unsigned mismatches = 0;
+    PODVector<RayQueryResult> octreeResults;
+    timer.Reset();
+    for (unsigned i = 0; i < rays.Size(); i++) {
+        octreeResults.Clear();
+        RayOctreeQuery query(octreeResults, rays[i], RAY_TRIANGLE, maxDistance, DRAWABLE_GEOMETRY, VIEW_MASK_CHUNK);
+        octree->RaycastSingle(query);
+        if (octreeResults.Empty()) {
+            continue;
+        }
+        octreeHits++;
+        // Same block as found by nudging the hit position into the block
+        Vector3 inside = octreeResults[0].position_ - octreeResults[0].normal_ * 0.5f;
+        IntVector3 block(FloorToInt(inside.x_), FloorToInt(inside.y_), FloorToInt(inside.z_));
+        if (!results[i].chunk_ || results[i].blockPosition_ != block) {
+            mismatches++;
+        }
+    }
+    long long octreeTime = timer.GetUSec(false);
+    URHO3D_LOGINFOF("Raycast benchmark, octree triangles %.2f us/ray (%u hits), voxel speedup %.2fx, %u hits on a different block",
+                    (float)octreeTime / rays.Size(), octreeHits, (float)octreeTime / Max(singleTime, 1LL), mismatches);
+}
+
+void VoxelBenchmark::TestGenerationDeterminism(int count)
+{
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    auto workQueue = GetSubsystem<WorkQueue>();
+    if (!chunkGenerator) {
+        URHO3D_LOGERROR("Generation determinism test requires the chunk generator");
+        return;
+    }
+    Vector3 origin = TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0);
+    unsigned randomSeed = GetRandomSeed();
+
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, origin);
+    // Columns are sampled again in each run so that the noise itself is read concurrently
+    chunkGenerator->ClearColumnCache();
+    PODVector<unsigned> serialHashes;
+    for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+        GenerateBlocks(*it);
+        serialHashes.Push(HashChunkBlocks(*it));
+    }
+    chunks.Clear();
+
+    CreateChunks(chunks, count, origin);
+    chunkGenerator->ClearColumnCache();
+    // Reverse order, the workers reach the columns in a different order than the serial run
+    for (unsigned i = chunks.Size(); i-- > 0;) {
+        SharedPtr<WorkItem> item = workQueue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = LoadBenchmarkChunk;
+        item->aux_ = chunks[i].Get();
+        item->sendEvent_ = false;
+        item->start_ = nullptr;
+        item->end_ = nullptr;
+        workQueue->AddWorkItem(item);
+    }
+    workQueue->Complete(M_MAX_UNSIGNED);
+
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        if (HashChunkBlocks(chunks[i]) != serialHashes[i]) {
+            mismatches++;
+        }
+    }
+    bool randomUntouched = GetRandomSeed() == randomSeed;
+
+    if (mismatches == 0 && randomUntouched) {
+        URHO3D_LOGINFOF("Generation determinism test PASSED, %d chunks identical on %d threads", chunks.Size(), workQueue->GetNumThreads() + 1);
+    } else {
+        URHO3D_LOGERRORF("Generation determinism test FAILED, %u of %d chunks differ, global random state %s",
+                         mismatches, chunks.Size(), randomUntouched ? "untouched" : "changed");
+    }
+}
+
+void VoxelBenchmark::TestDecorationDeterminism(int count)
+{
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    auto workQueue = GetSubsystem<WorkQueue>();
+    if (!chunkGenerator) {
+        URHO3D_LOGERROR("Decoration determinism test requires the chunk generator");
+        return;
+    }
+    Vector3 origin = TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0);
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, origin);
+    // Stages up to water, the chunks stay undecorated
+    PODVector<BlockType> terrain(chunks.Size() * CHUNK_VOXEL_COUNT);
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        chunks[i]->Load();
+        chunks[i]->GetBlocks(&terrain[i * CHUNK_VOXEL_COUNT]);
+    }
+
+    PODVector<unsigned> hashes[2];
+    long long times[2];
+    unsigned decoratedBlocks = 0;
+    for (int run = 0; run < 2; run++) {
+        PODVector<BlockType> blocks(terrain);
+        Vector<DecorationJob> jobs(chunks.Size());
+        for (unsigned i = 0; i < chunks.Size(); i++) {
+            jobs[i].generator_ = chunkGenerator;
+            jobs[i].coordinates_ = chunks[i]->GetChunkCoordinates();
+            jobs[i].blocks_ = &blocks[i * CHUNK_VOXEL_COUNT];
+        }
+
+        HiresTimer timer;
+        if (run == 0) {
+            for (unsigned i = 0; i < jobs.Size(); i++) {
+                RunDecorationJob(jobs[i]);
+            }
+        } else {
+            // Reverse order on all threads
+            for (unsigned i = jobs.Size(); i-- > 0;) {
+                SharedPtr<WorkItem> item = workQueue->GetFreeItem();
+                item->priority_ = M_MAX_UNSIGNED;
+                item->workFunction_ = DecorateBenchmarkBlocks;
+                item->aux_ = &jobs[i];
+                item->sendEvent_ = false;
+                item->start_ = nullptr;
+                item->end_ = nullptr;
+                workQueue->AddWorkItem(item);
+            }
+            workQueue->Complete(M_MAX_UNSIGNED);
+        }
+        times[run] = timer.GetUSec(false);
+
+        if (run == 0) {
+            for (unsigned i = 0; i < blocks.Size(); i++) {
+                if (blocks[i] != terrain[i]) {
+                    decoratedBlocks++;
+                }
+            }
+        }
+        for (unsigned i = 0; i < chunks.Size(); i++) {
+            hashes[run].Push(HashBlocks(&blocks[i * CHUNK_VOXEL_COUNT]));
+        }
+    }
+
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        if (hashes[0][i] != hashes[1][i]) {
+            mismatches++;
+        }
+    }
+    URHO3D_LOGINFOF("Decoration of %d chunks: serial %.1f us/chunk, parallel %.1f us/chunk, %u blocks decorated",
+                    chunks.Size(), (float)times[0] / chunks.Size(), (float)times[1] / chunks.Size(), decoratedBlocks);
+    if (mismatches == 0) {
+        URHO3D_LOGINFOF("Decoration determinism test PASSED, %d chunks identical on %d threads", chunks.Size(), workQueue->GetNumThreads() + 1);
+    } else {
+        URHO3D_LOGERRORF("Decoration determinism test FAILED, %u of %d chunks differ", mismatches, chunks.Size());
+    }
+}
+
+void VoxelBenchmark::BenchmarkNoise(int count)
+{
+    PerlinNoise perlin(1);
+    SimplexNoise simplex;
+    simplex.SetSeed(1);
+
+    // Coordinates as used by the terrain, a few thousand blocks around the origin divided by the smoothness
+    unsigned state = 1;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / (float)(1 << 24);
+    };
+    PODVector<double> x(count), y(count), result(count), reference(count);
+    PODVector<float> floatX(count), floatY(count), floatResult(count), floatReference(count);
+    PODVector<int> octaves(count);
+    for (int i = 0; i < count; i++) {
+        x[i] = (random() * 8192.0f - 4096.0f) / 111.13f;
+        y[i] = (random() * 8192.0f - 4096.0f) / 111.13f;
+        floatX[i] = (float)x[i] * 30.0f;
+        floatY[i] = (float)y[i] * 30.0f;
+        octaves[i] = 16 + (int)(random() * 16);
+    }
+
+    const char* kernelNames[] = {"perlin 1 octave", "perlin 6 octaves", "perlin 16-32 octaves", "simplex 4 octaves"};
+    auto sample = [&](int kernel, bool batch, double* out, float* floatOut) {
+        switch (kernel) {
+            case 0:
+            case 1: {
+                int octaveCount = kernel == 0 ? 1 : 6;
+                if (batch) {
+                    perlin.octaveNoise(&x[0], &y[0], out, count, octaveCount);
+                } else {
+                    for (int i = 0; i < count; i++) {
+                        out[i] = perlin.octaveNoise(x[i], y[i], octaveCount);
+                    }
+                }
+                break;
+            }
+            case 2:
+                if (batch) {
+                    perlin.octaveNoise(&x[0], &y[0], &octaves[0], out, count);
+                } else {
+                    for (int i = 0; i < count; i++) {
+                        out[i] = perlin.octaveNoise(x[i], y[i], octaves[i]);
+                    }
+                }
+                break;
+            default:
+                if (batch) {
+                    simplex.fractal(4, &floatX[0], &floatY[0], floatOut, count);
+                } else {
+                    for (int i = 0; i < count; i++) {
+                        floatOut[i] = simplex.fractal(4, floatX[i], floatY[i]);
+                    }
+                }
+                break;
+        }
+    };
+
+    NoiseKernel previousKernel = GetNoiseKernel();
+    for (int kernel = 0; kernel < 4; kernel++) {
+        HiresTimer timer;
+        sample(kernel, false, &reference[0], &floatReference[0]);
+        long long scalarTime = timer.GetUSec(false);
+        float scalarRate = count / Max(scalarTime / 1000000.0f, 0.000001f);
+        String report;
+        report.AppendWithFormat("Noise benchmark, %s, %d samples: scalar %.2f M samples/s", kernelNames[kernel], count, scalarRate / 1000000.0f);
+
+        for (int batchKernel = NK_SSE2; batchKernel < NK_NONE; batchKernel++) {
+            if (!SetNoiseKernel(static_cast<NoiseKernel>(batchKernel))) {
+                report.AppendWithFormat(", %s unsupported", GetNoiseKernelName(static_cast<NoiseKernel>(batchKernel)));
+                continue;
+            }
+            timer.Reset();
+            sample(kernel, true, &result[0], &floatResult[0]);
+            long long batchTime = timer.GetUSec(false);
+
+            // Kernels are meant to be bit exact, any difference is reported
+            unsigned differ = 0;
+            double maxDifference = 0.0;
+            for (int i = 0; i < count; i++) {
+                double difference = kernel < 3 ? Abs(result[i] - reference[i]) : Abs((double)floatResult[i] - floatReference[i]);
+                bool same = kernel < 3 ? memcmp(&result[i], &reference[i], sizeof(double)) == 0
+                    : memcmp(&floatResult[i], &floatReference[i], sizeof(float)) == 0;
+                if (!same) {
+                    differ++;
+                }
+                maxDifference = Max(maxDifference, difference);
+            }
+            float batchRate = count / Max(batchTime / 1000000.0f, 0.000001f);
+            report.AppendWithFormat(", %s %.2f M samples/s (%.2fx, %u differ, max difference %g)", GetNoiseKernelName(static_cast<NoiseKernel>(batchKernel)),
+                                    batchRate / 1000000.0f, batchRate / scalarRate, differ, maxDifference);
+        }
+        SetNoiseKernel(previousKernel);
+        URHO3D_LOGINFO(report);
+    }
+
+    // Chunk terrain and caves from batched noise planes against the per block functions
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    if (!chunkGenerator) {
+        return;
+    }
+    const int chunkCount = 16;
+    unsigned differentBlocks = 0;
+    long long blockTime = 0;
+    long long planeTime = 0;
+    BlockType blocks[CHUNK_VOXEL_COUNT];
+    BlockType planeBlocks[CHUNK_VOXEL_COUNT];
+    for (int i = 0; i < chunkCount; i++) {
+        Vector3 position = TERRAIN_BENCHMARK_ORIGIN + Vector3((i % 4) * SIZE_X, (i / 4 - 2) * SIZE_Y, 0);
+        ChunkColumn column;
+        chunkGenerator->GetColumn(FloorToInt(position.x_ / SIZE_X), FloorToInt(position.z_ / SIZE_Z), column);
+
+        HiresTimer timer;
+        for (int x = 0; x < SIZE_X; x++) {
+            for (int y = 0; y < SIZE_Y; y++) {
+                for (int z = 0; z < SIZE_Z; z++) {
+                    Vector3 blockPosition = position + Vector3(x, y, z);
+                    BlockType block = chunkGenerator->GetBlockType(blockPosition, column.heights_[x * SIZE_Z + z],
+                        static_cast<Biome>(column.biomes_[x * SIZE_Z + z]));
+                    blocks[Chunk::GetBlockIndex(x, y, z)] = chunkGenerator->GetCaveBlockType(blockPosition, block);
+                }
+            }
+        }
+        blockTime += timer.GetUSec(true);
+        ChunkDensity density;
+        chunkGenerator->GetDensity(position, 1, density);
+        chunkGenerator->GetBlockTypes(position, column, density, planeBlocks);
+        chunkGenerator->ApplyCaves(density, planeBlocks);
+        planeTime += timer.GetUSec(false);
+
+        for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+            if (blocks[j] != planeBlocks[j]) {
+                differentBlocks++;
+            }
+        }
+    }
+    URHO3D_LOGINFOF("Chunk noise, %d chunks: per block %.1f us/chunk, %s noise planes %.1f us/chunk, speedup %.2fx, %u blocks differ",
+                    chunkCount, (float)blockTime / chunkCount, GetNoiseKernelName(GetNoiseKernel()), (float)planeTime / chunkCount,
+                    (float)blockTime / Max(planeTime, 1LL), differentBlocks);
+}
+
+void VoxelBenchmark::BenchmarkDensityLattice(int count)
+{
+    auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+    if (!chunkGenerator) {
+        URHO3D_LOGERROR("Density lattice benchmark requires the chunk generator");
+        return;
+    }
+    Vector3 origin = TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0);
+    int previousStep = chunkGenerator->GetDensityStep();
+    PODVector<unsigned char> exactBlocks;
+    long long exactTime = 0;
+    const int steps[] = {1, 2, 4, 8};
+    for (int step : steps) {
+        chunkGenerator->SetDensityStep(step);
+        Vector<SharedPtr<Chunk>> chunks;
+        CreateChunks(chunks, count, origin);
+        // Columns do not depend on the step, keep them out of the timing
+        for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+            ChunkColumn column;
+            IntVector3 chunkCoordinates = (*it)->GetChunkCoordinates();
+            chunkGenerator->GetColumn(chunkCoordinates.x_, chunkCoordinates.z_, column);
+        }
+
+        HiresTimer timer;
+        for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+            GenerateBlocks(*it);
+        }
+        long long loadTime = timer.GetUSec(false);
+
+        // Density alone, the part the lattice replaces
+        ChunkDensity density;
+        timer.Reset();
+        for (auto it = chunks.Begin(); it != chunks.End(); ++it) {
+            chunkGenerator->GetDensity((*it)->GetPosition(), step, density);
+        }
+        long long densityTime = timer.GetUSec(false);
+
+        unsigned differ = 0;
+        unsigned solid = 0;
+        BlockType blocks[CHUNK_VOXEL_COUNT];
+        for (unsigned i = 0; i < chunks.Size(); i++) {
+            chunks[i]->GetBlocks(blocks);
+            for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+                if (step == 1) {
+                    exactBlocks.Push(static_cast<unsigned char>(blocks[j]));
+                } else if (exactBlocks[i * CHUNK_VOXEL_COUNT + j] != blocks[j]) {
+                    differ++;
+                }
+                if (blocks[j] != BT_AIR) {
+                    solid++;
+                }
+            }
+        }
+        if (step == 1) {
+            exactTime = loadTime;
+        }
+
+        unsigned total = chunks.Size() * CHUNK_VOXEL_COUNT;
+        URHO3D_LOGINFOF("Density lattice benchmark, step %d, %d chunks: load %.1f us/chunk (%.2fx), density %.1f us/chunk, "
+                        "%u of %u blocks differ from exact (%.3f%%), %u solid blocks",
+                        step, chunks.Size(), (float)loadTime / chunks.Size(), (float)exactTime / Max(loadTime, 1LL),
+                        (float)densityTime / chunks.Size(), differ, total, 100.0f * differ / total, solid);
+    }
+    chunkGenerator->SetDensityStep(previousStep);
+}
+
+void VoxelBenchmark::BenchmarkPersistence(int count)
+{
+    if (!GetSubsystem<ChunkGenerator>()) {
+        URHO3D_LOGERROR("Persistence benchmark requires the chunk generator");
+        return;
+    }
+    const unsigned EDITED_CHUNK_INTERVAL = 8;
+    const int EDITS_PER_CHUNK = 32;
+    const int BORDER_EDITS_PER_CHUNK = 8;
+    Vector3 origin = TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0);
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, origin);
+
+    // Player edits are written into the expected blocks directly, the benchmark chunks are not part of the lit world
+    PODVector<BlockType> blocks(chunks.Size() * CHUNK_VOXEL_COUNT);
+    Vector<PODVector<BlockEdit>> edits(chunks.Size());
+    unsigned borderEdits = 0;
+    unsigned state = 1;
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        GenerateBlocks(chunks[i]);
+        BlockType* chunkBlocks = &blocks[i * CHUNK_VOXEL_COUNT];
+        chunks[i]->GetBlocks(chunkBlocks);
+        if (i % EDITED_CHUNK_INTERVAL != 0) {
+            continue;
+        }
+        for (int j = 0; j < EDITS_PER_CHUNK; j++) {
+            state = state * 1664525u + 1013904223u;
+            BlockEdit edit;
+            edit.index_ = static_cast<unsigned short>((state >> 8) % CHUNK_VOXEL_COUNT);
+            // Digging and building
+            edit.type_ = static_cast<unsigned char>(chunkBlocks[edit.index_] == BT_AIR ? BT_STONE : BT_AIR);
+            chunkBlocks[edit.index_] = static_cast<BlockType>(edit.type_);
+            edits[i].Push(edit);
+        }
+        // Leaves on the sides are often grown by the trees of the neighbor columns, they have to stay removed
+        // when the chunk is generated again next to its decorated neighbors
+        int removed = 0;
+        for (int index = 0; index < CHUNK_VOXEL_COUNT && removed < BORDER_EDITS_PER_CHUNK; index++) {
+            int x = index / (SIZE_Y * SIZE_Z);
+            int z = index % SIZE_Z;
+            if (chunkBlocks[index] != BT_TREE_LEAVES || (x > 0 && x < SIZE_X - 1 && z > 0 && z < SIZE_Z - 1)) {
+                continue;
+            }
+            BlockEdit edit;
+            edit.index_ = static_cast<unsigned short>(index);
+            edit.type_ = static_cast<unsigned char>(BT_AIR);
+            chunkBlocks[index] = BT_AIR;
+            edits[i].Push(edit);
+            removed++;
+        }
+        borderEdits += removed;
+    }
+
+    // Region files store payloads in whole sectors
+    auto sectorBytes = [](unsigned size) {
+        return (size + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE * REGION_SECTOR_SIZE;
+    };
+    unsigned long long blockBytes = 0;
+    unsigned long long editBytes = 0;
+    unsigned storedEditChunks = 0;
+    Vector<PODVector<unsigned char>> editPayloads(chunks.Size());
+    HiresTimer timer;
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        VectorBuffer buffer;
+        ChunkStorage::EncodeVoxels(&blocks[i * CHUNK_VOXEL_COUNT], buffer);
+        blockBytes += sectorBytes(buffer.GetSize());
+    }
+    long long blockTime = timer.GetUSec(false);
+    timer.Reset();
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        // Untouched chunks write nothing
+        if (edits[i].Empty()) {
+            continue;
+        }
+        VectorBuffer buffer;
+        ChunkStorage::EncodeEdits(edits[i], buffer);
+        editBytes += sectorBytes(buffer.GetSize());
+        editPayloads[i] = buffer.GetBuffer();
+        storedEditChunks++;
+    }
+    long long editTime = timer.GetUSec(false);
+
+    // Stored edits on top of the generated chunk have to give the same blocks. The original chunk is unloaded
+    // first, its neighbors stay decorated
+    unsigned mismatches = 0;
+    unsigned blockMismatches = 0;
+    Vector<SharedPtr<Chunk>> restored;
+    timer.Reset();
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        if (editPayloads[i].Empty()) {
+            continue;
+        }
+        Vector3 position = chunks[i]->GetPosition();
+        chunks[i] = new Chunk(context_);
+        chunks[i]->Init(scene_, position);
+        chunks[i]->SetDiskData(true, editPayloads[i], true);
+        GenerateBlocks(chunks[i]);
+        restored.Push(chunks[i]);
+        if (HashChunkBlocks(chunks[i]) != HashBlocks(&blocks[i * CHUNK_VOXEL_COUNT])) {
+            mismatches++;
+        }
+    }
+    long long restoreTime = timer.GetUSec(false);
+    // Block records are complete, nothing generated may be merged over them
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        if (editPayloads[i].Empty()) {
+            continue;
+        }
+        PODVector<unsigned char> data(CHUNK_VOXEL_COUNT);
+        for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+            data[j] = static_cast<unsigned char>(blocks[i * CHUNK_VOXEL_COUNT + j]);
+        }
+        SharedPtr<Chunk> chunk(new Chunk(context_));
+        chunk->Init(scene_, chunks[i]->GetPosition());
+        chunk->SetDiskData(true, data);
+        GenerateBlocks(chunk);
+        if (HashChunkBlocks(chunk) != HashBlocks(&blocks[i * CHUNK_VOXEL_COUNT])) {
+            blockMismatches++;
+        }
+    }
+
+    URHO3D_LOGINFOF("Persistence benchmark, %d chunks, %u edited: blocks %llu KB (%.1f us/chunk encode), "
+                    "edits %llu KB in %u chunks (%.1f us/chunk encode), %.1fx smaller, regenerate %.1f us/edited chunk",
+                    chunks.Size(), storedEditChunks, blockBytes / 1024, (float)blockTime / chunks.Size(),
+                    editBytes / 1024, storedEditChunks, (float)editTime / chunks.Size(),
+                    (float)blockBytes / Max(editBytes, 1ULL), (float)restoreTime / Max(restored.Size(), 1U));
+    if (mismatches == 0 && blockMismatches == 0) {
+        URHO3D_LOGINFOF("Persistence round trip PASSED, %d regenerated chunks and their block records match, "
+                        "%u removed border leaves stayed removed", restored.Size(), borderEdits);
+    } else {
+        URHO3D_LOGERRORF("Persistence round trip FAILED, %u of %d regenerated chunks and %u block records differ",
+                         mismatches, restored.Size(), blockMismatches);
+    }
+}
+
+void VoxelBenchmark::TestEditJournal(int count)
+{
+    // Same batch as the journal default, a crash loses at most one unsynced batch
+    const int SYNC_BATCH = 256;
+    const int SINGLE_SYNC_COUNT = 64;
+    const int CHUNK_COUNT = 9;
+    const String directory = "World/benchmark_journal";
+    const String crashDirectory = "World/benchmark_journal_crash";
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->DirExists("World")) {
+        fileSystem->CreateDir("World");
+    }
+    // Scratch worlds next to the running one, emptied before and after the test
+    auto clearDirectory = [&](const String& path) {
+        if (!fileSystem->DirExists(path)) {
+            fileSystem->CreateDir(path);
+            return;
+        }
+        Vector<String> files;
+        fileSystem->ScanDir(files, path, "", SCAN_FILES, false);
+        for (auto it = files.Begin(); it != files.End(); ++it) {
+            fileSystem->Delete(path + "/" + (*it));
+        }
+    };
+    clearDirectory(directory);
+    clearDirectory(crashDirectory);
+
+    SharedPtr<ChunkStorage> storage(new ChunkStorage(context_));
+    storage->SetDirectory(directory);
+    SharedPtr<ChunkStorage> crashStorage(new ChunkStorage(context_));
+    crashStorage->SetDirectory(crashDirectory);
+
+    // Every third chunk is stored as blocks, every third as edits and the rest is not stored yet.
+    // Generated blocks that are not edited are BT_NONE in the expected blocks
+    PODVector<IntVector3> chunks;
+    PODVector<BlockType> expected(CHUNK_COUNT * CHUNK_VOXEL_COUNT);
+    for (int i = 0; i < CHUNK_COUNT; i++) {
+        chunks.Push(IntVector3(i * 7 - 30, -1, 5));
+        BlockType* chunkBlocks = &expected[i * CHUNK_VOXEL_COUNT];
+        for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+            chunkBlocks[j] = i % 3 == 0 ? static_cast<BlockType>((j * 7 + i) % BT_NONE) : BT_NONE;
+        }
+        if (i % 3 == 0) {
+            storage->SaveChunk(chunks[i], chunkBlocks);
+            crashStorage->SaveChunk(chunks[i], chunkBlocks);
+        } else if (i % 3 == 1) {
+            PODVector<BlockEdit> edits;
+            for (int j = 0; j < 16; j++) {
+                BlockEdit edit;
+                edit.index_ = static_cast<unsigned short>((j * 97 + i) % CHUNK_VOXEL_COUNT);
+                edit.type_ = static_cast<unsigned char>(j % BT_NONE);
+                chunkBlocks[edit.index_] = static_cast<BlockType>(edit.type_);
+                edits.Push(edit);
+            }
+            storage->SaveChunkEdits(chunks[i], edits);
+            crashStorage->SaveChunkEdits(chunks[i], edits);
+        }
+    }
+
+    PODVector<JournalRecord> records;
+    unsigned state = 1;
+    for (int i = 0; i < count; i++) {
+        state = state * 1664525u + 1013904223u;
+        JournalRecord record;
+        record.chunk_ = chunks[(state >> 24) % CHUNK_COUNT];
+        record.index_ = static_cast<unsigned short>((state >> 4) % CHUNK_VOXEL_COUNT);
+        record.oldType_ = BT_AIR;
+        record.newType_ = static_cast<unsigned char>((state >> 16) % BT_NONE);
+        records.Push(record);
+    }
+    // Edits synced one by one repeat the first records
+    for (int i = 0; i < Min(count, SINGLE_SYNC_COUNT); i++) {
+        records.Push(records[i]);
+    }
+
+    SharedPtr<EditJournal> journal(new EditJournal(context_));
+    journal->SetFileName(directory + "/edits.journal");
+    journal->SetStorage(storage);
+    if (!journal->Open()) {
+        URHO3D_LOGERROR("Edit journal test can't create " + journal->GetFileName());
+        return;
+    }
+    unsigned syncs = 0;
+    HiresTimer timer;
+    for (int i = 0; i < count; i++) {
+        journal->Append(records[i].chunk_, records[i].index_, BT_AIR, static_cast<BlockType>(records[i].newType_));
+        if ((i + 1) % SYNC_BATCH == 0 || i == count - 1) {
+            journal->Sync(true);
+            syncs++;
+        }
+    }
+    long long batchedTime = timer.GetUSec(false);
+    timer.Reset();
+    for (unsigned i = count; i < records.Size(); i++) {
+        journal->Append(records[i].chunk_, records[i].index_, BT_AIR, static_cast<BlockType>(records[i].newType_));
+        journal->Sync(true);
+    }
+    long long singleTime = timer.GetUSec(false);
+
+    // Crash in the middle of the last record: the journal on the disk is cut and opened by a new instance
+    PODVector<unsigned char> journalData;
+    {
+        File file(context_, journal->GetFileName(), FILE_READ);
+        journalData.Resize(file.GetSize());
+        file.Read(&journalData[0], journalData.Size());
+    }
+    {
+        File file(context_, crashDirectory + "/edits.journal", FILE_WRITE);
+        file.Write(&journalData[0], journalData.Size() - EDIT_JOURNAL_RECORD_SIZE / 2);
+    }
+    SharedPtr<EditJournal> crashJournal(new EditJournal(context_));
+    crashJournal->SetFileName(crashDirectory + "/edits.journal");
+    crashJournal->SetStorage(crashStorage);
+    bool reopened = crashJournal->Open();
+    crashJournal->Close();
+    // The complete journal is folded when it is closed
+    journal->Close();
+
+    auto applyRecords = [&](PODVector<BlockType>& blocks, unsigned recordCount) {
+        for (unsigned i = 0; i < recordCount; i++) {
+            unsigned chunkIndex = 0;
+            while (chunks[chunkIndex] != records[i].chunk_) {
+                chunkIndex++;
+            }
+            blocks[chunkIndex * CHUNK_VOXEL_COUNT + records[i].index_] = static_cast<BlockType>(records[i].newType_);
+        }
+    };
+    auto countMismatches = [&](ChunkStorage* chunkStorage, const PODVector<BlockType>& expectedBlocks) {
+        unsigned differ = 0;
+        for (int i = 0; i < CHUNK_COUNT; i++) {
+            BlockType blocks[CHUNK_VOXEL_COUNT];
+            PODVector<BlockEdit> edits;
+            ChunkRecord record = chunkStorage->LoadChunk(chunks[i], blocks, edits);
+            if (record == CR_ERROR || (record == CR_BLOCKS) != (i % 3 == 0)) {
+                differ++;
+                continue;
+            }
+            if (record != CR_BLOCKS) {
+                for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+                    blocks[j] = BT_NONE;
+                }
+                for (auto it = edits.Begin(); it != edits.End(); ++it) {
+                    blocks[(*it).index_] = static_cast<BlockType>((*it).type_);
+                }
+            }
+            if (memcmp(blocks, &expectedBlocks[i * CHUNK_VOXEL_COUNT], sizeof(blocks)) != 0) {
+                differ++;
+            }
+        }
+        return differ;
+    };
+    PODVector<BlockType> expectedCrash(expected);
+    applyRecords(expectedCrash, records.Size() - 1);
+    applyRecords(expected, records.Size());
+    unsigned mismatches = countMismatches(storage, expected);
+    unsigned crashMismatches = countMismatches(crashStorage, expectedCrash);
+    bool journalsRemoved = !fileSystem->FileExists(journal->GetFileName()) && !fileSystem->FileExists(crashJournal->GetFileName());
+    storage->Close();
+    crashStorage->Close();
+    clearDirectory(directory);
+    clearDirectory(crashDirectory);
+
+    // A chunk rewrite per edit would write at least one region sector
+    URHO3D_LOGINFOF("Edit journal, %d edits: batched %.2f us/edit in %u syncs, synced per edit %.1f us/edit, "
+                    "%u bytes per edit against %u for a chunk rewrite",
+                    count, (float)batchedTime / count, syncs, (float)singleTime / Max(Min(count, SINGLE_SYNC_COUNT), 1),
+                    EDIT_JOURNAL_RECORD_SIZE, REGION_SECTOR_SIZE);
+    if (reopened && journalsRemoved && mismatches == 0 && crashMismatches == 0
+        && journal->GetCompactedCount() == records.Size() && crashJournal->GetCompactedCount() == records.Size() - 1) {
+        URHO3D_LOGINFOF("Edit journal test PASSED, %u edits folded into %d chunks, torn record dropped after the crash", records.Size(), CHUNK_COUNT);
+    } else {
+        URHO3D_LOGERRORF("Edit journal test FAILED, %u of %u and %u of %u edits folded, %u chunks differ after close, %u after the crash",
+                         journal->GetCompactedCount(), records.Size(), crashJournal->GetCompactedCount(), records.Size() - 1,
+                         mismatches, crashMismatches);
+    }
+}
+
+void VoxelBenchmark::TestRegionRoundTrip(int count)
+{
+    const unsigned LEGACY_CHUNK_COUNT = 4;
+    const String regionFileName = "World/benchmark_region.bin";
+    const String legacyFileName = "World/benchmark_chunk.json";
+    auto storage = GetSubsystem<ChunkStorage>();
+    if (!GetSubsystem<ChunkGenerator>() || !storage) {
+        URHO3D_LOGERROR("Region round trip test requires the chunk generator and the chunk storage");
+        return;
+    }
+    auto fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem->DirExists("World")) {
+        fileSystem->CreateDir("World");
+    }
+    if (fileSystem->FileExists(regionFileName)) {
+        fileSystem->Delete(regionFileName);
+    }
+
+    // Every chunk gets its own entry of the scratch region
+    count = Min(count, REGION_SIZE);
+    Vector<SharedPtr<Chunk>> chunks;
+    CreateChunks(chunks, count, TERRAIN_BENCHMARK_ORIGIN - Vector3(0, count * SIZE_Y / 2, 0));
+    PODVector<BlockType> blocks(chunks.Size() * CHUNK_VOXEL_COUNT);
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        GenerateBlocks(chunks[i]);
+        chunks[i]->GetBlocks(&blocks[i * CHUNK_VOXEL_COUNT]);
+    }
+
+    // Legacy files are written the way Chunk::Save used to, one key per block
+    auto writeLegacyFile = [&](const BlockType* chunkBlocks) {
+        JSONFile file(context_);
+        JSONValue& root = file.GetRoot();
+        for (int x = 0; x < SIZE_X; x++) {
+            for (int y = 0; y < SIZE_Y; y++) {
+                for (int z = 0; z < SIZE_Z; z++) {
+                    root.Set(String(x) + "_" + String(y) + "_" + String(z), static_cast<int>(chunkBlocks[Chunk::GetBlockIndex(x, y, z)]));
+                }
+            }
+        }
+        return file.SaveFile(legacyFileName);
+    };
+    unsigned legacyChunks = Min(chunks.Size(), LEGACY_CHUNK_COUNT);
+    unsigned legacyMismatches = 0;
+    for (unsigned i = 0; i < legacyChunks; i++) {
+        BlockType legacy[CHUNK_VOXEL_COUNT];
+        if (!writeLegacyFile(&blocks[i * CHUNK_VOXEL_COUNT]) || !storage->LoadLegacyChunk(legacyFileName, legacy)
+            || memcmp(legacy, &blocks[i * CHUNK_VOXEL_COUNT], sizeof(legacy)) != 0) {
+            legacyMismatches++;
+        }
+        // The converted blocks go into the region like ConvertLegacyFiles does
+        memcpy(&blocks[i * CHUNK_VOXEL_COUNT], legacy, sizeof(legacy));
+    }
+    // Values that are no block type must not reach the palette
+    unsigned invalidAccepted = 0;
+    const int invalidTypes[] = {BT_NONE, BT_NONE + 1, -1};
+    for (int invalidType : invalidTypes) {
+        PODVector<BlockType> invalid(&blocks[0], CHUNK_VOXEL_COUNT);
+        invalid[Chunk::GetBlockIndex(1, 2, 3)] = static_cast<BlockType>(invalidType);
+        BlockType legacy[CHUNK_VOXEL_COUNT];
+        if (writeLegacyFile(&invalid[0]) && storage->LoadLegacyChunk(legacyFileName, legacy)) {
+            invalidAccepted++;
+        }
+    }
+    fileSystem->Delete(legacyFileName);
+
+    auto writeChunks = [&](RegionFile* region) {
+        unsigned failed = 0;
+        for (unsigned i = 0; i < chunks.Size(); i++) {
+            VectorBuffer buffer;
+            ChunkStorage::EncodeVoxels(&blocks[i * CHUNK_VOXEL_COUNT], buffer);
+            if (!region->Write(i, buffer.GetBuffer())) {
+                failed++;
+            }
+        }
+        return failed;
+    };
+    auto compareChunks = [&](RegionFile* region) {
+        unsigned differ = 0;
+        for (unsigned i = 0; i < chunks.Size(); i++) {
+            PODVector<unsigned char> payload;
+            BlockType read[CHUNK_VOXEL_COUNT];
+            if (!region->Read(i, payload)) {
+                differ++;
+                continue;
+            }
+            MemoryBuffer buffer(payload);
+            if (!ChunkStorage::DecodeVoxels(buffer, read) || memcmp(read, &blocks[i * CHUNK_VOXEL_COUNT], sizeof(read)) != 0) {
+                differ++;
+            }
+        }
+        return differ;
+    };
+    SharedPtr<RegionFile> region(new RegionFile(context_));
+    if (!region->Open(regionFileName)) {
+        URHO3D_LOGERROR("Region round trip test can't create " + regionFileName);
+        return;
+    }
+    HiresTimer timer;
+    unsigned writeFailures = writeChunks(region);
+    long long writeTime = timer.GetUSec(false);
+    timer.Reset();
+    unsigned mismatches = compareChunks(region);
+    long long readTime = timer.GetUSec(false);
+
+    // Rewrites that grow, shrink and keep the payload size
+    unsigned state = 1;
+    for (unsigned i = 0; i < chunks.Size(); i++) {
+        BlockType* chunkBlocks = &blocks[i * CHUNK_VOXEL_COUNT];
+        if (i % 3 == 0) {
+            for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+                state = state * 1664525u + 1013904223u;
+                chunkBlocks[j] = static_cast<BlockType>((state >> 16) % BT_NONE);
+            }
+        } else if (i % 3 == 1) {
+            for (int j = 0; j < CHUNK_VOXEL_COUNT; j++) {
+                chunkBlocks[j] = BT_AIR;
+            }
+        }
+    }
+    writeFailures += writeChunks(region);
+    region->Sync();
+
+    // Read back from a freshly opened file, only what reached the offset table counts
+    region = new RegionFile(context_);
+    if (region->Open(regionFileName)) {
+        mismatches += compareChunks(region);
+    } else {
+        mismatches += chunks.Size();
+    }
+    region.Reset();
+    fileSystem->Delete(regionFileName);
+
+    URHO3D_LOGINFOF("Region round trip, %d chunks: write %.1f us/chunk, read %.1f us/chunk",
+                    chunks.Size(), (float)writeTime / chunks.Size(), (float)readTime / chunks.Size());
+    if (legacyMismatches == 0 && invalidAccepted == 0 && writeFailures == 0 && mismatches == 0) {
+        URHO3D_LOGINFOF("Region round trip test PASSED, %d chunks match exactly after writing and rewriting them, "
+                        "%u of them read from legacy files, invalid legacy types rejected",
+                        chunks.Size(), legacyChunks);
+    } else {
+        URHO3D_LOGERRORF("Region round trip test FAILED, %u reads of %d chunks differ, %u writes failed, %u of %u legacy chunks differ, "
+                         "%u invalid legacy files accepted", mismatches, chunks.Size(), writeFailures, legacyMismatches, legacyChunks, invalidAccepted);
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Scene/Scene.h>
+#include "VoxelDefs.h"
+#include "Chunk.h"
+#include "ChunkMap.h"
+
+using namespace Urho3D;
+
+/**
+ * Headless voxel benchmarks, available as console commands.
+ * Chunks are created far away from the played area in a separate scene
+ * so that the running world is not affected
+ */
+class VoxelBenchmark : public Object {
+    URHO3D_OBJECT(VoxelBenchmark, Object);
+    VoxelBenchmark(Context* context);
+    virtual ~VoxelBenchmark();
+
+public:
+    static void RegisterObject(Context* context);
+
+    /**
+     * Generate and mesh count^3 chunks serially and on all WorkQueue threads
+     */
+    void BenchmarkChunkGeneration(int count);
+
+    /**
+     * Mesh the same count^3 chunks with every meshing mode, report geometry size and time
+     */
+    void BenchmarkMeshing(int count);
+
+    /**
+     * Time chunk lookups by String identifier against ChunkMap with the same chunks and queries
+     */
+    void BenchmarkChunkLookup(int count);
+
+    /**
+     * Place and remove count blocks on the terrain surface of the running world,
+     * report light propagation time and visited nodes per edit
+     */
+    void BenchmarkRelight(int count);
+
+    /**
+     * Apply count block edits to the running world, propagate light serially and in
+     * parallel waves from the same state and compare the resulting light maps.
+     * The world is restored afterwards
+     */
+    void TestLightDeterminism(int count);
+
+    /**
+     * Round-trip count^3 generated terrain chunks through the chunk wire codec,
+     * verify the blocks and report bytes per chunk against the raw format
+     */
+    void TestChunkCodec(int count);
+
+    /**
+     * Build collision for count^3 terrain chunks as triangle meshes and as merged boxes,
+     * report block edit latency including the collision rebuild and physics step time
+     */
+    void BenchmarkCollision(int count);
+
+    /**
+     * Cast count random rays through the loaded world, one at a time and as a batch,
+     * against the Octree triangle raycast when the scene has one
+     */
+    void BenchmarkRaycast(int count);
+
+    /**
+     * Generate the same count^3 terrain chunks serially and on all WorkQueue threads in reverse order,
+     * compare block hashes of every chunk
+     */
+    void TestGenerationDeterminism(int count);
+
+    /**
+     * Decorate the same count^3 terrain chunks serially and on all WorkQueue threads in reverse order,
+     * compare block hashes of every chunk
+     */
+    void TestDecorationDeterminism(int count);
+
+    /**
+     * Sample count noise values per kernel with the scalar calls and every supported batch kernel,
+     * report samples per second and differences, then compare batched chunk noise planes with the per block functions
+     */
+    void BenchmarkNoise(int count);
+
+    /**
+     * Generate count^3 terrain chunks with every density lattice step, report load time per chunk
+     * and the share of blocks that differ from the exact density
+     */
+    void BenchmarkDensityLattice(int count);
+
+    /**
+     * Edit every 8th of count^3 terrain chunks, compare the stored size of full block records
+     * with player edit records and check that regenerated chunks with the edits applied match,
+     * including removed leaves on the chunk sides and the same blocks loaded as block records
+     */
+    void BenchmarkPersistence(int count);
+
+    /**
+     * Journal count edits of a scratch world with batched syncs and with a sync per edit. The journal is folded
+     * on close, a copy cut in the middle of the last record is folded by a new journal as after a crash.
+     * Both chunk storages have to hold exactly the journaled edits
+     */
+    void TestEditJournal(int count);
+
+    /**
+     * Write count^3 generated chunks, the first of them read from legacy JSON files, into a scratch region file.
+     * Rewrite them with larger, smaller and equal payloads, reopen the file and compare every block.
+     * Legacy files with values that are no block type have to be rejected
+     */
+    void TestRegionRoundTrip(int count);
+
+private:
+    void RegisterConsoleCommands();
+    void CreateChunks(Vector<SharedPtr<Chunk>>& chunks, int count, const Vector3& origin);
+
+    SharedPtr<Scene> scene_;
+};
@@ -12,6 +12,20 @@ enum BlockSide {
     BACK
 };
 
+enum MeshingMode {
+    // One quad per visible block face
+    MM_NAIVE,
+    // Coplanar faces with equal block type and light merged into rectangles
+    MM_GREEDY
+};
+
+enum CollisionMode {
+    // Render mesh triangles as a Bullet triangle mesh
+    CM_TRIANGLE_MESH,
+    // Blocks merged into as few boxes as possible
+    CM_BOXES
+};
+
 enum BlockType {
     BT_AIR,
     BT_STONE,
@@ -34,10 +48,25 @@ enum Biome {
     B_NONE,
 };
 
+/**
+ * Stable reference to a chunk owned by VoxelWorld.
+ * The slot is reused after the chunk is removed, the generation tells the owners apart
+ */
+struct ChunkHandle {
+    unsigned slot_{0xFFFFFFFF};
+    unsigned generation_{0};
+};
+
 struct VoxelBlock {
     BlockType type;
 };
 
+struct BlockEdit {
+    // Linear block index inside the chunk
+    unsigned short index_;
+    unsigned char type_;
+};
+
 const int NETWORK_REQUEST_CHUNK = 153;
 const int NETWORK_SEND_CHUNK = 154;
 const int NETWORK_REQUEST_CHUNK_HIT = 155;
@@ -18,6 +18,10 @@ namespace VoxelEvents {
         URHO3D_PARAM(P_POSITION, Position); // Vector3 - block position
     }
 
+    URHO3D_EVENT(E_LIGHT_PROPAGATED, LightPropagated) {
+        URHO3D_PARAM(P_WAVES, Waves); // unsigned - waves needed to settle the light
+    }
+
     URHO3D_EVENT(E_CHUNK_HIT, ChunkHit) {
         URHO3D_PARAM(P_POSITION, Position); // Vector3 - block position
         URHO3D_PARAM(P_DIRECTION, Direction); // Vector3 - block position
@@ -37,4 +41,15 @@ namespace VoxelEvents {
         URHO3D_PARAM(P_POSITION, Position);
         URHO3D_PARAM(P_DATA, Data);
     }
+
+    URHO3D_EVENT(E_CHUNK_IO_LOADED, ChunkIOLoaded) {
+        URHO3D_PARAM(P_POSITION, Position); // Vector3 - chunk position
+        URHO3D_PARAM(P_FOUND, Found); // bool - chunk was found on disk
+        URHO3D_PARAM(P_DATA, Data); // Buffer - block types or encoded player edits
+        URHO3D_PARAM(P_EDITS, Edits); // bool - data holds player edits to apply to the generated chunk
+    }
+
+    URHO3D_EVENT(E_CHUNK_IO_SAVED, ChunkIOSaved) {
+        URHO3D_PARAM(P_POSITION, Position); // Vector3 - chunk position
+    }
 }
\ No newline at end of file
@@ -16,35 +16,69 @@
 #include "../../Console/ConsoleHandlerEvents.h"
 #include "../../Global.h"
 #include "LightManager.h"
+#include "ChunkCodec.h"
 #include "TreeGenerator.h"
+#include "ChunkStorage.h"
+#include "ChunkIOService.h"
+#include "EditJournal.h"
+#include "ChunkStreamer.h"
+#include "ChunkGenerator.h"
 
 using namespace VoxelEvents;
 using namespace ConsoleHandlerEvents;
 
+// Chunk coordinate step towards each BlockSide
+static const IntVector3 CHUNK_SIDE_OFFSETS[6] = {
+        IntVector3(0, 1, 0), IntVector3(0, -1, 0), IntVector3(-1, 0, 0),
+        IntVector3(1, 0, 0), IntVector3(0, 0, -1), IntVector3(0, 0, 1)
+};
+
 bool CompareChunks(const Chunk* lhs, const Chunk* rhs)
 {
    return lhs->GetDistance() < rhs->GetDistance();
 }
 
+void GenerateChunk(const WorkItem* item, unsigned threadIndex)
+{
+    Chunk* chunk = reinterpret_cast<Chunk*>(item->aux_);
+    chunk->Load();
+}
+
+void DecorateChunk(const WorkItem* item, unsigned threadIndex)
+{
+    Chunk* chunk = reinterpret_cast<Chunk*>(item->aux_);
+    chunk->Decorate();
+}
+
+void CalculateChunkGeometry(const WorkItem* item, unsigned threadIndex)
+{
+    Chunk* chunk = reinterpret_cast<Chunk*>(item->aux_);
+    chunk->CalculateGeometry();
+}
+
 void UpdateChunkState(const WorkItem* item, unsigned threadIndex)
 {
     Timer loadTime;
     VoxelWorld* world = reinterpret_cast<VoxelWorld*>(item->aux_);
     MutexLock lock(world->mutex_);
     if (world->GetSubsystem<LightManager>()) {
+        for (unsigned i = 0; i < world->chunks_.GetCapacity(); i++) {
+            Chunk* chunk = world->chunks_.GetSlot(i);
+            if (chunk && chunk->IsLoaded() && chunk->IsLightSeedPending()) {
+                world->GetSubsystem<LightManager>()->SeedChunkBorders(chunk);
+                chunk->SetLightSeedPending(false);
+            }
+        }
         world->GetSubsystem<LightManager>()->ResetFailedCalculations();
-        world->GetSubsystem<LightManager>()->Process();
-    }
-    if (world->GetSubsystem<TreeGenerator>()) {
-        world->GetSubsystem<TreeGenerator>()->Process();
     }
     if (world->GetSubsystem<DebugHud>()) {
         world->GetSubsystem<DebugHud>()->SetAppStats("Chunks Loaded", world->chunks_.Size());
     }
 
     int counter = 0;
-    for (auto chIt = world->chunks_.Begin(); chIt != world->chunks_.End(); ++chIt) {
-        if ((*chIt).second_ && (*chIt).second_->IsActive()) {
+    for (unsigned i = 0; i < world->chunks_.GetCapacity(); i++) {
+        Chunk* chunk = world->chunks_.GetSlot(i);
+        if (chunk && chunk->IsActive()) {
             counter++;
         }
     }
@@ -53,12 +87,12 @@ void UpdateChunkState(const WorkItem* item, unsigned threadIndex)
     }
 
     int requestedFromServerCount = 0;
-    int savePerFrame = 0;
+    auto ioService = world->GetSubsystem<ChunkIOService>();
 
     Vector<Chunk*> chunks;
-    for (auto it = world->chunks_.Begin(); it != world->chunks_.End(); ++it) {
-        if ((*it).second_) {
-            chunks.Push((*it).second_.Get());
+    for (unsigned i = 0; i < world->chunks_.GetCapacity(); i++) {
+        if (world->chunks_.GetSlot(i)) {
+            chunks.Push(world->chunks_.GetSlot(i));
         }
     }
 
@@ -71,32 +105,23 @@ void UpdateChunkState(const WorkItem* item, unsigned threadIndex)
         // Initialize new chunks
         if (!(*it)->IsLoaded()) {
             if (!world->GetSubsystem<Network>()->GetServerConnection()) {
-                (*it)->Load();
-//                for (int i = 0; i < 6; i++) {
-//                    auto neighbor = (*it).second_->GetNeighbor(static_cast<BlockSide>(i));
-//                    if (neighbor) {
-////                        neighbor->CalculateLight();
-//                    }
-//                }
+                if (ioService && (*it)->GetDiskState() == CDS_NONE) {
+                    // Disk read happens on the I/O thread, chunk is generated once the data arrives
+                    (*it)->SetDiskState(CDS_REQUESTED);
+                    ioService->RequestLoad((*it)->GetChunkCoordinates(), (*it)->GetDistance());
+                }
             } else if (!(*it)->IsRequestedFromServer()) {
                 (*it)->LoadFromServer();
                 requestedFromServerCount++;
             }
         }
 
-        if (!(*it)->IsGeometryCalculated()) {
-            (*it)->CalculateGeometry();
-//            URHO3D_LOGINFO("CalculateGeometry " + (*it).second_->GetPosition().ToString());
-        }
-
-        if ((*it)->ShouldSave() && savePerFrame < 1) {
+        if ((*it)->ShouldSave()) {
+            // Only snapshots the voxels, writing is done by the I/O thread
             (*it)->Save();
-            savePerFrame++;
         }
     }
 
-    world->ProcessQueue();
-
     world->reloadAllChunks_ = false;
 //    URHO3D_LOGINFO("Chunks updated in " + String(loadTime.GetMSec(false)) + "ms");
 }
@@ -106,13 +131,34 @@ VoxelWorld::VoxelWorld(Context* context):
 {
 }
 
+VoxelWorld::~VoxelWorld()
+{
+    // Work items and light waves hold raw chunk pointers, they have to finish before the chunks are released.
+    // Without the subscriptions their completion can't schedule new work
+    UnsubscribeFromAllEvents();
+    GetSubsystem<WorkQueue>()->Complete(0);
+    if (GetSubsystem<LightManager>()) {
+        GetSubsystem<LightManager>()->CompletePropagation();
+    }
+    // Keep unsaved edits
+    MutexLock lock(mutex_);
+    for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+        Chunk* chunk = chunks_.GetSlot(i);
+        if (chunk && chunk->ShouldSave()) {
+            chunk->Save();
+        }
+    }
+}
+
 void VoxelWorld::Init()
 {
     scene_ = GetSubsystem<SceneManager>()->GetActiveScene();
 
     SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(VoxelWorld, HandleUpdate));
     SubscribeToEvent(E_CHUNK_RECEIVED, URHO3D_HANDLER(VoxelWorld, HandleChunkReceived));
+    SubscribeToEvent(E_CHUNK_IO_LOADED, URHO3D_HANDLER(VoxelWorld, HandleChunkIOLoaded));
     SubscribeToEvent(E_WORKITEMCOMPLETED, URHO3D_HANDLER(VoxelWorld, HandleWorkItemFinished));
+    SubscribeToEvent(E_LIGHT_PROPAGATED, URHO3D_HANDLER(VoxelWorld, HandleLightPropagated));
     SubscribeToEvent(E_NETWORKMESSAGE, URHO3D_HANDLER(VoxelWorld, HandleNetworkMessage));
 
     SendEvent(
@@ -146,6 +192,12 @@ void VoxelWorld::Init()
             URHO3D_LOGERROR("This command doesn't have any arguments!");
             return;
         }
+        if (GetSubsystem<EditJournal>()) {
+            GetSubsystem<EditJournal>()->Close();
+        }
+        if (GetSubsystem<ChunkStorage>()) {
+            GetSubsystem<ChunkStorage>()->Close();
+        }
         if(GetSubsystem<FileSystem>()->DirExists("World")) {
             Vector<String> files;
             GetSubsystem<FileSystem>()->ScanDir(files, "World", "", SCAN_FILES, false);
@@ -154,6 +206,25 @@ void VoxelWorld::Init()
                 GetSubsystem<FileSystem>()->Delete("World/" + (*it));
             }
         }
+        OpenWorld();
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "world_convert",
+            ConsoleCommandAdd::P_EVENT, "#world_convert",
+            ConsoleCommandAdd::P_DESCRIPTION, "Convert legacy JSON chunk files to region files",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#world_convert", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 1) {
+            URHO3D_LOGERROR("This command doesn't have any arguments!");
+            return;
+        }
+        if (GetSubsystem<ChunkStorage>()) {
+            GetSubsystem<ChunkStorage>()->ConvertLegacyFiles();
+        }
     });
 
     SendEvent(
@@ -171,6 +242,216 @@ void VoxelWorld::Init()
         }
        SetSunlight(ToFloat(params[1]));
     });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "chunk_greedy_meshing",
+            ConsoleCommandAdd::P_EVENT, "#chunk_greedy_meshing",
+            ConsoleCommandAdd::P_DESCRIPTION, "Merge coplanar block faces when building chunk geometry [0|1]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#chunk_greedy_meshing", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 2) {
+            URHO3D_LOGERROR("This command requires exactly 1 argument!");
+            return;
+        }
+        SetMeshingMode(ToBool(params[1]) ? MM_GREEDY : MM_NAIVE);
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "chunk_box_collision",
+            ConsoleCommandAdd::P_EVENT, "#chunk_box_collision",
+            ConsoleCommandAdd::P_DESCRIPTION, "Build chunk collision from merged block boxes instead of triangle meshes [0|1]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#chunk_box_collision", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 2) {
+            URHO3D_LOGERROR("This command requires exactly 1 argument!");
+            return;
+        }
+        SetCollisionMode(ToBool(params[1]) ? CM_BOXES : CM_TRIANGLE_MESH);
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "chunk_density_step",
+            ConsoleCommandAdd::P_EVENT, "#chunk_density_step",
+            ConsoleCommandAdd::P_DESCRIPTION, "Sample ore and cave noise every N blocks and interpolate, 1 is exact [1|2|4|8]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#chunk_density_step", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 2) {
+            URHO3D_LOGERROR("This command requires exactly 1 argument!");
+            return;
+        }
+        auto generator = GetSubsystem<ChunkGenerator>();
+        if (!generator) {
+            return;
+        }
+        // Stored edits are relative to the generated blocks, the world keeps the step it was generated with.
+        // Only a world without stored chunks or journaled edits can change it
+        auto storage = GetSubsystem<ChunkStorage>();
+        auto journal = GetSubsystem<EditJournal>();
+        if (storage && (storage->HasStoredChunks() || (journal && journal->GetJournalCount() + journal->GetPendingCount() > 0))) {
+            URHO3D_LOGERRORF("World has stored chunks generated with density step %d, use world_reset to start a world with another step",
+                storage->GetWorldHeader().densityStep_);
+            return;
+        }
+        generator->SetDensityStep(ToInt(params[1]));
+        if (storage) {
+            WorldHeader header = storage->GetWorldHeader();
+            header.densityStep_ = generator->GetDensityStep();
+            storage->SetWorldHeader(header);
+        }
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "world_journal",
+            ConsoleCommandAdd::P_EVENT, "#world_journal",
+            ConsoleCommandAdd::P_DESCRIPTION, "Edit journal sync interval in ms and the number of edits after which it is folded into the chunks [ms] [edits]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#world_journal", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        auto journal = GetSubsystem<EditJournal>();
+        if (params.Size() < 2 || params.Size() > 3 || !journal) {
+            URHO3D_LOGERROR("This command requires 1 or 2 arguments!");
+            return;
+        }
+        journal->SetSyncInterval(ToUInt(params[1]));
+        if (params.Size() == 3) {
+            journal->SetCompactionSize(ToUInt(params[2]));
+        }
+        URHO3D_LOGINFOF("Edit journal sync interval %d ms, folded after %d edits", journal->GetSyncInterval(), journal->GetCompactionSize());
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "world_persistence",
+            ConsoleCommandAdd::P_EVENT, "#world_persistence",
+            ConsoleCommandAdd::P_DESCRIPTION, "Store all chunk blocks or only the player edits of generated chunks [blocks|edits]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#world_persistence", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 2 || (params[1] != "blocks" && params[1] != "edits")) {
+            URHO3D_LOGERROR("This command requires exactly 1 argument: blocks or edits");
+            return;
+        }
+        auto storage = GetSubsystem<ChunkStorage>();
+        if (!storage) {
+            return;
+        }
+        // Chunks saved before keep their record kind until they are saved again
+        WorldHeader header = storage->GetWorldHeader();
+        header.persistence_ = params[1] == "blocks" ? CP_BLOCKS : CP_EDITS;
+        storage->SetWorldHeader(header);
+        URHO3D_LOGINFO("World persistence changed to " + params[1]);
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "chunk_cache",
+            ConsoleCommandAdd::P_EVENT, "#chunk_cache",
+            ConsoleCommandAdd::P_DESCRIPTION, "Memory for recently unloaded chunks and whether their meshes are kept [mb] [0|1]",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#chunk_cache", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() < 2 || params.Size() > 3) {
+            URHO3D_LOGERROR("This command requires 1 or 2 arguments!");
+            return;
+        }
+        chunkCache_.SetMemoryLimit(ToUInt(params[1]) * 1024 * 1024);
+        if (params.Size() == 3) {
+            cacheMeshes_ = ToBool(params[2]);
+        }
+        chunkCache_.Trim();
+        URHO3D_LOGINFOF("Chunk cache limit %d MB, keeping meshes %d", ToUInt(params[1]), cacheMeshes_);
+    });
+
+    SendEvent(
+            E_CONSOLE_COMMAND_ADD,
+            ConsoleCommandAdd::P_NAME, "chunk_upload_budget",
+            ConsoleCommandAdd::P_EVENT, "#chunk_upload_budget",
+            ConsoleCommandAdd::P_DESCRIPTION, "Milliseconds per frame spent uploading chunk meshes",
+            ConsoleCommandAdd::P_OVERWRITE, true
+    );
+    SubscribeToEvent("#chunk_upload_budget", [&](StringHash eventType, VariantMap& eventData) {
+        StringVector params = eventData["Parameters"].GetStringVector();
+        if (params.Size() != 2) {
+            URHO3D_LOGERROR("This command requires exactly 1 argument!");
+            return;
+        }
+        uploadBudget_ = Max(ToFloat(params[1]), 0.0f);
+        URHO3D_LOGINFOF("Chunk upload budget %.2f ms", uploadBudget_);
+    });
+
+    OpenWorld();
+
+    auto cache = GetSubsystem<ResourceCache>();
+    landMaterial_ = cache->GetResource<Material>("Materials/Voxel.xml");
+    waterMaterial_ = cache->GetResource<Material>("Materials/VoxelWater.xml");
+    waterMaterial_->SetShaderParameter("TileSize", Chunk::GetTextureTileSize());
+    landMaterial_->SetShaderParameter("TileSize", Chunk::GetTextureTileSize());
+}
+
+void VoxelWorld::OpenWorld()
+{
+    auto storage = GetSubsystem<ChunkStorage>();
+    auto generator = GetSubsystem<ChunkGenerator>();
+    if (!storage || !generator) {
+        return;
+    }
+    WorldHeader header;
+    header.seed_ = generator->GetSeed();
+    header.generatorVersion_ = GENERATOR_VERSION;
+    header.densityStep_ = generator->GetDensityStep();
+    if (!storage->OpenWorld(header)) {
+        return;
+    }
+    // Edit records only make sense on top of the same generated blocks
+    if (header.seed_ != generator->GetSeed()) {
+        generator->SetSeed(header.seed_);
+    }
+    if (header.densityStep_ != generator->GetDensityStep()) {
+        generator->SetDensityStep(header.densityStep_);
+    }
+    if (header.generatorVersion_ != GENERATOR_VERSION) {
+        URHO3D_LOGWARNINGF("World was generated with generator version %d, current version is %d. Chunks stored as edits may differ",
+            header.generatorVersion_, GENERATOR_VERSION);
+    }
+    // Edits of a crashed session reach the storage before any chunk is read
+    if (GetSubsystem<EditJournal>()) {
+        GetSubsystem<EditJournal>()->Open();
+    }
+}
+
+void VoxelWorld::SetMeshingMode(MeshingMode mode)
+{
+    if (meshingMode_ == mode) {
+        return;
+    }
+    meshingMode_ = mode;
+    // Rebuild all chunk geometry with the new mode
+    reloadAllChunks_ = true;
+    URHO3D_LOGINFOF("Chunk meshing mode changed to %s", mode == MM_GREEDY ? "greedy" : "naive");
+}
+
+void VoxelWorld::SetCollisionMode(CollisionMode mode)
+{
+    if (collisionMode_ == mode) {
+        return;
+    }
+    collisionMode_ = mode;
+    // Collision is built together with the chunk geometry
+    reloadAllChunks_ = true;
+    URHO3D_LOGINFOF("Chunk collision mode changed to %s", mode == CM_BOXES ? "boxes" : "triangle mesh");
 }
 
 void VoxelWorld::RegisterObject(Context* context)
@@ -180,16 +461,24 @@ void VoxelWorld::RegisterObject(Context* context)
 
 void VoxelWorld::AddObserver(SharedPtr<Node> observer)
 {
-    observers_.Push(observer);
+    ChunkObserver entry;
+    entry.node_ = observer;
+    observers_.Push(entry);
     URHO3D_LOGINFO("Adding observer to voxel world!");
 }
 
 void VoxelWorld::RemoveObserver(SharedPtr<Node> observer)
 {
-    auto it = observers_.Find(observer);
-    if (it != observers_.End()) {
-        observers_.Erase(it);
-        URHO3D_LOGINFO("Removing observer from voxel world!");
+    for (auto it = observers_.Begin(); it != observers_.End(); ++it) {
+        if ((*it).node_.Get() == observer.Get()) {
+            if ((*it).placed_) {
+                ChangeViewArea((*it).center_, viewRadius_, -1);
+                viewChanged_ = true;
+            }
+            observers_.Erase(it);
+            URHO3D_LOGINFO("Removing observer from voxel world!");
+            return;
+        }
     }
 }
 
@@ -209,17 +498,153 @@ void VoxelWorld::HandleUpdate(StringHash eventType, VariantMap& eventData)
         }
     }
 
+    UpdateViews();
     UpdateChunks();
 
+    if (GetSubsystem<Network>()->IsServerRunning()) {
+        UpdateEditSubscriptions();
+        FlushBlockEdits();
+    }
+
     SetSunlight(Sin(GetSubsystem<Time>()->GetElapsedTime() * 10.0f) * 0.5f + 0.5f);
 }
 
 Chunk* VoxelWorld::CreateChunk(const Vector3& position)
 {
-    String id = GetChunkIdentificator(position);
-    chunks_[id] = new Chunk(context_);
-    chunks_[id]->Init(scene_, position);
-    return chunks_[id].Get();
+    IntVector3 coordinates = GetChunkCoordinates(position);
+    SharedPtr<Chunk> chunk = chunkCache_.Take(coordinates);
+    if (chunk) {
+        // Blocks and light are still valid, no generation needed
+        chunk->Resume();
+    } else {
+        chunk = chunkCache_.Acquire(context_);
+        chunk->Init(scene_, position);
+    }
+    chunks_.Insert(coordinates, chunk);
+    chunk->SetHandle(AcquireHandle(chunk));
+    LinkNeighbors(chunk, true);
+    return chunk.Get();
+}
+
+void VoxelWorld::LinkNeighbors(Chunk* chunk, bool link)
+{
+    IntVector3 coordinates = chunk->GetChunkCoordinates();
+    for (int i = 0; i < 6; i++) {
+        BlockSide side = static_cast<BlockSide>(i);
+        // Sides come in opposite pairs
+        BlockSide opposite = static_cast<BlockSide>(i ^ 1);
+        Chunk* neighbor = chunks_.Find(coordinates + CHUNK_SIDE_OFFSETS[i]);
+        chunk->SetNeighbor(side, link ? neighbor : nullptr);
+        if (neighbor) {
+            neighbor->SetNeighbor(opposite, link ? chunk : nullptr);
+        }
+    }
+}
+
+IntVector3 VoxelWorld::GetChunkCoordinates(const Vector3& position)
+{
+    return IntVector3(FloorToInt(position.x_ / SIZE_X), FloorToInt(position.y_ / SIZE_Y), FloorToInt(position.z_ / SIZE_Z));
+}
+
+static int FloorDivide(int value, int size)
+{
+    return value >= 0 ? value / size : (value - size + 1) / size;
+}
+
+bool VoxelWorld::Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, VoxelRaycastResult& result)
+{
+    Chunk* chunk = nullptr;
+    IntVector3 chunkCoordinates(M_MIN_INT, M_MIN_INT, M_MIN_INT);
+    return RaycastBlocks(Ray(origin, direction), maxDistance, result, chunkCoordinates, chunk);
+}
+
+unsigned VoxelWorld::Raycast(const PODVector<Ray>& rays, float maxDistance, PODVector<VoxelRaycastResult>& results)
+{
+    results.Resize(rays.Size());
+    // Rays of a batch tend to start close together, the last chunk is reused between them
+    Chunk* chunk = nullptr;
+    IntVector3 chunkCoordinates(M_MIN_INT, M_MIN_INT, M_MIN_INT);
+    unsigned hits = 0;
+    for (unsigned i = 0; i < rays.Size(); i++) {
+        if (RaycastBlocks(rays[i], maxDistance, results[i], chunkCoordinates, chunk)) {
+            hits++;
+        } else {
+            results[i].chunk_ = nullptr;
+        }
+    }
+    return hits;
+}
+
+bool VoxelWorld::RaycastBlocks(const Ray& ray, float maxDistance, VoxelRaycastResult& result, IntVector3& chunkCoordinates, Chunk*& chunk)
+{
+    const float* origin = ray.origin_.Data();
+    const float* direction = ray.direction_.Data();
+    // Side a block is entered through when stepping forward along x, y and z
+    const BlockSide positiveEntry[3] = {LEFT, BOTTOM, FRONT};
+    const BlockSide negativeEntry[3] = {RIGHT, TOP, BACK};
+    int block[3];
+    int step[3];
+    // Ray distance to the next block boundary and between two boundaries per axis
+    float next[3];
+    float delta[3];
+    BlockSide entry[3];
+    // Axis of the last step, the block the ray starts in counts as entered along the main direction
+    int axis = 0;
+    for (int i = 0; i < 3; i++) {
+        block[i] = FloorToInt(origin[i]);
+        if (direction[i] > 0.0f) {
+            step[i] = 1;
+            delta[i] = 1.0f / direction[i];
+            next[i] = (block[i] + 1 - origin[i]) * delta[i];
+            entry[i] = positiveEntry[i];
+        } else if (direction[i] < 0.0f) {
+            step[i] = -1;
+            delta[i] = -1.0f / direction[i];
+            next[i] = (origin[i] - block[i]) * delta[i];
+            entry[i] = negativeEntry[i];
+        } else {
+            step[i] = 0;
+            delta[i] = M_INFINITY;
+            next[i] = M_INFINITY;
+            entry[i] = positiveEntry[i];
+        }
+        if (Abs(direction[i]) > Abs(direction[axis])) {
+            axis = i;
+        }
+    }
+
+    float distance = 0.0f;
+    while (distance <= maxDistance) {
+        IntVector3 coordinates(FloorDivide(block[0], SIZE_X), FloorDivide(block[1], SIZE_Y), FloorDivide(block[2], SIZE_Z));
+        if (coordinates != chunkCoordinates) {
+            chunk = chunks_.Find(coordinates);
+            chunkCoordinates = coordinates;
+        }
+        // Unloaded chunks are looked through
+        if (chunk && chunk->IsLoaded()) {
+            IntVector3 chunkBlock(block[0] - coordinates.x_ * SIZE_X, block[1] - coordinates.y_ * SIZE_Y, block[2] - coordinates.z_ * SIZE_Z);
+            BlockType type = chunk->GetBlockValue(chunkBlock.x_, chunkBlock.y_, chunkBlock.z_);
+            if (type != BT_AIR) {
+                const IntVector3& normal = CHUNK_SIDE_OFFSETS[entry[axis]];
+                result.blockPosition_ = IntVector3(block[0], block[1], block[2]);
+                result.chunkBlockPosition_ = chunkBlock;
+                result.side_ = entry[axis];
+                result.normal_ = Vector3(normal.x_, normal.y_, normal.z_);
+                result.position_ = ray.origin_ + ray.direction_ * distance;
+                result.distance_ = distance;
+                result.type_ = type;
+                result.chunk_ = chunk;
+                return true;
+            }
+        }
+
+        // Cross the nearest block boundary
+        axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+        distance = next[axis];
+        next[axis] += delta[axis];
+        block[axis] += step[axis];
+    }
+    return false;
 }
 
 Vector3 VoxelWorld::GetNodeToChunkPosition(Node* node)
@@ -230,11 +655,7 @@ Vector3 VoxelWorld::GetNodeToChunkPosition(Node* node)
 
 bool VoxelWorld::IsChunkLoaded(const Vector3& position)
 {
-    String id = GetChunkIdentificator(position);
-    if (chunks_.Contains(id) && chunks_[id]) {
-        return true;
-    }
-    return false;
+    return chunks_.Contains(GetChunkCoordinates(position));
 }
 
 void VoxelWorld::LoadChunk(const Vector3& position)
@@ -306,13 +727,7 @@ bool VoxelWorld::IsEqualPositions(Vector3 a, Vector3 b)
 
 Chunk* VoxelWorld::GetChunkByPosition(const Vector3& position)
 {
-    Vector3 fixedPositon = GetWorldToChunkPosition(position);
-    String id = GetChunkIdentificator(fixedPositon);
-    if (chunks_.Find(id) != chunks_.End() && chunks_[id]) {
-        return chunks_[id].Get();
-    }
-
-    return nullptr;
+    return chunks_.Find(GetChunkCoordinates(position));
 }
 
 Vector3 VoxelWorld::GetWorldToChunkPosition(const Vector3& position)
@@ -341,42 +756,55 @@ void VoxelWorld::RemoveBlockAtPosition(const Vector3& position)
 
 void VoxelWorld::UpdateChunks()
 {
-    if (!updateWorkItem_) {
-        if (!chunksToLoad_.Empty()) {
-            for (auto it = chunks_.Begin(); it != chunks_.End(); ++it) {
-                if ((*it).second_) {
-                    (*it).second_->MarkForDeletion(true);
-                    (*it).second_->SetDistance(-1);
-                }
+    // Chunk set is only changed while no worker touches the chunks
+    auto lightManager = GetSubsystem<LightManager>();
+    if (!updateWorkItem_ && pendingChunkWork_ == 0 && !(lightManager && lightManager->IsPropagating())) {
+        MutexLock lock(mutex_);
+        // Server data may change while a client does not see the chunk, clients always request it again
+        bool useCache = GetSubsystem<Network>()->GetServerConnection() == nullptr;
+        for (auto it = leavingChunks_.Begin(); it != leavingChunks_.End(); ++it) {
+            SharedPtr<Chunk> chunk(chunks_.Find(*it));
+            if (!chunk) {
+                continue;
+            }
+            if (chunk->ShouldSave()) {
+                chunk->Save();
+            }
+            if (chunk->GetDiskState() == CDS_REQUESTED && GetSubsystem<ChunkIOService>()) {
+                GetSubsystem<ChunkIOService>()->CancelLoad(chunk->GetChunkCoordinates());
+            }
+            if (chunk->IsRequestedFromServer() && !chunk->IsLoaded() && GetSubsystem<ChunkStreamer>()) {
+                GetSubsystem<ChunkStreamer>()->CancelChunk(chunk->GetChunkCoordinates());
+            }
+            LinkNeighbors(chunk, false);
+            ReleaseHandle(chunk->GetHandle());
+            chunks_.Erase(*it);
+            if (useCache && chunk->IsLoaded()) {
+                chunk->Suspend(cacheMeshes_);
+                chunkCache_.Insert(chunk);
+            } else {
+                chunkCache_.Release(chunk);
             }
         }
+        leavingChunks_.Clear();
 
-        for (auto it = chunksToLoad_.Begin(); it != chunksToLoad_.End(); ++it) {
-            Vector3 position = (*it).first_;
-            String id = GetChunkIdentificator(position);
-            auto chunkIterator = chunks_.Find(id);
-            if (chunkIterator != chunks_.End()) {
-                (*chunkIterator).second_->MarkForDeletion(false);
-                (*chunkIterator).second_->SetDistance((*it).second_);
-            } else {
-                auto chunk = CreateChunk(position);
-                chunk->SetDistance((*it).second_);
+        for (auto it = enteringChunks_.Begin(); it != enteringChunks_.End(); ++it) {
+            if (!chunks_.Contains(*it)) {
+                CreateChunk(Vector3((*it).x_ * SIZE_X, (*it).y_ * SIZE_Y, (*it).z_ * SIZE_Z));
             }
         }
+        enteringChunks_.Clear();
 
-        chunksToLoad_.Clear();
+        if (viewChanged_) {
+            UpdateChunkDistances();
+            viewChanged_ = false;
+        }
 
-        MutexLock lock(mutex_);
-        for (auto it = chunks_.Begin(); it != chunks_.End(); ++it) {
-            if ((*it).second_) {
-                if ((*it).second_->IsMarkedForDeletion()) {
-                    int distance = (*it).second_->GetDistance();
-//                        URHO3D_LOGINFOF("Deleting chunk distance=%d ", distance);
-                    it = chunks_.Erase(it);
-                }
-                if (chunks_.End() == it) {
-                    break;
-                }
+        // No worker reads the chunks right now, replaced block layouts and uniform light maps can be released
+        for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+            Chunk* chunk = chunks_.GetSlot(i);
+            if (chunk && chunk->IsLoaded() && chunk->IsStorageDirty()) {
+                chunk->CompactStorage();
             }
         }
 
@@ -392,66 +820,246 @@ void VoxelWorld::UpdateChunks()
         workQueue->AddWorkItem(updateWorkItem_);
     }
 
-    int renderedChunkCount = 0;
-    int renderedChunkLimit = 1;
-    for (auto it = chunks_.Begin(); it != chunks_.End(); ++it) {
-        if ((*it).second_->ShouldRender()) {
-            bool rendered = (*it).second_->Render();
-//            URHO3D_LOGINFO("Rendering chunk " + (*it).second_->GetPosition().ToString());
-            if (rendered) {
-                renderedChunkCount++;
+    if (throughputTimer_.GetMSec(false) >= 1000) {
+        throughputTimer_.Reset();
+        if (GetSubsystem<DebugHud>()) {
+            GetSubsystem<DebugHud>()->SetAppStats("Chunks generated/s", generatedChunks_);
+            GetSubsystem<DebugHud>()->SetAppStats("Chunks decorated/s", decoratedChunks_);
+            GetSubsystem<DebugHud>()->SetAppStats("Chunks meshed/s", meshedChunks_);
+            GetSubsystem<DebugHud>()->SetAppStats("Pending chunk work", pendingChunkWork_);
+            GetSubsystem<DebugHud>()->SetAppStats("Meshing mode", meshingMode_ == MM_GREEDY ? "greedy" : "naive");
+            GetSubsystem<DebugHud>()->SetAppStats("Collision mode", collisionMode_ == CM_BOXES ? "boxes" : "triangle mesh");
+
+            unsigned storageBytes = 0;
+            unsigned uniformChunks = 0;
+            for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+                Chunk* chunk = chunks_.GetSlot(i);
+                if (chunk) {
+                    storageBytes += chunk->GetStorageMemory();
+                    uniformChunks += chunk->IsUniform() ? 1 : 0;
+                }
+            }
+            // Unpacked size is a 4 byte block type and a light byte per voxel
+            GetSubsystem<DebugHud>()->SetAppStats("Voxel memory KB", storageBytes / 1024);
+            GetSubsystem<DebugHud>()->SetAppStats("Voxel memory unpacked KB", chunks_.Size() * CHUNK_VOXEL_COUNT * (unsigned)(sizeof(VoxelBlock) + 1) / 1024);
+            GetSubsystem<DebugHud>()->SetAppStats("Uniform chunks", uniformChunks);
+            unsigned cacheLookups = chunkCache_.GetHits() + chunkCache_.GetMisses();
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk cache", chunkCache_.GetSize());
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk cache KB", chunkCache_.GetMemoryUsage() / 1024);
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk cache hit %", cacheLookups ? chunkCache_.GetHits() * 100 / cacheLookups : 0);
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk pool", chunkCache_.GetPoolSize());
+            auto chunkGenerator = GetSubsystem<ChunkGenerator>();
+            if (chunkGenerator) {
+                unsigned columnLookups = chunkGenerator->GetColumnCacheHits() + chunkGenerator->GetColumnCacheMisses();
+                GetSubsystem<DebugHud>()->SetAppStats("Column cache hit %", columnLookups ? chunkGenerator->GetColumnCacheHits() * 100 / columnLookups : 0);
+                chunkGenerator->ResetColumnCacheStats();
             }
-            if (renderedChunkCount >= renderedChunkLimit) {
-                break;
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk uploads/s", uploadCount_);
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk upload ms/s", uploadTime_ / 1000.0f);
+            GetSubsystem<DebugHud>()->SetAppStats("Chunk uploads pending", uploadsPending_);
+            if (GetSubsystem<Network>()->IsServerRunning()) {
+                GetSubsystem<DebugHud>()->SetAppStats("Edit messages sent/s", editMessagesSent_);
+                GetSubsystem<DebugHud>()->SetAppStats("Edit bytes sent/s", editBytesSent_);
+                GetSubsystem<DebugHud>()->SetAppStats("Edit bytes unfiltered/s", editBytesUnfiltered_);
+            }
+            if (meshedChunks_ > 0) {
+                GetSubsystem<DebugHud>()->SetAppStats("Avg chunk vertices", meshedVertices_ / meshedChunks_);
+                GetSubsystem<DebugHud>()->SetAppStats("Avg chunk indices", meshedIndices_ / meshedChunks_);
+                GetSubsystem<DebugHud>()->SetAppStats("Avg chunk vertex bytes", (unsigned)(meshedVertices_ / meshedChunks_ * sizeof(MeshVertex)));
+                GetSubsystem<DebugHud>()->SetAppStats("Avg chunk meshing us", (int)(meshingTime_ / meshedChunks_));
             }
         }
+        generatedChunks_ = 0;
+        decoratedChunks_ = 0;
+        meshedChunks_ = 0;
+        meshedVertices_ = 0;
+        meshedIndices_ = 0;
+        meshingTime_ = 0;
+        uploadCount_ = 0;
+        uploadTime_ = 0;
+        editMessagesSent_ = 0;
+        editBytesSent_ = 0;
+        editBytesUnfiltered_ = 0;
     }
+
+    UploadChunks();
 }
 
-String VoxelWorld::GetChunkIdentificator(const Vector3& position)
+void VoxelWorld::UploadChunks()
 {
-    return String((int)position.x_) + "_" +  String((int)position.y_) + "_" + String((int)position.z_);
+    PODVector<Chunk*> pending;
+    for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+        Chunk* chunk = chunks_.GetSlot(i);
+        if (chunk && chunk->ShouldRender()) {
+            pending.Push(chunk);
+        }
+    }
+    uploadsPending_ = pending.Size();
+    if (pending.Empty()) {
+        return;
+    }
+    Sort(pending.Begin(), pending.End(), CompareChunks);
+
+    // Nearest first until the frame budget is used, at least one chunk per frame
+    HiresTimer uploadTimer;
+    long long budget = (long long)(uploadBudget_ * 1000.0f);
+    for (auto it = pending.Begin(); it != pending.End(); ++it) {
+        if ((*it)->Render()) {
+            uploadCount_++;
+        }
+        if (uploadTimer.GetUSec(false) >= budget) {
+            break;
+        }
+    }
+    uploadTime_ += uploadTimer.GetUSec(false);
 }
 
-VoxelBlock* VoxelWorld::GetBlockAt(Vector3 position)
+VoxelBlock VoxelWorld::GetBlockAt(Vector3 position)
 {
     Vector3 chunkPosition = GetWorldToChunkPosition(position);
-    String id = GetChunkIdentificator(chunkPosition);
-    if (chunks_.Contains(id) && chunks_[id]) {
+    Chunk* chunk = chunks_.Find(GetChunkCoordinates(chunkPosition));
+    if (chunk) {
         Vector3 blockPosition = position - chunkPosition;
-        return chunks_[id]->GetBlockAt(IntVector3(blockPosition.x_, blockPosition.y_, blockPosition.z_));
+        return chunk->GetBlockAt(IntVector3(blockPosition.x_, blockPosition.y_, blockPosition.z_));
+    }
+    VoxelBlock block;
+    block.type = BT_NONE;
+    return block;
+}
+
+bool VoxelWorld::IsChunkValid(const ChunkHandle& handle)
+{
+    return GetChunk(handle) != nullptr;
+}
+
+Chunk* VoxelWorld::GetChunk(const ChunkHandle& handle)
+{
+    if (handle.slot_ >= handleChunks_.Size() || handleGenerations_[handle.slot_] != handle.generation_) {
+        return nullptr;
     }
-    return nullptr;
+    return handleChunks_[handle.slot_];
 }
 
-bool VoxelWorld::IsChunkValid(Chunk* chunk)
+void VoxelWorld::GetLoadedChunks(PODVector<Chunk*>& chunks)
 {
-    for (auto it = chunks_.Begin(); it != chunks_.End(); ++it) {
-        if ((*it).second_.Get() == chunk) {
-            return true;
+    for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+        Chunk* chunk = chunks_.GetSlot(i);
+        if (chunk && chunk->IsLoaded()) {
+            chunks.Push(chunk);
         }
     }
+}
 
-    return false;
+ChunkHandle VoxelWorld::AcquireHandle(Chunk* chunk)
+{
+    ChunkHandle handle;
+    if (!freeHandleSlots_.Empty()) {
+        handle.slot_ = freeHandleSlots_.Back();
+        freeHandleSlots_.Pop();
+    } else {
+        handle.slot_ = handleChunks_.Size();
+        handleChunks_.Push(nullptr);
+        handleGenerations_.Push(0);
+    }
+    handle.generation_ = handleGenerations_[handle.slot_];
+    handleChunks_[handle.slot_] = chunk;
+    return handle;
+}
+
+void VoxelWorld::ReleaseHandle(const ChunkHandle& handle)
+{
+    if (GetChunk(handle) == nullptr) {
+        return;
+    }
+    // Outstanding handles to this slot stop resolving
+    handleGenerations_[handle.slot_]++;
+    handleChunks_[handle.slot_] = nullptr;
+    freeHandleSlots_.Push(handle.slot_);
 }
 
 void VoxelWorld::HandleWorkItemFinished(StringHash eventType, VariantMap& eventData) {
     using namespace WorkItemCompleted;
     WorkItem *workItem = reinterpret_cast<WorkItem *>(eventData[P_ITEM].GetPtr());
+    if (workItem->workFunction_ == GenerateChunk || workItem->workFunction_ == DecorateChunk || workItem->workFunction_ == CalculateChunkGeometry) {
+        Chunk* chunk = reinterpret_cast<Chunk*>(workItem->aux_);
+        chunk->SetWorkScheduled(false);
+        if (workItem->workFunction_ == GenerateChunk) {
+            generatedChunks_++;
+        } else if (workItem->workFunction_ == DecorateChunk) {
+            decoratedChunks_++;
+        } else {
+            meshedChunks_++;
+            meshedVertices_ += chunk->GetMeshStats().vertexCount_;
+            meshedIndices_ += chunk->GetMeshStats().indexCount_;
+            meshingTime_ += chunk->GetMeshStats().time_;
+        }
+        pendingChunkWork_--;
+        return;
+    }
     if (workItem->aux_ != this) {
         return;
     }
-//    if (workItem->workFunction_ == GenerateVoxelData) {
-//        CreateNode();
-//        generateWorkItem_.Reset();
-//        MarkDirty();
-//    } else if (workItem->workFunction_ == GenerateVertices) {
-////        GetSubsystem<VoxelWorld>()->AddChunkToRenderQueue(this);
-//        Render();
-//        generateGeometryWorkItem_.Reset();
-//    } else
     if (workItem->workFunction_ == UpdateChunkState) {
         updateWorkItem_.Reset();
+        // Meshing waits for the light, it is scheduled once the waves are done
+        if (GetSubsystem<LightManager>()) {
+            GetSubsystem<LightManager>()->StartPropagation();
+        } else {
+            ScheduleChunkWork();
+        }
+    }
+}
+
+void VoxelWorld::HandleLightPropagated(StringHash eventType, VariantMap& eventData)
+{
+    if (!updateWorkItem_) {
+        ScheduleChunkWork();
+    }
+}
+
+void VoxelWorld::ScheduleChunkWork()
+{
+    bool isClient = GetSubsystem<Network>()->GetServerConnection() != nullptr;
+    bool diskService = GetSubsystem<ChunkIOService>() != nullptr;
+    WorkQueue *workQueue = GetSubsystem<WorkQueue>();
+    for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+        Chunk* chunk = chunks_.GetSlot(i);
+        if (!chunk || chunk->IsWorkScheduled()) {
+            continue;
+        }
+
+        WorkFunctionPtr workFunction = nullptr;
+        if (chunk->GetGenerationStage() == CGS_NONE) {
+            ChunkDiskState diskState = chunk->GetDiskState();
+            bool diskReady = diskState == CDS_LOADED || diskState == CDS_MISSING || (!diskService && diskState == CDS_NONE);
+            if (!isClient && diskReady) {
+                workFunction = GenerateChunk;
+            }
+        } else if (!chunk->IsLoaded()) {
+            // Stages advance together with the neighbors. Trees growing in from the neighbor columns are
+            // placed by every chunk they reach, so the order of decoration does not matter
+            if (chunk->GetGenerationStage() == CGS_WATER && chunk->AreNeighborsAtStage(CGS_WATER)) {
+                workFunction = DecorateChunk;
+            }
+        } else if (!chunk->IsGeometryCalculated() && chunk->AreNeighborsLoaded()) {
+            // Neighbor faces and light are only known once all surrounding chunks exist
+            workFunction = CalculateChunkGeometry;
+        }
+        if (!workFunction) {
+            continue;
+        }
+
+        SharedPtr<WorkItem> item = workQueue->GetFreeItem();
+        // Nearest chunks first, but always behind the world update pass
+        item->priority_ = M_MAX_INT - 1 - Max(chunk->GetDistance(), 0);
+        item->workFunction_ = workFunction;
+        item->aux_ = chunk;
+        item->sendEvent_ = true;
+        item->start_ = nullptr;
+        item->end_ = nullptr;
+        chunk->SetWorkScheduled(true);
+        pendingChunkWork_++;
+        workQueue->AddWorkItem(item);
     }
 }
 
@@ -481,65 +1089,145 @@ const String VoxelWorld::GetBlockName(BlockType type)
     }
 }
 
-bool VoxelWorld::ProcessQueue()
+void VoxelWorld::UpdateViews()
 {
     if (updateTimer_.GetMSec(false) < 100) {
-        return false;
+        return;
     }
     updateTimer_.Reset();
 
-    bool haveChanges = false;
+    if (viewRadius_ != visibleDistance_) {
+        // Swap every view for one of the new size, chunks in both only change their count
+        for (auto it = observers_.Begin(); it != observers_.End(); ++it) {
+            if ((*it).placed_) {
+                ChangeViewArea((*it).center_, visibleDistance_, 1);
+                ChangeViewArea((*it).center_, viewRadius_, -1);
+            }
+        }
+        viewRadius_ = visibleDistance_;
+        BuildViewShells();
+    }
 
-    for (auto it = observers_.Begin(); it != observers_.End(); ++it) {
-        Vector3 currentChunkPosition = GetWorldToChunkPosition((*it)->GetWorldPosition());
-        if (!(*it)->GetVar("ChunkPosition").IsEmpty()) {
-            Vector3 lastChunkPosition = (*it)->GetVar("ChunkPosition").GetVector3();
-            if (lastChunkPosition.x_ != currentChunkPosition.x_ || lastChunkPosition.y_ != currentChunkPosition.y_ ||
-                lastChunkPosition.z_ != currentChunkPosition.z_) {
-                haveChanges = true;
+    for (auto it = observers_.Begin(); it != observers_.End();) {
+        ChunkObserver& observer = *it;
+        if (!observer.node_) {
+            if (observer.placed_) {
+                ChangeViewArea(observer.center_, viewRadius_, -1);
             }
-        } else {
-            haveChanges = true;
+            it = observers_.Erase(it);
+            continue;
+        }
+        IntVector3 center = GetChunkCoordinates(observer.node_->GetWorldPosition());
+        if (!observer.placed_) {
+            ChangeViewArea(center, viewRadius_, 1);
+        } else if (center != observer.center_) {
+            MoveView(observer.center_, center);
         }
-        if (haveChanges) {
-            (*it)->SetVar("ChunkPosition", currentChunkPosition);
-            URHO3D_LOGINFOF("Player %s moved to chunk %dx%dx%d", (*it)->GetName().CString(), (int)currentChunkPosition.x_, (int)currentChunkPosition.y_, (int)currentChunkPosition.z_);
+        if (!observer.placed_ || center != observer.center_) {
+            observer.center_ = center;
+            observer.placed_ = true;
+            viewChanged_ = true;
+            URHO3D_LOGDEBUGF("Player %s moved to chunk %dx%dx%d", observer.node_->GetName().CString(), center.x_, center.y_, center.z_);
         }
+        ++it;
     }
+}
 
-    if (!haveChanges) {
-        return false;
+void VoxelWorld::BuildViewShells()
+{
+    // Offsets inside the view which were outside of it before moving one chunk towards the side
+    for (int i = 0; i < 6; i++) {
+        viewShells_[i].Clear();
+        for (int x = -viewRadius_; x <= viewRadius_; x++) {
+            for (int y = -viewRadius_ + Abs(x); y <= viewRadius_ - Abs(x); y++) {
+                int depth = viewRadius_ - Abs(x) - Abs(y);
+                for (int z = -depth; z <= depth; z++) {
+                    IntVector3 previous = IntVector3(x, y, z) + CHUNK_SIDE_OFFSETS[i];
+                    if (Abs(previous.x_) + Abs(previous.y_) + Abs(previous.z_) > viewRadius_) {
+                        viewShells_[i].Push(IntVector3(x, y, z));
+                    }
+                }
+            }
+        }
     }
+}
 
-    for (auto it = observers_.Begin(); it != observers_.End(); ++it) {
-        AddChunkToQueue(((*it)->GetWorldPosition()));
+void VoxelWorld::ChangeViewArea(const IntVector3& center, int radius, int delta)
+{
+    for (int x = -radius; x <= radius; x++) {
+        for (int y = -radius + Abs(x); y <= radius - Abs(x); y++) {
+            int depth = radius - Abs(x) - Abs(y);
+            for (int z = -depth; z <= depth; z++) {
+                ChangeViewCount(center + IntVector3(x, y, z), delta);
+            }
+        }
     }
+}
 
-    while (!chunkBfsQueue_.empty()) {
-        ChunkNode& node = chunkBfsQueue_.front();
-        int distance = node.distance_ + 1;
-        chunkBfsQueue_.pop();
-        if (distance <= visibleDistance_) {
-            AddChunkToQueue(node.position_ + Vector3::LEFT * SIZE_X, distance);
-            AddChunkToQueue(node.position_ + Vector3::RIGHT * SIZE_X, distance);
-            AddChunkToQueue(node.position_ + Vector3::FORWARD * SIZE_Z, distance);
-            AddChunkToQueue(node.position_ + Vector3::BACK * SIZE_Z, distance);
-            AddChunkToQueue(node.position_ + Vector3::UP * SIZE_Y, distance);
-            AddChunkToQueue(node.position_ + Vector3::DOWN * SIZE_Y, distance);
+void VoxelWorld::MoveView(IntVector3 from, const IntVector3& to)
+{
+    IntVector3 difference = to - from;
+    if (Abs(difference.x_) + Abs(difference.y_) + Abs(difference.z_) > viewRadius_) {
+        // Teleported, the shells would cover more than both views
+        ChangeViewArea(to, viewRadius_, 1);
+        ChangeViewArea(from, viewRadius_, -1);
+        return;
+    }
+    while (from != to) {
+        int side;
+        if (from.x_ != to.x_) {
+            side = from.x_ < to.x_ ? RIGHT : LEFT;
+        } else if (from.y_ != to.y_) {
+            side = from.y_ < to.y_ ? TOP : BOTTOM;
+        } else {
+            side = from.z_ < to.z_ ? BACK : FRONT;
+        }
+        IntVector3 next = from + CHUNK_SIDE_OFFSETS[side];
+        const PODVector<IntVector3>& entering = viewShells_[side];
+        for (auto it = entering.Begin(); it != entering.End(); ++it) {
+            ChangeViewCount(next + *it, 1);
         }
+        // Leaving shell is the entering shell of the opposite move
+        const PODVector<IntVector3>& leaving = viewShells_[side ^ 1];
+        for (auto it = leaving.Begin(); it != leaving.End(); ++it) {
+            ChangeViewCount(from + *it, -1);
+        }
+        from = next;
     }
+}
 
-    return true;
+void VoxelWorld::ChangeViewCount(const IntVector3& coordinates, int delta)
+{
+    unsigned& count = viewCounts_[coordinates];
+    count += delta;
+    if (count == 1 && delta > 0) {
+        if (!leavingChunks_.Erase(coordinates)) {
+            enteringChunks_.Insert(coordinates);
+        }
+    } else if (count == 0) {
+        viewCounts_.Erase(coordinates);
+        if (!enteringChunks_.Erase(coordinates)) {
+            leavingChunks_.Insert(coordinates);
+        }
+    }
 }
 
-void VoxelWorld::AddChunkToQueue(Vector3 position, int distance)
+void VoxelWorld::UpdateChunkDistances()
 {
-    Vector3 fixedPosition = GetWorldToChunkPosition(position);
-    String id = GetChunkIdentificator(fixedPosition);
-    ChunkNode node(position, distance);
-    if (!chunksToLoad_.Contains(fixedPosition)) {
-        chunksToLoad_[fixedPosition] = distance;
-        chunkBfsQueue_.emplace(node);
+    for (unsigned i = 0; i < chunks_.GetCapacity(); i++) {
+        Chunk* chunk = chunks_.GetSlot(i);
+        if (!chunk) {
+            continue;
+        }
+        IntVector3 coordinates = chunk->GetChunkCoordinates();
+        int distance = M_MAX_INT;
+        for (auto it = observers_.Begin(); it != observers_.End(); ++it) {
+            if ((*it).placed_) {
+                IntVector3 offset = coordinates - (*it).center_;
+                distance = Min(distance, Abs(offset.x_) + Abs(offset.y_) + Abs(offset.z_));
+            }
+        }
+        chunk->SetDistance(distance);
     }
 }
 
@@ -549,21 +1237,34 @@ void VoxelWorld::HandleChunkReceived(StringHash eventType, VariantMap& eventData
     Vector3 position = eventData[P_POSITION].GetVector3();
     URHO3D_LOGINFO("Chunk received: " + position.ToString());
     PODVector<unsigned char>* data = reinterpret_cast<PODVector<unsigned char>*>(eventData[P_DATA].GetPtr());
-    String id = GetChunkIdentificator(position);
-    auto chunkIterator = chunks_.Find(id);
-    if (chunkIterator != chunks_.End()) {
+    Chunk* chunk = chunks_.Find(GetChunkCoordinates(position));
+    if (chunk) {
+        if (GetSubsystem<LightManager>()) {
+            GetSubsystem<LightManager>()->CompletePropagation();
+        }
         int index = 0;
         for (int x = 0; x < SIZE_X; x++) {
             for (int y = 0; y < SIZE_Y; y++) {
                 for (int z = 0; z < SIZE_Z; z++) {
                     int value = data->At(index);
                     BlockType type = static_cast<BlockType>(value);
-                    (*chunkIterator).second_->SetVoxel(x, y, z, type);
+                    chunk->SetVoxel(x, y, z, type);
                 }
             }
         }
-        (*chunkIterator).second_->CalculateLight();
-        (*chunkIterator).second_->MarkForGeometryCalculation();
+        chunk->CalculateLight();
+        chunk->CalculateSunlight();
+        chunk->SetLightSeedPending(true);
+        chunk->MarkForGeometryCalculation();
+    }
+}
+
+void VoxelWorld::HandleChunkIOLoaded(StringHash eventType, VariantMap& eventData)
+{
+    using namespace ChunkIOLoaded;
+    auto chunk = GetChunkByPosition(eventData[P_POSITION].GetVector3());
+    if (chunk && chunk->GetDiskState() == CDS_REQUESTED) {
+        chunk->SetDiskData(eventData[P_FOUND].GetBool(), eventData[P_DATA].GetBuffer(), eventData[P_EDITS].GetBool());
     }
 }
 
@@ -574,40 +1275,29 @@ void VoxelWorld::HandleNetworkMessage(StringHash eventType, VariantMap& eventDat
     using namespace NetworkMessage;
 
     int msgID = eventData[P_MESSAGEID].GetInt();
-    if (msgID == NETWORK_REQUEST_CHUNK)
-    {
-        const PODVector<unsigned char>& data = eventData[P_DATA].GetBuffer();
-        // Use a MemoryBuffer to read the message data so that there is no unnecessary copying
-        MemoryBuffer msg(data);
-        Vector3 chunkPosition = msg.ReadVector3();
-
-        Chunk* chunk = GetChunkByPosition(chunkPosition);
-        // If we are the server, prepend the sender's IP address and port and echo to everyone
-        // If we are a client, just display the message
-        if (network->IsServerRunning())
-        {
-            if (chunk) {
-                if (chunk->IsLoaded()) {
-                    auto *sender = static_cast<Connection *>(eventData[P_CONNECTION].GetPtr());
-//                URHO3D_LOGINFO("Client " + sender->ToString() + " requested chunk : " + chunkPosition.ToString());
-
-                    VectorBuffer sendMsg;
-                    sendMsg.WriteVector3(chunk->GetPosition());
-                    for (int x = 0; x < SIZE_X; x++) {
-                        for (int y = 0; y < SIZE_Y; y++) {
-                            for (int z = 0; z < SIZE_Z; z++) {
-                                sendMsg.WriteInt(static_cast<int>(chunk->GetBlockAt(IntVector3(x, y, z))->type));
-                            }
-                        }
-                    }
-                    // Broadcast as in-order and reliable
-                    sender->SendMessage(NETWORK_SEND_CHUNK, true, true, sendMsg);
-                } else {
-//                    URHO3D_LOGINFO("Chunk not yet loaded, cannot send it to client " + chunkPosition.ToString());
-                }
-            } else {
-//                URHO3D_LOGINFO("Requested chunk doesn't exist " + chunkPosition.ToString());
-            }
+    if (msgID == NETWORK_REQUEST_CHUNK) {
+        if (network->IsServerRunning() && GetSubsystem<ChunkStreamer>()) {
+            const PODVector<unsigned char>& data = eventData[P_DATA].GetBuffer();
+            MemoryBuffer msg(data);
+            Vector3 chunkPosition = msg.ReadVector3();
+            int priority = msg.IsEof() ? 0 : (int)msg.ReadVLE();
+            auto* sender = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+            // Sent from the streamer update in nearest first order
+            GetSubsystem<ChunkStreamer>()->QueueServerRequest(sender, GetChunkCoordinates(chunkPosition), priority);
+        }
+    } else if (msgID == NETWORK_CANCEL_CHUNK) {
+        if (network->IsServerRunning() && GetSubsystem<ChunkStreamer>()) {
+            const PODVector<unsigned char>& data = eventData[P_DATA].GetBuffer();
+            MemoryBuffer msg(data);
+            Vector3 chunkPosition = msg.ReadVector3();
+            auto* sender = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+            GetSubsystem<ChunkStreamer>()->CancelServerRequest(sender, GetChunkCoordinates(chunkPosition));
+        }
+    } else if (msgID == NETWORK_CHUNK_BUSY) {
+        if (!network->IsServerRunning() && GetSubsystem<ChunkStreamer>()) {
+            const PODVector<unsigned char>& data = eventData[P_DATA].GetBuffer();
+            MemoryBuffer msg(data);
+            GetSubsystem<ChunkStreamer>()->ChunkBusy(GetChunkCoordinates(msg.ReadVector3()));
         }
     } else if (msgID == NETWORK_SEND_CHUNK) {
         if (!network->IsServerRunning()) {
@@ -615,6 +1305,9 @@ void VoxelWorld::HandleNetworkMessage(StringHash eventType, VariantMap& eventDat
             // Use a MemoryBuffer to read the message data so that there is no unnecessary copying
             MemoryBuffer msg(data);
             Vector3 chunkPosition = msg.ReadVector3();
+            if (GetSubsystem<ChunkStreamer>()) {
+                GetSubsystem<ChunkStreamer>()->ChunkReceived(GetChunkCoordinates(chunkPosition), data.Size());
+            }
             auto chunk = GetChunkByPosition(chunkPosition);
             if (chunk) {
                 chunk->ProcessServerResponse(msg);
@@ -629,17 +1322,18 @@ void VoxelWorld::HandleNetworkMessage(StringHash eventType, VariantMap& eventDat
             MemoryBuffer msg(data);
             Vector3 chunkPosition = msg.ReadVector3();
             IntVector3 blockPosition = msg.ReadIntVector3();
+            // Clients send any position, only blocks inside of the chunk may be written
+            if (!Chunk::IsBlockInside(blockPosition)) {
+                return;
+            }
+            // Chunks still being generated or decorated are filled by a worker, requests for them are dropped
             auto chunk = GetChunkByPosition(chunkPosition);
-            if (chunk) {
-                chunk->SetBlockData(blockPosition, BT_AIR);
+            if (chunk && chunk->IsLoaded()) {
+                chunk->SetPlayerBlock(blockPosition, BT_AIR);
                 chunk->MarkForGeometryCalculation();
+                // Only applied edits reach the subscribers, otherwise they would diverge from the server
+                QueueBlockEdit(chunk->GetChunkCoordinates(), blockPosition, BT_AIR);
             }
-
-            VectorBuffer buffer;
-            buffer.WriteVector3(chunkPosition);
-            buffer.WriteIntVector3(blockPosition);
-            buffer.WriteInt(static_cast<int>(BT_AIR));
-            network->BroadcastMessage(NETWORK_SEND_CHUNK_UPDATE, true, true, buffer);
         }
     } else if (msgID == NETWORK_REQUEST_CHUNK_ADD) {
         if (network->IsServerRunning()) {
@@ -649,39 +1343,161 @@ void VoxelWorld::HandleNetworkMessage(StringHash eventType, VariantMap& eventDat
             Vector3 chunkPosition = msg.ReadVector3();
             IntVector3 blockPosition = msg.ReadIntVector3();
             BlockType type = static_cast<BlockType>(msg.ReadInt());
+            if (type < 0 || type >= BT_NONE || !Chunk::IsBlockInside(blockPosition)) {
+                return;
+            }
             auto chunk = GetChunkByPosition(chunkPosition);
-            if (chunk) {
-                chunk->SetBlockData(blockPosition, type);
-//                chunk->MarkForGeometryCalculation();
+            if (chunk && chunk->IsLoaded()) {
+                chunk->SetPlayerBlock(blockPosition, type);
+                QueueBlockEdit(chunk->GetChunkCoordinates(), blockPosition, type);
             }
-            VectorBuffer buffer;
-            buffer.WriteVector3(chunkPosition);
-            buffer.WriteIntVector3(blockPosition);
-            buffer.WriteInt(static_cast<int>(type));
-            network->BroadcastMessage(NETWORK_SEND_CHUNK_UPDATE, true, true, buffer);
         }
     } else if (msgID == NETWORK_SEND_CHUNK_UPDATE) {
         if (!network->IsServerRunning()) {
             const PODVector<unsigned char> &data = eventData[P_DATA].GetBuffer();
             // Use a MemoryBuffer to read the message data so that there is no unnecessary copying
             MemoryBuffer msg(data);
-            Vector3 chunkPosition = msg.ReadVector3();
-            IntVector3 blockPosition = msg.ReadIntVector3();
-            BlockType type = static_cast<BlockType>(msg.ReadInt());
-            auto chunk = GetChunkByPosition(chunkPosition);
-            if (chunk) {
-                chunk->SetBlockData(blockPosition, type);
-//                chunk->MarkForGeometryCalculation();
+            unsigned batchCount = msg.ReadVLE();
+            for (unsigned i = 0; i < batchCount && !msg.IsEof(); i++) {
+                IntVector3 coordinates = msg.ReadIntVector3();
+                unsigned editCount = msg.ReadVLE();
+                // Chunks not loaded here will get the edits with their data when requested
+                Chunk* chunk = chunks_.Find(coordinates);
+                for (unsigned j = 0; j < editCount; j++) {
+                    unsigned index = msg.ReadUShort();
+                    unsigned type = msg.ReadUByte();
+                    if (chunk && index < CHUNK_VOXEL_COUNT && type < BT_NONE) {
+                        IntVector3 blockPosition(index / (SIZE_Y * SIZE_Z), index / SIZE_Z % SIZE_Y, index % SIZE_Z);
+                        chunk->SetBlockData(blockPosition, static_cast<BlockType>(type));
+                    }
+                }
             }
         }
     }
 }
 
+void VoxelWorld::AddEditSubscriber(Connection* connection, Node* node)
+{
+    EditSubscriber& subscriber = editSubscribers_[connection];
+    subscriber.connection_ = connection;
+    subscriber.node_ = node;
+    subscriber.radius_ = -1;
+    subscriber.chunks_.Clear();
+}
+
+void VoxelWorld::RemoveEditSubscriber(Connection* connection)
+{
+    editSubscribers_.Erase(connection);
+}
+
+void VoxelWorld::AddEditSubscription(Connection* connection, const IntVector3& chunkCoordinates)
+{
+    auto it = editSubscribers_.Find(connection);
+    if (it != editSubscribers_.End()) {
+        (*it).second_.chunks_.Insert(chunkCoordinates);
+    }
+}
+
+void VoxelWorld::QueueBlockEdit(const IntVector3& chunkCoordinates, const IntVector3& blockPosition, BlockType type)
+{
+    if (!Chunk::IsBlockInside(blockPosition)) {
+        return;
+    }
+    auto index = static_cast<unsigned short>(Chunk::GetBlockIndex(blockPosition.x_, blockPosition.y_, blockPosition.z_));
+    PODVector<BlockEdit>& batch = pendingEdits_[chunkCoordinates];
+    // Only the last edit of a block within the frame is sent
+    for (auto it = batch.Begin(); it != batch.End(); ++it) {
+        if ((*it).index_ == index) {
+            (*it).type_ = static_cast<unsigned char>(type);
+            return;
+        }
+    }
+    BlockEdit edit;
+    edit.index_ = index;
+    edit.type_ = static_cast<unsigned char>(type);
+    batch.Push(edit);
+}
+
+void VoxelWorld::UpdateEditSubscriptions()
+{
+    // Clients load chunks up to visibleDistance_ steps away, the margin covers player replication lag
+    int radius = visibleDistance_ + 2;
+    for (auto it = editSubscribers_.Begin(); it != editSubscribers_.End();) {
+        EditSubscriber& subscriber = (*it).second_;
+        if (!subscriber.connection_ || !subscriber.node_) {
+            it = editSubscribers_.Erase(it);
+            continue;
+        }
+        IntVector3 center = GetChunkCoordinates(subscriber.node_->GetWorldPosition());
+        if (center != subscriber.center_ || radius != subscriber.radius_) {
+            subscriber.center_ = center;
+            subscriber.radius_ = radius;
+            subscriber.chunks_.Clear();
+            for (int x = -radius; x <= radius; x++) {
+                for (int y = -radius + Abs(x); y <= radius - Abs(x); y++) {
+                    int depth = radius - Abs(x) - Abs(y);
+                    for (int z = -depth; z <= depth; z++) {
+                        subscriber.chunks_.Insert(center + IntVector3(x, y, z));
+                    }
+                }
+            }
+        }
+        ++it;
+    }
+}
+
+void VoxelWorld::FlushBlockEdits()
+{
+    if (pendingEdits_.Empty()) {
+        return;
+    }
+
+    unsigned allBatchesSize = 0;
+    for (auto it = pendingEdits_.Begin(); it != pendingEdits_.End(); ++it) {
+        allBatchesSize += sizeof(IntVector3) + 1 + (*it).second_.Size() * 3;
+    }
+
+    PODVector<const HashMap<IntVector3, PODVector<BlockEdit>>::KeyValue*> batches;
+    for (auto it = editSubscribers_.Begin(); it != editSubscribers_.End(); ++it) {
+        EditSubscriber& subscriber = (*it).second_;
+        if (!subscriber.connection_) {
+            continue;
+        }
+        editBytesUnfiltered_ += allBatchesSize;
+
+        batches.Clear();
+        for (auto batchIt = pendingEdits_.Begin(); batchIt != pendingEdits_.End(); ++batchIt) {
+            if (subscriber.chunks_.Contains((*batchIt).first_)) {
+                batches.Push(&(*batchIt));
+            }
+        }
+        if (batches.Empty()) {
+            continue;
+        }
+
+        VectorBuffer buffer;
+        buffer.WriteVLE(batches.Size());
+        for (auto batchIt = batches.Begin(); batchIt != batches.End(); ++batchIt) {
+            const PODVector<BlockEdit>& edits = (*batchIt)->second_;
+            buffer.WriteIntVector3((*batchIt)->first_);
+            buffer.WriteVLE(edits.Size());
+            for (auto editIt = edits.Begin(); editIt != edits.End(); ++editIt) {
+                buffer.WriteUShort((*editIt).index_);
+                buffer.WriteUByte((*editIt).type_);
+            }
+        }
+        subscriber.connection_->SendMessage(NETWORK_SEND_CHUNK_UPDATE, true, true, buffer);
+        editMessagesSent_++;
+        editBytesSent_ += buffer.GetSize();
+    }
+    pendingEdits_.Clear();
+}
+
 void VoxelWorld::SetSunlight(float value)
 {
-    auto cache = GetSubsystem<ResourceCache>();
-    auto waterMaterial = cache->GetResource<Material>("Materials/VoxelWater.xml");
-    auto landMaterial = cache->GetResource<Material>("Materials/Voxel.xml");
-    waterMaterial->SetShaderParameter("SunlightIntensity", value);
-    landMaterial->SetShaderParameter("SunlightIntensity", value);
+    if (!landMaterial_) {
+        return;
+    }
+    waterMaterial_->SetShaderParameter("SunlightIntensity", value);
+    landMaterial_->SetShaderParameter("SunlightIntensity", value);
 }
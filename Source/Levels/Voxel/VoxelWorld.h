@@ -3,64 +3,193 @@
 #include <Urho3D/Container/List.h>
 #include <Urho3D/Scene/Node.h>
 #include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Graphics/Material.h>
 #include <Urho3D/Core/Timer.h>
-#include <queue>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Network/Connection.h>
 #include <map>
 
 #include "Chunk.h"
+#include "ChunkMap.h"
+#include "ChunkCache.h"
 
-struct ChunkNode {
-    ChunkNode(Vector3 position, int distance): position_(position), distance_(distance) {}
+struct ChunkObserver {
+    WeakPtr<Node> node_;
+    // Chunk the view is centered on, valid once placed
+    IntVector3 center_;
+    bool placed_{false};
+};
+
+/**
+ * Remote client receiving block edits, only for chunks around its player
+ */
+struct EditSubscriber {
+    WeakPtr<Connection> connection_;
+    WeakPtr<Node> node_;
+    IntVector3 center_;
+    int radius_{-1};
+    HashSet<IntVector3> chunks_;
+};
+
+/**
+ * First non-air block along a ray
+ */
+struct VoxelRaycastResult {
+    // World block coordinates
+    IntVector3 blockPosition_;
+    // Block coordinates inside chunk_
+    IntVector3 chunkBlockPosition_;
+    // Face the ray entered the block through
+    BlockSide side_;
+    Vector3 normal_;
     Vector3 position_;
-    int distance_;
+    float distance_;
+    BlockType type_;
+    Chunk* chunk_;
 };
 
 class VoxelWorld : public Object {
     URHO3D_OBJECT(VoxelWorld, Object);
     VoxelWorld(Context* context);
+    virtual ~VoxelWorld();
 
     static void RegisterObject(Context* context);
     friend void UpdateChunkState(const WorkItem* item, unsigned threadIndex);
+    friend void GenerateChunk(const WorkItem* item, unsigned threadIndex);
+    friend void DecorateChunk(const WorkItem* item, unsigned threadIndex);
+    friend void CalculateChunkGeometry(const WorkItem* item, unsigned threadIndex);
 
     void AddObserver(SharedPtr<Node> observer);
     void RemoveObserver(SharedPtr<Node> observer);
     Chunk* GetChunkByPosition(const Vector3& position);
     void RemoveBlockAtPosition(const Vector3& position);
-    VoxelBlock* GetBlockAt(Vector3 position);
+    VoxelBlock GetBlockAt(Vector3 position);
     void Init();
-    bool IsChunkValid(Chunk* chunk);
+    bool IsChunkValid(const ChunkHandle& handle);
+    /**
+     * Chunk referenced by the handle or null if it was removed, constant time
+     */
+    Chunk* GetChunk(const ChunkHandle& handle);
+    void GetLoadedChunks(PODVector<Chunk*>& chunks);
     const String GetBlockName(BlockType type);
     Vector3 GetWorldToChunkPosition(const Vector3& position);
+    void SetMeshingMode(MeshingMode mode);
+    MeshingMode GetMeshingMode() const { return meshingMode_; }
+    void SetCollisionMode(CollisionMode mode);
+    CollisionMode GetCollisionMode() const { return collisionMode_; }
     IntVector3 GetWorldToChunkBlockPosition(const Vector3& position);
+    IntVector3 GetChunkCoordinates(const Vector3& position);
+    /**
+     * Walk the block grid from origin with a 3D-DDA and return the first non-air block of a loaded chunk.
+     * Uses block data only, works without render meshes. Main thread only
+     */
+    bool Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, VoxelRaycastResult& result);
+    /**
+     * Raycast every ray, results of missed rays have a null chunk. Returns the hit count
+     */
+    unsigned Raycast(const PODVector<Ray>& rays, float maxDistance, PODVector<VoxelRaycastResult>& results);
+    Material* GetLandMaterial() const { return landMaterial_; }
+    Material* GetWaterMaterial() const { return waterMaterial_; }
+    /**
+     * Send block edits around the node to the connection, server only
+     */
+    void AddEditSubscriber(Connection* connection, Node* node);
+    void RemoveEditSubscriber(Connection* connection);
+    /**
+     * Connection received the chunk, its edits are sent even outside the player neighborhood
+     */
+    void AddEditSubscription(Connection* connection, const IntVector3& chunkCoordinates);
 private:
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
     void HandleChunkReceived(StringHash eventType, VariantMap& eventData);
+    void HandleChunkIOLoaded(StringHash eventType, VariantMap& eventData);
     void HandleWorkItemFinished(StringHash eventType, VariantMap& eventData);
+    void HandleLightPropagated(StringHash eventType, VariantMap& eventData);
     void HandleNetworkMessage(StringHash eventType, VariantMap& eventData);
     void LoadChunk(const Vector3& position);
     void UpdateChunks();
+    /**
+     * Upload finished chunk meshes to the GPU within the per frame time budget
+     */
+    void UploadChunks();
+    void ScheduleChunkWork();
     Vector3 GetNodeToChunkPosition(Node* node);
     bool IsChunkLoaded(const Vector3& position);
     bool IsEqualPositions(Vector3 a, Vector3 b);
     Chunk* CreateChunk(const Vector3& position);
-    String GetChunkIdentificator(const Vector3& position);
-    bool ProcessQueue();
-    void AddChunkToQueue(Vector3 position, int distance = 0);
+    void LinkNeighbors(Chunk* chunk, bool link);
+    ChunkHandle AcquireHandle(Chunk* chunk);
+    void ReleaseHandle(const ChunkHandle& handle);
+    /**
+     * Track observer chunk changes, only the shells entering and leaving a moved view are visited
+     */
+    void UpdateViews();
+    void BuildViewShells();
+    void ChangeViewArea(const IntVector3& center, int radius, int delta);
+    void MoveView(IntVector3 from, const IntVector3& to);
+    void ChangeViewCount(const IntVector3& coordinates, int delta);
+    void UpdateChunkDistances();
     void SetSunlight(float value);
+    void OpenWorld();
+    bool RaycastBlocks(const Ray& ray, float maxDistance, VoxelRaycastResult& result, IntVector3& chunkCoordinates, Chunk*& chunk);
+    void QueueBlockEdit(const IntVector3& chunkCoordinates, const IntVector3& blockPosition, BlockType type);
+    void UpdateEditSubscriptions();
+    void FlushBlockEdits();
 
 //    void RaycastFromObservers();
 
 //    List<SharedPtr<Chunk>> chunks_;
-    List<WeakPtr<Node>> observers_;
+    Vector<ChunkObserver> observers_;
     Scene* scene_;
     List<Vector3> removeBlocks_;
-    HashMap<String, SharedPtr<Chunk>> chunks_;
+    ChunkMap chunks_;
+    // Chunk handle slots, a slot generation is bumped every time its chunk is removed
+    PODVector<Chunk*> handleChunks_;
+    PODVector<unsigned> handleGenerations_;
+    PODVector<unsigned> freeHandleSlots_;
     Mutex mutex_;
     SharedPtr<WorkItem> updateWorkItem_;
+    // Generation and meshing items currently in the work queue
+    int pendingChunkWork_{0};
+    int generatedChunks_{0};
+    int decoratedChunks_{0};
+    int meshedChunks_{0};
+    unsigned meshedVertices_{0};
+    unsigned meshedIndices_{0};
+    long long meshingTime_{0};
+    MeshingMode meshingMode_{MM_GREEDY};
+    CollisionMode collisionMode_{CM_BOXES};
+    Timer throughputTimer_;
     bool reloadAllChunks_{false};
     Timer sunlightTimer_;
-    std::queue<ChunkNode> chunkBfsQueue_;
-    HashMap<Vector3, int> chunksToLoad_;
+    // Observers seeing each chunk, a chunk is part of the world while its count is above zero
+    HashMap<IntVector3, unsigned> viewCounts_;
+    // View changes not yet applied to the chunk set
+    HashSet<IntVector3> enteringChunks_;
+    HashSet<IntVector3> leavingChunks_;
+    // Offsets entering the view when it moves one chunk towards each BlockSide
+    PODVector<IntVector3> viewShells_[6];
+    int viewRadius_{-1};
+    bool viewChanged_{false};
+    SharedPtr<Material> landMaterial_;
+    SharedPtr<Material> waterMaterial_;
+    // Milliseconds per frame
+    float uploadBudget_{2.0f};
+    unsigned uploadsPending_{0};
+    unsigned uploadCount_{0};
+    // Microseconds
+    long long uploadTime_{0};
+    ChunkCache chunkCache_;
+    // Cached chunks keep their geometry and collision
+    bool cacheMeshes_{true};
     Timer updateTimer_;
     int visibleDistance_{5};
+    HashMap<Connection*, EditSubscriber> editSubscribers_;
+    // Edits received during this frame, sent out together in FlushBlockEdits
+    HashMap<IntVector3, PODVector<BlockEdit>> pendingEdits_;
+    unsigned editMessagesSent_{0};
+    unsigned editBytesSent_{0};
+    // What broadcasting every edit to every client would have sent
+    unsigned editBytesUnfiltered_{0};
 };
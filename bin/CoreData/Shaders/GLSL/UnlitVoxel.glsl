@@ -9,25 +9,43 @@ precision mediump float;
 #endif
 
 varying vec2 vTexCoord;
+varying vec2 vTileOffset;
 varying vec4 vWorldPos;
 varying vec4 vColor;
 uniform float cSunlightIntensity;
+// Size of a single block texture inside the atlas
+uniform vec2 cTileSize;
 
 void VS()
 {
     mat4 modelMatrix = iModelMatrix;
-    vec3 worldPos = GetWorldPos(modelMatrix);
+    #ifdef PACKEDVERTEX
+        // iPos holds x, y, z and face, iColor holds u, v, light and atlas tile as unnormalized bytes
+        vec3 worldPos = (vec4(iPos.xyz, 1.0) * modelMatrix).xyz;
+        vTexCoord = iColor.xy;
+        float light = floor(iColor.z + 0.5);
+        float sun = floor(light / 16.0);
+        vColor = vec4((light - sun * 16.0) / 15.0, sun / 15.0, 0.0, 1.0);
+        float tile = floor(iColor.w + 0.5);
+        float row = floor(tile / 6.0);
+        vTileOffset = vec2(tile - row * 6.0, row) * cTileSize;
+    #else
+        vec3 worldPos = GetWorldPos(modelMatrix);
+        vTexCoord = iTexCoord;
+        vTileOffset = iTexCoord1;
+        vColor = iColor;
+    #endif
     gl_Position = GetClipPos(worldPos);
-    vTexCoord = GetTexCoord(iTexCoord);
     vWorldPos = vec4(worldPos, GetDepth(gl_Position));
-    vColor = iColor;
 }
 
 void PS()
 {
     // Get material diffuse albedo
     #ifdef DIFFMAP
-        vec4 diffColor = cMatDiffColor * texture2D(sDiffMap, vTexCoord);
+        // Merged faces span several blocks, repeat the tile across them
+        vec2 atlasCoord = vTileOffset + fract(vTexCoord) * cTileSize;
+        vec4 diffColor = cMatDiffColor * texture2D(sDiffMap, atlasCoord);
         diffColor.rgb = diffColor.rgb * vColor.r + diffColor.rgb * vColor.g * cSunlightIntensity;
 //        diffColor = vColor;
         #ifdef ALPHAMASK